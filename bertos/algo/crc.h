@@ -46,6 +46,7 @@
  * \author Bernie Innocenti <bernie@codewiz.org>
  *
  * $WIZ$ module_name = "crc16"
+ * $WIZ$ module_configuration = "bertos/cfg/cfg_crc.h"
  */
 
 #ifndef ALGO_CRC_H
@@ -0,0 +1,87 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2011 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \brief Cyclic Redundancy Check 32 (CRC32), the reflected one used by
+ * zip, PNG and ethernet (polynomial 0x04C11DB7).
+ *
+ * \note This is the same CRC computed by zlib crc32(): oldcrc is 0 on the
+ * first call, and the value returned can be passed back to continue the
+ * computation on more data.
+ *
+ * $WIZ$ module_name = "crc32"
+ * $WIZ$ module_configuration = "bertos/cfg/cfg_crc.h"
+ */
+
+#ifndef ALGO_CRC32_H
+#define ALGO_CRC32_H
+
+#include <cfg/compiler.h>
+
+EXTERN_C_BEGIN
+
+/* CRC table */
+extern const uint32_t crc32tab[256];
+
+/** CRC32 init value */
+#define CRC32_INIT_VAL ((uint32_t)0)
+
+/**
+ * \brief Update the CRC32 shift register with one octet (inline version)
+ *
+ * \note This works on the shift register: the initial and final
+ *       inversion of the CRC32 are left to the caller, i.e.
+ *       crc32(buf, len, crc) == ~updcrc32(buf[len - 1], ... updcrc32(buf[0], ~crc)).
+ */
+INLINE uint32_t updcrc32(uint8_t c, uint32_t oldcrc)
+{
+	return (oldcrc >> 8) ^ crc32tab[(oldcrc ^ c) & 0xff];
+}
+
+/**
+ * This function implements the CRC32 calculation on a buffer.
+ *
+ * The CRC hardware of the CPU is used when available and enabled with
+ * CONFIG_CRC_HW, otherwise the buffer is processed CONFIG_CRC_SLICE bytes
+ * at a time with table lookups.
+ *
+ * \param buf     The buffer to perform CRC calculation on.
+ * \param len     The length of the Buffer.
+ * \param oldcrc  CRC32_INIT_VAL the first time, the previous result
+ *                to continue the calculation on more data.
+ *
+ * \return The updated CRC32 value.
+ */
+uint32_t crc32(const void *buf, size_t len, uint32_t oldcrc);
+
+EXTERN_C_END
+
+#endif /* ALGO_CRC32_H */
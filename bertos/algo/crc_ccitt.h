@@ -37,6 +37,7 @@
  * \author Francesco Sacchi <batt@develer.com>
  *
  * $WIZ$ module_name = "crc-ccitt"
+ * $WIZ$ module_configuration = "bertos/cfg/cfg_crc.h"
  */
 
 #ifndef ALGO_CRC_CCITT_H
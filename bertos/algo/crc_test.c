@@ -31,13 +31,14 @@
  *
  * -->
  *
- * \brief CRC-CCITT table and support routines
+ * \brief CRC-CCITT, CRC16 and CRC32 test
  *
  * \author Francesco Sacchi <batt@develer.com>
  */
 
 #include "crc_ccitt.h"
 #include "crc.h"
+#include "crc32.h"
 
 #include <cfg/debug.h>
 #include <cfg/test.h>
@@ -68,6 +69,47 @@ int crc_testRun(void)
 	kprintf("crc16 [%04X]\n", crc);
 	ASSERT(crc == 0x31C3);
 
+	uint32_t crc32_val = crc32(vector, sizeof(vector), CRC32_INIT_VAL);
+	kprintf("crc32 [%08lX]\n", (unsigned long)crc32_val);
+	ASSERT(crc32_val == 0xCBF43926UL);
+
+	/*
+	 * Sliced and hardware versions must match the byte at a time update
+	 * for every length and alignment, and when split in two calls.
+	 */
+	static uint8_t buf[128];
+	uint32_t seed = 1;
+
+	for (size_t i = 0; i < sizeof(buf); i++)
+	{
+		seed = seed * 1103515245UL + 12345;
+		buf[i] = seed >> 16;
+	}
+
+	for (size_t off = 0; off < 8; off++)
+	{
+		for (size_t len = 0; len <= sizeof(buf) - off; len++)
+		{
+			const uint8_t *p = buf + off;
+			uint16_t ref16 = CRC16_INIT_VAL;
+			uint16_t ref_ccitt = CRC_CCITT_INIT_VAL;
+			uint32_t ref32 = ~CRC32_INIT_VAL;
+
+			for (size_t i = 0; i < len; i++)
+			{
+				ref16 = updcrc16(p[i], ref16);
+				ref_ccitt = updcrc_ccitt(p[i], ref_ccitt);
+				ref32 = updcrc32(p[i], ref32);
+			}
+			ref32 = ~ref32;
+
+			ASSERT(crc16(CRC16_INIT_VAL, p, len) == ref16);
+			ASSERT(crc_ccitt(CRC_CCITT_INIT_VAL, p, len) == ref_ccitt);
+			ASSERT(crc32(p, len, CRC32_INIT_VAL) == ref32);
+			ASSERT(crc32(p + len / 3, len - len / 3, crc32(p, len / 3, CRC32_INIT_VAL)) == ref32);
+		}
+	}
+
 	return 0;
 }
 
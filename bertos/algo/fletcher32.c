@@ -30,14 +30,49 @@
  *
  * -->
  *
- * \brief Fletcher-32 checksum algorithm
+ * \brief Fletcher-32 and Adler-32 checksum algorithms
  *
  * \author Francesco Sacchi <batt@develer.com>
  */
 
 #include "fletcher32.h"
+
 #include <cfg/macros.h> //MIN()
 
+#include <cpu/byteorder.h>
+
+#include <string.h> // memcpy()
+
+/*
+ * Max 16 bit words summed before sum2 may overflow 32 bits, starting
+ * from sums folded to 17 bits: 360 * 0x1FFFE + 0xFFFF * 359 * 360 / 2.
+ */
+#define FLETCHER32_BLOCK 359
+
+/*
+ * Max bytes summed before b may overflow 32 bits, starting from sums
+ * reduced modulo ADLER32_MOD (same as zlib NMAX).
+ */
+#define ADLER32_BLOCK 5552
+#define ADLER32_MOD   65521
+
+INLINE uint32_t fletcher32_fold(uint32_t sum)
+{
+	return (sum & 0xffff) + (sum >> 16);
+}
+
+/*
+ * Little endian 32 bit load from any alignment. The compiler turns it
+ * into a single load on CPUs that handle unaligned accesses.
+ */
+INLINE uint32_t load_le32(const uint8_t *buf)
+{
+	uint32_t w;
+
+	memcpy(&w, buf, sizeof(w));
+	return le32_to_cpu(w);
+}
+
 void fletcher32_init(Fletcher32 *f)
 {
 	f->sum1 = 0xFFFF;
@@ -47,40 +82,60 @@ void fletcher32_init(Fletcher32 *f)
 
 void fletcher32_update(Fletcher32 *f, const void *_buf, size_t len)
 {
-	uint16_t data = 0;
 	const uint8_t *buf = (const uint8_t *)_buf;
-	uint8_t last = buf[len - 1];
+	uint32_t sum1 = f->sum1;
+	uint32_t sum2 = f->sum2;
 
-	if (f->carry != -1 && len)
+	if (!len)
+		return;
+
+	/* Complete the word left half done by the previous update */
+	if (f->carry != -1)
 	{
-		data = f->carry | *buf++ << 8;
+		sum1 += f->carry | *buf++ << 8;
+		sum2 += sum1;
+		sum1 = fletcher32_fold(sum1);
+		sum2 = fletcher32_fold(sum2);
 		f->carry = -1;
-		++len;
+		len--;
 	}
-	else if (len > 1)
+
+	size_t words = len / 2;
+	while (words)
 	{
-		data = buf[0] | buf[1] << 8;
-		buf += 2;
-	}
+		size_t n = MIN(words, (size_t)FLETCHER32_BLOCK);
+		words -= n;
 
-	if (len & 1)
-		f->carry = last;
+		/* Sums are folded only once per block */
+		for (; n >= 4; n -= 4, buf += 8)
+		{
+			uint32_t w0 = load_le32(buf);
+			uint32_t w1 = load_le32(buf + 4);
 
-	size_t l = len / 2;
-	while (l)
-	{
-		size_t tlen = MIN(l, (size_t)360);
-		l -= tlen;
-		do
+			sum1 += w0 & 0xffff;
+			sum2 += sum1;
+			sum1 += w0 >> 16;
+			sum2 += sum1;
+			sum1 += w1 & 0xffff;
+			sum2 += sum1;
+			sum1 += w1 >> 16;
+			sum2 += sum1;
+		}
+		for (; n; n--, buf += 2)
 		{
-			f->sum1 += data;
-			f->sum2 += f->sum1;
-			data = buf[0] | buf[1] << 8;
-			buf += 2;
-		} while (--tlen);
-		f->sum1 = (f->sum1 & 0xffff) + (f->sum1 >> 16);
-		f->sum2 = (f->sum2 & 0xffff) + (f->sum2 >> 16);
+			sum1 += buf[0] | buf[1] << 8;
+			sum2 += sum1;
+		}
+
+		sum1 = fletcher32_fold(sum1);
+		sum2 = fletcher32_fold(sum2);
 	}
+
+	if (len & 1)
+		f->carry = *buf;
+
+	f->sum1 = sum1;
+	f->sum2 = sum2;
 }
 
 uint32_t fletcher32_final(Fletcher32 *f)
@@ -93,13 +148,61 @@ uint32_t fletcher32_final(Fletcher32 *f)
 	{
 		sum1 += f->carry;
 		sum2 += sum1;
-		sum1 = (sum1 & 0xffff) + (sum1 >> 16);
-		sum2 = (sum2 & 0xffff) + (sum2 >> 16);
+		sum1 = fletcher32_fold(sum1);
+		sum2 = fletcher32_fold(sum2);
 	}
 
 	/* Second reduction step to reduce sums to 16 bits */
-	sum1 = (sum1 & 0xffff) + (sum1 >> 16);
-	sum2 = (sum2 & 0xffff) + (sum2 >> 16);
+	sum1 = fletcher32_fold(sum1);
+	sum2 = fletcher32_fold(sum2);
 
 	return sum2 << 16 | sum1;
 }
+
+void adler32_init(Adler32 *a)
+{
+	a->a = 1;
+	a->b = 0;
+}
+
+void adler32_update(Adler32 *a, const void *_buf, size_t len)
+{
+	const uint8_t *buf = (const uint8_t *)_buf;
+	uint32_t s1 = a->a;
+	uint32_t s2 = a->b;
+
+	while (len)
+	{
+		size_t n = MIN(len, (size_t)ADLER32_BLOCK);
+		len -= n;
+
+		/* Modulo is taken only once per block */
+		for (; n >= 8; n -= 8, buf += 8)
+		{
+			s1 += buf[0]; s2 += s1;
+			s1 += buf[1]; s2 += s1;
+			s1 += buf[2]; s2 += s1;
+			s1 += buf[3]; s2 += s1;
+			s1 += buf[4]; s2 += s1;
+			s1 += buf[5]; s2 += s1;
+			s1 += buf[6]; s2 += s1;
+			s1 += buf[7]; s2 += s1;
+		}
+		while (n--)
+		{
+			s1 += *buf++;
+			s2 += s1;
+		}
+
+		s1 %= ADLER32_MOD;
+		s2 %= ADLER32_MOD;
+	}
+
+	a->a = s1;
+	a->b = s2;
+}
+
+uint32_t adler32_final(Adler32 *a)
+{
+	return a->b << 16 | a->a;
+}
@@ -30,7 +30,11 @@
  *
  * -->
  *
- * \brief Fletcher-32 checksum algorithm
+ * \brief Fletcher-32 and Adler-32 checksum algorithms
+ *
+ * Fletcher-32 sums the data as little endian 16 bit words, an odd
+ * trailing byte is padded with zero. Both checksums can be computed on
+ * data split in any number of updates, of any length and alignment.
  *
  * \author Bernie Innocenti <batt@develer.com>
  */
@@ -50,4 +54,17 @@ void fletcher32_init(Fletcher32 *f);
 void fletcher32_update(Fletcher32 *f, const void *_buf, size_t len);
 uint32_t fletcher32_final(Fletcher32 *f);
 
+typedef struct Adler32
+{
+	uint32_t a, b;
+} Adler32;
+
+void adler32_init(Adler32 *a);
+void adler32_update(Adler32 *a, const void *_buf, size_t len);
+uint32_t adler32_final(Adler32 *a);
+
+int fletcher32_testSetup(void);
+int fletcher32_testRun(void);
+int fletcher32_testTearDown(void);
+
 #endif /* ALGO_FLETCHER32_H */
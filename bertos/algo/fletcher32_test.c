@@ -41,6 +41,7 @@
 #include <cfg/debug.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 /* Wikipedia reference implementation */
 static uint32_t fletcher32(uint16_t *data, size_t len)
@@ -49,7 +50,7 @@ static uint32_t fletcher32(uint16_t *data, size_t len)
 
 	while (len)
 	{
-		unsigned tlen = len > 360 ? 360 : len;
+		unsigned tlen = len > 359 ? 359 : len;
 		//kprintf("tlen %d\n", tlen);
 		len -= tlen;
 		do
@@ -81,6 +82,23 @@ static uint32_t fletcher32_b(const void *buf, size_t len)
 	return f2;
 }
 
+#define ALIGN_LEN   1500
+#define BENCH_LEN   (64 * 1024L)
+#define BENCH_ROUND 256
+
+/* Adler-32 by the definition, modulo at every byte */
+static uint32_t adler32_b(const uint8_t *buf, size_t len)
+{
+	uint32_t a = 1, b = 0;
+
+	while (len--)
+	{
+		a = (a + *buf++) % 65521;
+		b = (b + a) % 65521;
+	}
+	return b << 16 | a;
+}
+
 int fletcher32_testSetup(void)
 {
 	kdbg_init();
@@ -535,6 +553,68 @@ int fletcher32_testRun(void)
 	free(start);
 	kprintf("ft1 %08X, ft2 %08X\n", ft1, ft2);
 	ASSERT(ft1 == ft2);
+
+	Adler32 a;
+	adler32_init(&a);
+	adler32_update(&a, "Wikipedia", 9);
+	kprintf("adler32 %08X\n", adler32_final(&a));
+	ASSERT(adler32_final(&a) == 0x11E60398);
+
+	/*
+	 * Every alignment and length, in one update and split in two at
+	 * every point, on data long enough to span several reduction blocks.
+	 */
+	static uint8_t data[ALIGN_LEN + 8];
+	for (size_t i = 0; i < sizeof(data); i++)
+		data[i] = (i & 1) ? 0xFF : rand();
+
+	for (size_t off = 0; off < 8; off++)
+	{
+		const uint8_t *p = data + off;
+
+		for (size_t len = 0; len <= ALIGN_LEN; len += (len < 40 ? 1 : 97))
+		{
+			uint32_t fref = fletcher32_b(p, len);
+			uint32_t aref = adler32_b(p, len);
+
+			for (size_t split = 0; split <= len; split += (len < 40 ? 1 : 61))
+			{
+				fletcher32_init(&f);
+				fletcher32_update(&f, p, split);
+				fletcher32_update(&f, p + split, len - split);
+				ASSERT(fletcher32_final(&f) == fref);
+
+				adler32_init(&a);
+				adler32_update(&a, p, split);
+				adler32_update(&a, p + split, len - split);
+				ASSERT(adler32_final(&a) == aref);
+			}
+		}
+	}
+
+	/* Throughput on a buffer misaligned on purpose */
+	uint8_t *bench = malloc(BENCH_LEN + 1);
+	ASSERT(bench);
+	for (long i = 0; i < BENCH_LEN + 1; i++)
+		bench[i] = rand();
+
+	clock_t t0 = clock();
+	fletcher32_init(&f);
+	for (int r = 0; r < BENCH_ROUND; r++)
+		fletcher32_update(&f, bench + 1, BENCH_LEN);
+	double secs = (double)(clock() - t0) / CLOCKS_PER_SEC;
+	kprintf("fletcher32 %08X: %.0f MB/s\n", fletcher32_final(&f),
+		secs > 0 ? BENCH_LEN * BENCH_ROUND / secs / 1e6 : 0);
+
+	t0 = clock();
+	adler32_init(&a);
+	for (int r = 0; r < BENCH_ROUND; r++)
+		adler32_update(&a, bench + 1, BENCH_LEN);
+	secs = (double)(clock() - t0) / CLOCKS_PER_SEC;
+	kprintf("adler32    %08X: %.0f MB/s\n", adler32_final(&a),
+		secs > 0 ? BENCH_LEN * BENCH_ROUND / secs / 1e6 : 0);
+
+	free(bench);
 	return 0;
 }
 
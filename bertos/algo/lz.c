@@ -0,0 +1,252 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2011 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \brief Small window LZ77 compression, LZ4 style block format.
+ */
+
+#include "lz.h"
+
+#include <cfg/macros.h>
+
+#include <string.h>
+
+#define LZ_RUN_MASK 15
+
+INLINE uint32_t lz_read32(const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+INLINE unsigned lz_hash(uint32_t seq)
+{
+	return (uint32_t)(seq * 2654435761UL) >> (32 - CONFIG_LZ_HASH_BITS);
+}
+
+/*
+ * Write the token extension of \a len, that is \a len as a sequence
+ * of 255 terminated by a smaller byte.
+ */
+static uint8_t *lz_putLen(uint8_t *op, const uint8_t *oend, size_t len)
+{
+	for (; len >= 255; len -= 255)
+	{
+		if (op >= oend)
+			return NULL;
+		*op++ = 255;
+	}
+	if (op >= oend)
+		return NULL;
+	*op++ = len;
+	return op;
+}
+
+/*
+ * Emit a sequence: literals from \a lit to \a lit + \a nlit, then the
+ * match (if \a mlen is not 0).
+ */
+static uint8_t *lz_putSeq(uint8_t *op, const uint8_t *oend, const uint8_t *lit,
+	size_t nlit, size_t dist, size_t mlen)
+{
+	uint8_t *token = op++;
+	size_t mcode = mlen ? mlen - LZ_MIN_MATCH : 0;
+
+	if (token >= oend)
+		return NULL;
+
+	*token = (MIN(nlit, (size_t)LZ_RUN_MASK) << 4) | MIN(mcode, (size_t)LZ_RUN_MASK);
+
+	if (nlit >= LZ_RUN_MASK && !(op = lz_putLen(op, oend, nlit - LZ_RUN_MASK)))
+		return NULL;
+	if (nlit > (size_t)(oend - op))
+		return NULL;
+	memcpy(op, lit, nlit);
+	op += nlit;
+
+	if (!mlen)
+		return op;
+
+	if (oend - op < 2)
+		return NULL;
+	*op++ = dist & 0xff;
+	*op++ = dist >> 8;
+
+	if (mcode >= LZ_RUN_MASK)
+		op = lz_putLen(op, oend, mcode - LZ_RUN_MASK);
+	return op;
+}
+
+/**
+ * Compress \a len bytes from \a src to \a dst.
+ *
+ * Greedy parsing, matches are searched in a hash table of the last
+ * positions of each 4 bytes sequence. The scan step grows by one every
+ * 64 positions without a match, not to waste time on incompressible data.
+ *
+ * \return the compressed size, 0 if it does not fit in \a dst_len bytes
+ *         (LZ_COMPRESS_BOUND(\a len) is always enough).
+ */
+size_t lz_compress(LzCtx *ctx, void *dst, size_t dst_len, const void *src, size_t len)
+{
+	const uint8_t *base = (const uint8_t *)src;
+	const uint8_t *ip = base;
+	const uint8_t *anchor = base;
+	const uint8_t *iend = base + len;
+	uint8_t *op = (uint8_t *)dst;
+	const uint8_t *oend = op + dst_len;
+
+	unsigned misses = 0;
+
+	memset(ctx->table, 0, sizeof(ctx->table));
+
+	while (len >= LZ_MIN_MATCH && ip <= iend - LZ_MIN_MATCH)
+	{
+		uint32_t seq = lz_read32(ip);
+		unsigned h = lz_hash(seq);
+		size_t pos = ip - base;
+		/* Positions are stored modulo 64k, far older ones fail the checks */
+		size_t dist = (uint16_t)(pos - ctx->table[h]);
+
+		ctx->table[h] = pos;
+
+		if (dist == 0 || dist > CONFIG_LZ_WINDOW || dist > pos
+			|| lz_read32(ip - dist) != seq)
+		{
+			ip += 1 + (misses++ >> 6);
+			continue;
+		}
+
+		const uint8_t *ref = ip - dist;
+		size_t mlen = LZ_MIN_MATCH;
+
+		while (ip + mlen < iend && ip[mlen] == ref[mlen])
+			mlen++;
+
+		if (!(op = lz_putSeq(op, oend, anchor, ip - anchor, dist, mlen)))
+			return 0;
+
+		ip += mlen;
+		anchor = ip;
+		misses = 0;
+
+		/* The match end is a likely match start for what follows */
+		if (ip - 2 <= iend - LZ_MIN_MATCH)
+			ctx->table[lz_hash(lz_read32(ip - 2))] = ip - 2 - base;
+	}
+
+	if (anchor < iend && !(op = lz_putSeq(op, oend, anchor, iend - anchor, 0, 0)))
+		return 0;
+
+	return op - (uint8_t *)dst;
+}
+
+/*
+ * Add a token extension to \a len, \return NULL if the block is truncated.
+ */
+static const uint8_t *lz_getLen(const uint8_t *ip, const uint8_t *iend, size_t *len)
+{
+	uint8_t b;
+
+	do
+	{
+		if (ip >= iend)
+			return NULL;
+		b = *ip++;
+		*len += b;
+	}
+	while (b == 255);
+
+	return ip;
+}
+
+/**
+ * Decompress the block of \a src_len bytes at \a src to \a dst.
+ *
+ * Corrupted data never make it write outside \a dst_len bytes. When
+ * \a src is inside the \a dst buffer (decompression in place) the output
+ * is also checked not to overwrite data not yet read.
+ *
+ * \return the decompressed size, -1 if the data is corrupted or does not
+ *         fit in \a dst_len bytes.
+ */
+int lz_decompress(void *dst, size_t dst_len, const void *src, size_t src_len)
+{
+	const uint8_t *ip = (const uint8_t *)src;
+	const uint8_t *iend = ip + src_len;
+	uint8_t *op = (uint8_t *)dst;
+	uint8_t *oend = op + dst_len;
+	bool inplace = ip >= op && ip < oend;
+
+	while (ip < iend)
+	{
+		unsigned token = *ip++;
+		size_t nlit = token >> 4;
+
+		if (nlit == LZ_RUN_MASK && !(ip = lz_getLen(ip, iend, &nlit)))
+			return -1;
+		if (nlit > (size_t)(iend - ip) || nlit > (size_t)(oend - op)
+			|| (inplace && op > ip))
+			return -1;
+
+		/* Output may overlap input when in place */
+		memmove(op, ip, nlit);
+		op += nlit;
+		ip += nlit;
+
+		if (ip == iend)
+			break;
+
+		if (iend - ip < 2)
+			return -1;
+		size_t dist = ip[0] | (ip[1] << 8);
+		ip += 2;
+
+		size_t mlen = token & LZ_RUN_MASK;
+		if (mlen == LZ_RUN_MASK && !(ip = lz_getLen(ip, iend, &mlen)))
+			return -1;
+		mlen += LZ_MIN_MATCH;
+
+		if (dist == 0 || dist > (size_t)(op - (uint8_t *)dst)
+			|| mlen > (size_t)(oend - op)
+			|| (inplace && op + mlen > ip))
+			return -1;
+
+		/* Byte by byte: the match may overlap the bytes it produces */
+		const uint8_t *ref = op - dist;
+		while (mlen--)
+			*op++ = *ref++;
+	}
+
+	return (int)(op - (uint8_t *)dst);
+}
@@ -0,0 +1,102 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2011 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \brief Small window LZ77 compression, LZ4 style block format.
+ *
+ * A compressed block is a sequence of:
+ * - a token byte: literal count in the high nibble, match length - 4
+ *   in the low nibble; 15 means that the value continues in the
+ *   following bytes, each one added until a byte different from 255;
+ * - the literal bytes;
+ * - the match: 2 bytes little endian distance (1 .. CONFIG_LZ_WINDOW)
+ *   of the data to copy from the output already decoded.
+ * The last sequence has literals only and ends with the block.
+ *
+ * Compression needs a LzCtx (2 << CONFIG_LZ_HASH_BITS bytes), the
+ * decompressor needs no RAM besides the output buffer. A block can be
+ * decompressed in place: put it at the end of an output buffer of
+ * decompressed size + LZ_INPLACE_MARGIN() bytes.
+ *
+ * \code
+ * static LzCtx lz;
+ * uint8_t packed[LZ_COMPRESS_BOUND(sizeof(log))];
+ *
+ * size_t len = lz_compress(&lz, packed, sizeof(packed), log, sizeof(log));
+ * ...
+ * int n = lz_decompress(log, sizeof(log), packed, len);
+ * \endcode
+ *
+ * $WIZ$ module_name = "lz"
+ * $WIZ$ module_configuration = "bertos/cfg/cfg_lz.h"
+ */
+
+#ifndef ALGO_LZ_H
+#define ALGO_LZ_H
+
+#include "cfg/cfg_lz.h"
+
+#include <cfg/compiler.h>
+
+#if CONFIG_LZ_WINDOW < 1024 || CONFIG_LZ_WINDOW > 4096
+	#error CONFIG_LZ_WINDOW must be between 1024 and 4096
+#endif
+
+/** Shortest match encoded. */
+#define LZ_MIN_MATCH 4
+
+/** Max compressed size of \a len bytes, incompressible data included. */
+#define LZ_COMPRESS_BOUND(len) ((len) + (len) / 255 + 16)
+
+/**
+ * Extra room needed to decompress \a len bytes in place: the compressed
+ * block must end at the end of a buffer of \a len + LZ_INPLACE_MARGIN(len)
+ * bytes, whose start is the output.
+ */
+#define LZ_INPLACE_MARGIN(len) ((len) / 255 + 16)
+
+/**
+ * Compressor context, holds the positions of the last occurrences of
+ * the hashed 4 bytes sequences.
+ */
+typedef struct LzCtx
+{
+	uint16_t table[1 << CONFIG_LZ_HASH_BITS];
+} LzCtx;
+
+size_t lz_compress(LzCtx *ctx, void *dst, size_t dst_len, const void *src, size_t len);
+int lz_decompress(void *dst, size_t dst_len, const void *src, size_t src_len);
+
+int lz_testSetup(void);
+int lz_testRun(void);
+int lz_testTearDown(void);
+
+#endif /* ALGO_LZ_H */
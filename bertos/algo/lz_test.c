@@ -0,0 +1,209 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2011 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \brief LZ test: round trip fuzzing, in place decompression, corrupted
+ * blocks, and ratio/throughput on log data compared to RLE.
+ */
+
+#include "lz.h"
+#include "rle.h"
+
+#include <cfg/debug.h>
+#include <cfg/test.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define LZ_TEST_LEN  (16 * 1024)
+#define LZ_BENCH_LEN (64 * 1024)
+
+static LzCtx lz;
+static uint8_t data[LZ_BENCH_LEN];
+static uint8_t packed[LZ_COMPRESS_BOUND(LZ_BENCH_LEN)];
+static uint8_t unpacked[LZ_BENCH_LEN + LZ_INPLACE_MARGIN(LZ_BENCH_LEN)];
+/* RLE worst case: a count byte every 127 literals, plus EOF */
+static uint8_t rle_out[LZ_BENCH_LEN + LZ_BENCH_LEN / 127 + 2];
+
+/*
+ * Log lines as sent by the syslog LOG_FORMAT: mostly the same functions
+ * and messages, with changing counters and values.
+ */
+static size_t lz_logCorpus(uint8_t *buf, size_t len)
+{
+	static const char *funcs[] = { "tftp_recv", "eth_hw_isr", "flash_write", "main", "ax25_poll" };
+	static const char *levels[] = { "INFO", "WARN", "ERR" };
+	static const char *msgs[] =
+	{
+		"block %d received, len %d\n",
+		"rx overrun, %d frames dropped\n",
+		"write at 0x%08x, %d bytes\n",
+		"state %d -> %d\n",
+	};
+	char line[128];
+	size_t pos = 0;
+
+	for (int cnt = 0; ; cnt++)
+	{
+		int n = snprintf(line, sizeof(line), "<182>%d-%s():%d:%s: ", cnt,
+			funcs[rand() % countof(funcs)], 100 + rand() % 300, levels[rand() % 4 ? 0 : 1 + rand() % 2]);
+		n += snprintf(line + n, sizeof(line) - n, msgs[rand() % countof(msgs)], rand() % 4096, rand() % 1024);
+		if (pos + n > len)
+			break;
+		memcpy(buf + pos, line, n);
+		pos += n;
+	}
+	return pos;
+}
+
+/* Random, low entropy, long runs or log text */
+static size_t lz_fill(uint8_t *buf, size_t max)
+{
+	size_t len = rand() % (max + 1);
+
+	switch (rand() % 4)
+	{
+	case 0:
+		for (size_t i = 0; i < len; i++)
+			buf[i] = rand();
+		break;
+	case 1:
+		for (size_t i = 0; i < len; i++)
+			buf[i] = 'a' + rand() % 3;
+		break;
+	case 2:
+		for (size_t i = 0; i < len; i++)
+			buf[i] = (i / (1 + rand() % 300)) & 1 ? 0xff : 0;
+		break;
+	default:
+		len = lz_logCorpus(buf, len);
+		break;
+	}
+	return len;
+}
+
+static void lz_bench(const char *name, const uint8_t *buf, size_t len)
+{
+	const int rounds = 50;
+	size_t plen = 0;
+	int ulen = 0;
+
+	clock_t t0 = clock();
+	for (int r = 0; r < rounds; r++)
+		plen = lz_compress(&lz, packed, sizeof(packed), buf, len);
+	clock_t t1 = clock();
+	for (int r = 0; r < rounds; r++)
+		ulen = lz_decompress(unpacked, sizeof(unpacked), packed, plen);
+	clock_t t2 = clock();
+
+	ASSERT(ulen == (int)len && !memcmp(unpacked, buf, len));
+
+	/* RLE on the same data, for reference */
+	int rlen = rle(rle_out, buf, len);
+
+	kprintf("%-8s %6zu bytes: lz %5.1f%% (%.0f MB/s comp, %.0f MB/s decomp), rle %5.1f%%\n",
+		name, len, 100.0 * plen / len,
+		(double)len * rounds / ((double)(t1 - t0) / CLOCKS_PER_SEC + 1e-9) / 1e6,
+		(double)len * rounds / ((double)(t2 - t1) / CLOCKS_PER_SEC + 1e-9) / 1e6,
+		100.0 * rlen / len);
+}
+
+int lz_testSetup(void)
+{
+	kdbg_init();
+	return 0;
+}
+
+int lz_testTearDown(void)
+{
+	return 0;
+}
+
+int lz_testRun(void)
+{
+	srand(0);
+
+	/* Round trip, normal and in place */
+	for (int iter = 0; iter < 3000; iter++)
+	{
+		size_t len = lz_fill(data, LZ_TEST_LEN);
+		size_t plen = lz_compress(&lz, packed, LZ_COMPRESS_BOUND(len), data, len);
+
+		ASSERT(plen || !len);
+		ASSERT(lz_decompress(unpacked, len, packed, plen) == (int)len);
+		ASSERT(!memcmp(unpacked, data, len));
+
+		size_t size = len + LZ_INPLACE_MARGIN(len);
+		uint8_t *inplace = unpacked + size - plen;
+
+		memmove(inplace, packed, plen);
+		ASSERT(lz_decompress(unpacked, size, inplace, plen) == (int)len);
+		ASSERT(!memcmp(unpacked, data, len));
+
+		/* Output too small */
+		if (len)
+			ASSERT(lz_decompress(unpacked, len - 1, packed, plen) == -1);
+		if (plen > 1)
+			ASSERT(lz_compress(&lz, packed, plen - 1, data, len) == 0);
+	}
+
+	/* Corrupted blocks must never write out of the output buffer */
+	for (int iter = 0; iter < 3000; iter++)
+	{
+		size_t len = lz_fill(data, 2048);
+		size_t plen = lz_compress(&lz, packed, sizeof(packed), data, len);
+		size_t ulen = rand() % (2 * len + 1);
+		uint8_t *out = malloc(ulen + 1);
+
+		ASSERT(out);
+		for (int n = rand() % 8; plen && n >= 0; n--)
+			packed[rand() % plen] = rand();
+		if (plen)
+			plen = rand() % (plen + 1);
+
+		int ret = lz_decompress(out, ulen, packed, plen);
+		ASSERT(ret >= -1 && ret <= (int)ulen);
+		free(out);
+	}
+
+	/* Ratio and throughput */
+	size_t len = lz_logCorpus(data, sizeof(data));
+	lz_bench("log", data, len);
+	for (size_t i = 0; i < sizeof(data); i++)
+		data[i] = rand();
+	lz_bench("random", data, sizeof(data));
+
+	return 0;
+}
+
+TEST_MAIN(lz);
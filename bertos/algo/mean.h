@@ -1,4 +1,58 @@
-#warning revise me!
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2011 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \brief Fixed point mean, decimation and averaging filters.
+ *
+ * All the filters work on unsigned 16 bit samples (eg. ADC readings) with
+ * 32 bit accumulators and power of two lengths: adding a sample costs a
+ * few additions and shifts, reading the filtered value is O(1).
+ * They are meant to be fed in interrupt context, for example by an ADC
+ * scan hook, while tasks read the result at any time. On 32 bit CPUs
+ * the read is a single word access and needs no locking.
+ *
+ * - DecimMean: boxcar decimator, averages blocks of 2^shift samples and
+ *   publishes one result per block;
+ * - MovMean: moving average of the last 2^shift samples;
+ * - EwmaMean: exponentially weighted moving average, a first order
+ *   low pass filter with alpha = 2^-shift and no history buffer.
+ *
+ * The SMEAN_* macros implement a decimator of any length on generic types.
+ */
+
+#ifndef ALGO_MEAN_H
+#define ALGO_MEAN_H
+
+#include <cfg/compiler.h>
+#include <cfg/debug.h>
 
 /**
  *  DECLARE_SMEAN(temperature, uint8_t, uint16_t);
@@ -27,7 +81,7 @@
 	do                                                  \
 	{                                                   \
 		(mean).sum += (sample);                         \
-		if ((mean).count++ >= (max_samples))            \
+		if (++(mean).count >= (max_samples))            \
 		{                                               \
 			(mean).result = (mean).sum / (max_samples); \
 			(mean).sum = 0;                             \
@@ -39,3 +93,149 @@
  * Return current mean value.
  */
 #define SMEAN_GET(mean) ((mean).result)
+
+/** Max shift for the fixed point filters: 2^16 samples of 16 bits fit in 32 bits. */
+#define MEAN_MAX_SHIFT 16
+
+/**
+ * Boxcar decimator.
+ */
+typedef struct DecimMean
+{
+	uint32_t sum;
+	uint32_t count;
+	uint8_t shift;
+	volatile uint16_t result;
+} DecimMean;
+
+/**
+ * Init the decimator \a m to average blocks of 2^\a shift samples.
+ */
+INLINE void decim_init(DecimMean *m, uint8_t shift)
+{
+	ASSERT(shift <= MEAN_MAX_SHIFT);
+	m->sum = 0;
+	m->count = 0;
+	m->shift = shift;
+	m->result = 0;
+}
+
+/**
+ * Add \a sample to the decimator \a m.
+ *
+ * \return true when the block is complete and a new result is available.
+ */
+INLINE bool decim_add(DecimMean *m, uint16_t sample)
+{
+	m->sum += sample;
+	if (++m->count < (1UL << m->shift))
+		return false;
+
+	/* Round to nearest: the sum can not overflow, see MEAN_MAX_SHIFT */
+	m->result = (uint16_t)((m->sum + ((1UL << m->shift) >> 1)) >> m->shift);
+	m->sum = 0;
+	m->count = 0;
+	return true;
+}
+
+/**
+ * Return the mean of the last complete block.
+ */
+INLINE uint16_t decim_get(const DecimMean *m)
+{
+	return m->result;
+}
+
+/**
+ * Moving average.
+ */
+typedef struct MovMean
+{
+	uint16_t *hist;
+	volatile uint32_t sum;
+	uint16_t idx;
+	uint8_t shift;
+} MovMean;
+
+/**
+ * Init the moving average \a m on a window of 2^\a shift samples.
+ *
+ * \param hist History buffer of 2^\a shift samples.
+ * \param initial Value used to fill the window.
+ */
+INLINE void movmean_init(MovMean *m, uint16_t *hist, uint8_t shift, uint16_t initial)
+{
+	ASSERT(shift <= MEAN_MAX_SHIFT);
+	ASSERT(hist);
+
+	for (uint32_t i = 0; i < (1UL << shift); i++)
+		hist[i] = initial;
+	m->hist = hist;
+	m->sum = (uint32_t)initial << shift;
+	m->idx = 0;
+	m->shift = shift;
+}
+
+/**
+ * Add \a sample to the moving average \a m, dropping the oldest one.
+ */
+INLINE void movmean_add(MovMean *m, uint16_t sample)
+{
+	m->sum = m->sum - m->hist[m->idx] + sample;
+	m->hist[m->idx] = sample;
+	m->idx = (uint16_t)((m->idx + 1) & ((1UL << m->shift) - 1));
+}
+
+/**
+ * Return the mean of the samples in the window.
+ */
+INLINE uint16_t movmean_get(const MovMean *m)
+{
+	return (uint16_t)((m->sum + ((1UL << m->shift) >> 1)) >> m->shift);
+}
+
+/**
+ * Exponentially weighted moving average.
+ *
+ * y[n] = y[n-1] + (x[n] - y[n-1]) / 2^shift
+ *
+ * The state keeps y scaled by 2^shift, so no precision is lost on
+ * the division. The time constant is about 2^shift samples.
+ */
+typedef struct EwmaMean
+{
+	volatile uint32_t acc;
+	uint8_t shift;
+} EwmaMean;
+
+/**
+ * Init the filter \a m with alpha = 2^-\a shift, starting from \a initial.
+ */
+INLINE void ewma_init(EwmaMean *m, uint8_t shift, uint16_t initial)
+{
+	ASSERT(shift <= MEAN_MAX_SHIFT);
+	m->acc = (uint32_t)initial << shift;
+	m->shift = shift;
+}
+
+/**
+ * Add \a sample to the filter \a m.
+ */
+INLINE void ewma_add(EwmaMean *m, uint16_t sample)
+{
+	uint32_t acc = m->acc;
+	m->acc = acc - (acc >> m->shift) + sample;
+}
+
+/**
+ * Return the filtered value.
+ *
+ * \note The result is truncated: on a constant input the state settles
+ *       in [x * 2^shift, (x + 1) * 2^shift), so rounding would be biased.
+ */
+INLINE uint16_t ewma_get(const EwmaMean *m)
+{
+	return (uint16_t)(m->acc >> m->shift);
+}
+
+#endif /* ALGO_MEAN_H */
@@ -0,0 +1,180 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2011 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \brief Fixed point mean filters test.
+ */
+
+#include "mean.h"
+
+#include <cfg/debug.h>
+#include <cfg/test.h>
+
+#include <stdlib.h>
+
+#define SHIFT 4
+#define LEN   (1 << SHIFT)
+
+int mean_testSetup(void)
+{
+	kdbg_init();
+	return 0;
+}
+
+int mean_testTearDown(void)
+{
+	return 0;
+}
+
+static int mean_testDecim(void)
+{
+	DecimMean m;
+	decim_init(&m, SHIFT);
+
+	uint32_t sum = 0;
+	for (unsigned i = 0; i < 10 * LEN; i++)
+	{
+		uint16_t sample = (uint16_t)rand();
+		sum += sample;
+
+		if (decim_add(&m, sample))
+		{
+			if (i % LEN != LEN - 1)
+				return -1;
+			if (decim_get(&m) != (sum + LEN / 2) / LEN)
+				return -1;
+			sum = 0;
+		}
+	}
+
+	/* Full scale must not overflow */
+	decim_init(&m, MEAN_MAX_SHIFT);
+	for (uint32_t i = 0; i < (1UL << MEAN_MAX_SHIFT); i++)
+		decim_add(&m, 0xFFFF);
+	if (decim_get(&m) != 0xFFFF)
+		return -1;
+
+	return 0;
+}
+
+static int mean_testMov(void)
+{
+	MovMean m;
+	uint16_t hist[LEN];
+	uint16_t ref[LEN];
+
+	movmean_init(&m, hist, SHIFT, 100);
+	if (movmean_get(&m) != 100)
+		return -1;
+	for (unsigned i = 0; i < LEN; i++)
+		ref[i] = 100;
+
+	for (unsigned i = 0; i < 20 * LEN; i++)
+	{
+		uint16_t sample = (uint16_t)rand();
+		movmean_add(&m, sample);
+		ref[i % LEN] = sample;
+
+		uint32_t sum = 0;
+		for (unsigned j = 0; j < LEN; j++)
+			sum += ref[j];
+		if (movmean_get(&m) != (sum + LEN / 2) / LEN)
+			return -1;
+	}
+	return 0;
+}
+
+static int mean_testEwma(void)
+{
+	EwmaMean m;
+
+	/* Step up and down: the output must settle exactly on the input */
+	ewma_init(&m, SHIFT, 0);
+	for (unsigned i = 0; i < 40 * LEN; i++)
+		ewma_add(&m, 4000);
+	if (ewma_get(&m) != 4000)
+		return -1;
+
+	for (unsigned i = 0; i < 40 * LEN; i++)
+		ewma_add(&m, 1234);
+	if (ewma_get(&m) != 1234)
+		return -1;
+
+	/* Follow the floating point filter */
+	double y = 1234;
+	for (unsigned i = 0; i < 20 * LEN; i++)
+	{
+		uint16_t sample = (uint16_t)(rand() & 0xFFF);
+		ewma_add(&m, sample);
+		y += (sample - y) / LEN;
+
+		int diff = ewma_get(&m) - (int)y;
+		if (diff < -1 || diff > 1)
+			return -1;
+	}
+
+	/* Full scale must not overflow */
+	ewma_init(&m, MEAN_MAX_SHIFT, 0xFFFF);
+	for (unsigned i = 0; i < 100; i++)
+		ewma_add(&m, 0xFFFF);
+	if (ewma_get(&m) != 0xFFFF)
+		return -1;
+
+	return 0;
+}
+
+int mean_testRun(void)
+{
+	DECLARE_SMEAN(smean, uint16_t, uint32_t);
+	for (unsigned i = 0; i < 10; i++)
+		SMEAN_ADD(smean, i, 10);
+	kprintf("smean %d\n", SMEAN_GET(smean));
+	ASSERT(SMEAN_GET(smean) == 4);
+
+	if (mean_testDecim() < 0)
+	{
+		kprintf("decimator failed\n");
+		return -1;
+	}
+	if (mean_testMov() < 0)
+	{
+		kprintf("moving average failed\n");
+		return -1;
+	}
+	if (mean_testEwma() < 0)
+	{
+		kprintf("ewma failed\n");
+		return -1;
+	}
+	return 0;
+}
+
+TEST_MAIN(mean);
@@ -40,6 +40,21 @@
 
 #include "rle.h"
 
+#include <string.h> // memset()
+
+/* Longest run of both kinds, the count is a signed char */
+#define RLE_MAX_RUN 127
+
+/* Streaming encoder context */
+typedef struct RleEnc
+{
+	KFile *out;
+	kfile_off_t written;
+	bool error;
+	int nlit;                        ///< Pending literal bytes
+	unsigned char lit[RLE_MAX_RUN];
+} RleEnc;
+
 /**
  * Run-length encode \a len bytes from the \a input buffer
  * to the \a output buffer.
@@ -144,3 +159,141 @@ int unrle(unsigned char *output, const unsigned char *input)
 
 	return (out - output);
 }
+
+static void rle_put(RleEnc *e, const void *buf, size_t len)
+{
+	if (kfile_write(e->out, buf, len) != len)
+		e->error = true;
+	e->written += len;
+}
+
+static void rle_flushLiterals(RleEnc *e)
+{
+	unsigned char count = (unsigned char)-e->nlit;
+
+	if (!e->nlit)
+		return;
+
+	rle_put(e, &count, 1);
+	rle_put(e, e->lit, e->nlit);
+	e->nlit = 0;
+}
+
+/*
+ * Output \a n bytes equal to \a val. As rle() does, a run of 2 bytes
+ * after a literal run is kept in the literal run: there is no gain in
+ * splitting it, and a loss if more literals follow.
+ */
+static void rle_putRun(RleEnc *e, unsigned char val, int n)
+{
+	if (n >= 3 || (n == 2 && !e->nlit))
+	{
+		unsigned char run[2] = { (unsigned char)n, val };
+
+		rle_flushLiterals(e);
+		rle_put(e, run, sizeof(run));
+	}
+	else
+	{
+		while (n--)
+		{
+			e->lit[e->nlit++] = val;
+			if (e->nlit == RLE_MAX_RUN)
+				rle_flushLiterals(e);
+		}
+	}
+}
+
+/**
+ * Run-length encode \a in up to its end to \a out.
+ *
+ * The output can be decoded by unrle() and unrle_kfile(). RAM usage does
+ * not depend on the data size: only the pending literal run is buffered.
+ *
+ * \return the number of bytes written to \a out, EOF on write error.
+ */
+kfile_off_t rle_kfile(KFile *out, KFile *in)
+{
+	RleEnc e;
+	unsigned char buf[32];
+	unsigned char val = 0;
+	int n = 0;
+	size_t len;
+
+	e.out = out;
+	e.written = 0;
+	e.error = false;
+	e.nlit = 0;
+
+	while ((len = kfile_read(in, buf, sizeof(buf))) > 0)
+	{
+		for (size_t i = 0; i < len; i++)
+		{
+			if (n && buf[i] == val && n < RLE_MAX_RUN)
+			{
+				n++;
+				continue;
+			}
+			if (n)
+				rle_putRun(&e, val, n);
+			val = buf[i];
+			n = 1;
+		}
+	}
+
+	if (n)
+		rle_putRun(&e, val, n);
+	rle_flushLiterals(&e);
+
+	/* EOF marker */
+	val = 0;
+	rle_put(&e, &val, 1);
+
+	return e.error ? EOF : e.written;
+}
+
+/**
+ * Run-length decode from \a in to \a out, up to the end of stream marker.
+ *
+ * \return the number of bytes written to \a out, EOF on write error or
+ *         if \a in ends before the end of stream marker.
+ */
+kfile_off_t unrle_kfile(KFile *out, KFile *in)
+{
+	unsigned char buf[RLE_MAX_RUN + 1];
+	kfile_off_t written = 0;
+
+	for (;;)
+	{
+		int c = kfile_getc(in);
+		size_t len;
+
+		if (c == EOF)
+			return EOF;
+
+		if ((signed char)c > 0)
+		{
+			/* replicate run */
+			int value = kfile_getc(in);
+
+			if (value == EOF)
+				return EOF;
+			len = (signed char)c;
+			memset(buf, value, len);
+		}
+		else if ((signed char)c < 0)
+		{
+			/* literal run */
+			len = -(signed char)c;
+			if (kfile_read(in, buf, len) != len)
+				return EOF;
+		}
+		else
+			/* EOF */
+			return written;
+
+		if (kfile_write(out, buf, len) != len)
+			return EOF;
+		written += len;
+	}
+}
@@ -35,12 +35,29 @@
  *
  * \author Bernie Innocenti <bernie@codewiz.org>
  *
+ * The encoded stream is a sequence of runs, each starting with a count
+ * byte: n > 0 repeats the following byte n times, n < 0 is followed by
+ * -n literal bytes, 0 ends the stream.
+ *
+ * rle_kfile() and unrle_kfile() produce and read the same format
+ * streaming between two KFiles, with a fixed amount of RAM.
+ *
  * $WIZ$ module_name = "rle"
+ * $WIZ$ module_depends = "kfile"
  */
 #ifndef RLE_H
 #define RLE_H
 
+#include <io/kfile.h>
+
 int rle(unsigned char *output, const unsigned char *input, int length);
 int unrle(unsigned char *output, const unsigned char *input);
 
+kfile_off_t rle_kfile(KFile *out, KFile *in);
+kfile_off_t unrle_kfile(KFile *out, KFile *in);
+
+int rle_testSetup(void);
+int rle_testRun(void);
+int rle_testTearDown(void);
+
 #endif /* RLE_H */
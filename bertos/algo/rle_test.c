@@ -0,0 +1,135 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2011 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \brief RLE test: round trip of the buffer and the streaming codecs.
+ */
+
+#include "rle.h"
+
+#include <cfg/debug.h>
+#include <cfg/test.h>
+
+#include <struct/kfile_mem.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#define RLE_TEST_LEN   2048
+/* Worst case: a count byte every 127 literals, plus EOF */
+#define RLE_PACKED_LEN (RLE_TEST_LEN + RLE_TEST_LEN / 127 + 2)
+
+static unsigned char data[RLE_TEST_LEN];
+static unsigned char packed[RLE_PACKED_LEN];
+static unsigned char spacked[RLE_PACKED_LEN];
+static unsigned char unpacked[RLE_TEST_LEN];
+
+/*
+ * Random data with runs of random length, or no runs at all.
+ * KFileMem does not take empty buffers, so at least 1 byte.
+ */
+static size_t rle_fill(unsigned char *buf, size_t max)
+{
+	size_t len = 1 + rand() % max;
+	int max_run = 1 + rand() % 200;
+
+	for (size_t i = 0; i < len; )
+	{
+		unsigned char c = rand() % 4 ? rand() : 'a';
+		size_t run = 1 + rand() % max_run;
+
+		while (run-- && i < len)
+			buf[i++] = c;
+	}
+	return len;
+}
+
+int rle_testSetup(void)
+{
+	kdbg_init();
+	return 0;
+}
+
+int rle_testTearDown(void)
+{
+	return 0;
+}
+
+int rle_testRun(void)
+{
+	KFileMem in, out;
+
+	srand(0);
+	for (int iter = 0; iter < 2000; iter++)
+	{
+		size_t len = rle_fill(data, sizeof(data));
+
+		/* Buffer codec */
+		int plen = rle(packed, data, len);
+		ASSERT(plen > 0 && (size_t)plen <= sizeof(packed));
+		ASSERT(unrle(unpacked, packed) == (int)len);
+		ASSERT(!memcmp(unpacked, data, len));
+
+		/* Streaming encoder, decoded by both decoders */
+		kfilemem_init(&in, data, len);
+		kfilemem_init(&out, spacked, sizeof(spacked));
+		kfile_off_t slen = rle_kfile(&out.fd, &in.fd);
+		ASSERT(slen > 0 && slen <= (kfile_off_t)sizeof(spacked));
+		ASSERT(unrle(unpacked, spacked) == (int)len);
+		ASSERT(!memcmp(unpacked, data, len));
+
+		memset(unpacked, 0, sizeof(unpacked));
+		kfilemem_init(&in, spacked, slen);
+		kfilemem_init(&out, unpacked, sizeof(unpacked));
+		ASSERT(unrle_kfile(&out.fd, &in.fd) == (kfile_off_t)len);
+		ASSERT(!memcmp(unpacked, data, len));
+
+		/* Streaming decoder on the buffer encoder output */
+		kfilemem_init(&in, packed, plen);
+		kfilemem_init(&out, unpacked, sizeof(unpacked));
+		ASSERT(unrle_kfile(&out.fd, &in.fd) == (kfile_off_t)len);
+		ASSERT(!memcmp(unpacked, data, len));
+
+		/* A truncated stream is an error, not a short result */
+		kfilemem_init(&in, spacked, 1 + rand() % (slen - 1));
+		kfilemem_init(&out, unpacked, sizeof(unpacked));
+		ASSERT(unrle_kfile(&out.fd, &in.fd) == EOF);
+
+		/* Output full */
+		kfilemem_init(&in, data, len);
+		kfilemem_init(&out, spacked, 1 + rand() % (slen - 1));
+		ASSERT(rle_kfile(&out.fd, &in.fd) == EOF);
+	}
+
+	return 0;
+}
+
+TEST_MAIN(rle);
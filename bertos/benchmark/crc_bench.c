@@ -0,0 +1,140 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2011 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \brief CRC throughput benchmark.
+ */
+
+#include "crc_bench.h"
+
+#include "cfg/cfg_crc.h"
+#include <cfg/debug.h>
+
+#include <algo/crc.h>
+#include <algo/crc_ccitt.h>
+#include <algo/crc32.h>
+
+#include <drv/timer.h>
+
+#define CRC_BENCH_LEN  4096
+/* Each CRC runs on the buffer over and over for this time */
+#define CRC_BENCH_MS   500
+
+static uint8_t bench_buf[CRC_BENCH_LEN];
+
+typedef uint32_t (*crc_bench_t)(const uint8_t *buf, size_t len);
+
+static uint32_t crc16_byte(const uint8_t *buf, size_t len)
+{
+	uint16_t crc = CRC16_INIT_VAL;
+
+	while (len--)
+		crc = updcrc16(*buf++, crc);
+	return crc;
+}
+
+static uint32_t crc16_lib(const uint8_t *buf, size_t len)
+{
+	return crc16(CRC16_INIT_VAL, buf, len);
+}
+
+static uint32_t crc_ccitt_byte(const uint8_t *buf, size_t len)
+{
+	uint16_t crc = CRC_CCITT_INIT_VAL;
+
+	while (len--)
+		crc = updcrc_ccitt(*buf++, crc);
+	return crc;
+}
+
+static uint32_t crc_ccitt_lib(const uint8_t *buf, size_t len)
+{
+	return crc_ccitt(CRC_CCITT_INIT_VAL, buf, len);
+}
+
+static uint32_t crc32_byte(const uint8_t *buf, size_t len)
+{
+	uint32_t crc = ~CRC32_INIT_VAL;
+
+	while (len--)
+		crc = updcrc32(*buf++, crc);
+	return ~crc;
+}
+
+static uint32_t crc32_lib(const uint8_t *buf, size_t len)
+{
+	return crc32(buf, len, CRC32_INIT_VAL);
+}
+
+static const struct
+{
+	const char *name;
+	crc_bench_t crc;
+} benchs[] =
+{
+	{ "crc16 byte",     crc16_byte },
+	{ "crc16",          crc16_lib },
+	{ "crc_ccitt byte", crc_ccitt_byte },
+	{ "crc_ccitt",      crc_ccitt_lib },
+	{ "crc32 byte",     crc32_byte },
+	{ "crc32",          crc32_lib },
+};
+
+void crc_bench(void)
+{
+	for (size_t i = 0; i < sizeof(bench_buf); i++)
+		bench_buf[i] = i * 7 + (i >> 8);
+
+	kprintf("CRC benchmark, %d bytes blocks, slice-by-%d, hw %s\n",
+		CRC_BENCH_LEN, CONFIG_CRC_SLICE, CONFIG_CRC_HW ? "on" : "off");
+
+	for (size_t i = 0; i < countof(benchs); i++)
+	{
+		uint32_t crc;
+		unsigned long rounds = 0;
+		ticks_t start = timer_clock();
+		ticks_t elapsed;
+
+		do
+		{
+			crc = benchs[i].crc(bench_buf, sizeof(bench_buf));
+			rounds++;
+		}
+		while ((elapsed = timer_clock() - start) < ms_to_ticks(CRC_BENCH_MS));
+
+		/* Byte at a time and library results must match */
+		if (i & 1)
+			ASSERT(crc == benchs[i - 1].crc(bench_buf, sizeof(bench_buf)));
+
+		kprintf("%-15s [%08lX] %8lu KB/s\n", benchs[i].name, (unsigned long)crc,
+			rounds * (CRC_BENCH_LEN / 1024) * 1000 / ticks_to_ms(elapsed));
+	}
+}
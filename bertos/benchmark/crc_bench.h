@@ -0,0 +1,48 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2011 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \brief CRC throughput benchmark.
+ *
+ * Compares the byte at a time table lookup of CRC16, CRC-CCITT and CRC32
+ * with the library functions, which use the slicing tables and the
+ * hardware selected in cfg_crc.h.
+ *
+ * $WIZ$ module_name = "crc_bench"
+ * $WIZ$ module_depends = "timer", "crc16", "crc-ccitt", "crc32"
+ */
+
+#ifndef BENCHMARK_CRC_BENCH_H
+#define BENCHMARK_CRC_BENCH_H
+
+void crc_bench(void);
+
+#endif /* BENCHMARK_CRC_BENCH_H */
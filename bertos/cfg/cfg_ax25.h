@@ -62,10 +62,22 @@
  */
 #define CONFIG_AX25_FRAME_BUF_LEN 330
 
+/**
+ * Number of frame buffers of the receive queue.
+ * If greater than 0, ax25_poll() only queues the received frames and
+ * the hook is called by ax25_dispatch(), usually from another process,
+ * so that a slow hook does not drop frames.
+ * Each buffer uses CONFIG_AX25_FRAME_BUF_LEN bytes of RAM.
+ * If 0 the hook is called by ax25_poll().
+ *
+ * $WIZ$ type = "int"
+ * $WIZ$ min = 0
+ * $WIZ$ max = 255
+ */
+#define CONFIG_AX25_RX_QUEUE 0
+
 /**
  * Enable repeaters listing in AX25 frames.
- * If enabled use 56 addtional bytes of RAM
- * for each message received.
  *
  * $WIZ$ type = "boolean"
  */
@@ -0,0 +1,130 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2011 Develer S.r.l. (http://www.develer.com/)
+ * -->
+ *
+ * \brief Configuration file for the AX25 connected mode module.
+ */
+
+#ifndef CFG_AX25_LAPB_H
+#define CFG_AX25_LAPB_H
+
+/**
+ * Module logging level.
+ *
+ * $WIZ$ type = "enum"
+ * $WIZ$ value_list = "log_level"
+ */
+#define AX25_LAPB_LOG_LEVEL LOG_LVL_WARN
+
+/**
+ * Module logging format.
+ *
+ * $WIZ$ type = "enum"
+ * $WIZ$ value_list = "log_format"
+ */
+#define AX25_LAPB_LOG_FORMAT LOG_FMT_TERSE
+
+/**
+ * Max I frames sent and not yet acknowledged (k).
+ * Every frame needs a send and a receive buffer of CONFIG_AX25_LAPB_N1
+ * bytes. The window used by a link can be lowered at runtime, and it
+ * is also limited to 7 with modulo 8 sequence numbers (4 with
+ * CONFIG_AX25_LAPB_SREJ).
+ *
+ * $WIZ$ type = "int"
+ * $WIZ$ min = 1
+ * $WIZ$ max = 127
+ */
+#define CONFIG_AX25_LAPB_WINDOW 4
+
+/**
+ * Max payload of an I frame (N1), in bytes.
+ *
+ * $WIZ$ type = "int"
+ * $WIZ$ min = 1
+ * $WIZ$ max = 256
+ */
+#define CONFIG_AX25_LAPB_N1 128
+
+/**
+ * Receive stream buffer length, in bytes, must be greater than
+ * CONFIG_AX25_LAPB_N1.
+ * When less than CONFIG_AX25_LAPB_N1 bytes are free the link
+ * tells the remote station that the receiver is busy.
+ *
+ * $WIZ$ type = "int"
+ * $WIZ$ min = 2
+ */
+#define CONFIG_AX25_LAPB_RXBUF 512
+
+/**
+ * Use modulo 128 sequence numbers (SABME) for outgoing connections.
+ *
+ * $WIZ$ type = "boolean"
+ */
+#define CONFIG_AX25_LAPB_MOD128 0
+
+/**
+ * Request only the missing I frames with selective reject (SREJ)
+ * and keep the ones received out of sequence.
+ * If disabled the remote station resends all the frames from the
+ * missing one (REJ).
+ * The window is limited to half the modulus, both stations should
+ * use the same setting.
+ *
+ * $WIZ$ type = "boolean"
+ */
+#define CONFIG_AX25_LAPB_SREJ 1
+
+/**
+ * Acknowledgement timer (T1), in ms.
+ *
+ * $WIZ$ type = "int"
+ * $WIZ$ min = 1
+ */
+#define CONFIG_AX25_LAPB_T1 3000
+
+/**
+ * Response delay timer (T2), in ms. Must be lower than T1.
+ *
+ * $WIZ$ type = "int"
+ * $WIZ$ min = 0
+ */
+#define CONFIG_AX25_LAPB_T2 1000
+
+/**
+ * Max retries (N2) before the link is declared failed.
+ *
+ * $WIZ$ type = "int"
+ * $WIZ$ min = 1
+ */
+#define CONFIG_AX25_LAPB_N2 10
+
+#endif /* CFG_AX25_LAPB_H */
@@ -62,4 +62,70 @@
  */
 #define CONFIG_BATTFS_SHUFFLE_FREE_PAGES 0
 
+/**
+ * Set to 1 to enable page table checkpointing.
+ * The page table is saved on a reserved area at umount
+ * (or on request) and reloaded at mount, avoiding
+ * the full disk scan when the checkpoint is still valid.
+ * $WIZ$ type = "boolean"
+ */
+#define CONFIG_BATTFS_CHECKPOINT 1
+
+/**
+ * Set to 1 to enable wear leveling.
+ * Keep an erase counter for each page: new pages are chosen
+ * between the least worn near the head of the free list and
+ * battfs_gc() moves cold data away from pages that are much
+ * less worn than the free ones.
+ * $WIZ$ type = "boolean"
+ */
+#define CONFIG_BATTFS_WEAR_LEVELING 1
+
+/**
+ * Number of free pages examined when allocating a new page.
+ * $WIZ$ type = "int"
+ * $WIZ$ min = 1
+ */
+#define CONFIG_BATTFS_WEAR_WINDOW 8
+
+/**
+ * Erase count difference that triggers moving cold data.
+ * $WIZ$ type = "int"
+ * $WIZ$ min = 1
+ */
+#define CONFIG_BATTFS_WEAR_THRESHOLD 64
+
+/**
+ * Set to 1 to enable the background garbage collector process.
+ * Requires the kernel.
+ * $WIZ$ type = "boolean"
+ */
+#define CONFIG_BATTFS_GC 0
+
+/**
+ * Garbage collector process stack size.
+ * $WIZ$ type = "int"
+ */
+#define CONFIG_BATTFS_GC_STACK 512
+
+/**
+ * Garbage collector process priority.
+ * Should be lower than the priority of the processes using the disk.
+ * $WIZ$ type = "int"
+ */
+#define CONFIG_BATTFS_GC_PRI -1
+
+/**
+ * Garbage collector period, in ms.
+ * $WIZ$ type = "int"
+ */
+#define CONFIG_BATTFS_GC_INTERVAL 100
+
+/**
+ * Number of pages examined by each garbage collector step.
+ * $WIZ$ type = "int"
+ * $WIZ$ min = 1
+ */
+#define CONFIG_BATTFS_GC_PAGES 8
+
 #endif /* BATTFS */
@@ -0,0 +1,60 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2011 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \brief Configuration file for the CRC modules (CRC16, CRC-CCITT, CRC32).
+ */
+
+#ifndef CFG_CRC_H
+#define CFG_CRC_H
+
+/**
+ * Bytes processed for each round of table lookups (slicing-by-N).
+ *
+ * 1 uses only the classic 256 entries table, 4 and 8 add 3 or 7 more
+ * tables to the flash footprint of each CRC, trading ROM for speed.
+ * Ignored on Harvard CPUs, where every lookup is a program memory read.
+ *
+ * $WIZ$ type = "int"
+ * $WIZ$ min = 1
+ * $WIZ$ max = 8
+ */
+#define CONFIG_CRC_SLICE 8
+
+/**
+ * Use the CRC hardware of the CPU for CRC32, when available.
+ *
+ * STM32 CRC unit on Cortex-M3, CRC32 instructions on ARMv8 hosts.
+ * $WIZ$ type = "boolean"
+ */
+#define CONFIG_CRC_HW 1
+
+#endif /* CFG_CRC_H */
@@ -61,4 +61,25 @@
  */
 #define CONFIG_EEPROM_DISABLE_OLD_API 0
 
+/**
+ * Write-back page shadow.
+ * Keep a RAM copy of the last accessed page: small writes are merged
+ * in it and reach the memory as a single page write, on kblock_flush()
+ * or when another page is accessed.
+ *
+ * $WIZ$ type = "boolean"
+ */
+#define CONFIG_EEPROM_WRITE_BACK 0
+
+/**
+ * Asynchronous writes.
+ * When enabled a page write returns as soon as its data is sent,
+ * and the memory completes the write cycle in background: the
+ * next access, or eeprom_sync(), waits for it.
+ * Otherwise each page write waits for the end of its own cycle.
+ *
+ * $WIZ$ type = "boolean"
+ */
+#define CONFIG_EEPROM_ASYNC 1
+
 #endif /* CFG_EEPROM_H */
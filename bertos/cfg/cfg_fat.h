@@ -106,6 +106,31 @@
 #define CONFIG_FAT_USE_FORWARD 0
 #define _USE_FORWARD           (CONFIG_FAT_USE_FORWARD && CONFIG_FAT_FS_TINY)
 
+/**
+ * Enable the fast seek cluster link map.
+ * Each FatFile keeps a map of the fragments of its cluster chain, so seeks
+ * and cluster crossings do not have to follow the FAT on disk.
+ * $WIZ$ type = "boolean"
+ */
+#define CONFIG_FAT_USE_FASTSEEK 1
+#define _USE_FASTSEEK           CONFIG_FAT_USE_FASTSEEK
+
+/**
+ * Size of the cluster link map of each FatFile, in DWORDs.
+ * A map of n DWORDs describes up to (n - 2) / 2 fragments; seeks beyond the
+ * mapped part of a more fragmented file fall back to following the FAT.
+ * $WIZ$ type = "int"; min = 4
+ */
+#define CONFIG_FAT_FASTSEEK_SIZE 32
+
+/**
+ * Enable f_expand function to allocate contiguous files.
+ * Requires CONFIG_FAT_FS_READONLY = 0 and CONFIG_FAT_FS_MINIMIZE = 0.
+ * $WIZ$ type = "boolean"
+ */
+#define CONFIG_FAT_USE_EXPAND 1
+#define _USE_EXPAND           (CONFIG_FAT_USE_EXPAND && !CONFIG_FAT_FS_READONLY && CONFIG_FAT_FS_MINIMIZE == 0)
+
 /**
  * Number of volumes (logical drives) to be used.
  * $WIZ$ type = "int"; min = 1; max = 255
@@ -47,4 +47,17 @@
  */
 #define CONFIG_FLASH25 FLASH25_AT25F2048
 
+/**
+ * Data lines used by memory reads.
+ * With 1 line FAST_READ is used when the memory has it, 2 and 4
+ * select the dual and quad output reads, that need a SPI controller
+ * able to receive on more lines (see SPI_HW_READ_LINES() in hw_spi.h).
+ * With 4 lines flash25_init() sets the quad enable bit of the memory.
+ *
+ * $WIZ$ type = "int"
+ * $WIZ$ min = 1
+ * $WIZ$ max = 4
+ */
+#define CONFIG_FLASH25_READ_LINES 1
+
 #endif /* CFG_FALSH25_H */
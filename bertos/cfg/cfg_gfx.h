@@ -56,6 +56,17 @@
  */
 #define CONFIG_GFX_VCOORDS 1
 
+/**
+ * Number of dirty rectangles tracked in a bitmap, 0 to disable tracking.
+ *
+ * Drawing primitives record the areas they change, so display drivers
+ * can refresh only those. Distant changes are kept in separate
+ * rectangles up to this number, then the closest ones are merged.
+ * $WIZ$ type = "int"
+ * $WIZ$ min = 0
+ */
+#define CONFIG_GFX_DIRTY_RECTS 4
+
 /**
  * Select bitmap pixel format.
  * $WIZ$ type = "enum"
@@ -62,6 +62,14 @@
  */
 #define CONFIG_I2C_DISABLE_OLD_API 0
 
+/**
+ * Stack size of the bus owner process of the i2c transaction queue.
+ *
+ * $WIZ$ type = "int"
+ * $WIZ$ min = 256
+ */
+#define CONFIG_I2C_QUEUE_STACK 512
+
 /**
  * Module logging level.
  *
@@ -71,4 +71,12 @@
  */
 #define CONFIG_SD_OLD_INIT 1
 
+/**
+ * Check the CRC16 of the data blocks read from the card, and send the
+ * right one with the blocks written.
+ * $WIZ$ type = "boolean"
+ * $WIZ$ conditional_deps = "crc16"
+ */
+#define CONFIG_SD_CRC16 0
+
 #endif /* CFG_SD_H */
@@ -201,6 +201,22 @@
  */
 #define CONFIG_SER_RXTIMEOUT -1
 
+/**
+ * Sleep instead of busy waiting when the tx FIFO is full or the rx FIFO
+ * is empty.
+ *
+ * The waiting process is woken up by the driver interrupt when the FIFO
+ * is half empty (tx) or holds the requested data, up to half of its
+ * size (rx), so that it runs once per burst instead of once per
+ * character. Timeouts keep working as usual.
+ * Requires the kernel with signals.
+ *
+ * $WIZ$ type = "boolean"
+ * $WIZ$ conditional_deps = "signal"
+ * $WIZ$ supports = "lm3s or lpc2 or stm32 or sam3 or at91 or avr"
+ */
+#define CONFIG_SER_EVENTS 0
+
 /**
  * Use RTS/CTS handshake.
  * $WIZ$ type = "boolean"
@@ -215,6 +231,31 @@
  */
 #define CONFIG_SER_DEFBAUDRATE 0UL
 
+/**
+ * Move USART data with the peripheral DMA controller instead of
+ * interrupting on every character.
+ *
+ * The tx FIFO is sent in place a contiguous run at a time, while the
+ * receiver writes in the rx FIFO memory used as a circular buffer.
+ * Received data is handed to the reader when half of the rx buffer
+ * has been filled or when the line stays idle for
+ * CONFIG_SER_DMA_RXIDLE bit periods.
+ *
+ * $WIZ$ type = "boolean"
+ * $WIZ$ supports = "at91 or sam3"
+ */
+#define CONFIG_SER_DMA 0
+
+/**
+ * Idle line time after which a partially received block is delivered
+ * to the reader [bit periods].
+ * $WIZ$ type = "int"
+ * $WIZ$ min = 1
+ * $WIZ$ max = 65535
+ * $WIZ$ supports = "at91 or sam3"
+ */
+#define CONFIG_SER_DMA_RXIDLE 20
+
 /// Enable strobe pin for debugging serial interrupt. $WIZ$ type = "boolean"
 #define CONFIG_SER_STROBE 0
 
@@ -295,6 +295,8 @@ static void uart_irq_rx(int port)
 		else
 			fifo_push(rxfifo, c);
 	}
+
+	ser_rxNotify(ser_handles[port]);
 }
 
 INLINE bool lpc2_uartTxReady(int port)
@@ -323,6 +325,8 @@ static void uart_irq_tx(int port)
 		/* THR: put a character to the Transmit Holding Register */
 		*(reg8_t *)(uart_param[port].base + THR) = fifo_pop(txfifo);
 	}
+
+	ser_txNotify(ser_handles[port]);
 }
 
 static void uart_common_irq_handler(int port)
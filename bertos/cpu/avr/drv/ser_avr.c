@@ -995,6 +995,7 @@ DECLARE_ISR(USART0_UDRE_vect)
 	{
 		char c = fifo_pop(txfifo);
 		SER_UART0_BUS_TXCHAR(c);
+		ser_txNotify(ser_handles[SER_UART0]);
 	}
 
 	SER_STROBE_OFF;
@@ -1065,6 +1066,7 @@ DECLARE_ISR(USART1_UDRE_vect)
 	{
 		char c = fifo_pop(txfifo);
 		SER_UART1_BUS_TXCHAR(c);
+		ser_txNotify(ser_handles[SER_UART1]);
 	}
 
 	SER_STROBE_OFF;
@@ -1117,6 +1119,7 @@ DECLARE_ISR(USART2_UDRE_vect)
 	{
 		char c = fifo_pop(txfifo);
 		SER_UART2_BUS_TXCHAR(c);
+		ser_txNotify(ser_handles[SER_UART2]);
 	}
 
 	SER_STROBE_OFF;
@@ -1169,6 +1172,7 @@ DECLARE_ISR(USART3_UDRE_vect)
 	{
 		char c = fifo_pop(txfifo);
 		SER_UART3_BUS_TXCHAR(c);
+		ser_txNotify(ser_handles[SER_UART3]);
 	}
 
 	SER_STROBE_OFF;
@@ -1243,6 +1247,8 @@ DECLARE_ISR(USART0_RX_vect)
 #endif
 	}
 
+	ser_rxNotify(ser_handles[SER_UART0]);
+
 	/* Reenable receive complete int */
 	//IRQ_DISABLE;
 	//UCSR0B |= BV(RXCIE);
@@ -1291,6 +1297,8 @@ DECLARE_ISR(USART1_RX_vect)
 			RTS_OFF;
 	#endif
 	}
+
+	ser_rxNotify(ser_handles[SER_UART1]);
 	/* Re-enable receive complete int */
 	//IRQ_DISABLE;
 	//UCSR1B |= BV(RXCIE);
@@ -1341,6 +1349,8 @@ DECLARE_ISR(USART2_RX_vect)
 			RTS_OFF;
 	#endif
 	}
+
+	ser_rxNotify(ser_handles[SER_UART2]);
 	/* Re-enable receive complete int */
 	//IRQ_DISABLE;
 	//UCSR1B |= BV(RXCIE);
@@ -1391,6 +1401,8 @@ DECLARE_ISR(USART3_RX_vect)
 			RTS_OFF;
 	#endif
 	}
+
+	ser_rxNotify(ser_handles[SER_UART3]);
 	/* Re-enable receive complete int */
 	//IRQ_DISABLE;
 	//UCSR1B |= BV(RXCIE);
@@ -1422,5 +1434,8 @@ DECLARE_ISR(SPI_STC_vect)
 	else
 		UARTDescs[SER_SPI].sending = false;
 
+	ser_rxNotify(ser_handles[SER_SPI]);
+	ser_txNotify(ser_handles[SER_SPI]);
+
 	SER_STROBE_OFF;
 }
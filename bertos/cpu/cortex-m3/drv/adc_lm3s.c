@@ -118,6 +118,125 @@ static void adc_enable_irq(void)
 
 #endif /* CONFIG_KERN */
 
+#if CONFIG_ADC_SCAN
+	#include <drv/irq_cm3.h>
+
+/*
+ * These parts have no DMA controller: sequencer 0 converts all the
+ * channels continuously and its ISR moves the results from the 8 entries
+ * FIFO to the ring, once per sequence.
+ */
+static struct AdcScan
+{
+	void (*hook)(const uint16_t *block, size_t len, void *user);
+	void *user;
+	uint16_t *ring;
+	size_t half;
+	size_t pos;
+	size_t seq_len;
+} scan;
+
+/**
+ * Sequencer 0 ISR: a whole sequence is in the FIFO.
+ */
+static DECLARE_ISR(adc_scan_irq)
+{
+	HWREG(ADC_BASE + ADC_O_ISC) = ADC_ISC_IN0;
+
+	if (HWREG(ADC_BASE + ADC_O_OSTAT) & ADC_OSTAT_OV0)
+	{
+		/*
+		 * Some samples have been lost: restart the sequence from its first
+		 * step, dropping the partial scan, to keep channels interleaved.
+		 */
+		HWREG(ADC_BASE + ADC_O_ACTSS) &= ~ADC_ACTSS_ASEN0;
+		while (!(HWREG(ADC_BASE + ADC_O_SSFSTAT0) & ADC_SSFSTAT0_EMPTY))
+			(void)HWREG(ADC_BASE + ADC_O_SSFIFO0);
+		HWREG(ADC_BASE + ADC_O_OSTAT) = ADC_OSTAT_OV0;
+		scan.pos -= scan.pos % scan.seq_len;
+		HWREG(ADC_BASE + ADC_O_ACTSS) |= ADC_ACTSS_ASEN0;
+		return;
+	}
+
+	for (size_t i = 0; i < scan.seq_len; i++)
+	{
+		scan.ring[scan.pos++] = (uint16_t)HWREG(ADC_BASE + ADC_O_SSFIFO0);
+
+		if (scan.pos == scan.half)
+			scan.hook(scan.ring, scan.half, scan.user);
+		else if (scan.pos == 2 * scan.half)
+		{
+			scan.hook(scan.ring + scan.half, scan.half, scan.user);
+			scan.pos = 0;
+		}
+	}
+}
+
+/**
+ * Start a continuous scan of the channels in \a mask.
+ */
+void adc_hw_scanStart(uint32_t mask, uint16_t *ring, size_t len,
+                      void (*hook)(const uint16_t *block, size_t len, void *user), void *user)
+{
+	scan.hook = hook;
+	scan.user = user;
+	scan.ring = ring;
+	scan.half = len / 2;
+	scan.pos = 0;
+
+	/* Disable sequence 0 while programming it */
+	HWREG(ADC_BASE + ADC_O_ACTSS) &= ~ADC_ACTSS_ASEN0;
+
+	/* One step for each channel, in ascending order */
+	uint32_t mux = 0;
+	size_t n = 0;
+	for (uint8_t ch = 0; ch < 32; ch++)
+	{
+		if (mask & BV32(ch))
+		{
+			/* Here ADC_MUX_MAXCH is the number of inputs */
+			ASSERT(ch < ADC_MUX_MAXCH);
+			mux |= (uint32_t)ch << (4 * n++);
+		}
+	}
+	/* The sequence 0 holds at most 8 steps */
+	ASSERT(n <= 8);
+	scan.seq_len = n;
+
+	HWREG(ADC_BASE + ADC_O_SSMUX0) = mux;
+	/* Last step ends the sequence and raises the interrupt */
+	HWREG(ADC_BASE + ADC_O_SSCTL0) = (ADC_SSCTL0_END0 | ADC_SSCTL0_IE0) << (4 * (n - 1));
+
+	HWREG(ADC_BASE + ADC_O_SAC) = CONFIG_ADC_SCAN_HW_AVG;
+
+	/* Trigger the sequence continuously */
+	HWREG(ADC_BASE + ADC_O_EMUX) = (HWREG(ADC_BASE + ADC_O_EMUX) & ~ADC_EMUX_EM0_M) | ADC_EMUX_EM0_ALWAYS;
+
+	HWREG(ADC_BASE + ADC_O_OSTAT) = ADC_OSTAT_OV0;
+	HWREG(ADC_BASE + ADC_O_ISC) = ADC_ISC_IN0;
+	sysirq_setHandler(INT_ADC0, adc_scan_irq);
+	HWREG(ADC_BASE + ADC_O_IM) |= ADC_IM_MASK0;
+
+	HWREG(ADC_BASE + ADC_O_ACTSS) |= ADC_ACTSS_ASEN0;
+}
+
+/**
+ * Stop the background scan.
+ */
+void adc_hw_scanStop(void)
+{
+	HWREG(ADC_BASE + ADC_O_ACTSS) &= ~ADC_ACTSS_ASEN0;
+	HWREG(ADC_BASE + ADC_O_IM) &= ~ADC_IM_MASK0;
+	HWREG(ADC_BASE + ADC_O_EMUX) &= ~ADC_EMUX_EM0_M;
+	HWREG(ADC_BASE + ADC_O_SAC) = ADC_SAC_AVG_OFF;
+
+	while (!(HWREG(ADC_BASE + ADC_O_SSFSTAT0) & ADC_SSFSTAT0_EMPTY))
+		(void)HWREG(ADC_BASE + ADC_O_SSFIFO0);
+	HWREG(ADC_BASE + ADC_O_ISC) = ADC_ISC_IN0;
+}
+
+#endif /* CONFIG_ADC_SCAN */
+
 /**
  * Select mux channel \a ch.
  * Generally the stm32 cpu family allow us to program the order
@@ -113,6 +113,166 @@ static void adc_enable_irq(void)
 
 #endif /* CONFIG_KERN */
 
+#if CONFIG_ADC_SCAN
+	#include <drv/irq_cm3.h>
+
+	#if CPU_CM3_STM32F1
+		/* ADC1 requests are routed to DMA1 channel 1 */
+		#define ADC_DMA     DMA1
+		#define ADC_DMA_CH  0
+		#define ADC_DMA_IRQ DMACHANNEL1_IRQHANDLER
+	#else
+		/* ADC1 requests are routed to DMA2 stream 0, channel 0 */
+		#define ADC_DMA        DMA2
+		#define ADC_DMA_STREAM 0
+		#define ADC_DMA_CH     0
+		#define ADC_DMA_IRQ    DMA2STREAM0_IRQHANDLER
+	#endif
+
+/* Background scan status */
+static struct AdcScan
+{
+	void (*hook)(const uint16_t *block, size_t len, void *user);
+	void *user;
+	uint16_t *ring;
+	size_t half;
+} scan;
+
+/**
+ * DMA ISR: one half of the ring has been filled.
+ *
+ * The DMA is already storing samples in the other half, so the
+ * hook can process this one without stopping the conversions.
+ */
+static DECLARE_ISR(adc_scan_irq)
+{
+	#if CPU_CM3_STM32F1
+	uint32_t status = ADC_DMA->ISR;
+	ADC_DMA->IFCR = DMA_HTIF(ADC_DMA_CH) | DMA_TCIF(ADC_DMA_CH);
+
+	if (status & DMA_HTIF(ADC_DMA_CH))
+		scan.hook(scan.ring, scan.half, scan.user);
+	if (status & DMA_TCIF(ADC_DMA_CH))
+		scan.hook(scan.ring + scan.half, scan.half, scan.user);
+	#else
+	/* The current target is the buffer being filled, the other one is complete */
+	const uint16_t *block = (ADC_DMA->STR[ADC_DMA_STREAM].CR & DMA_CR_TARGET_1) ?
+	                            scan.ring :
+	                            scan.ring + scan.half;
+
+	DMA_CLEAR_TCI(ADC_DMA, ADC_DMA_STREAM);
+	scan.hook(block, scan.half, scan.user);
+	#endif
+}
+
+/**
+ * Start a continuous scan of the channels in \a mask.
+ *
+ * The ADC converts the regular sequence back to back (scan + continuous
+ * mode) and each result is moved to \a ring by the DMA, so the CPU is
+ * only interrupted once for every half ring.
+ */
+void adc_hw_scanStart(uint32_t mask, uint16_t *ring, size_t len,
+                      void (*hook)(const uint16_t *block, size_t len, void *user), void *user)
+{
+	/* DMA transfer counter is 16 bits wide */
+	ASSERT(len <= 0xFFFF);
+
+	scan.hook = hook;
+	scan.user = user;
+	scan.ring = ring;
+	scan.half = len / 2;
+
+	/* Regular sequence: selected channels in ascending order */
+	uint8_t n = 0;
+	for (uint8_t ch = 0; ch <= ADC_MUX_MAXCH; ch++)
+		if (mask & BV(ch))
+			stm32_adcSetChannelSequence(adc, ch, n++);
+	/* The regular sequence holds at most 16 conversions */
+	ASSERT(n <= 16);
+	stm32_adcSetChannelSequenceLength(adc, n);
+
+	#if CONFIG_KERN
+	/* Results are collected by DMA, adc_hw_read() irq is not needed */
+	adc->CR1 &= ~BV(CR1_EOCIE);
+	#endif
+	sysirq_setHandler(ADC_DMA_IRQ, adc_scan_irq);
+
+	#if CPU_CM3_STM32F1
+	RCC->AHBENR |= RCC_AHB_DMA1;
+
+	struct stm32_dmachannel *dma = &ADC_DMA->CH[ADC_DMA_CH];
+	dma->CCR = 0;
+	dma->CPAR = (uint32_t)&adc->DR;
+	dma->CMAR = (uint32_t)ring;
+	dma->CNDTR = len;
+	ADC_DMA->IFCR = DMA_GIF(ADC_DMA_CH);
+
+	/* Circular mode, half and full transfer split the ring in two */
+	dma->CCR = DMA_CCR_PRI_HIGH | DMA_CCR_MSIZE_16 | DMA_CCR_PSIZE_16 |
+	           DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_HTIE | DMA_CCR_TCIE |
+	           DMA_CCR_EN;
+
+	adc->CR2 |= BV(CR2_CONT) | BV(CR2_DMA);
+	#else
+	RCC->AHB1ENR |= RCC_AHB1ENR_DMA2EN;
+
+	struct stm32_dmastream *dma = &ADC_DMA->STR[ADC_DMA_STREAM];
+	dma->CR = 0;
+	while (dma->CR & DMA_CR_EN)
+		;
+	dma->PAR = (uint32_t)&adc->DR;
+	dma->M0AR = (uint32_t)ring;
+	dma->M1AR = (uint32_t)(ring + scan.half);
+	dma->NDTR = scan.half;
+	DMA_CLEAR_TCI(ADC_DMA, ADC_DMA_STREAM);
+
+	/* Double buffer mode, the two halves are the two targets */
+	dma->CR = DMA_CR_CHAN(ADC_DMA_CH) | DMA_CR_DBUF | DMA_CR_PRI_HIGH |
+	          DMA_CR_MSIZE_16 | DMA_CR_PSIZE_16 | DMA_CR_MINC |
+	          DMA_CR_DIR_P2M | DMA_CR_TCIE | DMA_CR_EN;
+
+	/* DDS: keep issuing DMA requests after the first transfer */
+	adc->CR2 |= BV(CR2_CONT) | ADC_CR2_DMA | ADC_CR2_DDS;
+	#endif
+
+	adc->CR1 |= BV(CR1_SCAN);
+
+	/* Start the first sequence, the following ones are automatic */
+	adc->CR2 |= CR2_EXTTRIG_SWSTRT_SET;
+}
+
+/**
+ * Stop the background scan and restore single conversion mode.
+ */
+void adc_hw_scanStop(void)
+{
+	#if CPU_CM3_STM32F1
+	adc->CR2 &= ~(BV(CR2_CONT) | BV(CR2_DMA));
+	ADC_DMA->CH[ADC_DMA_CH].CCR = 0;
+	ADC_DMA->IFCR = DMA_GIF(ADC_DMA_CH);
+	#else
+	adc->CR2 &= ~(BV(CR2_CONT) | ADC_CR2_DMA | ADC_CR2_DDS);
+	ADC_DMA->STR[ADC_DMA_STREAM].CR = 0;
+	DMA_CLEAR_TCI(ADC_DMA, ADC_DMA_STREAM);
+	#endif
+	adc->CR1 &= ~BV(CR1_SCAN);
+
+	adc->SQR1 = 0;
+	adc->SQR2 = 0;
+	adc->SQR3 = 0;
+
+	/* Drop the last conversion, if any */
+	(void)adc->DR;
+	adc->SR &= ~BV(SR_EOC);
+
+	#if CONFIG_KERN
+	adc->CR1 |= BV(CR1_EOCIE);
+	#endif
+}
+
+#endif /* CONFIG_ADC_SCAN */
+
 /**
  * Select mux channel \a ch.
  * Generally the stm32 cpu family allow us to program the order
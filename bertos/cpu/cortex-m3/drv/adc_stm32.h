@@ -63,4 +63,10 @@ void adc_hw_select_ch(uint8_t ch);
 uint16_t adc_hw_read(void);
 void adc_hw_init(void);
 
+#if CONFIG_ADC_SCAN
+void adc_hw_scanStart(uint32_t mask, uint16_t *ring, size_t len,
+                      void (*hook)(const uint16_t *block, size_t len, void *user), void *user);
+void adc_hw_scanStop(void);
+#endif
+
 #endif /* DRV_ADC_STM32_H */
@@ -0,0 +1,103 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2011 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \brief STM32 CRC calculation unit driver.
+ */
+
+#include "crc32_stm32.h"
+
+#include <cpu/irq.h>
+
+#include <io/stm32.h>
+
+/* The unit has a single shift register, shared by all the callers */
+static bool crc_busy;
+
+INLINE uint32_t crc_rbit(uint32_t x)
+{
+	uint32_t r;
+
+	asm ("rbit %0, %1" : "=r" (r) : "r" (x));
+	return r;
+}
+
+/*
+ * Undo 32 steps of the shift register. Writing the result xor'ed with
+ * the reset value just after a reset loads \a state into the unit,
+ * which otherwise can only start from 0xFFFFFFFF.
+ */
+static uint32_t crc_unshift(uint32_t state)
+{
+	for (int i = 0; i < 32; i++)
+	{
+		/* Bit 0 of the polynomial is set: it flags the xor step */
+		if (state & 1)
+			state = ((state ^ CRC_POLY) >> 1) | 0x80000000UL;
+		else
+			state >>= 1;
+	}
+	return state;
+}
+
+bool crc32_hw_update(uint32_t *crc, const uint32_t *buf, size_t words)
+{
+	cpu_flags_t flags;
+	uint32_t state;
+
+	IRQ_SAVE_DISABLE(flags);
+	if (crc_busy)
+	{
+		IRQ_RESTORE(flags);
+		return false;
+	}
+	crc_busy = true;
+	IRQ_RESTORE(flags);
+
+	#if CPU_CM3_STM32F2
+	RCC->AHB1ENR |= RCC_AHB1ENR_CRCEN;
+	#else
+	RCC->AHBENR |= RCC_AHB_CRC;
+	#endif
+
+	CRC->CR = CRC_CR_RESET;
+	state = crc_rbit(*crc);
+	if (state != 0xFFFFFFFFUL)
+		CRC->DR = crc_unshift(state) ^ 0xFFFFFFFFUL;
+
+	while (words--)
+		CRC->DR = crc_rbit(*buf++);
+
+	*crc = crc_rbit(CRC->DR);
+	crc_busy = false;
+
+	return true;
+}
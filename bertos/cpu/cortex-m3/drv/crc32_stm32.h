@@ -0,0 +1,58 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2011 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \brief STM32 CRC calculation unit driver, used by the CRC32 module.
+ *
+ * The unit computes the not reflected CRC-32 on 32 bit words; bit
+ * reversing data and result gives the reflected CRC32 used by zip and
+ * ethernet.
+ */
+
+#ifndef DRV_CRC32_STM32_H
+#define DRV_CRC32_STM32_H
+
+#include <cfg/compiler.h>
+
+/**
+ * Update a CRC32 with the CRC unit.
+ *
+ * \param crc   Pointer to the CRC32 shift register, without the initial
+ *              and final inversion of the CRC32 specification.
+ * \param buf   Word aligned data.
+ * \param words Number of 32 bit words in \a buf.
+ *
+ * \return true on success, false if the unit is in use by another process
+ *         and the CRC must be computed in software.
+ */
+bool crc32_hw_update(uint32_t *crc, const uint32_t *buf, size_t words);
+
+#endif /* DRV_CRC32_STM32_H */
@@ -163,10 +163,36 @@ void lm3s_uartInit(int port)
 	lm3s_uartSetParity(base, SER_PARITY_NONE);
 }
 
+/*
+ * The transmitter is busy until the last bit of the hardware FIFO
+ * has been shifted out.
+ */
 static bool tx_sending(struct SerialHardware *_hw)
 {
 	struct CM3Serial *hw = (struct CM3Serial *)_hw;
-	return hw->sending;
+	return hw->sending || !lm3s_uartReady(hw->base);
+}
+
+/*
+ * Fill the hardware FIFO straight from the caller buffer, bypassing the
+ * software tx FIFO. Only used while the transmitter is idle.
+ *
+ * Like txStart(), the transmission is marked in progress and the TX
+ * interrupt is enabled: the handler ends it when the FIFO empties.
+ */
+static size_t uart_txPush(struct SerialHardware *_hw, const uint8_t *buf, size_t len)
+{
+	struct CM3Serial *hw = (struct CM3Serial *)_hw;
+	size_t i = 0;
+
+	if (hw->sending)
+		return 0;
+
+	hw->sending = true;
+	while (i < len && lm3s_uartTxReady(hw->base))
+		HWREG(hw->base + UART_O_DR) = buf[i++];
+	HWREG(hw->base + UART_O_IM) |= UART_IM_TXIM;
+	return i;
 }
 
 static void uart_irq_rx(int port)
@@ -183,6 +209,8 @@ static void uart_irq_rx(int port)
 		else
 			fifo_push(rxfifo, c);
 	}
+
+	ser_rxNotify(ser_handles[port]);
 }
 
 static void uart_irq_tx(int port)
@@ -204,6 +232,8 @@ static void uart_irq_tx(int port)
 		}
 		HWREG(base + UART_O_DR) = fifo_pop(txfifo);
 	}
+
+	ser_txNotify(ser_handles[port]);
 }
 
 static void uart_common_irq_handler(int port)
@@ -263,7 +293,9 @@ static void lm3s_uartIRQDisable(int port)
                                                                           \
 		if (hw->sending)                                                  \
 			return;                                                       \
-		lm3s_uartPutChar(UART##port##_BASE, fifo_pop(txfifo));            \
+		while (!fifo_isempty(txfifo) &&                                   \
+		       lm3s_uartTxReady(UART##port##_BASE))                       \
+			HWREG(UART##port##_BASE + UART_O_DR) = fifo_pop(txfifo);      \
 		if (!fifo_isempty(txfifo))                                        \
 		{                                                                 \
 			HWREG(UART##port##_BASE + UART_O_IM) |=                       \
@@ -315,6 +347,7 @@ static void lm3s_uartIRQDisable(int port)
 	        .setParity = uart##port##_setparity,                          \
 	        .txStart = uart##port##_txStart,                              \
 	        .txSending = tx_sending,                                      \
+	        .txPush = uart_txPush,                                        \
 	};
 
 /* UART port instances */
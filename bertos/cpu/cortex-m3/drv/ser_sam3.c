@@ -340,6 +340,9 @@ struct ArmSerial
 {
 	struct SerialHardware hw;
 	volatile bool sending;
+#if CONFIG_SER_DMA
+	size_t dma_txlen; ///< Length of the tx FIFO run being sent by the PDC.
+#endif
 };
 
 static ISR_PROTO(uart0_irq_dispatcher);
@@ -350,6 +353,136 @@ static ISR_PROTO(spi0_irq_handler);
 #if CPU_ARM_SAM7X
 static ISR_PROTO(spi1_irq_handler);
 #endif
+
+#if CONFIG_SER_DMA
+
+	#if !USART_HAS_PDC
+		#error CONFIG_SER_DMA requires USARTs with a PDC channel
+	#endif
+
+	#define US_REG(base, offset) HWREG((base) + (offset))
+
+/*
+ * PDC transfers, shared by all the USARTs.
+ *
+ * The transmitter sends the tx FIFO in place, one contiguous run at a
+ * time, and releases the run only when the PDC is done with it.
+ *
+ * The receiver uses the rx FIFO memory as a circular buffer split in two
+ * halves, which the PDC fills in turn through the "next" registers.
+ * The FIFO tail is moved up to the PDC pointer when a half is full and
+ * when the line has been idle for CONFIG_SER_DMA_RXIDLE bit periods,
+ * so short frames reach the reader without waiting for the buffer to fill.
+ */
+static void uart_dmaInit(uint32_t base, FIFOBuffer *rxfifo)
+{
+	size_t size = rxfifo->end - rxfifo->begin + 1;
+	size_t half = size / 2;
+
+	ASSERT(half);
+	US_REG(base, PERIPH_PTCR_OFF) = BV(PDC_RXTDIS) | BV(PDC_TXTDIS);
+	US_REG(base, PERIPH_TCR_OFF) = 0;
+	US_REG(base, PERIPH_TNCR_OFF) = 0;
+	US_REG(base, PERIPH_RPR_OFF) = (reg32_t)rxfifo->begin;
+	US_REG(base, PERIPH_RCR_OFF) = half;
+	US_REG(base, PERIPH_RNPR_OFF) = (reg32_t)(rxfifo->begin + half);
+	US_REG(base, PERIPH_RNCR_OFF) = size - half;
+
+	US_REG(base, US_RTOR_OFF) = CONFIG_SER_DMA_RXIDLE;
+	US_REG(base, US_CR_OFF) = BV(US_STTTO);
+	US_REG(base, US_IER_OFF) = BV(US_ENDRX) | BV(US_TIMEOUT);
+	US_REG(base, PERIPH_PTCR_OFF) = BV(PDC_RXTEN) | BV(PDC_TXTEN);
+}
+
+static void uart_dmaCleanup(uint32_t base)
+{
+	US_REG(base, PERIPH_PTCR_OFF) = BV(PDC_RXTDIS) | BV(PDC_TXTDIS);
+}
+
+/*
+ * Start sending the next run of the tx FIFO.
+ * \return false if there is nothing left to send.
+ */
+static bool uart_dmaTx(uint32_t base, struct ArmSerial *hw, FIFOBuffer *txfifo)
+{
+	unsigned char *data;
+
+	hw->dma_txlen = fifo_peekblock(txfifo, &data);
+	if (!hw->dma_txlen)
+		return false;
+
+	US_REG(base, PERIPH_TPR_OFF) = (reg32_t)data;
+	US_REG(base, PERIPH_TCR_OFF) = hw->dma_txlen;
+	US_REG(base, US_IER_OFF) = BV(US_ENDTX);
+	return true;
+}
+
+/*
+ * Serve the interrupts of a USART working in DMA mode.
+ *
+ * Transmission is (re)started from the TXEMPTY interrupt, so txStart()
+ * is the same in both modes.
+ *
+ * \return true when the last character has been shifted out and the
+ *         transmitter is idle.
+ */
+static bool uart_dmaIrq(uint32_t base, struct ArmSerial *hw, struct Serial *ser)
+{
+	uint32_t status = US_REG(base, US_CSR_OFF);
+	uint32_t pending = status & US_REG(base, US_IMR_OFF);
+
+	if (pending & (BV(US_ENDRX) | BV(US_TIMEOUT)))
+	{
+		FIFOBuffer *rxfifo = &ser->rxfifo;
+
+		ser->status |= status & (SERRF_RXSROVERRUN | SERRF_FRAMEERROR);
+		US_REG(base, US_CR_OFF) = BV(US_RSTSTA) | BV(US_STTTO);
+
+		if (pending & BV(US_ENDRX))
+		{
+			size_t size = rxfifo->end - rxfifo->begin + 1;
+			size_t half = size / 2;
+
+			/* The PDC moved on the other half: queue the one just filled */
+			if ((unsigned char *)US_REG(base, PERIPH_RPR_OFF) < rxfifo->begin + half)
+			{
+				US_REG(base, PERIPH_RNPR_OFF) = (reg32_t)(rxfifo->begin + half);
+				US_REG(base, PERIPH_RNCR_OFF) = size - half;
+			}
+			else
+			{
+				US_REG(base, PERIPH_RNPR_OFF) = (reg32_t)rxfifo->begin;
+				US_REG(base, PERIPH_RNCR_OFF) = half;
+			}
+		}
+
+		if (!fifo_fillto(rxfifo, (unsigned char *)US_REG(base, PERIPH_RPR_OFF)))
+			ser->status |= SERRF_RXFIFOOVERRUN;
+		ser_rxNotify(ser);
+	}
+
+	if (pending & BV(US_ENDTX))
+	{
+		fifo_skip(&ser->txfifo, hw->dma_txlen);
+		ser_txNotify(ser);
+		if (!uart_dmaTx(base, hw, &ser->txfifo))
+		{
+			/* Wait for the last character to be shifted out */
+			US_REG(base, US_IDR_OFF) = BV(US_ENDTX);
+			US_REG(base, US_IER_OFF) = BV(US_TXEMPTY);
+		}
+	}
+	else if (pending & BV(US_TXEMPTY))
+	{
+		US_REG(base, US_IDR_OFF) = BV(US_TXEMPTY);
+		if (!uart_dmaTx(base, hw, &ser->txfifo))
+			return true;
+	}
+	return false;
+}
+
+#endif /* CONFIG_SER_DMA */
+
 /*
  * Callbacks for USART0
  */
@@ -369,7 +502,11 @@ static void uart0_init(
 	US0_CR = BV(US_RSTRX) | BV(US_RSTTX);
 	US0_MR = US_CHMODE_NORMAL | US_CHRL_8 | US_NBSTOP_1 | US_PAR_NO;
 	US0_CR = BV(US_RXEN) | BV(US_TXEN);
+#if CONFIG_SER_DMA
+	uart_dmaInit(USART0_BASE, &ser_handles[SER_UART0]->rxfifo);
+#else
 	US0_IER = BV(US_RXRDY);
+#endif
 
 	SER_UART0_BUS_TXINIT;
 
@@ -381,6 +518,9 @@ static void uart0_init(
 
 static void uart0_cleanup(UNUSED_ARG(struct SerialHardware *, _hw))
 {
+#if CONFIG_SER_DMA
+	uart_dmaCleanup(USART0_BASE);
+#endif
 	US0_CR = BV(US_RSTRX) | BV(US_RSTTX) | BV(US_RXDIS) | BV(US_TXDIS) | BV(US_RSTSTA);
 }
 
@@ -462,7 +602,11 @@ static void uart1_init(
 	US1_CR = BV(US_RSTRX) | BV(US_RSTTX);
 	US1_MR = US_CHMODE_NORMAL | US_CHRL_8 | US_NBSTOP_1 | US_PAR_NO;
 	US1_CR = BV(US_RXEN) | BV(US_TXEN);
+#if CONFIG_SER_DMA
+	uart_dmaInit(USART1_BASE, &ser_handles[SER_UART1]->rxfifo);
+#else
 	US1_IER = BV(US_RXRDY);
+#endif
 
 	SER_UART1_BUS_TXINIT;
 
@@ -474,6 +618,9 @@ static void uart1_init(
 
 static void uart1_cleanup(UNUSED_ARG(struct SerialHardware *, _hw))
 {
+#if CONFIG_SER_DMA
+	uart_dmaCleanup(USART1_BASE);
+#endif
 	US1_CR = BV(US_RSTRX) | BV(US_RSTTX) | BV(US_RXDIS) | BV(US_TXDIS) | BV(US_RSTSTA);
 }
 
@@ -841,6 +988,7 @@ INLINE void uart0_irq_tx(void)
 	{
 		char c = fifo_pop(txfifo);
 		SER_UART0_BUS_TXCHAR(c);
+		ser_txNotify(ser_handles[SER_UART0]);
 	}
 
 	SER_STROBE_OFF;
@@ -865,6 +1013,8 @@ INLINE void uart0_irq_rx(void)
 	else
 		fifo_push(rxfifo, c);
 
+	ser_rxNotify(ser_handles[SER_UART0]);
+
 	SER_STROBE_OFF;
 }
 
@@ -873,11 +1023,21 @@ INLINE void uart0_irq_rx(void)
  */
 static DECLARE_ISR(uart0_irq_dispatcher)
 {
+#if CONFIG_SER_DMA
+	SER_STROBE_ON;
+	if (uart_dmaIrq(USART0_BASE, &UARTDescs[SER_UART0], ser_handles[SER_UART0]))
+	{
+		SER_UART0_BUS_TXEND;
+		UARTDescs[SER_UART0].sending = false;
+	}
+	SER_STROBE_OFF;
+#else
 	if (US0_CSR & BV(US_RXRDY))
 		uart0_irq_rx();
 
 	if (US0_CSR & BV(US_TXEMPTY))
 		uart0_irq_tx();
+#endif
 
 	SER_INT_ACK;
 }
@@ -906,6 +1066,7 @@ INLINE void uart1_irq_tx(void)
 	{
 		char c = fifo_pop(txfifo);
 		SER_UART1_BUS_TXCHAR(c);
+		ser_txNotify(ser_handles[SER_UART1]);
 	}
 
 	SER_STROBE_OFF;
@@ -930,6 +1091,8 @@ INLINE void uart1_irq_rx(void)
 	else
 		fifo_push(rxfifo, c);
 
+	ser_rxNotify(ser_handles[SER_UART1]);
+
 	SER_STROBE_OFF;
 }
 
@@ -938,11 +1101,21 @@ INLINE void uart1_irq_rx(void)
  */
 static DECLARE_ISR(uart1_irq_dispatcher)
 {
+#if CONFIG_SER_DMA
+	SER_STROBE_ON;
+	if (uart_dmaIrq(USART1_BASE, &UARTDescs[SER_UART1], ser_handles[SER_UART1]))
+	{
+		SER_UART1_BUS_TXEND;
+		UARTDescs[SER_UART1].sending = false;
+	}
+	SER_STROBE_OFF;
+#else
 	if (US1_CSR & BV(US_RXRDY))
 		uart1_irq_rx();
 
 	if (US1_CSR & BV(US_TXEMPTY))
 		uart1_irq_tx();
+#endif
 
 	SER_INT_ACK;
 }
@@ -972,6 +1145,9 @@ static DECLARE_ISR(spi0_irq_handler)
 	else
 	{
 		UARTDescs[SER_SPI0].sending = false;
+
+	ser_rxNotify(ser_handles[SER_SPI0]);
+	ser_txNotify(ser_handles[SER_SPI0]);
 		/* Disable interrupt on tx buffer empty */
 		SPI0_IDR = BV(SPI_TXEMPTY);
 	}
@@ -1005,6 +1181,9 @@ static DECLARE_ISR(spi1_irq_handler)
 	else
 	{
 		UARTDescs[SER_SPI1].sending = false;
+
+	ser_rxNotify(ser_handles[SER_SPI1]);
+	ser_txNotify(ser_handles[SER_SPI1]);
 		/* Disable interrupt on tx buffer empty */
 		SPI1_IDR = BV(SPI_TXEMPTY);
 	}
@@ -201,6 +201,8 @@ static void uart_irq_rx(int port)
 		else
 			fifo_push(rxfifo, c);
 	}
+
+	ser_rxNotify(ser_handles[port]);
 }
 
 static void uart_irq_tx(int port)
@@ -221,6 +223,8 @@ static void uart_irq_tx(int port)
 	{
 		base->DR = fifo_pop(txfifo);
 	}
+
+	ser_txNotify(ser_handles[port]);
 }
 
 static void uart_common_irq_handler(int port)
@@ -52,6 +52,7 @@
 #include "stm32_i2c.h"
 #include "stm32_flash.h"
 #include "stm32_dma.h"
+#include "stm32_crc.h"
 #include "stm32_spi.h"
 #include "stm32_timer.h"
 #include "stm32_scb.h"
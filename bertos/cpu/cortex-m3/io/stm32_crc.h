@@ -0,0 +1,64 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2011 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \brief STM32 CRC calculation unit definition.
+ */
+
+#ifndef STM32_CRC_H
+#define STM32_CRC_H
+
+#include <cfg/compiler.h>
+
+#if CPU_CM3_STM32F1 || CPU_CM3_STM32F2
+
+struct stm32_crc
+{
+	reg32_t DR;  /*!< CRC Data register,             Address offset: 0x00 */
+	reg8_t IDR;  /*!< CRC Independent data register, Address offset: 0x04 */
+	uint8_t RESERVED0;
+	uint16_t RESERVED1;
+	reg32_t CR;  /*!< CRC Control register,          Address offset: 0x08 */
+};
+
+	#define CRC ((struct stm32_crc *)CRC_BASE)
+
+	/* CRC_CR register */
+	#define CRC_CR_RESET BV(0) ///< Reset the unit, DR is set to 0xFFFFFFFF
+
+	/// Polynomial of the unit, CRC-32 (IEEE 802.3), not reflected
+	#define CRC_POLY 0x04C11DB7UL
+
+#else
+	#error Unknown CPU
+#endif
+
+#endif /* STM32_CRC_H */
@@ -30,7 +30,7 @@
  *
  * -->
  *
- * \brief STM32F2xx DMA definition.
+ * \brief STM32F1xx and STM32F2xx DMA definition.
  */
 
 #ifndef STM32_DMA_H
@@ -249,6 +249,60 @@ struct stm32_dma
 				(dma)->HIFCR |= DMA_TCI_BIT(stream); \
 		} while (0)
 
+#elif CPU_CM3_STM32F1
+
+struct stm32_dmachannel
+{
+	reg32_t CCR;   /*!< DMA channel x configuration register        */
+	reg32_t CNDTR; /*!< DMA channel x number of data register       */
+	reg32_t CPAR;  /*!< DMA channel x peripheral address register   */
+	reg32_t CMAR;  /*!< DMA channel x memory address register       */
+	reg32_t _reserved;
+};
+
+struct stm32_dma
+{
+	reg32_t ISR;  /*!< DMA interrupt status register,     Address offset: 0x00 */
+	reg32_t IFCR; /*!< DMA interrupt flag clear register, Address offset: 0x04 */
+	struct stm32_dmachannel CH[7];
+};
+
+	#define DMA1 ((struct stm32_dma *)DMA1_BASE)
+	#define DMA2 ((struct stm32_dma *)DMA2_BASE)
+
+	/* Bits definition for DMA_CCR register */
+	#define DMA_CCR_EN      ((uint32_t)0x00000001)
+	#define DMA_CCR_TCIE    ((uint32_t)0x00000002) /*<! Transfer complete interrupt */
+	#define DMA_CCR_HTIE    ((uint32_t)0x00000004) /*<! Half transfer interrupt */
+	#define DMA_CCR_TEIE    ((uint32_t)0x00000008)
+	#define DMA_CCR_DIR     ((uint32_t)0x00000010)
+	#define DMA_CCR_CIRC    ((uint32_t)0x00000020)
+	#define DMA_CCR_PINC    ((uint32_t)0x00000040)
+	#define DMA_CCR_MINC    ((uint32_t)0x00000080)
+	#define DMA_CCR_MEM2MEM ((uint32_t)0x00004000)
+
+	#define DMA_CCR_PSIZE_8  ((uint32_t)0 << 8)
+	#define DMA_CCR_PSIZE_16 ((uint32_t)1 << 8)
+	#define DMA_CCR_PSIZE_32 ((uint32_t)2 << 8)
+
+	#define DMA_CCR_MSIZE_8  ((uint32_t)0 << 10)
+	#define DMA_CCR_MSIZE_16 ((uint32_t)1 << 10)
+	#define DMA_CCR_MSIZE_32 ((uint32_t)2 << 10)
+
+	#define DMA_CCR_PRI_LOW   ((uint32_t)0 << 12)
+	#define DMA_CCR_PRI_MED   ((uint32_t)1 << 12)
+	#define DMA_CCR_PRI_HIGH  ((uint32_t)2 << 12)
+	#define DMA_CCR_PRI_VHIGH ((uint32_t)3 << 12)
+
+	/*
+	 * Bits definition for DMA_ISR and DMA_IFCR registers,
+	 * \a ch is the channel index starting from 0.
+	 */
+	#define DMA_GIF(ch)  BV((ch)*4)
+	#define DMA_TCIF(ch) BV((ch)*4 + 1)
+	#define DMA_HTIF(ch) BV((ch)*4 + 2)
+	#define DMA_TEIF(ch) BV((ch)*4 + 3)
+
 #else
 	#error Unknown CPU
 #endif
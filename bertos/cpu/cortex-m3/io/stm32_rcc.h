@@ -201,6 +201,15 @@
 	#define RCC_SYSCLK_DIV512 (0x000000F0)
 	/*\}*/
 
+	/**
+ * RCC register: AHB peripheral
+ */
+	/*\{*/
+	#define RCC_AHB_DMA1 (0x00000001)
+	#define RCC_AHB_DMA2 (0x00000002)
+	#define RCC_AHB_CRC  (0x00000040)
+	/*\}*/
+
 	/**
  * RCC register: APB1 peripheral
  */
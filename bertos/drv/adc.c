@@ -49,11 +49,18 @@
 #include <cfg/compiler.h>
 #include <cfg/module.h>
 
+#if CONFIG_ADC_SCAN
+static bool adc_scanning;
+#endif
+
 /**
  * Read the ADC channel \a ch.
  */
 adcread_t adc_read(adc_ch_t ch)
 {
+#if CONFIG_ADC_SCAN
+	ASSERT(!adc_scanning);
+#endif
 	ASSERT(ch <= (adc_ch_t)ADC_MUX_MAXCH);
 	ch = MIN(ch, (adc_ch_t)ADC_MUX_MAXCH);
 
@@ -62,6 +69,43 @@ adcread_t adc_read(adc_ch_t ch)
 	return (adc_hw_read());
 }
 
+#if CONFIG_ADC_SCAN
+void adc_scanStart(uint32_t mask, adcread_t *ring, size_t len, adc_scan_hook_t hook, void *user)
+{
+	ASSERT(!adc_scanning);
+	ASSERT(mask);
+	ASSERT(ring);
+	ASSERT(hook);
+
+	DB(
+		size_t channels = 0;
+		for (unsigned ch = 0; ch < 32; ch++)
+		{
+			if (mask & BV32(ch))
+			{
+				/* Same bound as adc_read() */
+				ASSERT(ch <= ADC_MUX_MAXCH);
+				channels++;
+			}
+		}
+		ASSERT(len % (2 * channels) == 0);
+	);
+	ASSERT(len);
+
+	adc_scanning = true;
+	adc_hw_scanStart(mask, ring, len, hook, user);
+}
+
+void adc_scanStop(void)
+{
+	if (!adc_scanning)
+		return;
+
+	adc_hw_scanStop();
+	adc_scanning = false;
+}
+#endif
+
 MOD_DEFINE(adc);
 
 /**
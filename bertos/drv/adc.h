@@ -48,6 +48,8 @@
 #include <cpu/attr.h>
 #include CPU_HEADER(adc)
 
+#include "cfg/cfg_adc.h"
+
 #define CONFIG_ADC_STREAMING_API 1
 
 /** Type for ADC return value. */
@@ -179,6 +181,58 @@ INLINE void adc_dmaStop(struct AdcContext *ctx)
 adcread_t adc_read(adc_ch_t ch);
 void adc_init(void);
 
+#if CONFIG_ADC_SCAN
+/**
+ * Block callback for continuous scanning.
+ *
+ * Called in interrupt context each time half of the scan ring has
+ * been filled. \a block holds \a len samples, interleaved by channel
+ * in ascending channel order: with mask BV(1) | BV(4) the block is
+ * ch1, ch4, ch1, ch4...
+ * The half is not overwritten until the other one has been filled,
+ * so the callback has a full half ring period to consume it.
+ */
+typedef void (*adc_scan_hook_t)(const adcread_t *block, size_t len, void *user);
+
+/**
+ * Start converting continuously the channels in \a mask.
+ *
+ * Samples are stored in background into \a ring, of \a len samples,
+ * used as a double buffer: \a hook is called with the first half
+ * while the second is being filled and vice versa.
+ * \a len must be twice a multiple of the number of channels in \a mask.
+ *
+ * A typical use is feeding the samples into the filters in algo/mean.h
+ * from \a hook and reading the filtered values from the measurement
+ * tasks, without ever waiting for a conversion:
+ * \code
+ * static adcread_t ring[2 * 16 * 2];
+ * static DecimMean mean[2];
+ *
+ * static void hook(const adcread_t *block, size_t len, UNUSED_ARG(void *, user))
+ * {
+ *     for (size_t i = 0; i < len; i += 2)
+ *     {
+ *         decim_add(&mean[0], block[i]);
+ *         decim_add(&mean[1], block[i + 1]);
+ *     }
+ * }
+ *
+ * adc_scanStart(BV(1) | BV(4), ring, countof(ring), hook, NULL);
+ * ...
+ * uint16_t v = decim_get(&mean[0]);
+ * \endcode
+ *
+ * adc_read() can not be used while scanning.
+ */
+void adc_scanStart(uint32_t mask, adcread_t *ring, size_t len, adc_scan_hook_t hook, void *user);
+
+/**
+ * Stop background conversions started with adc_scanStart().
+ */
+void adc_scanStop(void);
+#endif
+
 /**
  * Macro used to convert data from adc range (0...(2 ^ADC_BITS - 1)) to
  * \a y1 ... \a y2 range.
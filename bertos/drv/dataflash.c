@@ -99,6 +99,18 @@ static const DataflashInfo mem_info[] =
 
 STATIC_ASSERT(countof(mem_info) == DFT_CNT);
 
+/**
+ * Commands for the two SRAM buffers, indexed by DataFlash.buffer.
+ *
+ * Writes use the buffers in turn: while one is being programmed in
+ * the main memory, the next page is filled in the other one.
+ * \{
+ */
+static const DataFlashOpcode buff_write[2] = { DFO_WRITE_BUFF1, DFO_WRITE_BUFF2 };
+static const DataFlashOpcode buff_program[2] = { DFO_WRITE_BUFF1_TO_MEM_E, DFO_WRITE_BUFF2_TO_MEM_E };
+static const DataFlashOpcode buff_load[2] = { DFO_MOV_MEM_TO_BUFF1, DFO_MOV_MEM_TO_BUFF2 };
+/* \} */
+
 /**
  * Macro that toggle CS of dataflash.
  * \note This is equivalent to fd->setCS(false) immediately followed by fd->setCS(true).
@@ -189,6 +201,45 @@ static uint8_t dataflash_stat(DataFlash *fd)
 	return kfile_getc(fd->channel);
 }
 
+/**
+ * Wait for the end of a page program started by dataflash_startCmd().
+ *
+ * The status register is output continuously as long as CS is
+ * low, so it is polled with a single command.
+ */
+static void dataflash_waitReady(DataFlash *fd)
+{
+	if (!fd->busy)
+		return;
+
+	CS_TOGGLE(fd);
+	kfile_putc(DFO_READ_STATUS, fd->channel);
+	while (!(kfile_getc(fd->channel) & BUSY_BIT))
+		cpu_relax();
+
+	kfile_flush(fd->channel);
+	fd->setCS(false);
+	fd->busy = false;
+}
+
+/**
+ * Start a main memory command without waiting for its completion.
+ *
+ * The only commands accepted until the memory is ready again are
+ * the ones on the other SRAM buffer: any other access must call
+ * dataflash_waitReady() first.
+ */
+static void dataflash_startCmd(DataFlash *fd, dataflash_page_t page_addr, DataFlashOpcode opcode)
+{
+	dataflash_waitReady(fd);
+	send_cmd(fd, page_addr, 0x00, opcode);
+
+	/* The operation starts on the rising edge of CS */
+	kfile_flush(fd->channel);
+	fd->setCS(false);
+	fd->busy = true;
+}
+
 /**
  * Send one command to data flash memory, and
  * return status register value.
@@ -198,6 +249,7 @@ static uint8_t dataflash_cmd(DataFlash *fd, dataflash_page_t page_addr, dataflas
 {
 	uint8_t stat;
 
+	dataflash_waitReady(fd);
 	send_cmd(fd, page_addr, byte_addr, opcode);
 
 	CS_TOGGLE(fd);
@@ -227,6 +279,8 @@ static uint8_t dataflash_cmd(DataFlash *fd, dataflash_page_t page_addr, dataflas
 static void dataflash_readBlock(DataFlash *fd, dataflash_page_t page_addr, dataflash_offset_t byte_addr, uint8_t *block, dataflash_size_t len)
 {
 	DataFlashOpcode opcode = mem_info[fd->dev].read_cmd;
+
+	dataflash_waitReady(fd);
 	send_cmd(fd, page_addr, byte_addr, opcode);
 
 	if (opcode == DFO_READ_FLASH_MEM_BYTE_B)
@@ -250,12 +304,14 @@ static void dataflash_readBlock(DataFlash *fd, dataflash_page_t page_addr, dataf
  * \note Is not possible to write directly in dataflash main memory.
  * To perform a write in main memory you must first write in dataflash buffer
  * memory and then send a command to write the page in main memory.
+ *
+ * \note This can be done while the other buffer is being programmed.
  */
 static void dataflash_writeBlock(DataFlash *fd, dataflash_offset_t offset, const uint8_t *block, dataflash_size_t len)
 {
 	ASSERT(offset + len <= mem_info[fd->dev].page_size);
 
-	send_cmd(fd, 0x00, offset, DFO_WRITE_BUFF1);
+	send_cmd(fd, 0x00, offset, buff_write[fd->buffer]);
 
 	kfile_write(fd->channel, block, len); //Write len bytes.
 	kfile_flush(fd->channel);             // Flush channel
@@ -268,7 +324,30 @@ static void dataflash_writeBlock(DataFlash *fd, dataflash_offset_t offset, const
  */
 static void dataflash_loadPage(DataFlash *fd, dataflash_page_t page_addr)
 {
-	dataflash_cmd(fd, page_addr, 0x00, DFO_MOV_MEM_TO_BUFF1);
+	dataflash_cmd(fd, page_addr, 0x00, buff_load[fd->buffer]);
+	fd->fill = mem_info[fd->dev].page_size;
+}
+
+/**
+ * Complete the buffer of a page selected without loading it, copying
+ * the part not written yet from the main memory.
+ */
+static void dataflash_fillBuffer(DataFlash *fd)
+{
+	uint8_t tmp[32];
+	dataflash_size_t page_size = mem_info[fd->dev].page_size;
+
+	if (fd->fill == 0)
+		dataflash_loadPage(fd, fd->current_page);
+
+	while (fd->fill < page_size)
+	{
+		dataflash_size_t len = MIN((dataflash_size_t)sizeof(tmp), page_size - fd->fill);
+
+		dataflash_readBlock(fd, fd->current_page, fd->fill, tmp, len);
+		dataflash_writeBlock(fd, fd->fill, tmp, len);
+		fd->fill += len;
+	}
 }
 
 /* Battfs disk interface section */
@@ -370,15 +449,36 @@ static int dataflash_flush(KFile *_fd)
 	DataFlash *fd = DATAFLASH_CAST(_fd);
 	if (fd->page_dirty)
 	{
-		dataflash_cmd(fd, fd->current_page, 0x00, DFO_WRITE_BUFF1_TO_MEM_E);
+		dataflash_fillBuffer(fd);
+		dataflash_cmd(fd, fd->current_page, 0x00, buff_program[fd->buffer]);
 
 		fd->page_dirty = false;
 
 		LOG_INFO("Flushing page {%ld}\n", fd->current_page);
 	}
+	/* Wait for a page program started while writing */
+	dataflash_waitReady(fd);
 	return 0;
 }
 
+/**
+ * Start programming the current page, if dirty, and move to the other
+ * buffer without waiting: the next page is written there meanwhile.
+ */
+static void dataflash_startFlush(DataFlash *fd)
+{
+	if (fd->page_dirty)
+	{
+		dataflash_fillBuffer(fd);
+		dataflash_startCmd(fd, fd->current_page, buff_program[fd->buffer]);
+
+		fd->page_dirty = false;
+		fd->buffer ^= 1;
+
+		LOG_INFO("Programming page {%ld}\n", fd->current_page);
+	}
+}
+
 /**
  * Close file \a fd.
  */
@@ -497,19 +597,35 @@ static size_t dataflash_write(struct KFile *_fd, const void *_buf, size_t size)
 
 		if (new_page != fd->current_page)
 		{
-			/* Flush current page in main memory*/
-			dataflash_flush(&fd->fd);
-			/* Load select page memory from data flash memory*/
-			dataflash_loadPage(fd, new_page);
-
+			/* Program current page in main memory, in background */
+			dataflash_startFlush(fd);
 			fd->current_page = new_page;
-			LOG_INFO(" >> Load page: {%ld}\n", new_page);
+
+			/*
+			 * Load select page memory from data flash memory.
+			 * Loading has to wait for the end of the program, so
+			 * when writing from the start of the page it is
+			 * deferred: sequential writes overwrite the whole
+			 * page and never need it.
+			 */
+			if (offset == 0)
+				fd->fill = 0;
+			else
+			{
+				dataflash_loadPage(fd, new_page);
+				LOG_INFO(" >> Load page: {%ld}\n", new_page);
+			}
 		}
+		/* Writes must extend the valid part of the buffer */
+		if (offset > fd->fill)
+			dataflash_fillBuffer(fd);
+
 		/*
 		* Write byte in current page, and set true
 		* page_dirty flag.
 		*/
 		dataflash_writeBlock(fd, offset, data, wr_len);
+		fd->fill = MAX(fd->fill, (dataflash_size_t)(offset + wr_len));
 		fd->page_dirty = true;
 
 		data += wr_len;
@@ -91,6 +91,9 @@ typedef struct DataFlash
 	DataflashType dev;              ///< Memory device type;
 	dataflash_page_t current_page;  ///< Current loaded dataflash page.
 	bool page_dirty;                ///< True if current_page is dirty (needs to be flushed).
+	uint8_t buffer;                 ///< SRAM buffer (0 or 1) holding current_page.
+	dataflash_size_t fill;          ///< Bytes valid from the start of the buffer, if current_page was not loaded.
+	bool busy;                      ///< True if a page program may still be running.
 	dataflash_setReset_t *setReset; ///< Callback used to set reset pin of dataflash.
 	dataflash_setCS_t *setCS;       ///< Callback used to set CS pin of dataflash.
 } DataFlash;
@@ -187,11 +190,12 @@ bool dataflash_init(DataFlash *fd, KFile *ch, DataflashType type, dataflash_setC
 bool dataflash_diskInit(struct BattFsSuper *d, DataFlash *fd, pgcnt_t *page_array);
 
 /**
- * To test data falsh drive you could use
+ * To test data flash drive you could use
  * this functions. To use these functions make sure to include in your make file the
- * drv/datafalsh_test.c source.
+ * drv/dataflash_test.c source, which runs on a simulated memory, or
+ * drv/dataflash_hwtest.c on the target.
  *
- * (see drv/datafalsh_test.c for more detail)
+ * (see drv/dataflash_test.c for more detail)
  */
 int dataflash_testSetup(void);
 /* For backward compatibility */
@@ -0,0 +1,377 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2011 Develer S.r.l. (http://www.develer.com/)
+ * -->
+ *
+ * \brief DataFlash driver test, run on a simulated AT45DB161D.
+ *
+ * The SPI channel is a KFile connected to a model of the memory, which
+ * decodes the commands used by the driver, keeps the main memory and
+ * the two SRAM buffers in RAM and runs page programs and page loads
+ * when CS is released, like the real device.
+ * Time is counted in bytes clocked on the bus: an operation keeps the
+ * memory busy for its duration converted to bus bytes at the SPI clock.
+ * Any command sent while the memory is busy, other than a status read
+ * or an access to the SRAM buffer not involved in the operation, is
+ * counted as a violation.
+ *
+ * For hardware testing see drv/dataflash_hwtest.c.
+ */
+
+#include "cfg/cfg_dataflash.h"
+
+#include <drv/dataflash.h>
+#include <drv/timer.h>
+
+#include <io/kfile.h>
+
+#include <cfg/compiler.h>
+#include <cfg/macros.h>
+#include <cfg/module.h>
+#include <cfg/test.h>
+#include <cfg/debug.h>
+
+#include <string.h>
+
+#define PAGE_SIZE   528
+#define PAGE_BITS   10
+#define PAGE_CNT    4096
+#define DENSITY_ID  0x0B
+
+/* Page load time, in microseconds */
+#define FLASH_TXFR  200
+
+#define SEQ_SIZE    (33 * 1024L)
+#define SEQ_CHUNK   256
+#define RANDOM_OPS  3000
+#define RANDOM_SIZE (64L * PAGE_SIZE)
+
+static struct Flash
+{
+	KFile fd;
+
+	uint8_t mem[PAGE_CNT * PAGE_SIZE];
+	uint8_t buf[2][PAGE_SIZE];
+
+	/* Current command */
+	bool selected;
+	uint8_t opcode;
+	size_t n;
+	uint32_t addr;
+
+	/* Operation running until bus byte busy_until, on SRAM buffer busy_buf */
+	unsigned long busy_until;
+	int busy_buf;
+
+	/* SPI clock and page erase and program time, in microseconds */
+	unsigned long clock;
+	unsigned long t_ep;
+
+	/* Bytes clocked on the bus */
+	unsigned long bus;
+	unsigned long violations;
+	unsigned long programs;
+} flash;
+
+static DataFlash df;
+static uint8_t shadow[RANDOM_SIZE];
+
+MOD_DEFINE(hw_dataflash);
+
+static unsigned long flash_bytes(unsigned long us)
+{
+	return (unsigned long)((uint64_t)us * (flash.clock / 8) / 1000000L);
+}
+
+static bool flash_busy(void)
+{
+	return flash.bus < flash.busy_until;
+}
+
+static void flash_start(int buffer, unsigned long us)
+{
+	flash.busy_until = flash.bus + flash_bytes(us);
+	flash.busy_buf = buffer;
+}
+
+/* Buffer accessed by an opcode, -1 for main memory commands */
+static int flash_buffer(uint8_t opcode)
+{
+	switch (opcode)
+	{
+	case DFO_WRITE_BUFF1:
+	case DFO_READ_BUFF1:
+		return 0;
+	case DFO_WRITE_BUFF2:
+	case DFO_READ_BUFF2:
+		return 1;
+	default:
+		return -1;
+	}
+}
+
+static uint32_t flash_page(void)
+{
+	return flash.addr >> PAGE_BITS;
+}
+
+static uint32_t flash_offset(void)
+{
+	return flash.addr & (BV32(PAGE_BITS) - 1);
+}
+
+/* Run the operation of the current command when CS is released */
+static void flash_release(void)
+{
+	if (flash.n != 4)
+		return;
+
+	switch (flash.opcode)
+	{
+	case DFO_WRITE_BUFF1_TO_MEM_E:
+	case DFO_WRITE_BUFF2_TO_MEM_E:
+	{
+		int b = (flash.opcode == DFO_WRITE_BUFF2_TO_MEM_E);
+		memcpy(flash.mem + flash_page() * PAGE_SIZE, flash.buf[b], PAGE_SIZE);
+		flash_start(b, flash.t_ep);
+		flash.programs++;
+		break;
+	}
+	case DFO_MOV_MEM_TO_BUFF1:
+	case DFO_MOV_MEM_TO_BUFF2:
+	{
+		int b = (flash.opcode == DFO_MOV_MEM_TO_BUFF2);
+		memcpy(flash.buf[b], flash.mem + flash_page() * PAGE_SIZE, PAGE_SIZE);
+		flash_start(b, FLASH_TXFR);
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+static void flash_setCS(bool enable)
+{
+	if (flash.selected && !enable)
+		flash_release();
+
+	flash.selected = enable;
+	flash.n = 0;
+}
+
+/* Clock one byte on the bus: \a in from the driver, return the byte from the memory */
+static uint8_t flash_xfer(uint8_t in)
+{
+	uint8_t out = 0xFF;
+
+	flash.bus++;
+	if (!flash.selected)
+		return out;
+
+	if (flash.n == 0)
+	{
+		int b = flash_buffer(in);
+
+		flash.opcode = in;
+		flash.addr = 0;
+		if (flash_busy() && in != DFO_READ_STATUS && (b < 0 || b == flash.busy_buf))
+			flash.violations++;
+	}
+	else if (flash.opcode == DFO_READ_STATUS)
+		out = (flash_busy() ? 0 : BUSY_BIT) | (DENSITY_ID << 2);
+	else if (flash.n < 4)
+		flash.addr = (flash.addr << 8) | in;
+	else
+	{
+		switch (flash.opcode)
+		{
+		case DFO_READ_FLASH_MEM_BYTE_D:
+			/* Continuous array read, after a don't care byte */
+			if (flash.n > 4)
+			{
+				uint32_t pos = flash_page() * PAGE_SIZE + flash_offset();
+				out = flash.mem[pos];
+				pos = (pos + 1) % sizeof(flash.mem);
+				flash.addr = ((pos / PAGE_SIZE) << PAGE_BITS) | (pos % PAGE_SIZE);
+			}
+			break;
+		case DFO_WRITE_BUFF1:
+		case DFO_WRITE_BUFF2:
+			flash.buf[flash_buffer(flash.opcode)][flash_offset()] = in;
+			flash.addr = (flash_offset() + 1) % PAGE_SIZE;
+			break;
+		default:
+			/* Not used by the driver */
+			ASSERT(0);
+			break;
+		}
+	}
+	flash.n++;
+	return out;
+}
+
+static size_t flash_read(struct KFile *fd, void *buf, size_t size)
+{
+	uint8_t *p = (uint8_t *)buf;
+	(void)fd;
+
+	for (size_t i = 0; i < size; i++)
+		p[i] = flash_xfer(0);
+	return size;
+}
+
+static size_t flash_write(struct KFile *fd, const void *buf, size_t size)
+{
+	const uint8_t *p = (const uint8_t *)buf;
+	(void)fd;
+
+	for (size_t i = 0; i < size; i++)
+		flash_xfer(p[i]);
+	return size;
+}
+
+static int flash_flush(struct KFile *fd)
+{
+	(void)fd;
+	return 0;
+}
+
+static uint32_t seed = 1;
+
+static unsigned rnd(unsigned n)
+{
+	seed = seed * 1103515245UL + 12345;
+	return (seed >> 16) % n;
+}
+
+/*
+ * Write SEQ_SIZE bytes from the start of the memory, SEQ_CHUNK at a time,
+ * and return the throughput in KB/s computed from the bus time.
+ */
+static unsigned long dataflash_testSequential(unsigned long clock, unsigned long t_ep)
+{
+	static uint8_t chunk[SEQ_CHUNK];
+	unsigned long start;
+
+	flash.clock = clock;
+	flash.t_ep = t_ep;
+	start = flash.bus;
+
+	kfile_seek(&df.fd, 0, KSM_SEEK_SET);
+	for (long pos = 0; pos < SEQ_SIZE; pos += SEQ_CHUNK)
+	{
+		for (size_t i = 0; i < SEQ_CHUNK; i++)
+			chunk[i] = (uint8_t)((pos + i) * 7 + clock);
+		ASSERT(kfile_write(&df.fd, chunk, SEQ_CHUNK) == SEQ_CHUNK);
+	}
+	ASSERT(kfile_flush(&df.fd) == 0);
+
+	for (long pos = 0; pos < SEQ_SIZE; pos++)
+		ASSERT(flash.mem[pos] == (uint8_t)(pos * 7 + clock));
+
+	/* payload / (bus bytes * 8 / clock), in KB/s */
+	unsigned long kbs = (unsigned long)((uint64_t)SEQ_SIZE * (clock / 8) / (flash.bus - start) / 1024);
+	kprintf("SPI %luMHz, tEP %2lums: %4lu KB/s (%lu bus bytes)\n",
+	        clock / 1000000L, t_ep / 1000, kbs, flash.bus - start);
+	return kbs;
+}
+
+int dataflash_testSetup(void)
+{
+	kdbg_init();
+	timer_init();
+
+	kfile_init(&flash.fd);
+	flash.fd.read = flash_read;
+	flash.fd.write = flash_write;
+	flash.fd.flush = flash_flush;
+	flash.clock = 8000000L;
+	flash.t_ep = 14000;
+	for (size_t i = 0; i < sizeof(flash.mem); i++)
+		flash.mem[i] = (uint8_t)(i * 13 + (i >> 9));
+
+	MOD_INIT(hw_dataflash);
+	return 0;
+}
+
+int dataflash_testRun(void)
+{
+	static uint8_t buf[PAGE_SIZE * 2];
+
+	ASSERT(dataflash_init(&df, &flash.fd, DFT_AT45DB161D, flash_setCS, NULL));
+	ASSERT(df.fd.size == PAGE_SIZE * PAGE_CNT);
+
+	/*
+	 * Random reads and writes, crossing pages in both directions:
+	 * partial pages are completed from the main memory.
+	 */
+	memcpy(shadow, flash.mem, sizeof(shadow));
+	for (int op = 0; op < RANDOM_OPS; op++)
+	{
+		kfile_off_t pos = rnd(RANDOM_SIZE);
+		size_t len = MIN((size_t)rnd(sizeof(buf)) + 1, (size_t)(RANDOM_SIZE - pos));
+
+		kfile_seek(&df.fd, pos, KSM_SEEK_SET);
+		if (rnd(2))
+		{
+			for (size_t i = 0; i < len; i++)
+				buf[i] = shadow[pos + i] = rnd(256);
+			ASSERT(kfile_write(&df.fd, buf, len) == len);
+		}
+		else
+		{
+			ASSERT(kfile_read(&df.fd, buf, len) == len);
+			ASSERT(!memcmp(buf, shadow + pos, len));
+		}
+	}
+	ASSERT(kfile_flush(&df.fd) == 0);
+	ASSERT(!memcmp(flash.mem, shadow, sizeof(shadow)));
+	ASSERT(flash.violations == 0);
+
+	/* Sequential writes overlap the page programs with the buffer writes */
+	unsigned long slow = dataflash_testSequential(2000000L, 2000);
+	unsigned long fast = dataflash_testSequential(8000000L, 2000);
+	unsigned long prog = dataflash_testSequential(8000000L, 14000);
+	ASSERT(flash.violations == 0);
+	ASSERT(fast > slow);
+	ASSERT(fast > prog);
+
+	/* Bound by the page program: close to a page per tEP */
+	ASSERT(prog <= PAGE_SIZE * 1000L / 14 / 1024 + 1);
+
+	ASSERT(kfile_close(&df.fd) == 0);
+	return 0;
+}
+
+int dataflash_testTearDown(void)
+{
+	return 0;
+}
+
+TEST_MAIN(dataflash);
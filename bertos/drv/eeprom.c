@@ -125,29 +125,82 @@ STATIC_ASSERT(countof(mem_info) == EEPROM_CNT);
 
 #define CHUNCK_SIZE 16
 
+static size_t eeprom_write(KBlock *blk, block_idx_t idx, const void *buf, size_t offset, size_t size);
+
+/**
+ * Compare \a size bytes of EEPROM from \a addr with \a buf,
+ * or with the erased value if \a buf is NULL.
+ */
+static bool eeprom_compare(Eeprom *eep, e2addr_t addr, const void *buf, size_t size)
+{
+	uint8_t verify_buf[CHUNCK_SIZE];
+	while (size)
+	{
+		block_idx_t idx = addr / eep->blk.blk_size;
+		size_t offset = addr % eep->blk.blk_size;
+		size_t count = MIN(size, (size_t)CHUNCK_SIZE);
+
+		size_t ret_len = eep->blk.priv.vt->readDirect((KBlock *)eep, idx, verify_buf, offset, count);
+
+		if (ret_len != count)
+		{
+			LOG_ERR("Verify read fail.\n");
+			return false;
+		}
+
+		for (size_t i = 0; i < ret_len; i++)
+		{
+			if (verify_buf[i] != (buf ? ((const uint8_t *)buf)[i] : 0xFF))
+			{
+				LOG_ERR("Data mismatch!\n");
+				return false;
+			}
+		}
+
+		size -= ret_len;
+		addr += ret_len;
+		if (buf)
+			buf = ((const char *)buf) + ret_len;
+	}
+	return true;
+}
+
 /**
  * Erase EEPROM.
  * \param eep is the Kblock context.
  * \param addr eeprom address where start to erase
  * \param size number of byte to erase
+ *
+ * Each page is erased with a single write cycle.
  */
 bool eeprom_erase(Eeprom *eep, e2addr_t addr, e2_size_t size)
 {
-	uint8_t tmp[CHUNCK_SIZE] = {[0 ...(CHUNCK_SIZE - 1)] = 0xFF};
+	bool ret = true;
+
+	/* Erase bypasses the page shadow: write it back now and reload it at the end */
+	if (kblock_flush(&eep->blk) != 0)
+		return false;
 
 	while (size)
 	{
 		block_idx_t idx = addr / eep->blk.blk_size;
 		size_t offset = addr % eep->blk.blk_size;
-		size_t count = MIN(size, (e2_size_t)CHUNCK_SIZE);
-		size_t ret_len = eep->blk.priv.vt->writeDirect((KBlock *)eep, idx, tmp, offset, count);
+		size_t count = MIN(size, (e2_size_t)(eep->blk.blk_size - offset));
+		size_t ret_len = eeprom_write((KBlock *)eep, idx, NULL, offset, count);
+
+		if (ret_len != count || (eep->verify && !eeprom_compare(eep, addr, NULL, count)))
+		{
+			ret = false;
+			break;
+		}
 		size -= ret_len;
 		addr += ret_len;
-
-		if (ret_len != count)
-			return false;
 	}
-	return true;
+
+	if (kblock_buffered(&eep->blk))
+		eep->blk.priv.vt->load(&eep->blk, eep->blk.priv.blk_start + eep->blk.priv.curr_blk);
+
+	return ret;
 }
 
 /**
@@ -159,34 +212,43 @@ bool eeprom_erase(Eeprom *eep, e2addr_t addr, e2_size_t size)
  */
 bool eeprom_verify(Eeprom *eep, e2addr_t addr, const void *buf, size_t size)
 {
-	uint8_t verify_buf[CHUNCK_SIZE];
-	while (size)
-	{
-		block_idx_t idx = addr / eep->blk.blk_size;
-		size_t offset = addr % eep->blk.blk_size;
-		size_t count = MIN(size, (size_t)CHUNCK_SIZE);
+	/* The memory must hold the data cached in the page shadow */
+	if (kblock_flush(&eep->blk) != 0)
+		return false;
 
-		size_t ret_len = eep->blk.priv.vt->readDirect((KBlock *)eep, idx, verify_buf, offset, count);
+	return eeprom_compare(eep, addr, buf, size);
+}
 
-		if (ret_len != count)
-		{
-			LOG_ERR("Verify read fail.\n");
-			return false;
-		}
+/**
+ * Wait the end of the last write cycle.
+ *
+ * While writing, the memory does not acknowledge its address:
+ * we poll it with an address only write, which the i2c driver
+ * repeats until the memory answers.
+ * No write cycle is started since no data follows the address.
+ *
+ * \return true if the memory is ready, false on i2c errors.
+ */
+bool eeprom_sync(Eeprom *eep)
+{
+	uint8_t addr_buf[2] = { 0, 0 };
+	uint8_t addr_len = mem_info[eep->type].has_dev_addr ? 2 : 1;
+	e2dev_addr_t dev_addr = mem_info[eep->type].has_dev_addr ? eep->addr : 0;
 
-		if (memcmp(buf, verify_buf, ret_len) != 0)
-		{
-			LOG_ERR("Data mismatch!\n");
-			return false;
-		}
+	if (!eep->busy)
+		return true;
 
-		size -= ret_len;
-		addr += ret_len;
-		buf = ((const char *)buf) + ret_len;
-	}
-	return true;
+	i2c_start_w(eep->i2c, EEPROM_ADDR(dev_addr), addr_len, I2C_STOP);
+	i2c_write(eep->i2c, addr_buf, addr_len);
+
+	eep->busy = false;
+	return !i2c_error(eep->i2c);
 }
 
+/*
+ * Write \a size bytes of \a buf in a single page write cycle, or
+ * the erased value if \a buf is NULL.
+ */
 static size_t eeprom_write(KBlock *blk, block_idx_t idx, const void *buf, size_t offset, size_t size)
 {
 	Eeprom *eep = EEPROM_CAST_KBLOCK(blk);
@@ -225,11 +287,21 @@ static size_t eeprom_write(KBlock *blk, block_idx_t idx, const void *buf, size_t
 
 	i2c_start_w(eep->i2c, EEPROM_ADDR(dev_addr), addr_len + size, I2C_STOP);
 	i2c_write(eep->i2c, addr_buf, addr_len);
-	i2c_write(eep->i2c, buf, size);
+	if (buf)
+		i2c_write(eep->i2c, buf, size);
+	else
+		for (size_t i = 0; i < size; i++)
+			i2c_putc(eep->i2c, 0xFF);
 
 	if (i2c_error(eep->i2c))
 		return 0;
 
+	eep->busy = true;
+	#if !CONFIG_EEPROM_ASYNC
+		if (!eeprom_sync(eep))
+			return 0;
+	#endif
+
 	return size;
 }
 
@@ -272,6 +344,8 @@ static size_t eeprom_readDirect(struct KBlock *_blk, block_idx_t idx, void *_buf
 	if (i2c_error(blk->i2c))
 		return rd_len;
 
+	/* The memory answered, so no write cycle is pending */
+	blk->busy = false;
 	rd_len += size;
 
 	return rd_len;
@@ -284,39 +358,19 @@ static size_t eeprom_writeDirect(KBlock *blk, block_idx_t idx, const void *buf,
 		return eeprom_write(blk, idx, buf, offset, size);
 	else
 	{
+		/* Write the whole page at once, then read it back in smaller pieces */
 		int retries = 5;
 		while (retries--)
 		{
-			uint8_t verify_buf[CHUNCK_SIZE];
-			size_t wr_len = 0;
-			size_t len = 0;
-			while (size)
+			size_t wr_len = eeprom_write(blk, idx, buf, offset, size);
+			if (wr_len == 0)
 			{
-				/* Split read in smaller pieces */
-				size_t count = MIN(size, (size_t)CHUNCK_SIZE);
-				if ((wr_len = eeprom_write(blk, idx, buf, offset, count)) != 0)
-				{
-					if (eeprom_readDirect(blk, idx, verify_buf, offset, count) != wr_len)
-					{
-						LOG_ERR("Verify read fail.\n");
-						return 0;
-					}
-					else if (memcmp(buf, verify_buf, wr_len) != 0)
-					{
-						LOG_ERR("Data mismatch!\n");
-						continue;
-					}
-				}
-				else
-				{
-					LOG_ERR("Write fail.\n");
-					return 0;
-				}
-				size -= wr_len;
-				len += wr_len;
-				buf = ((const char *)buf) + wr_len;
+				LOG_ERR("Write fail.\n");
+				return 0;
 			}
-			return len;
+
+			if (eeprom_compare(eep, (e2addr_t)(blk->blk_size * idx + offset), buf, wr_len))
+				return wr_len;
 		}
 	}
 
@@ -328,6 +382,7 @@ static int kblockEeprom_dummy(UNUSED_ARG(struct KBlock *, b))
 	return 0;
 }
 
+#if !CONFIG_EEPROM_WRITE_BACK
 static const KBlockVTable eeprom_unbuffered_vt =
     {
         .readDirect = eeprom_readDirect,
@@ -336,6 +391,21 @@ static const KBlockVTable eeprom_unbuffered_vt =
         .error = kblockEeprom_dummy,
         .clearerr = (kblock_clearerr_t)kblockEeprom_dummy,
 };
+#else
+static const KBlockVTable eeprom_buffered_vt =
+    {
+        .readDirect = eeprom_readDirect,
+        .writeDirect = eeprom_writeDirect,
+
+        .readBuf = kblock_swReadBuf,
+        .writeBuf = kblock_swWriteBuf,
+        .load = kblock_swLoad,
+        .store = kblock_swStore,
+
+        .error = kblockEeprom_dummy,
+        .clearerr = (kblock_clearerr_t)kblockEeprom_dummy,
+};
+#endif
 
 /**
  * Initialize EEPROM module.
@@ -344,6 +414,9 @@ static const KBlockVTable eeprom_unbuffered_vt =
  * \param i2c context for i2c channel
  * \param addr is the i2c devide address (usually pins A0, A1, A2).
  * \param verify enable the write check.
+ *
+ * With CONFIG_EEPROM_WRITE_BACK the KBlock is buffered on a copy of the
+ * current page: remember to kblock_flush() it to commit writes.
  */
 void eeprom_init_5(Eeprom *eep, I2c *i2c, EepromType type, e2dev_addr_t addr, bool verify)
 {
@@ -360,5 +433,15 @@ void eeprom_init_5(Eeprom *eep, I2c *i2c, EepromType type, e2dev_addr_t addr, bo
 	eep->blk.blk_size = mem_info[type].blk_size;
 	eep->blk.blk_cnt = mem_info[type].e2_size / mem_info[type].blk_size;
 	eep->blk.priv.flags |= KB_PARTIAL_WRITE;
+
+#if CONFIG_EEPROM_WRITE_BACK
+	ASSERT(mem_info[type].blk_size <= EEPROM_MAX_BLK_SIZE);
+
+	eep->blk.priv.buf = eep->shadow;
+	eep->blk.priv.flags |= KB_BUFFERED;
+	eep->blk.priv.vt = &eeprom_buffered_vt;
+	eep->blk.priv.vt->load(&eep->blk, 0);
+#else
 	eep->blk.priv.vt = &eeprom_unbuffered_vt;
+#endif
 }
@@ -95,6 +95,11 @@ typedef enum EepromType
  */
 typedef uint8_t e2dev_addr_t;
 
+/**
+ * Biggest page size of the supported memories.
+ */
+#define EEPROM_MAX_BLK_SIZE 0x100
+
 /**
  * Describe an EEPROM context, used by the driver to
  * access the single device.
@@ -106,6 +111,10 @@ typedef struct Eeprom
 	EepromType type;   ///< EEPROM type
 	e2dev_addr_t addr; ///< Device address.
 	bool verify;
+	bool busy;         ///< A write cycle may be still in progress.
+#if CONFIG_EEPROM_WRITE_BACK
+	uint8_t shadow[EEPROM_MAX_BLK_SIZE]; ///< Write-back copy of the current page.
+#endif
 #if !CONFIG_EEPROM_DISABLE_OLD_API
 	union
 	{
@@ -169,6 +178,7 @@ typedef struct EepromInfo
 } EepromInfo;
 
 bool eeprom_erase(Eeprom *eep, e2addr_t addr, e2_size_t count);
+bool eeprom_sync(Eeprom *eep);
 bool eeprom_verify_4(Eeprom *eep, e2addr_t addr, const void *buf, size_t count);
 void eeprom_init_5(Eeprom *eep, I2c *i2c, EepromType type, e2dev_addr_t addr, bool verify);
 
@@ -0,0 +1,316 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2011 Develer S.r.l. (http://www.develer.com/)
+ * -->
+ *
+ *
+ * \brief EEPROM driver test, run on a simulated 24xx256.
+ *
+ * The i2c context is driven by a model of a 24xx256 at 100kHz: time
+ * is counted in bus bit times, a page write starts a write cycle of
+ * EEPROM_TWR at the stop, and the memory does not acknowledge its
+ * address until the cycle ends. Like the bitbang driver, the start is
+ * then repeated (ack polling) up to CONFIG_I2C_START_TIMEOUT.
+ * The test counts write cycles and bus time of typical access patterns
+ * and checks the data against a shadow copy of the memory.
+ *
+ * $test$: cp bertos/cfg/cfg_eeprom.h $cfgdir/
+ * $test$: echo  "#undef CONFIG_EEPROM_WRITE_BACK" >> $cfgdir/cfg_eeprom.h
+ * $test$: echo "#define CONFIG_EEPROM_WRITE_BACK 1" >> $cfgdir/cfg_eeprom.h
+ * $test$: echo  "#undef CONFIG_EEPROM_DISABLE_OLD_API" >> $cfgdir/cfg_eeprom.h
+ * $test$: echo "#define CONFIG_EEPROM_DISABLE_OLD_API 1" >> $cfgdir/cfg_eeprom.h
+ * $test$: cp bertos/cfg/cfg_i2c.h $cfgdir/
+ * $test$: echo  "#undef CONFIG_I2C_DISABLE_OLD_API" >> $cfgdir/cfg_i2c.h
+ * $test$: echo "#define CONFIG_I2C_DISABLE_OLD_API 1" >> $cfgdir/cfg_i2c.h
+ */
+
+#include "cfg/cfg_i2c.h"
+#include "cfg/cfg_eeprom.h"
+
+#include <drv/eeprom.h>
+#include <drv/i2c.h>
+
+#include <io/kblock.h>
+#include <io/kfile.h>
+#include <io/kfile_block.h>
+
+#include <cfg/compiler.h>
+#include <cfg/macros.h>
+#include <cfg/test.h>
+#include <cfg/debug.h>
+
+#include <string.h>
+
+#define E2_ADDR   0xA0
+#define E2_SIZE   0x8000
+#define E2_PAGE   64
+
+/* Bit time at 100kHz and write cycle time, in microseconds */
+#define E2_BIT    10
+#define E2_TWR    5000
+
+#define RANDOM_OPS 2000
+
+static struct Chip
+{
+	uint8_t mem[E2_SIZE];
+	uint8_t page[E2_PAGE];
+	bool page_dirty[E2_PAGE];
+	uint16_t ptr;
+	size_t addr_bytes;
+	size_t page_len;
+	bool selected;
+	bool busy;
+
+	/* Bus time and end of the write cycle, in microseconds */
+	unsigned long time;
+	unsigned long cycle_end;
+
+	unsigned long cycles;
+	unsigned long polls;
+} chip;
+
+static I2c i2c;
+static Eeprom eep;
+static KFileBlock f;
+static uint8_t shadow[E2_SIZE];
+static uint8_t buf[1024];
+
+static void bus_stop(void)
+{
+	ASSERT(chip.busy);
+	chip.busy = false;
+	chip.time += E2_BIT;
+
+	/* The page buffer is written at the stop, the address wraps in the page */
+	if (chip.selected && chip.page_len)
+	{
+		uint16_t base = chip.ptr & ~(E2_PAGE - 1);
+
+		for (size_t i = 0; i < E2_PAGE; i++)
+			if (chip.page_dirty[i])
+				chip.mem[base + i] = chip.page[i];
+		chip.ptr = base + ((chip.ptr + chip.page_len) & (E2_PAGE - 1));
+		chip.cycle_end = chip.time + E2_TWR;
+		chip.cycles++;
+	}
+	chip.selected = false;
+	chip.page_len = 0;
+}
+
+static void bus_start(I2c *i2c, uint16_t slave_addr)
+{
+	unsigned long start = chip.time;
+
+	ASSERT(i2c->xfer_size);
+	chip.busy = true;
+	chip.selected = false;
+
+	/* Start and address byte, repeated until the memory answers */
+	for (;;)
+	{
+		chip.time += 10 * E2_BIT;
+		if ((slave_addr & ~I2C_READBIT) != E2_ADDR)
+			break;
+		if (chip.time >= chip.cycle_end)
+		{
+			chip.selected = true;
+			chip.addr_bytes = 0;
+			chip.page_len = 0;
+			memset(chip.page_dirty, 0, sizeof(chip.page_dirty));
+			return;
+		}
+		if (chip.time - start > CONFIG_I2C_START_TIMEOUT * 1000L)
+			break;
+		chip.polls++;
+	}
+
+	i2c->errors |= I2C_START_TIMEOUT;
+	bus_stop();
+}
+
+static void bus_putc(I2c *i2c, uint8_t data)
+{
+	ASSERT(chip.busy && chip.selected);
+	chip.time += 9 * E2_BIT;
+
+	if (chip.addr_bytes < 2)
+	{
+		chip.ptr = (chip.ptr << 8 | data) & (E2_SIZE - 1);
+		chip.addr_bytes++;
+	}
+	else
+	{
+		size_t i = (chip.ptr + chip.page_len++) & (E2_PAGE - 1);
+
+		chip.page[i] = data;
+		chip.page_dirty[i] = true;
+	}
+
+	if (i2c->xfer_size == 1 && (i2c->flags & I2C_STOP))
+		bus_stop();
+}
+
+static uint8_t bus_getc(I2c *i2c)
+{
+	ASSERT(chip.busy && chip.selected);
+	chip.time += 9 * E2_BIT;
+
+	uint8_t data = chip.mem[chip.ptr];
+	chip.ptr = (chip.ptr + 1) & (E2_SIZE - 1);
+
+	if (i2c->xfer_size == 1 && (i2c->flags & I2C_STOP))
+		bus_stop();
+	return data;
+}
+
+static const I2cVT bus_vt =
+{
+	.start = bus_start,
+	.getc = bus_getc,
+	.putc = bus_putc,
+	.write = i2c_genericWrite,
+	.read = i2c_genericRead,
+};
+
+static uint32_t seed = 1;
+
+static unsigned rnd(unsigned n)
+{
+	seed = seed * 1103515245UL + 12345;
+	return (seed >> 16) % n;
+}
+
+/* Wait for the last cycle, then print and check the write cycles since \a cycles */
+static void eeprom_testReport(const char *name, unsigned long time, unsigned long cycles, unsigned long expected)
+{
+	ASSERT(eeprom_sync(&eep));
+	kprintf("%-16s %5lu ms, %4lu write cycles\n", name,
+		(chip.time - time) / 1000, chip.cycles - cycles);
+	ASSERT(chip.cycles - cycles == expected);
+}
+
+int eeprom_testSetup(void)
+{
+	kdbg_init();
+
+	memset(&i2c, 0, sizeof(i2c));
+	i2c.vt = &bus_vt;
+	for (size_t i = 0; i < sizeof(chip.mem); i++)
+		chip.mem[i] = 0x55 ^ i;
+
+	eeprom_init(&eep, &i2c, EEPROM_24XX256, 0, false);
+	kfileblock_init(&f, &eep.blk);
+	memcpy(shadow, chip.mem, sizeof(shadow));
+	return 0;
+}
+
+int eeprom_testRun(void)
+{
+	unsigned long time, cycles;
+
+	/* Byte by byte fill of 2KB, as done by dli on reset */
+	time = chip.time;
+	cycles = chip.cycles;
+	kfile_seek(&f.fd, 0, KSM_SEEK_SET);
+	for (int i = 0; i < 2048; i++)
+		ASSERT(kfile_putc(0xFF, &f.fd) == 0xFF);
+	ASSERT(kfile_flush(&f.fd) == 0);
+	memset(shadow, 0xFF, 2048);
+	eeprom_testReport("putc 2KB", time, cycles, CONFIG_EEPROM_WRITE_BACK ? 2048 / E2_PAGE : 2048);
+
+	/* 8 byte records */
+	time = chip.time;
+	cycles = chip.cycles;
+	for (int i = 0; i < 256; i++)
+	{
+		memset(buf, i, 8);
+		ASSERT(kfile_write(&f.fd, buf, 8) == 8);
+		memset(shadow + 2048 + i * 8, i, 8);
+	}
+	ASSERT(kfile_flush(&f.fd) == 0);
+	eeprom_testReport("8 bytes x 256", time, cycles, CONFIG_EEPROM_WRITE_BACK ? 2048 / E2_PAGE : 256);
+
+	/* Erase: a cycle per page */
+	time = chip.time;
+	cycles = chip.cycles;
+	ASSERT(eeprom_erase(&eep, 4096, 4096));
+	memset(shadow + 4096, 0xFF, 4096);
+	eeprom_testReport("erase 4KB", time, cycles, 4096 / E2_PAGE);
+
+	/* Verified writes: a cycle per page, read back after the cycle */
+	eep.verify = true;
+	for (size_t i = 0; i < sizeof(buf); i++)
+		buf[i] = rnd(256);
+	time = chip.time;
+	cycles = chip.cycles;
+	kfile_seek(&f.fd, 8192, KSM_SEEK_SET);
+	ASSERT(kfile_write(&f.fd, buf, sizeof(buf)) == sizeof(buf));
+	ASSERT(kfile_flush(&f.fd) == 0);
+	memcpy(shadow + 8192, buf, sizeof(buf));
+	eeprom_testReport("verified 1KB", time, cycles, sizeof(buf) / E2_PAGE);
+	ASSERT(eeprom_verify(&eep, 8192, buf, sizeof(buf)));
+	eep.verify = false;
+
+	/* Random reads and writes crossing pages */
+	for (int op = 0; op < RANDOM_OPS; op++)
+	{
+		kfile_off_t pos = rnd(E2_SIZE / 4);
+		size_t len = rnd(3 * E2_PAGE) + 1;
+
+		kfile_seek(&f.fd, pos, KSM_SEEK_SET);
+		if (rnd(2))
+		{
+			for (size_t i = 0; i < len; i++)
+				buf[i] = shadow[pos + i] = rnd(256);
+			ASSERT(kfile_write(&f.fd, buf, len) == len);
+		}
+		else
+		{
+			ASSERT(kfile_read(&f.fd, buf, len) == len);
+			ASSERT(!memcmp(buf, shadow + pos, len));
+		}
+	}
+	ASSERT(kfile_flush(&f.fd) == 0);
+	ASSERT(eeprom_sync(&eep));
+	ASSERT(!memcmp(chip.mem, shadow, sizeof(shadow)));
+
+	/* The asynchronous writes overlap the cycles with the next transfers */
+	kprintf("%lu ack polls\n", chip.polls);
+	ASSERT(chip.polls);
+	ASSERT(!chip.busy);
+	return 0;
+}
+
+int eeprom_testTearDown(void)
+{
+	return 0;
+}
+
+TEST_MAIN(eeprom);
@@ -57,27 +57,59 @@
 
 #warning FIXME:This file was changed, but is untested!
 
+#include <string.h> /* memset() */
+
+/*
+ * Read opcode and data phase, see CONFIG_FLASH25_READ_LINES.
+ */
+#if CONFIG_FLASH25_READ_LINES > 1
+	#if !FLASH25_HAS_FAST_READ
+		#error Selected memory has no dual or quad output read.
+	#endif
+	#ifndef SPI_HW_READ_LINES
+		#error Dual and quad reads need SPI_HW_READ_LINES() in hw_spi.h.
+	#endif
+	#if CONFIG_FLASH25_READ_LINES == 4
+		#define FLASH25_READ_CMD FLASH25_QUAD_READ
+	#else
+		#define FLASH25_READ_CMD FLASH25_DUAL_READ
+	#endif
+	#define FLASH25_READ_DUMMY 1
+	#define FLASH25_READ_DATA(fd, buf, len) SPI_HW_READ_LINES(CONFIG_FLASH25_READ_LINES, (buf), (len))
+#else
+	#if FLASH25_HAS_FAST_READ
+		#define FLASH25_READ_CMD   FLASH25_FAST_READ
+		#define FLASH25_READ_DUMMY 1
+	#else
+		#define FLASH25_READ_CMD   FLASH25_READ
+		#define FLASH25_READ_DUMMY 0
+	#endif
+	#define FLASH25_READ_DATA(fd, buf, len) kfile_read((fd)->channel, (buf), (len))
+#endif
+
 /**
  * Wait until flash memory is ready.
+ *
+ * Program and erase commands do not wait for their own
+ * cycle: the next command does, so the caller can go on
+ * preparing data meanwhile.
+ * The status register is output continuously while CS is
+ * low, so we poll it without sending the opcode again.
  */
 static void flash25_waitReady(Flash25 *fd)
 {
-	uint8_t stat;
+	if (!fd->busy)
+		return;
 
-	while (1)
-	{
-		CS_ENABLE();
-
-		kfile_putc(FLASH25_RDSR, fd->channel);
-		stat = kfile_getc(fd->channel);
+	CS_ENABLE();
 
-		CS_DISABLE();
+	kfile_putc(FLASH25_RDSR, fd->channel);
+	while (kfile_getc(fd->channel) & RDY_BIT)
+		cpu_relax();
 
-		if (!(stat & RDY_BIT))
-			break;
+	CS_DISABLE();
 
-		cpu_relax();
-	}
+	fd->busy = false;
 }
 
 /**
@@ -92,6 +124,148 @@ static void flash25_sendCmd(Flash25 *fd, Flash25Opcode cmd)
 	CS_DISABLE();
 }
 
+/**
+ * Start a program or erase cycle at \a addr.
+ *
+ * Send WREN and then \a cmd, followed by 3 byte of address
+ * and \a len bytes of \a data, all with a single write on
+ * the channel. We do not wait for the end of the cycle.
+ */
+static void flash25_startCmd(Flash25 *fd, Flash25Opcode cmd, flash25Addr_t addr, const void *data, size_t len)
+{
+	uint8_t hdr[4] = { cmd, (addr >> 16) & 0xFF, (addr >> 8) & 0xFF, addr & 0xFF };
+
+	flash25_waitReady(fd);
+	flash25_sendCmd(fd, FLASH25_WREN);
+
+	CS_ENABLE();
+	kfile_write(fd->channel, hdr, sizeof(hdr));
+	if (len)
+		kfile_write(fd->channel, data, len);
+	CS_DISABLE();
+
+	fd->busy = true;
+}
+
+/**
+ * Open a read transfer at \a addr: the data follows on the channel
+ * until CS is disabled.
+ */
+static void flash25_startRead(Flash25 *fd, flash25Addr_t addr)
+{
+	uint8_t hdr[4 + FLASH25_READ_DUMMY] = { FLASH25_READ_CMD, (addr >> 16) & 0xFF, (addr >> 8) & 0xFF, addr & 0xFF };
+
+	flash25_waitReady(fd);
+
+	CS_ENABLE();
+	kfile_write(fd->channel, hdr, sizeof(hdr));
+}
+
+/**
+ * Read \a len bytes at \a addr in \a buf, with a single command.
+ */
+static void flash25_readData(Flash25 *fd, flash25Addr_t addr, void *buf, size_t len)
+{
+	flash25_startRead(fd, addr);
+	FLASH25_READ_DATA(fd, buf, len);
+	CS_DISABLE();
+}
+
+#define FLASH25_CHECK_LEN 64 ///< Bytes read at a time by flash25_isBlank()
+
+/**
+ * \return true if the \a len bytes at \a addr are all erased.
+ *
+ * Reading even a whole sector is much faster than erasing it,
+ * and we stop at the first programmed byte.
+ */
+static bool flash25_isBlank(Flash25 *fd, flash25Addr_t addr, flash25Size_t len)
+{
+	uint8_t buf[FLASH25_CHECK_LEN];
+	bool blank = true;
+
+	flash25_startRead(fd, addr);
+	while (len && blank)
+	{
+		size_t chunk = MIN(len, (flash25Size_t)FLASH25_CHECK_LEN);
+
+		FLASH25_READ_DATA(fd, buf, chunk);
+		for (size_t i = 0; i < chunk; i++)
+			if (buf[i] != 0xFF)
+			{
+				blank = false;
+				break;
+			}
+		len -= chunk;
+	}
+	CS_DISABLE();
+
+	return blank;
+}
+
+/**
+ * Erase \a len bytes from \a addr, both sector aligned.
+ *
+ * All the erases are scheduled before programming starts, using
+ * the biggest erase unit that fits, and units already blank are
+ * skipped.
+ */
+static void flash25_eraseRange(Flash25 *fd, flash25Addr_t addr, flash25Size_t len)
+{
+	ASSERT(addr % FLASH25_SECTOR_SIZE == 0);
+	ASSERT(len % FLASH25_SECTOR_SIZE == 0);
+
+	while (len)
+	{
+		flash25Size_t unit = FLASH25_SECTOR_SIZE;
+		Flash25Opcode cmd = FLASH25_SECTORE_ERASE;
+
+		#if FLASH25_BLOCK_SIZE
+			if (addr % FLASH25_BLOCK_SIZE == 0 && len >= FLASH25_BLOCK_SIZE)
+			{
+				unit = FLASH25_BLOCK_SIZE;
+				cmd = FLASH25_BLOCK_ERASE;
+			}
+		#endif
+
+		if (!flash25_isBlank(fd, addr, unit))
+			flash25_startCmd(fd, cmd, addr, NULL, 0);
+
+		addr += unit;
+		len -= unit;
+	}
+}
+
+/**
+ * Program \a len bytes of \a data at \a addr.
+ *
+ * Data is split on page boundaries and every page program is sent
+ * as soon as the previous one is over; pages left all 0xFF need no
+ * program cycle at all.
+ *
+ * \note The same byte cannot be reprogrammed without erasing the
+ * whole sector first.
+ */
+static void flash25_program(Flash25 *fd, flash25Addr_t addr, const uint8_t *data, flash25Size_t len)
+{
+	while (len)
+	{
+		flash25Size_t wr_len = MIN(len, FLASH25_PAGE_SIZE - addr % (flash25Size_t)FLASH25_PAGE_SIZE);
+		flash25Size_t i;
+
+		for (i = 0; i < wr_len; i++)
+			if (data[i] != 0xFF)
+				break;
+
+		if (i < wr_len)
+			flash25_startCmd(fd, FLASH25_PROGRAM, addr, data, wr_len);
+
+		data += wr_len;
+		addr += wr_len;
+		len -= wr_len;
+	}
+}
+
 /**
  * flash25 init function.
  * This function init a comunication channel and
@@ -146,11 +320,12 @@ static KFile *flash25_reopen(struct KFile *_fd)
 /**
  * Close a serial memory interface.
  *
- * For serial memory this funtion do nothing,
- * and return always 0.
+ * For serial memory this funtion only waits the end
+ * of the last program cycle, and return always 0.
  */
-static int flash25_close(UNUSED_ARG(struct KFile *, fd))
+static int flash25_close(struct KFile *_fd)
 {
+	flash25_waitReady(FLASH25_CAST(_fd));
 	kprintf("flash25 file closed\n");
 	return 0;
 }
@@ -175,21 +350,7 @@ static size_t flash25_read(struct KFile *_fd, void *buf, size_t size)
 	ASSERT(fd->fd.seek_pos + (kfile_off_t)size <= fd->fd.size);
 	size = MIN((kfile_off_t)size, fd->fd.size - fd->fd.seek_pos);
 
-	//kprintf("Reading at addr[%lu], size[%d]\n", fd->seek_pos, size);
-	CS_ENABLE();
-
-	kfile_putc(FLASH25_READ, fd->channel);
-
-	/*
-	 * Address that we want to read.
-	 */
-	kfile_putc((fd->fd.seek_pos >> 16) & 0xFF, fd->channel);
-	kfile_putc((fd->fd.seek_pos >> 8) & 0xFF, fd->channel);
-	kfile_putc(fd->fd.seek_pos & 0xFF, fd->channel);
-
-	kfile_read(fd->channel, data, size);
-
-	CS_DISABLE();
+	flash25_readData(fd, fd->fd.seek_pos, data, size);
 
 	fd->fd.seek_pos += size;
 
@@ -217,66 +378,16 @@ static size_t flash25_read(struct KFile *_fd, void *buf, size_t size)
  */
 static size_t flash25_write(struct KFile *_fd, const void *_buf, size_t size)
 {
-	flash25Offset_t offset;
-	flash25Size_t total_write = 0;
-	flash25Size_t wr_len;
-	const uint8_t *data = (const uint8_t *)_buf;
-
 	Flash25 *fd = FLASH25_CAST(_fd);
 
 	ASSERT(fd->fd.seek_pos + (kfile_off_t)size <= fd->fd.size);
 
 	size = MIN((kfile_off_t)size, fd->fd.size - fd->fd.seek_pos);
 
-	while (size)
-	{
-		offset = fd->fd.seek_pos % (flash25Size_t)FLASH25_PAGE_SIZE;
-		wr_len = MIN((flash25Size_t)size, FLASH25_PAGE_SIZE - (flash25Size_t)offset);
-
-		kprintf("[seek_pos-<%lu>, offset-<%d>]\n", fd->fd.seek_pos, offset);
-
-		/*
-		 * We check serial flash memory state, and wait until ready-flag
-		 * is high.
-		 */
-		flash25_waitReady(fd);
-
-		/*
-		 * Start write cycle.
-		 * We could write only data not more long than one
-		 * page size.
-		 *
-		 * To write on serial flash memory we must first
-		 * enable write with a WREN opcode command, before
-		 * the PROGRAM opcode.
-		 *
-		 * \note: the same byte cannot be reprogrammed without
-		 * erasing the whole sector first.
-		 */
-		flash25_sendCmd(fd, FLASH25_WREN);
-
-		CS_ENABLE();
-		kfile_putc(FLASH25_PROGRAM, fd->channel);
-
-		/*
-		 * Address that we want to write.
-		 */
-		kfile_putc((fd->fd.seek_pos >> 16) & 0xFF, fd->channel);
-		kfile_putc((fd->fd.seek_pos >> 8) & 0xFF, fd->channel);
-		kfile_putc(fd->fd.seek_pos & 0xFF, fd->channel);
-
-		kfile_write(fd->channel, data, wr_len);
-
-		CS_DISABLE();
-
-		data += wr_len;
-		fd->fd.seek_pos += wr_len;
-		size -= wr_len;
-		total_write += wr_len;
-	}
+	flash25_program(fd, fd->fd.seek_pos, (const uint8_t *)_buf, size);
+	fd->fd.seek_pos += size;
 
-	kprintf("written %lu bytes\n", total_write);
-	return total_write;
+	return size;
 }
 
 /**
@@ -297,8 +408,6 @@ void flash25_sectorErase(Flash25 *fd, Flash25Sector sector)
 	 */
 	DB(ticks_t start_time = timer_clock());
 
-	CS_ENABLE();
-
 	/*
 	 * To erase a sector of serial flash memory we must first
 	 * enable write with a WREN opcode command, before
@@ -306,16 +415,7 @@ void flash25_sectorErase(Flash25 *fd, Flash25Sector sector)
 	 * determinate if any address within the sector
 	 * is selected.
 	 */
-	kfile_putc(FLASH25_WREN, fd->channel);
-	kfile_putc(FLASH25_SECTORE_ERASE, fd->channel);
-
-	/*
-	 * Address inside the sector that we want to
-	 * erase.
-	 */
-	kfile_putc(sector, fd->channel);
-
-	CS_DISABLE();
+	flash25_startCmd(fd, FLASH25_SECTORE_ERASE, sector, NULL, 0);
 
 	/*
 	 * We check serial flash memory state, and wait until ready-flag
@@ -347,8 +447,10 @@ void flash25_chipErase(Flash25 *fd)
 	 * enable write with a WREN opcode command, before
 	 * the CHIP_ERASE opcode.
 	 */
+	flash25_waitReady(fd);
 	flash25_sendCmd(fd, FLASH25_WREN);
 	flash25_sendCmd(fd, FLASH25_CHIP_ERASE);
+	fd->busy = true;
 
 	/*
 	 * We check serial flash memory state, and wait until ready-flag
@@ -359,6 +461,42 @@ void flash25_chipErase(Flash25 *fd)
 	DB(kprintf("Erased all memory in %ld ms\n", ticks_to_ms(timer_clock() - start_time)));
 }
 
+#if CONFIG_FLASH25_READ_LINES == 4
+/**
+ * Set the QE bit, that turns the WP and HOLD pins into data lines.
+ *
+ * Quad reads give wrong data while QE is clear. The bit is non
+ * volatile, so we write the status register only the first time.
+ */
+static void flash25_quadEnable(Flash25 *fd)
+{
+	uint8_t status[3] = { FLASH25_WRSR };
+
+	CS_ENABLE();
+	kfile_putc(FLASH25_RDSR, fd->channel);
+	status[1] = kfile_getc(fd->channel);
+	CS_DISABLE();
+
+	CS_ENABLE();
+	kfile_putc(FLASH25_RDSR2, fd->channel);
+	status[2] = kfile_getc(fd->channel);
+	CS_DISABLE();
+
+	if (status[2] & QE_BIT)
+		return;
+
+	/* Both status registers are written, the first one unchanged */
+	status[2] |= QE_BIT;
+	flash25_sendCmd(fd, FLASH25_WREN);
+	CS_ENABLE();
+	kfile_write(fd->channel, status, sizeof(status));
+	CS_DISABLE();
+
+	fd->busy = true;
+	flash25_waitReady(fd);
+}
+#endif
+
 /**
  * Init data flash memory interface.
  */
@@ -382,6 +520,7 @@ void flash25_init(Flash25 *fd, KFile *ch)
 	 * Init a local channel structure and flash kfile interface.
 	 */
 	fd->channel = ch;
+	fd->busy = false;
 	flash25_reopen(&fd->fd);
 
 	/*
@@ -389,4 +528,125 @@ void flash25_init(Flash25 *fd, KFile *ch)
 	 */
 	if (!flash25_pin_init(fd))
 		ASSERT(0);
+
+#if CONFIG_FLASH25_READ_LINES == 4
+	flash25_quadEnable(fd);
+#endif
+}
+
+static size_t flash25_readDirect(KBlock *b, block_idx_t idx, void *buf, size_t offset, size_t size)
+{
+	Flash25Block *fb = FLASH25_BLOCK_CAST(b);
+
+	flash25_readData(&fb->flash, idx * FLASH25_SECTOR_SIZE + offset, buf, size);
+	return size;
+}
+
+/**
+ * Write a whole sector: erase it, unless blank, and program its pages.
+ */
+static size_t flash25_writeDirect(KBlock *b, block_idx_t idx, const void *buf, size_t offset, size_t size)
+{
+	Flash25Block *fb = FLASH25_BLOCK_CAST(b);
+	flash25Addr_t addr = idx * FLASH25_SECTOR_SIZE;
+
+	ASSERT(offset == 0);
+	ASSERT(size == FLASH25_SECTOR_SIZE);
+
+	flash25_eraseRange(&fb->flash, addr, size);
+	flash25_program(&fb->flash, addr, (const uint8_t *)buf, size);
+	return size;
+}
+
+static block_idx_t flash25_readBlocks(KBlock *b, block_idx_t idx, void *buf, block_idx_t count)
+{
+	Flash25Block *fb = FLASH25_BLOCK_CAST(b);
+
+	flash25_readData(&fb->flash, idx * FLASH25_SECTOR_SIZE, buf, count * FLASH25_SECTOR_SIZE);
+	return count;
+}
+
+/**
+ * Write \a count sectors: the whole range is erased ahead, with
+ * block erases where aligned, and then programmed page after page.
+ */
+static block_idx_t flash25_writeBlocks(KBlock *b, block_idx_t idx, const void *buf, block_idx_t count)
+{
+	Flash25Block *fb = FLASH25_BLOCK_CAST(b);
+	flash25Addr_t addr = idx * FLASH25_SECTOR_SIZE;
+
+	flash25_eraseRange(&fb->flash, addr, count * FLASH25_SECTOR_SIZE);
+	flash25_program(&fb->flash, addr, (const uint8_t *)buf, count * FLASH25_SECTOR_SIZE);
+	return count;
+}
+
+static int flash25_error(UNUSED_ARG(KBlock *, b))
+{
+	return 0;
+}
+
+static void flash25_clearerr(UNUSED_ARG(KBlock *, b))
+{
+}
+
+static int flash25_blockClose(KBlock *b)
+{
+	flash25_waitReady(&FLASH25_BLOCK_CAST(b)->flash);
+	return 0;
+}
+
+static const KBlockVTable flash25_unbuffered_vt =
+    {
+        .readDirect = flash25_readDirect,
+        .writeDirect = flash25_writeDirect,
+        .readBlocks = flash25_readBlocks,
+        .writeBlocks = flash25_writeBlocks,
+
+        .error = flash25_error,
+        .clearerr = flash25_clearerr,
+        .close = flash25_blockClose,
+};
+
+static const KBlockVTable flash25_buffered_vt =
+    {
+        .readDirect = flash25_readDirect,
+        .writeDirect = flash25_writeDirect,
+        .readBlocks = flash25_readBlocks,
+        .writeBlocks = flash25_writeBlocks,
+
+        .readBuf = kblock_swReadBuf,
+        .writeBuf = kblock_swWriteBuf,
+        .load = kblock_swLoad,
+        .store = kblock_swStore,
+
+        .error = flash25_error,
+        .clearerr = flash25_clearerr,
+        .close = flash25_blockClose,
+};
+
+/**
+ * Init the serial flash memory KBlock interface.
+ *
+ * Blocks are FLASH25_SECTOR_SIZE long. If \a buf is not NULL
+ * it must hold a whole sector and the KBlock is buffered, allowing
+ * partial block writes; otherwise only whole blocks can be written.
+ */
+void flash25_initBlock(Flash25Block *fb, KFile *ch, void *buf)
+{
+	memset(fb, 0, sizeof(*fb));
+	flash25_init(&fb->flash, ch);
+
+	DB(fb->blk.priv.type = KBT_FLASH25);
+	fb->blk.blk_size = FLASH25_SECTOR_SIZE;
+	fb->blk.blk_cnt = FLASH25_NUM_SECTOR;
+
+	if (buf)
+	{
+		fb->blk.priv.buf = buf;
+		fb->blk.priv.flags |= KB_BUFFERED | KB_PARTIAL_WRITE;
+		fb->blk.priv.vt = &flash25_buffered_vt;
+		fb->blk.priv.vt->load(&fb->blk, 0);
+	}
+	else
+		fb->blk.priv.vt = &flash25_unbuffered_vt;
 }
@@ -36,7 +36,7 @@
  * \author Daniele Basile <asterix@develer.com>
  *
  * $WIZ$ module_name = "flash25"
- * $WIZ$ module_depends = "kfile"
+ * $WIZ$ module_depends = "kfile", "kblock"
  * $WIZ$ module_configuration = "bertos/cfg/cfg_flash25.h"
  */
 
@@ -47,6 +47,7 @@
 #include <cfg/compiler.h>
 
 #include <io/kfile.h>
+#include <io/kblock.h>
 
 /**
  * Type definition for serial flash memory.
@@ -62,6 +63,7 @@ typedef struct Flash25
 {
 	KFile fd;       ///< File descriptor.
 	KFile *channel; ///< Dataflash comm channel (usually SPI).
+	bool busy;      ///< A program or erase cycle may be still running.
 } Flash25;
 
 /**
@@ -85,9 +87,10 @@ INLINE Flash25 *FLASH25_CAST(KFile *fd)
  * this drive. Every time we call flash25_init() function we check
  * if memory defined are right (see flash25.c form more detail).
  *
- * $WIZ$ flash25_list = "FLASH25_AT25F2048"
+ * $WIZ$ flash25_list = "FLASH25_AT25F2048", "FLASH25_W25Q32"
  */
 #define FLASH25_AT25F2048 1
+#define FLASH25_W25Q32    2
 
 #if CONFIG_FLASH25 == FLASH25_AT25F2048
 	#define FLASH25_MANUFACTURER_ID 0x1F    // ATMEL
@@ -97,11 +100,30 @@ INLINE Flash25 *FLASH25_CAST(KFile *fd)
 	#define FLASH25_SECTOR_SIZE     65536UL // Section size in byte
 	#define FLASH25_MEM_SIZE        FLASH25_NUM_SECTOR *FLASH25_SECTOR_SIZE
 	#define FLASH25_NUM_PAGE        FLASH25_MEM_SIZE / FLASH25_PAGE_SIZE
+	#define FLASH25_BLOCK_SIZE      0       // No bigger erase unit
+	#define FLASH25_HAS_FAST_READ   0       // Only the plain READ opcode
+	#define FLASH25_ID_OPCODE       0x15    // Read ID opcode
+	#define FLASH25_ERASE_OPCODE    0x52    // Sector erase opcode
+	#define FLASH25_CHIP_ERASE_OPCODE 0x62  // Chip erase opcode
+#elif CONFIG_FLASH25 == FLASH25_W25Q32
+	#define FLASH25_MANUFACTURER_ID 0xEF    // Winbond
+	#define FLASH25_DEVICE_ID       0x40    // JEDEC memory type
+	#define FLASH25_PAGE_SIZE       256     // Page size in byte
+	#define FLASH25_NUM_SECTOR      1024    // Number of section in serial memory
+	#define FLASH25_SECTOR_SIZE     4096UL  // Section size in byte
+	#define FLASH25_MEM_SIZE        FLASH25_NUM_SECTOR *FLASH25_SECTOR_SIZE
+	#define FLASH25_NUM_PAGE        FLASH25_MEM_SIZE / FLASH25_PAGE_SIZE
+	#define FLASH25_BLOCK_SIZE      65536UL // 64KB block erase
+	#define FLASH25_HAS_FAST_READ   1       // FAST_READ, dual and quad output reads
+	#define FLASH25_ID_OPCODE       0x9F    // JEDEC read ID opcode
+	#define FLASH25_ERASE_OPCODE    0x20    // 4KB sector erase opcode
+	#define FLASH25_CHIP_ERASE_OPCODE 0xC7  // Chip erase opcode
 #else
 	#error Nothing memory defined in CONFIG_FLASH25 are support.
 #endif
 
 #define RDY_BIT 0x1 // Statuts of write cycle
+#define QE_BIT  0x2 // Quad enable, in status register 2
 
 /**
  * Serial flash opcode commands.
@@ -112,20 +134,22 @@ typedef enum
 	FLASH25_WRDI = 0x4,           ///< Reset enable write latch
 	FLASH25_RDSR = 0x5,           ///< Read status register
 	FLASH25_WRSR = 0x1,           ///< Write status register
+	FLASH25_RDSR2 = 0x35,         ///< Read status register 2
 	FLASH25_READ = 0x3,           ///< Read data from memory array
+	FLASH25_FAST_READ = 0xB,      ///< Read with a dummy byte, at full clock
+	FLASH25_DUAL_READ = 0x3B,     ///< Fast read, data on two lines
+	FLASH25_QUAD_READ = 0x6B,     ///< Fast read, data on four lines
 	FLASH25_PROGRAM = 0x2,        ///< Program data into memory array
-	FLASH25_SECTORE_ERASE = 0x52, ///< Erase one sector in memory array
-	FLASH25_CHIP_ERASE = 0x62,    ///< Erase all sector in memory array
-	FLASH25_RDID = 0x15           ///< Read Manufacturer and product ID
+	FLASH25_SECTORE_ERASE = FLASH25_ERASE_OPCODE, ///< Erase one sector in memory array
+	FLASH25_BLOCK_ERASE = 0xD8,   ///< Erase a 64KB block in memory array
+	FLASH25_CHIP_ERASE = FLASH25_CHIP_ERASE_OPCODE, ///< Erase all sector in memory array
+	FLASH25_RDID = FLASH25_ID_OPCODE ///< Read Manufacturer and product ID
 } Flash25Opcode;
 
 /**
  * Serial flash sector memory address.
  */
-#if CONFIG_FLASH25 != FLASH25_AT25F2048
-	#error Nothing memory defined in CONFIG_FLASH25 are support.
-#endif
-
+#if CONFIG_FLASH25 == FLASH25_AT25F2048
 typedef enum
 {
 	FLASH25_SECT1 = 0x0,     ///< Sector 1 (0x0 -0xFFFF)
@@ -133,8 +157,39 @@ typedef enum
 	FLASH25_SECT3 = 0x20000, ///< Sector 3 (0x20000 -0x2FFFF)
 	FLASH25_SECT4 = 0x30000, ///< Sector 4 (0x30000 -0x3FFFF)
 } Flash25Sector;
+#else
+/** Any address inside the sector. */
+typedef flash25Addr_t Flash25Sector;
+#endif
+
+/**
+ * Flash25 KBlock context structure.
+ *
+ * A block is an erase sector of the memory: writing a block
+ * erases it and programs all its pages back to back.
+ */
+typedef struct Flash25Block
+{
+	KBlock blk;      ///< KBlock base class.
+	Flash25 flash;   ///< Memory and comm channel.
+} Flash25Block;
+
+/**
+ * ID for the flash25 KBlock.
+ */
+#define KBT_FLASH25 MAKE_ID('F', '2', '5', 'B')
+
+/**
+ * Convert + ASSERT from generic KBlock to Flash25Block.
+ */
+INLINE Flash25Block *FLASH25_BLOCK_CAST(KBlock *b)
+{
+	ASSERT(b->priv.type == KBT_FLASH25);
+	return (Flash25Block *)b;
+}
 
 void flash25_init(Flash25 *fd, KFile *ch);
+void flash25_initBlock(Flash25Block *fb, KFile *ch, void *buf);
 void flash25_chipErase(Flash25 *fd);
 void flash25_sectorErase(Flash25 *fd, Flash25Sector sector);
 bool flash25_test(KFile *channel);
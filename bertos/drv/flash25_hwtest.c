@@ -64,10 +64,8 @@ bool flash25_test(KFile *channel)
 
 	flash25_chipErase(&fd);
 
-	flash25_sectorErase(&fd, FLASH25_SECT1);
-	flash25_sectorErase(&fd, FLASH25_SECT2);
-	flash25_sectorErase(&fd, FLASH25_SECT3);
-	flash25_sectorErase(&fd, FLASH25_SECT4);
+	for (int i = 0; i < 4; i++)
+		flash25_sectorErase(&fd, (Flash25Sector)(i * FLASH25_SECTOR_SIZE));
 
 	/*
 	 * Launche a kfile test interface.
@@ -0,0 +1,478 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2011 Develer S.r.l. (http://www.develer.com/)
+ * -->
+ *
+ * \brief Serial flash driver test, run on a simulated W25Q32.
+ *
+ * The SPI channel is a KFile connected to a model of the memory, and
+ * the CS line of hw_spi.h is replaced by the model one, so the driver
+ * is built inside this file. The model decodes the commands used by
+ * the driver, keeps the memory in RAM and runs page programs, erases
+ * and status register writes when CS is released, like the real device.
+ * The driver is built for quad output reads, so the model receives the
+ * data phase of a read on four lines.
+ * Time is counted in SPI clocks: a cycle keeps the memory busy for its
+ * duration converted to clocks, a byte takes 8 clocks on one line and
+ * 2 on four lines.
+ * The model counts as violations any command but a status read sent
+ * while the memory is busy, programs, erases and status writes without
+ * WREN, programs turning a 0 bit into a 1 and quad reads with the QE
+ * bit clear.
+ *
+ * For hardware testing see drv/flash25_hwtest.c.
+ */
+
+#include "cfg/cfg_flash25.h"
+
+#include <drv/timer.h>
+
+#include <io/kfile.h>
+#include <io/kblock.h>
+
+#include <cfg/compiler.h>
+#include <cfg/macros.h>
+#include <cfg/test.h>
+#include <cfg/debug.h>
+
+#include <string.h>
+
+/* The model is a W25Q32, which has quad reads and block erase */
+#undef CONFIG_FLASH25
+#define CONFIG_FLASH25 FLASH25_W25Q32
+#undef CONFIG_FLASH25_READ_LINES
+#define CONFIG_FLASH25_READ_LINES 4
+
+static void flash_setCS(bool enable);
+static void flash_readLines(int lines, void *buf, size_t len);
+
+/* Stand-in for hw/hw_spi.h: CS and the quad data lines are the model ones */
+#define HW_SPI_H
+#define CS_ENABLE()   flash_setCS(true)
+#define CS_DISABLE()  flash_setCS(false)
+#define SPI_HW_INIT() CS_DISABLE()
+#define SPI_HW_READ_LINES(lines, buf, len) flash_readLines((lines), (buf), (len))
+
+#include <drv/flash25.c>
+
+#define FLASH_CLOCK 20000000L
+
+/* Page program, sector, block and chip erase, status write times, in microseconds */
+#define FLASH_TPP 700
+#define FLASH_TSE 45000
+#define FLASH_TBE 150000
+#define FLASH_TCE 10000000L
+#define FLASH_TW  10000
+
+#define BENCH_SIZE (512 * 1024L)
+#define RANDOM_OPS 500
+
+#define STATUS_BUSY BV(0)
+#define STATUS_WEL  BV(1)
+
+static struct Flash
+{
+	KFile fd;
+
+	uint8_t mem[FLASH25_MEM_SIZE];
+	uint8_t page[FLASH25_PAGE_SIZE];
+
+	/* Current command */
+	bool selected;
+	uint8_t opcode;
+	size_t n;
+	uint32_t addr;
+	size_t page_len;
+
+	uint8_t status[2];
+
+	bool wel;
+	/* Cycle running until SPI clock busy_until */
+	unsigned long busy_until;
+
+	/* SPI clocks since the start */
+	unsigned long bus;
+	unsigned long violations;
+	unsigned long programs;
+	unsigned long erases;
+	unsigned long status_writes;
+} flash;
+
+static uint8_t buf[BENCH_SIZE];
+static uint8_t shadow[16 * FLASH25_SECTOR_SIZE];
+static uint8_t cache[FLASH25_SECTOR_SIZE];
+
+static bool flash_busy(void)
+{
+	return flash.bus < flash.busy_until;
+}
+
+static void flash_start(unsigned long us)
+{
+	flash.busy_until = flash.bus + (unsigned long)((uint64_t)us * FLASH_CLOCK / 1000000L);
+	flash.wel = false;
+}
+
+static void flash_erase(uint32_t size, unsigned long us)
+{
+	uint32_t start = flash.addr & ~(size - 1);
+
+	memset(flash.mem + start, 0xFF, size);
+	flash_start(us);
+	flash.erases++;
+}
+
+/* Run the cycle of the current command when CS is released */
+static void flash_release(void)
+{
+	switch (flash.opcode)
+	{
+	case FLASH25_WREN:
+		if (flash.n == 1)
+			flash.wel = true;
+		return;
+	case FLASH25_PROGRAM:
+		if (flash.n < 4)
+			return;
+		break;
+	case FLASH25_SECTORE_ERASE:
+	case FLASH25_BLOCK_ERASE:
+		if (flash.n != 4)
+			return;
+		break;
+	case FLASH25_CHIP_ERASE:
+		if (flash.n != 1)
+			return;
+		break;
+	case FLASH25_WRSR:
+		if (flash.n != 2 && flash.n != 3)
+			return;
+		break;
+	default:
+		return;
+	}
+
+	if (!flash.wel)
+	{
+		flash.violations++;
+		return;
+	}
+
+	if (flash.opcode == FLASH25_PROGRAM)
+	{
+		/* Program the page buffer, the address wraps in the page */
+		uint32_t base = flash.addr & ~(FLASH25_PAGE_SIZE - 1);
+
+		for (size_t i = 0; i < flash.page_len; i++)
+		{
+			uint32_t pos = base + (flash.addr + i) % FLASH25_PAGE_SIZE;
+
+			if (flash.page[i] & ~flash.mem[pos])
+				flash.violations++;
+			flash.mem[pos] &= flash.page[i];
+		}
+		flash_start(FLASH_TPP);
+		flash.programs++;
+	}
+	else if (flash.opcode == FLASH25_SECTORE_ERASE)
+		flash_erase(FLASH25_SECTOR_SIZE, FLASH_TSE);
+	else if (flash.opcode == FLASH25_BLOCK_ERASE)
+		flash_erase(FLASH25_BLOCK_SIZE, FLASH_TBE);
+	else if (flash.opcode == FLASH25_CHIP_ERASE)
+	{
+		flash.addr = 0;
+		flash_erase(sizeof(flash.mem), FLASH_TCE);
+	}
+	else
+	{
+		/* Status register 2 is written only by the two byte form */
+		flash.status[0] = flash.page[0] & ~(STATUS_BUSY | STATUS_WEL);
+		if (flash.n == 3)
+			flash.status[1] = flash.page[1];
+		flash_start(FLASH_TW);
+		flash.status_writes++;
+	}
+}
+
+static void flash_setCS(bool enable)
+{
+	if (flash.selected && !enable)
+		flash_release();
+
+	flash.selected = enable;
+	flash.n = 0;
+}
+
+/* Clock one byte on the bus: \a in from the driver, return the byte from the memory */
+static uint8_t flash_xfer(uint8_t in)
+{
+	uint8_t out = 0xFF;
+
+	flash.bus += 8;
+	if (!flash.selected)
+		return out;
+
+	if (flash.n == 0)
+	{
+		flash.opcode = in;
+		flash.addr = 0;
+		flash.page_len = 0;
+		if (flash_busy() && in != FLASH25_RDSR)
+			flash.violations++;
+	}
+	else if (flash.opcode == FLASH25_RDSR)
+		out = flash.status[0] | (flash_busy() ? STATUS_BUSY : 0) | (flash.wel ? STATUS_WEL : 0);
+	else if (flash.opcode == FLASH25_RDSR2)
+		out = flash.status[1];
+	else if (flash.opcode == FLASH25_WRSR)
+	{
+		if (flash.n <= 2)
+			flash.page[flash.n - 1] = in;
+	}
+	else if (flash.opcode == FLASH25_RDID)
+	{
+		/* Manufacturer, memory type, capacity */
+		static const uint8_t id[] = { FLASH25_MANUFACTURER_ID, FLASH25_DEVICE_ID, 0x16 };
+		out = flash.n <= sizeof(id) ? id[flash.n - 1] : 0xFF;
+	}
+	else if (flash.n < 4)
+		flash.addr = ((flash.addr << 8) | in) & (sizeof(flash.mem) - 1);
+	else
+	{
+		switch (flash.opcode)
+		{
+		case FLASH25_QUAD_READ:
+			if (!(flash.status[1] & QE_BIT))
+				flash.violations++;
+			/* fall through */
+		case FLASH25_FAST_READ:
+			/* Skip the dummy byte */
+			if (flash.n == 4)
+				break;
+			/* fall through */
+		case FLASH25_READ:
+			out = flash.mem[flash.addr];
+			flash.addr = (flash.addr + 1) % sizeof(flash.mem);
+			break;
+		case FLASH25_PROGRAM:
+			/* The page buffer keeps the last bytes sent */
+			if (flash.page_len == FLASH25_PAGE_SIZE)
+				flash.violations++;
+			else
+				flash.page[flash.page_len++] = in;
+			break;
+		default:
+			/* Not used by the driver */
+			ASSERT(0);
+			break;
+		}
+	}
+	flash.n++;
+	return out;
+}
+
+static size_t flash_read(struct KFile *fd, void *_buf, size_t size)
+{
+	uint8_t *p = (uint8_t *)_buf;
+	(void)fd;
+
+	for (size_t i = 0; i < size; i++)
+		p[i] = flash_xfer(0);
+	return size;
+}
+
+static size_t flash_write(struct KFile *fd, const void *_buf, size_t size)
+{
+	const uint8_t *p = (const uint8_t *)_buf;
+	(void)fd;
+
+	for (size_t i = 0; i < size; i++)
+		flash_xfer(p[i]);
+	return size;
+}
+
+/* Data phase of a read on \a lines lines: a byte takes 8 / lines clocks */
+static void flash_readLines(int lines, void *buf, size_t len)
+{
+	ASSERT(flash.opcode == FLASH25_QUAD_READ && lines == 4);
+	flash_read(&flash.fd, buf, len);
+	flash.bus -= len * (8 - 8 / lines);
+}
+
+static uint32_t seed = 1;
+
+static unsigned rnd(unsigned n)
+{
+	seed = seed * 1103515245UL + 12345;
+	return (seed >> 16) % n;
+}
+
+static void fill(uint8_t *p, size_t len, uint8_t salt)
+{
+	for (size_t i = 0; i < len; i++)
+		p[i] = (uint8_t)(i * 7 + (i >> 8) + salt);
+}
+
+/* Print and return the throughput in KB/s of \a bytes transferred from SPI clock \a start */
+static unsigned long flash25_testSpeed(const char *name, unsigned long bytes, unsigned long start)
+{
+	unsigned long kbs = (unsigned long)((uint64_t)bytes * FLASH_CLOCK / (flash.bus - start) / 1024);
+
+	kprintf("%-24s %5lu KB/s (%lu clocks)\n", name, kbs, flash.bus - start);
+	return kbs;
+}
+
+int flash25_testSetup(void)
+{
+	kdbg_init();
+	timer_init();
+
+	kfile_init(&flash.fd);
+	flash.fd.read = flash_read;
+	flash.fd.write = flash_write;
+
+	/* Start with data everywhere: writes must erase first */
+	fill(flash.mem, sizeof(flash.mem), 0x5A);
+	return 0;
+}
+
+int flash25_testRun(void)
+{
+	static Flash25Block fb;
+	static Flash25 f;
+	unsigned long start;
+
+	/* The QE bit is set once, before the first quad read */
+	flash25_init(&f, &flash.fd);
+	ASSERT(flash.status[1] & QE_BIT);
+	ASSERT(flash.status_writes == 1);
+
+	/* KFile: page programs crossing page boundaries, read back with quad reads */
+	flash25_sectorErase(&f, 3 * FLASH25_SECTOR_SIZE);
+	fill(buf, 1000, 1);
+	kfile_seek(&f.fd, 3 * FLASH25_SECTOR_SIZE + 100, KSM_SEEK_SET);
+	ASSERT(kfile_write(&f.fd, buf, 1000) == 1000);
+	ASSERT(flash.programs == 5);
+	ASSERT(!memcmp(flash.mem + 3 * FLASH25_SECTOR_SIZE + 100, buf, 1000));
+
+	memset(buf, 0, 1000);
+	kfile_seek(&f.fd, 3 * FLASH25_SECTOR_SIZE + 100, KSM_SEEK_SET);
+	ASSERT(kfile_read(&f.fd, buf, 1000) == 1000);
+	ASSERT(!memcmp(flash.mem + 3 * FLASH25_SECTOR_SIZE + 100, buf, 1000));
+	ASSERT(kfile_close(&f.fd) == 0);
+
+	/* Unbuffered KBlock: one sector at a time, then a whole range */
+	flash25_initBlock(&fb, &flash.fd, NULL);
+	ASSERT(flash.status_writes == 1);
+	ASSERT(fb.blk.blk_size == FLASH25_SECTOR_SIZE);
+	ASSERT(fb.blk.blk_cnt == FLASH25_NUM_SECTOR);
+
+	fill(buf, BENCH_SIZE, 2);
+	start = flash.bus;
+	for (block_idx_t b = 0; b < 16; b++)
+		ASSERT(kblock_write(&fb.blk, 16 + b, buf + b * FLASH25_SECTOR_SIZE, 0, FLASH25_SECTOR_SIZE) == FLASH25_SECTOR_SIZE);
+	ASSERT(kblock_close(&fb.blk) == 0);
+	unsigned long sector = flash25_testSpeed("sector writes", 16 * FLASH25_SECTOR_SIZE, start);
+	ASSERT(!memcmp(flash.mem + 16 * FLASH25_SECTOR_SIZE, buf, 16 * FLASH25_SECTOR_SIZE));
+
+	/* Aligned to a 64KB block: block erases only */
+	unsigned long erases = flash.erases;
+	fill(buf, BENCH_SIZE, 3);
+	start = flash.bus;
+	ASSERT(kblock_writeBlocks(&fb.blk, 128, buf, BENCH_SIZE / FLASH25_SECTOR_SIZE) == BENCH_SIZE / FLASH25_SECTOR_SIZE);
+	ASSERT(kblock_close(&fb.blk) == 0);
+	unsigned long range = flash25_testSpeed("writeBlocks 512KB", BENCH_SIZE, start);
+	ASSERT(flash.erases - erases == BENCH_SIZE / FLASH25_BLOCK_SIZE);
+	ASSERT(!memcmp(flash.mem + 128 * FLASH25_SECTOR_SIZE, buf, BENCH_SIZE));
+
+	memset(buf, 0, BENCH_SIZE);
+	start = flash.bus;
+	ASSERT(kblock_readBlocks(&fb.blk, 128, buf, BENCH_SIZE / FLASH25_SECTOR_SIZE) == BENCH_SIZE / FLASH25_SECTOR_SIZE);
+	unsigned long rd = flash25_testSpeed("readBlocks 512KB", BENCH_SIZE, start);
+	ASSERT(!memcmp(flash.mem + 128 * FLASH25_SECTOR_SIZE, buf, BENCH_SIZE));
+
+	/* Blank sectors are not erased, blank pages are not programmed */
+	erases = flash.erases;
+	unsigned long programs = flash.programs;
+	memset(buf, 0xFF, FLASH25_SECTOR_SIZE);
+	ASSERT(kblock_write(&fb.blk, 128, buf, 0, FLASH25_SECTOR_SIZE) == FLASH25_SECTOR_SIZE);
+	ASSERT(kblock_write(&fb.blk, 128, buf, 0, FLASH25_SECTOR_SIZE) == FLASH25_SECTOR_SIZE);
+	ASSERT(flash.erases - erases == 1);
+	ASSERT(flash.programs == programs);
+	ASSERT(kblock_close(&fb.blk) == 0);
+
+	ASSERT(range > sector);
+	ASSERT(rd > range);
+
+	/* Buffered KBlock: random partial writes */
+	flash25_initBlock(&fb, &flash.fd, cache);
+	memcpy(shadow, flash.mem, sizeof(shadow));
+	for (int op = 0; op < RANDOM_OPS; op++)
+	{
+		block_idx_t b = rnd(sizeof(shadow) / FLASH25_SECTOR_SIZE);
+		size_t offset = rnd(FLASH25_SECTOR_SIZE);
+		size_t len = rnd(FLASH25_SECTOR_SIZE - offset) + 1;
+		uint8_t *p = shadow + b * FLASH25_SECTOR_SIZE + offset;
+
+		if (rnd(2))
+		{
+			for (size_t i = 0; i < len; i++)
+				buf[i] = p[i] = rnd(256);
+			ASSERT(kblock_write(&fb.blk, b, buf, offset, len) == len);
+		}
+		else
+		{
+			ASSERT(kblock_read(&fb.blk, b, buf, offset, len) == len);
+			ASSERT(!memcmp(buf, p, len));
+		}
+	}
+	ASSERT(kblock_flush(&fb.blk) == 0);
+	ASSERT(kblock_close(&fb.blk) == 0);
+	ASSERT(!memcmp(flash.mem, shadow, sizeof(shadow)));
+
+	/* Chip erase, with the opcode of the W25Q32 */
+	flash25_init(&f, &flash.fd);
+	erases = flash.erases;
+	flash25_chipErase(&f);
+	ASSERT(flash.erases - erases == 1);
+	ASSERT(!flash_busy());
+	for (size_t i = 0; i < sizeof(flash.mem); i++)
+		ASSERT(flash.mem[i] == 0xFF);
+	ASSERT(kfile_close(&f.fd) == 0);
+
+	ASSERT(flash.violations == 0);
+	return 0;
+}
+
+int flash25_testTearDown(void)
+{
+	return 0;
+}
+
+TEST_MAIN(flash25);
@@ -100,6 +100,7 @@
 #include <cfg/compiler.h>
 #include <cfg/macros.h>
 #include <cfg/debug.h>
+#include <cfg/os.h>
 
 #include <cpu/attr.h>
 
@@ -271,7 +272,17 @@ typedef struct I2c
 	const struct I2cVT *vt;
 } I2c;
 
-#include CPU_HEADER(i2c)
+#if OS_HOSTED
+	/* No i2c hardware on the host: contexts are set up by bus models, e.g. in unit tests */
+enum
+{
+	I2C0,
+
+	I2C_CNT /**< Number of i2c ports */
+};
+#else
+	#include CPU_HEADER(i2c)
+#endif
 
 /*
  * Low level i2c  init implementation prototype.
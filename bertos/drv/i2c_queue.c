@@ -0,0 +1,201 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2011 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \brief Asynchronous I2C transactions (implementation).
+ */
+
+#include "i2c_queue.h"
+
+#include "cfg/cfg_i2c.h"
+#include "cfg/cfg_signal.h"
+
+#define LOG_LEVEL  I2C_LOG_LEVEL
+#define LOG_FORMAT I2C_LOG_FORMAT
+#include <cfg/log.h>
+#include <cfg/debug.h>
+
+#if CONFIG_KERN
+	#if !CONFIG_KERN_SIGNALS || !CONFIG_KERN_SEMAPHORES
+		#error The i2c queue needs kernel signals and semaphores
+	#endif
+	#include <kern/signal.h>
+
+	/* Signal sent to the owner when transactions are queued */
+	#define SIG_I2C_QUEUE SIG_USER0
+
+STATIC_ASSERT(CONFIG_I2C_QUEUE_STACK >= KERN_MINSTACKSIZE);
+#endif
+
+/*
+ * Run the transaction \a x on \a i2c.
+ *
+ * Each run of segments with the same direction is a single transfer,
+ * started with a (repeated) start. Empty segments do not split a run
+ * and a run without data is not sent at all: the stop goes with the
+ * last run carrying data.
+ */
+static void i2c_xferRun(I2c *i2c, I2cXfer *x)
+{
+	I2cDevice *dev = x->dev;
+	ticks_t start = timer_clock();
+	uint32_t bytes = 0;
+	int errors = 0;
+	size_t i = 0;
+
+	/* Skip leading empty segments, a run starts with data */
+	while (i < x->seg_cnt && !x->seg[i].len)
+		i++;
+
+	while (i < x->seg_cnt && !errors)
+	{
+		bool read = x->seg[i].read;
+		size_t size = 0;
+		size_t end;
+
+		for (end = i; end < x->seg_cnt && (!x->seg[end].len || x->seg[end].read == read); end++)
+			size += x->seg[end].len;
+		ASSERT(size);
+
+		int flags = (end == x->seg_cnt) ? I2C_STOP : I2C_NOSTOP;
+		if (read)
+			i2c_start_r(i2c, dev->addr, size, flags);
+		else
+			i2c_start_w(i2c, dev->addr, size, flags);
+
+		for (; i < end; i++)
+		{
+			if (!x->seg[i].len)
+				continue;
+			if (read)
+				i2c_read(i2c, x->seg[i].buf, x->seg[i].len);
+			else
+				i2c_write(i2c, x->seg[i].buf, x->seg[i].len);
+		}
+
+		/* i2c_start() clears the errors: check before the next transfer */
+		errors = i2c_error(i2c);
+		bytes += size;
+	}
+
+	ticks_t now = timer_clock();
+	dev->bus_time += now - start;
+	dev->max_wait = MAX(dev->max_wait, now - x->submit_time);
+	dev->xfers++;
+	if (errors)
+	{
+		LOG_ERR("Transaction with %#x failed: %#x\n", dev->addr, errors);
+		dev->errors++;
+	}
+	else
+		dev->bytes += bytes;
+
+	x->errors = errors;
+	event_do(&x->done);
+}
+
+#if CONFIG_KERN
+
+static NORETURN void i2c_busProc(void)
+{
+	I2cBus *bus = (I2cBus *)proc_currentUserData();
+
+	while (1)
+	{
+		Msg *msg;
+
+		sig_wait(SIG_I2C_QUEUE);
+
+		/* Run everything queued meanwhile back to back, in a single lock */
+		sem_obtain(&bus->sem);
+		while ((msg = msg_get(&bus->port)))
+			i2c_xferRun(bus->i2c, containerof(msg, I2cXfer, msg));
+		sem_release(&bus->sem);
+	}
+}
+
+/**
+ * Queue the transaction \a x on \a bus and return immediately.
+ *
+ * \a x and its segments must stay valid until its completion event.
+ */
+void i2c_submit(I2cBus *bus, I2cXfer *x)
+{
+	x->submit_time = timer_clock();
+	msg_put(&bus->port, &x->msg);
+}
+
+/**
+ * Initialize \a bus on the i2c context \a i2c and start its owner process.
+ */
+void i2c_busInit(I2cBus *bus, I2c *i2c)
+{
+	bus->i2c = i2c;
+	sem_init(&bus->sem);
+
+	/* The port event needs the owner, which must not run before the port is ready */
+	proc_forbid();
+	bus->owner = proc_new(i2c_busProc, bus, sizeof(bus->stack), bus->stack);
+	ASSERT(bus->owner);
+	msg_initPort(&bus->port, event_createSignal(bus->owner, SIG_I2C_QUEUE));
+	proc_permit();
+}
+
+#else /* !CONFIG_KERN */
+
+void i2c_submit(I2cBus *bus, I2cXfer *x)
+{
+	x->submit_time = timer_clock();
+	i2c_xferRun(bus->i2c, x);
+}
+
+void i2c_busInit(I2cBus *bus, I2c *i2c)
+{
+	bus->i2c = i2c;
+}
+
+#endif /* CONFIG_KERN */
+
+/**
+ * Transfer \a seg_cnt segments \a seg with \a dev and wait the result.
+ *
+ * \return 0 on success, the i2c errors otherwise.
+ */
+int i2c_transfer(I2cBus *bus, I2cDevice *dev, const I2cSegment *seg, size_t seg_cnt)
+{
+	I2cXfer x;
+
+	i2c_xferInit(&x, dev, seg, seg_cnt, event_createGeneric());
+	i2c_submit(bus, &x);
+	event_wait(&x.done);
+
+	return x.errors;
+}
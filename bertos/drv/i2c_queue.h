@@ -0,0 +1,172 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2011 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \defgroup i2c_queue I2C transaction queue
+ * \ingroup i2c_driver
+ * \{
+ * \brief Asynchronous I2C transactions, serviced by a bus owner process.
+ *
+ * A transaction is a list of write and read segments addressed to one
+ * device. Consecutive segments with the same direction are sent in the
+ * same transfer, a change of direction generates a repeated start and
+ * the last segment ends with a stop. Empty segments are skipped, so a
+ * transaction without data does not use the bus at all.
+ *
+ * Transactions are submitted to an I2cBus and the bus owner process
+ * runs them back to back, triggering the completion event of each one.
+ * While running a batch the owner holds the bus semaphore, so code still
+ * using the synchronous i2c API on the same bus can share it by taking
+ * I2cBus::sem.
+ * Without the kernel, i2c_submit() runs the transaction immediately.
+ *
+ * Usage pattern:
+ * \code
+ * static I2cBus bus;
+ * static I2cDevice sensor;
+ * uint8_t reg = 0, data[2];
+ * I2cSegment seg[] = { { &reg, 1, false }, { data, 2, true } };
+ *
+ * i2c_busInit(&bus, &i2c);
+ * i2c_devInit(&sensor, 0x90);
+ * if (i2c_transfer(&bus, &sensor, seg, countof(seg)))
+ *	   // handle errors
+ * \endcode
+ *
+ * $WIZ$ module_name = "i2c_queue"
+ * $WIZ$ module_depends = "i2c", "timer", "event"
+ * $WIZ$ module_configuration = "bertos/cfg/cfg_i2c.h"
+ */
+
+#ifndef DRV_I2C_QUEUE_H
+#define DRV_I2C_QUEUE_H
+
+#include "cfg/cfg_i2c.h"
+#include "cfg/cfg_proc.h"
+#include "cfg/cfg_sem.h"
+
+#include <cfg/compiler.h>
+
+#include <drv/i2c.h>
+#include <drv/timer.h>
+
+#include <mware/event.h>
+
+#include <string.h> /* memset() */
+
+#if CONFIG_KERN
+	#include <kern/msg.h>
+	#include <kern/proc.h>
+	#include <kern/sem.h>
+#endif
+
+/**
+ * One segment of a transaction: \a len bytes written from, or read into, \a buf.
+ */
+typedef struct I2cSegment
+{
+	void *buf;   ///< Data to write or buffer to fill.
+	size_t len;  ///< Segment length, can be 0.
+	bool read;   ///< true for a read segment.
+} I2cSegment;
+
+/**
+ * An I2C device and its transfer statistics.
+ */
+typedef struct I2cDevice
+{
+	uint16_t addr;      ///< Slave address.
+	uint32_t xfers;     ///< Transactions done.
+	uint32_t errors;    ///< Transactions failed.
+	uint32_t bytes;     ///< Bytes transferred, address bytes excluded.
+	ticks_t bus_time;   ///< Time spent on the bus.
+	ticks_t max_wait;   ///< Longest time from submission to completion.
+} I2cDevice;
+
+/**
+ * A queued transaction.
+ */
+typedef struct I2cXfer
+{
+#if CONFIG_KERN
+	Msg msg;               ///< Link into the bus queue.
+#endif
+	I2cDevice *dev;        ///< Target device.
+	const I2cSegment *seg; ///< Segments to transfer.
+	size_t seg_cnt;        ///< Number of segments.
+	Event done;            ///< Triggered when the transaction is over.
+	int errors;            ///< Result, as returned by i2c_error().
+	ticks_t submit_time;   ///< When the transaction was queued.
+} I2cXfer;
+
+/**
+ * An I2C bus and its owner process.
+ */
+typedef struct I2cBus
+{
+	I2c *i2c;             ///< Context of the bus.
+#if CONFIG_KERN
+	MsgPort port;         ///< Queued transactions.
+	Semaphore sem;        ///< Held by the owner while running transactions.
+	Process *owner;       ///< Bus owner process.
+	cpu_stack_t stack[(CONFIG_I2C_QUEUE_STACK + sizeof(cpu_stack_t) - 1) / sizeof(cpu_stack_t)]; ///< Owner stack.
+#endif
+} I2cBus;
+
+/**
+ * Initialize \a dev, at slave address \a addr, clearing its statistics.
+ */
+INLINE void i2c_devInit(I2cDevice *dev, uint16_t addr)
+{
+	memset(dev, 0, sizeof(*dev));
+	dev->addr = addr;
+}
+
+/**
+ * Prepare \a x to transfer \a seg_cnt segments \a seg with \a dev.
+ * \a done is triggered when the transaction is over.
+ */
+INLINE void i2c_xferInit(I2cXfer *x, I2cDevice *dev, const I2cSegment *seg, size_t seg_cnt, Event done)
+{
+	x->dev = dev;
+	x->seg = seg;
+	x->seg_cnt = seg_cnt;
+	x->done = done;
+	x->errors = 0;
+}
+
+void i2c_busInit(I2cBus *bus, I2c *i2c);
+void i2c_submit(I2cBus *bus, I2cXfer *x);
+int i2c_transfer(I2cBus *bus, I2cDevice *dev, const I2cSegment *seg, size_t seg_cnt);
+
+/** \} */ //defgroup i2c_queue
+
+#endif /* DRV_I2C_QUEUE_H */
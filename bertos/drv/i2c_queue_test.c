@@ -0,0 +1,299 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2011 Develer S.r.l. (http://www.develer.com/)
+ * -->
+ *
+ * \brief I2C transaction queue test, run on a simulated 24xx256 eeprom.
+ *
+ * The i2c context is driven by a model of the bus with a 24xx256 on it,
+ * behaving like the bitbang driver: a stop is generated after the last
+ * byte of a transfer started with I2C_STOP, or on errors, and the start
+ * is retried while the eeprom is busy with its write cycle, up to
+ * CONFIG_I2C_START_TIMEOUT. The model counts starts and stops and checks
+ * that every transaction leaves the bus released.
+ */
+
+#include "cfg/cfg_i2c.h"
+
+#include <drv/i2c.h>
+#include <drv/i2c_queue.h>
+#include <drv/timer.h>
+
+#include <cfg/compiler.h>
+#include <cfg/macros.h>
+#include <cfg/test.h>
+#include <cfg/debug.h>
+
+#include <string.h>
+
+#define EEPROM_ADDR   0xA0
+#define EEPROM_SIZE   0x8000
+#define EEPROM_PAGE   64
+/* Write cycle time, in ms */
+#define EEPROM_TWR    5
+
+static struct Eeprom
+{
+	uint8_t mem[EEPROM_SIZE];
+	uint8_t page[EEPROM_PAGE];
+	uint16_t ptr;
+	size_t addr_bytes;
+	size_t page_len;
+	bool cycle;
+	ticks_t cycle_start;
+
+	/* Bus state and counters */
+	bool selected;
+	bool busy;
+	unsigned starts;
+	unsigned restarts;
+	unsigned stops;
+} eeprom;
+
+static I2c i2c;
+static I2cBus bus;
+static I2cDevice dev, ghost;
+
+static void bus_stop(void)
+{
+	ASSERT(eeprom.busy);
+	eeprom.busy = false;
+	eeprom.stops++;
+
+	/* A write with data starts the write cycle, the page buffer wraps */
+	if (eeprom.selected && eeprom.page_len)
+	{
+		uint16_t base = eeprom.ptr & ~(EEPROM_PAGE - 1);
+		for (size_t i = 0; i < eeprom.page_len; i++)
+			eeprom.mem[base + ((eeprom.ptr + i) & (EEPROM_PAGE - 1))] = eeprom.page[i];
+		eeprom.ptr = base + ((eeprom.ptr + eeprom.page_len) & (EEPROM_PAGE - 1));
+		eeprom.cycle = true;
+		eeprom.cycle_start = timer_clock();
+	}
+	eeprom.selected = false;
+	eeprom.page_len = 0;
+}
+
+static void bus_start(I2c *i2c, uint16_t slave_addr)
+{
+	/* Every transfer carries data */
+	ASSERT(i2c->xfer_size);
+
+	if (eeprom.busy)
+		eeprom.restarts++;
+	else
+		eeprom.starts++;
+	eeprom.busy = true;
+	eeprom.selected = false;
+
+	/* The eeprom does not acknowledge its address during the write cycle */
+	ticks_t start = timer_clock();
+	while (1)
+	{
+		if (eeprom.cycle && timer_clock() - eeprom.cycle_start >= ms_to_ticks(EEPROM_TWR))
+			eeprom.cycle = false;
+
+		if ((slave_addr & ~I2C_READBIT) == EEPROM_ADDR && !eeprom.cycle)
+		{
+			eeprom.selected = true;
+			eeprom.addr_bytes = 0;
+			eeprom.page_len = 0;
+			return;
+		}
+		if (timer_clock() - start > ms_to_ticks(CONFIG_I2C_START_TIMEOUT))
+			break;
+		cpu_relax();
+	}
+
+	i2c->errors |= I2C_START_TIMEOUT;
+	bus_stop();
+}
+
+static void bus_putc(I2c *i2c, uint8_t data)
+{
+	ASSERT(eeprom.busy && eeprom.selected);
+	ASSERT(!(i2c->flags & I2C_START_R));
+
+	if (eeprom.addr_bytes < 2)
+	{
+		eeprom.ptr = (eeprom.ptr << 8 | data) & (EEPROM_SIZE - 1);
+		eeprom.addr_bytes++;
+	}
+	else
+	{
+		ASSERT(eeprom.page_len < EEPROM_PAGE);
+		eeprom.page[eeprom.page_len++] = data;
+	}
+
+	if (i2c->xfer_size == 1 && (i2c->flags & I2C_STOP))
+		bus_stop();
+}
+
+static uint8_t bus_getc(I2c *i2c)
+{
+	ASSERT(eeprom.busy && eeprom.selected);
+	ASSERT(i2c->flags & I2C_START_R);
+
+	uint8_t data = eeprom.mem[eeprom.ptr];
+	eeprom.ptr = (eeprom.ptr + 1) & (EEPROM_SIZE - 1);
+
+	if (i2c->xfer_size == 1 && (i2c->flags & I2C_STOP))
+		bus_stop();
+	return data;
+}
+
+static void bus_write(I2c *i2c, const void *_buf, size_t count)
+{
+	const uint8_t *buf = (const uint8_t *)_buf;
+
+	while (count--)
+		i2c_putc(i2c, *buf++);
+}
+
+static void bus_read(I2c *i2c, void *_buf, size_t count)
+{
+	uint8_t *buf = (uint8_t *)_buf;
+
+	while (count--)
+		*buf++ = i2c_getc(i2c);
+}
+
+static const I2cVT bus_vt =
+{
+	.start = bus_start,
+	.getc = bus_getc,
+	.putc = bus_putc,
+	.write = bus_write,
+	.read = bus_read,
+};
+
+static void checkBus(unsigned starts, unsigned restarts)
+{
+	ASSERT(!eeprom.busy);
+	ASSERT(eeprom.starts == starts);
+	ASSERT(eeprom.restarts == restarts);
+	ASSERT(eeprom.stops == starts);
+}
+
+int i2c_queue_testSetup(void)
+{
+	kdbg_init();
+	timer_init();
+
+	memset(&i2c, 0, sizeof(i2c));
+	i2c.vt = &bus_vt;
+	for (size_t i = 0; i < sizeof(eeprom.mem); i++)
+		eeprom.mem[i] = i * 7;
+
+	i2c_busInit(&bus, &i2c);
+	i2c_devInit(&dev, EEPROM_ADDR);
+	i2c_devInit(&ghost, EEPROM_ADDR + 2);
+	return 0;
+}
+
+int i2c_queue_testRun(void)
+{
+	uint8_t addr[2] = { 0x12, 0x30 };
+	uint8_t data[EEPROM_PAGE], buf[EEPROM_PAGE + 8];
+
+	for (size_t i = 0; i < sizeof(data); i++)
+		data[i] = 0xA5 ^ i;
+
+	/* Page write: address and data in the same transfer */
+	I2cSegment wr[] = { { addr, 2, false }, { data, EEPROM_PAGE, false } };
+	ASSERT(i2c_transfer(&bus, &dev, wr, countof(wr)) == 0);
+	checkBus(1, 0);
+	ASSERT(!memcmp(eeprom.mem + 0x1200, data + 0x10, EEPROM_PAGE - 0x10));
+	ASSERT(!memcmp(eeprom.mem + 0x1230, data, 0x10));
+
+	/*
+	 * Random read split in two read segments, with empty segments
+	 * at the start, in the middle and after the last read: the address
+	 * waits for the write cycle, then a repeated start and one stop.
+	 */
+	addr[0] = 0x12;
+	addr[1] = 0x00;
+	memset(buf, 0, sizeof(buf));
+	I2cSegment rd[] =
+	{
+		{ NULL, 0, true },
+		{ addr, 2, false },
+		{ NULL, 0, true },
+		{ NULL, 0, false },
+		{ buf, 16, true },
+		{ NULL, 0, false },
+		{ buf + 16, EEPROM_PAGE - 16, true },
+		{ NULL, 0, false },
+	};
+	ASSERT(i2c_transfer(&bus, &dev, rd, countof(rd)) == 0);
+	checkBus(2, 1);
+	ASSERT(!memcmp(buf, data + 0x10, EEPROM_PAGE - 0x10));
+	ASSERT(!memcmp(buf + EEPROM_PAGE - 0x10, data, 0x10));
+	ASSERT(eeprom.ptr == 0x1240);
+
+	/* Current address read, followed by an empty write segment */
+	I2cSegment cur[] = { { buf, 8, true }, { NULL, 0, false } };
+	ASSERT(i2c_transfer(&bus, &dev, cur, countof(cur)) == 0);
+	checkBus(3, 1);
+	ASSERT(!memcmp(buf, eeprom.mem + 0x1240, 8));
+
+	/* Nothing to transfer: the bus is not touched */
+	I2cSegment none[] = { { NULL, 0, false }, { NULL, 0, true } };
+	ASSERT(i2c_transfer(&bus, &dev, none, countof(none)) == 0);
+	ASSERT(i2c_transfer(&bus, &dev, none, 0) == 0);
+	checkBus(3, 1);
+
+	/* A device not on the bus times out on the start */
+	ASSERT(i2c_transfer(&bus, &ghost, rd, countof(rd)) == I2C_START_TIMEOUT);
+	checkBus(4, 1);
+
+	/* Per device statistics */
+	kprintf("eeprom: %lu xfers, %lu errors, %lu bytes, bus %lu ticks, max wait %lu ticks\n",
+		(unsigned long)dev.xfers, (unsigned long)dev.errors, (unsigned long)dev.bytes,
+		(unsigned long)dev.bus_time, (unsigned long)dev.max_wait);
+	ASSERT(dev.xfers == 5);
+	ASSERT(dev.errors == 0);
+	ASSERT(dev.bytes == 2 + EEPROM_PAGE + 2 + EEPROM_PAGE + 8);
+	/* The random read waited for the write cycle */
+	ASSERT(dev.bus_time >= ms_to_ticks(EEPROM_TWR) - 1);
+	ASSERT(dev.max_wait >= ms_to_ticks(EEPROM_TWR) - 1);
+
+	ASSERT(ghost.xfers == 1);
+	ASSERT(ghost.errors == 1);
+	ASSERT(ghost.bytes == 0);
+	ASSERT(ghost.bus_time >= ms_to_ticks(CONFIG_I2C_START_TIMEOUT));
+	return 0;
+}
+
+int i2c_queue_testTearDown(void)
+{
+	return 0;
+}
+
+TEST_MAIN(i2c_queue);
@@ -76,7 +76,14 @@
 // Himax HX8347 chip id
 #define HX8347_ID_HIMAX 0x47
 
-static uint16_t lcd_row[LCD_WIDTH];
+/*
+ * Row buffers: when the bus supports DMA a row is converted while
+ * the previous one is being transferred.
+ */
+static uint16_t lcd_row[2][LCD_WIDTH];
+
+/* Colors of clear and set pixels of a Bitmap */
+static const uint16_t lcd_palette[2] = {0xFFFF, 0x0000};
 
 struct lcd_hx8347_reg
 {
@@ -173,12 +180,29 @@ static uint16_t regRead(uint8_t reg)
 
 /*
  * Write data in a buffer to the LCD controller.
+ *
+ * With DMA the transfer may still be running on return:
+ * call bufferFlush() before sending commands.
  */
 static void bufferWrite(const uint16_t *buf, uint16_t size)
 {
+#ifdef HX8347_HW_WRITE_BUF
+	hx8347_writeBuf(buf, size);
+#else
 	uint16_t i;
 	for (i = 0; i < size; ++i)
 		hx8347_write(buf[i]);
+#endif
+}
+
+/*
+ * Wait for bufferWrite() to be completed.
+ */
+static void bufferFlush(void)
+{
+#ifdef HX8347_HW_WRITE_BUF
+	hx8347_writeBufWait();
+#endif
 }
 
 static void lcd_setCursor(uint16_t x, uint16_t y)
@@ -209,42 +233,51 @@ static void lcd_setWindow(uint16_t x, uint16_t y, uint16_t width, uint16_t heigh
 }
 
 /*
- * Refresh a bitmap on screen
+ * Refresh the area \a r of a bitmap on screen.
  */
-void lcd_hx8347_blitBitmap(const Bitmap *bm)
+static void lcd_blitRect(const Bitmap *bm, const Rect *r)
 {
-	uint8_t mask;
-	int i, l, r;
+	coord_t width = RECT_WIDTH(r);
+	coord_t y;
 
-	lcd_setWindow(0, 0, bm->width, bm->height);
+	lcd_setWindow(r->xmin, r->ymin, width, RECT_HEIGHT(r));
 	hx8347_cmd(0x22);
 
-	for (l = 0; l < bm->height / 8; l++)
+	for (y = r->ymin; y < r->ymax; y++)
 	{
-		for (mask = 1; mask; mask <<= 1)
-		{
-			for (i = 0; i < bm->width; i++)
-			{
-				if (bm->raster[l * bm->width + i] & mask)
-					lcd_row[i] = 0x0000;
-				else
-					lcd_row[i] = 0xFFFF;
-			}
-			bufferWrite(lcd_row, bm->width);
-		}
-	}
+		uint16_t *row = lcd_row[y & 1];
 
-	for (r = 0, mask = 1; r < bm->height % 8; r++, mask <<= 1)
-	{
-		for (i = 0; i < bm->width; i++)
-		{
-			if (bm->raster[l * bm->width + i] & mask)
-				lcd_row[i] = 0x0000;
-			else
-				lcd_row[i] = 0xFFFF;
-		}
-		bufferWrite(lcd_row, bm->width);
+		gfx_expandRow(bm, y, r->xmin, r->xmax, lcd_palette, row);
+		bufferWrite(row, width);
 	}
+	bufferFlush();
+}
+
+/*
+ * Refresh a bitmap on screen
+ */
+void lcd_hx8347_blitBitmap(const Bitmap *bm)
+{
+	Rect r = {0, 0, bm->width, bm->height};
+
+	lcd_blitRect(bm, &r);
+}
+
+/**
+ * Refresh on screen only the areas of \a bm changed since the last call.
+ *
+ * Without dirty rectangles tracking (CONFIG_GFX_DIRTY_RECTS) the whole
+ * bitmap is refreshed.
+ */
+void lcd_hx8347_blitDirty(Bitmap *bm)
+{
+#if CONFIG_GFX_DIRTY_RECTS
+	for (int i = 0; i < bm->dirty_cnt; i++)
+		lcd_blitRect(bm, &bm->dirty[i]);
+	gfx_dirtyClear(bm);
+#else
+	lcd_hx8347_blitBitmap(bm);
+#endif
 }
 
 /*
@@ -259,16 +292,19 @@ void lcd_hx8347_blitBitmap24(int x, int y, int width, int height, const char *bm
 
 	for (l = 0; l < height; l++)
 	{
+		uint16_t *row = lcd_row[l & 1];
+
 		for (r = 0; r < width; r++)
 		{
-			lcd_row[r] =
+			row[r] =
 			    (((uint16_t)bmp[0] << 8) & 0xF800) |
 			    (((uint16_t)bmp[1] << 3) & 0x07E0) |
 			    (((uint16_t)bmp[2] >> 3) & 0x001F);
 			bmp += 3;
 		}
-		bufferWrite(lcd_row, width);
+		bufferWrite(row, width);
 	}
+	bufferFlush();
 }
 
 /**
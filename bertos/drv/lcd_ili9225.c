@@ -84,6 +84,9 @@ static struct KFile *spi;
  */
 static uint16_t lcd_row[LCD_WIDTH];
 
+/* Colors of clear and set pixels of a Bitmap */
+static const uint16_t lcd_palette[2] = {0xFFFF, 0x0000};
+
 struct lcd_ili9225_reg
 {
 	uint8_t cmd;   // Register index, if 0xFF wait for value ms
@@ -163,10 +166,13 @@ static void lcd_startBlit(uint8_t x, uint8_t y, uint8_t width, uint8_t height)
 {
 	ASSERT((x + width) <= LCD_WIDTH);
 	ASSERT((y + height) <= LCD_HEIGHT);
+	ASSERT(width > 0);
+	ASSERT(height > 0);
 
-	lcd_regWrite(0x36, x + width);
+	/* Window end addresses are inclusive */
+	lcd_regWrite(0x36, x + width - 1);
 	lcd_regWrite(0x37, x);
-	lcd_regWrite(0x38, y + height);
+	lcd_regWrite(0x38, y + height - 1);
 	lcd_regWrite(0x39, y);
 
 	lcd_regWrite(0x20, x);
@@ -184,43 +190,57 @@ void lcd_ili9225_blitRaw(UNUSED_ARG(const uint8_t *, data),
 }
 
 /*
- * Refresh a bitmap on screen
+ * Refresh the area \a r of a bitmap on screen.
+ *
+ * GRAM address advances by itself inside the window, so all the rows
+ * are sent after a single write command.
  */
-void lcd_ili9225_blitBitmap(const Bitmap *bm)
+static void lcd_blitRect(const Bitmap *bm, const Rect *r)
 {
-	uint8_t mask;
-	int i, l, r;
+	coord_t width = RECT_WIDTH(r);
+	coord_t y;
 
-	lcd_startBlit(0, 0, bm->width, bm->height);
+	lcd_startBlit(r->xmin, r->ymin, width, RECT_HEIGHT(r));
 
-	for (l = 0; l < bm->height / 8; l++)
-	{
-		for (mask = 1; mask; mask <<= 1)
-		{
-			for (i = 0; i < bm->width; i++)
-			{
-				if (bm->raster[l * bm->width + i] & mask)
-					lcd_row[i] = 0x0000;
-				else
-					lcd_row[i] = 0xFFFF;
-			}
-			lcd_cmd(0x22);
-			lcd_data(lcd_row, bm->width);
-		}
-	}
+	lcd_cmd(0x22);
+	kfile_flush(spi);
+	LCD_RS_HIGH();
 
-	for (r = 0, mask = 1; r < bm->height % 8; r++, mask <<= 1)
+	for (y = r->ymin; y < r->ymax; y++)
 	{
-		for (i = 0; i < bm->width; i++)
-		{
-			if (bm->raster[l * bm->width + i] & mask)
-				lcd_row[i] = 0x0000;
-			else
-				lcd_row[i] = 0xFFFF;
-		}
-		lcd_cmd(0x22);
-		lcd_data(lcd_row, bm->width);
+		gfx_expandRow(bm, y, r->xmin, r->xmax, lcd_palette, lcd_row);
+		kfile_write(spi, lcd_row, width * 2);
 	}
+
+	kfile_flush(spi);
+	LCD_CS_HIGH();
+}
+
+/*
+ * Refresh a bitmap on screen
+ */
+void lcd_ili9225_blitBitmap(const Bitmap *bm)
+{
+	Rect r = {0, 0, bm->width, bm->height};
+
+	lcd_blitRect(bm, &r);
+}
+
+/**
+ * Refresh on screen only the areas of \a bm changed since the last call.
+ *
+ * Without dirty rectangles tracking (CONFIG_GFX_DIRTY_RECTS) the whole
+ * bitmap is refreshed.
+ */
+void lcd_ili9225_blitDirty(Bitmap *bm)
+{
+#if CONFIG_GFX_DIRTY_RECTS
+	for (int i = 0; i < bm->dirty_cnt; i++)
+		lcd_blitRect(bm, &bm->dirty[i]);
+	gfx_dirtyClear(bm);
+#else
+	lcd_ili9225_blitBitmap(bm);
+#endif
 }
 
 /*
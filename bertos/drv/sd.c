@@ -44,6 +44,10 @@
 
 #include "cfg/cfg_sd.h"
 
+#if CONFIG_SD_CRC16
+	#include <algo/crc.h>
+#endif
+
 #define LOG_LEVEL  SD_LOG_LEVEL
 #define LOG_FORMAT SD_LOG_FORMAT
 #include <cfg/log.h>
@@ -60,16 +64,54 @@ typedef struct CardCSD
 	uint16_t block_len; ///< Length of a block
 	uint32_t block_num; ///< Number of block on the card
 	uint16_t capacity;  ///< Card capacity in MB
+	uint32_t max_clock; ///< Max SPI clock in Hz
 } CardCSD;
 
-#define SD_IN_IDLE    0x01
-#define SD_STARTTOKEN 0xFE
+#define SD_IN_IDLE          0x01
+#define SD_STARTTOKEN       0xFE
+#define SD_MULTI_STARTTOKEN 0xFC
+#define SD_STOPTOKEN        0xFD
 
 #define TIMEOUT_NAC         16384
 #define SD_DEFAULT_BLOCKLEN 512
 
+/*
+ * Bytes clocked in at once while waiting for a data token or for the
+ * end of busy: with a DMA SPI channel a transfer costs the same as a
+ * single byte.
+ */
+#define SD_POLL_LEN 8
+
 #define SD_BUSY_TIMEOUT ms_to_ticks(200)
 
+#ifndef SD_SPI_SETCLOCK
+	/* hw_sd.h without the hook: keep running at the init clock */
+	#define SD_SPI_SETCLOCK(rate) \
+		do                        \
+		{                         \
+		} while (0)
+#endif
+
+/*
+ * Wait for the card to leave the busy state (it keeps DO low while
+ * programming).
+ */
+static bool sd_waitReady(Sd *sd)
+{
+	uint8_t poll[SD_POLL_LEN];
+	ticks_t start = timer_clock();
+
+	do
+	{
+		if (kfile_read(sd->ch, poll, sizeof(poll)) == sizeof(poll) && poll[sizeof(poll) - 1] == 0xff)
+			return true;
+
+		cpu_relax();
+	} while (timer_clock() - start < SD_BUSY_TIMEOUT);
+
+	return false;
+}
+
 static bool sd_select(Sd *sd, bool state)
 {
 	KFile *fd = sd->ch;
@@ -78,14 +120,8 @@ static bool sd_select(Sd *sd, bool state)
 	{
 		SD_CS_ON();
 
-		ticks_t start = timer_clock();
-		do
-		{
-			if (kfile_getc(fd) == 0xff)
-				return true;
-
-			cpu_relax();
-		} while (timer_clock() - start < SD_BUSY_TIMEOUT);
+		if (sd_waitReady(sd))
+			return true;
 
 		SD_CS_OFF();
 		LOG_ERR("sd_select timeout\n");
@@ -114,52 +150,87 @@ static int16_t sd_waitR1(Sd *sd)
 	return EOF;
 }
 
-static int16_t sd_sendCommand(Sd *sd, uint8_t cmd, uint32_t param, uint8_t crc)
+static void sd_putCommand(Sd *sd, uint8_t cmd, uint32_t param, uint8_t crc)
 {
-	KFile *fd = sd->ch;
+	uint8_t frame[6];
+
 	/* The 7th bit of command must be a 1 */
-	kfile_putc(cmd | 0x40, fd);
+	frame[0] = cmd | 0x40;
 
 	/* send parameter */
-	kfile_putc((param >> 24) & 0xFF, fd);
-	kfile_putc((param >> 16) & 0xFF, fd);
-	kfile_putc((param >> 8) & 0xFF, fd);
-	kfile_putc((param)&0xFF, fd);
+	frame[1] = (param >> 24) & 0xFF;
+	frame[2] = (param >> 16) & 0xFF;
+	frame[3] = (param >> 8) & 0xFF;
+	frame[4] = (param)&0xFF;
 
-	kfile_putc(crc, fd);
+	frame[5] = crc;
 
+	kfile_write(sd->ch, frame, sizeof(frame));
+}
+
+static int16_t sd_sendCommand(Sd *sd, uint8_t cmd, uint32_t param, uint8_t crc)
+{
+	sd_putCommand(sd, cmd, param, crc);
 	return sd_waitR1(sd);
 }
 
+/*
+ * Read the data block following a read command.
+ *
+ * The start token is polled SD_POLL_LEN bytes at a time, but never past
+ * the end of the block: the bytes that follow the token are already
+ * data and are moved to \a buf.
+ */
 static bool sd_getBlock(Sd *sd, void *buf, size_t len)
 {
-	uint8_t token;
-	uint16_t crc;
+	uint8_t poll[SD_POLL_LEN];
+	uint8_t crc[2];
+	size_t chunk = MIN(sizeof(poll), len + sizeof(crc));
 
 	KFile *fd = sd->ch;
 
-	for (int i = 0; i < TIMEOUT_NAC; i++)
+	for (int i = 0; i < TIMEOUT_NAC; i += chunk)
 	{
-		token = kfile_getc(fd);
-		if (token != 0xff)
+		if (kfile_read(fd, poll, chunk) != chunk)
+			break;
+
+		for (size_t j = 0; j < chunk; j++)
 		{
-			if (token == SD_STARTTOKEN)
+			if (poll[j] == 0xff)
+				continue;
+
+			if (poll[j] != SD_STARTTOKEN)
 			{
-				if (kfile_read(fd, buf, len) == len)
-				{
-					if (kfile_read(fd, &crc, sizeof(crc)) == sizeof(crc))
-						/* check CRC here if needed */
-						return true;
-					else
-						LOG_ERR("get_block error getting crc\n");
-				}
-				else
-					LOG_ERR("get_block len error: %d\n", (int)len);
+				LOG_ERR("get_block token error: %02X\n", poll[j]);
+				return false;
 			}
-			else
-				LOG_ERR("get_block token error: %02X\n", token);
 
-			return false;
+			/* Split the bytes already read between data and crc */
+			size_t ahead = chunk - j - 1;
+			size_t data = MIN(ahead, len);
+
+			memcpy(buf, &poll[j + 1], data);
+			memcpy(crc, &poll[j + 1 + data], ahead - data);
+
+			if (kfile_read(fd, (uint8_t *)buf + data, len - data) != len - data)
+			{
+				LOG_ERR("get_block len error: %d\n", (int)len);
+				return false;
+			}
+			if (kfile_read(fd, crc + (ahead - data), sizeof(crc) - (ahead - data)) != sizeof(crc) - (ahead - data))
+			{
+				LOG_ERR("get_block error getting crc\n");
+				return false;
+			}
+
+#if CONFIG_SD_CRC16
+			if (crc16(CRC16_INIT_VAL, buf, len) != (uint16_t)((crc[0] << 8) | crc[1]))
+			{
+				LOG_ERR("get_block crc error\n");
+				return false;
+			}
+#endif
+			return true;
 		}
 	}
 
@@ -167,6 +238,43 @@ static bool sd_getBlock(Sd *sd, void *buf, size_t len)
 	return false;
 }
 
+#define SD_DATA_ACCEPTED 0x05
+
+/*
+ * Send a data block preceded by \a token, with the card already
+ * selected and the write command sent.
+ */
+static bool sd_putBlock(Sd *sd, const void *buf, uint8_t token)
+{
+	KFile *fd = sd->ch;
+	uint8_t crc[2] = { 0, 0 }; /* ignored by the card in SPI mode */
+
+#if CONFIG_SD_CRC16
+	uint16_t c = crc16(CRC16_INIT_VAL, buf, SD_DEFAULT_BLOCKLEN);
+	crc[0] = c >> 8;
+	crc[1] = c & 0xFF;
+#endif
+
+	/* Wait the end of programming of the previous block */
+	if (!sd_waitReady(sd))
+	{
+		LOG_ERR("put_block timeout, card busy\n");
+		return false;
+	}
+
+	kfile_putc(token, fd);
+	kfile_write(fd, buf, SD_DEFAULT_BLOCKLEN);
+	kfile_write(fd, crc, sizeof(crc));
+
+	uint8_t dataresp = kfile_getc(fd);
+	if ((dataresp & 0x1f) != SD_DATA_ACCEPTED)
+	{
+		LOG_ERR("put_block failed: %02X\n", dataresp);
+		return false;
+	}
+	return true;
+}
+
 #define SD_SELECT(sd)                                    \
 	do                                                   \
 	{                                                    \
@@ -225,7 +333,12 @@ static int16_t sd_getCSD(Sd *sd, CardCSD *csd)
 		csd->block_num = (c_size + 1) * mult;
 		csd->capacity = (csd->block_len * csd->block_num) >> 20; // in MB
 
-		LOG_INFO("block_len %d bytes, block_num %ld, total capacity %dMB\n", csd->block_len, csd->block_num, csd->capacity);
+		/* TRAN_SPEED: time value (x10) and rate unit (x10 bit/s) */
+		static const uint8_t time_value[16] = { 0, 10, 12, 13, 15, 20, 25, 30, 35, 40, 45, 50, 55, 60, 70, 80 };
+		static const uint32_t rate_unit[4] = { 10000L, 100000L, 1000000L, 10000000L };
+		csd->max_clock = time_value[(buf[3] >> 3) & 0x0F] * rate_unit[MIN(buf[3] & 0x07, 3)];
+
+		LOG_INFO("block_len %d bytes, block_num %ld, total capacity %dMB, max clock %ldHz\n", csd->block_len, csd->block_num, csd->capacity, csd->max_clock);
 		return 0;
 	}
 	else
@@ -272,12 +385,10 @@ static size_t sd_readDirect(struct KBlock *b, block_idx_t idx, void *buf, size_t
 }
 
 #define SD_WRITE_SINGLEBLOCK 0x58
-#define SD_DATA_ACCEPTED     0x05
 
 static size_t sd_writeDirect(KBlock *b, block_idx_t idx, const void *buf, size_t offset, size_t size)
 {
 	Sd *sd = SD_CAST(b);
-	KFile *fd = sd->ch;
 	ASSERT(offset == 0);
 	ASSERT(size == SD_DEFAULT_BLOCKLEN);
 
@@ -303,24 +414,134 @@ static size_t sd_writeDirect(KBlock *b, block_idx_t idx, const void *buf, size_t
 		return 0;
 	}
 
-	kfile_putc(SD_STARTTOKEN, fd);
-	kfile_write(fd, buf, SD_DEFAULT_BLOCKLEN);
-	/* send fake crc */
-	kfile_putc(0, fd);
-	kfile_putc(0, fd);
-
-	uint8_t dataresp = kfile_getc(fd);
+	bool res = sd_putBlock(sd, buf, SD_STARTTOKEN);
 	sd_select(sd, false);
 
-	if ((dataresp & 0x1f) != SD_DATA_ACCEPTED)
+	if (!res)
 	{
-		LOG_ERR("write block %ld failed: %02X\n", idx, dataresp);
-		return EOF;
+		LOG_ERR("write block %ld failed\n", idx);
+		return 0;
 	}
 
 	return SD_DEFAULT_BLOCKLEN;
 }
 
+#define SD_READ_MULTIPLEBLOCK     0x52
+#define SD_STOP_TRANSMISSION      0x4C
+#define SD_WRITE_MULTIPLEBLOCK    0x59
+#define SD_APP_CMD                0x77
+#define SD_SET_WR_BLK_ERASE_COUNT 0x57
+
+/*
+ * Select the card for a multiple block transfer of whole blocks.
+ */
+static bool sd_selectBlocks(Sd *sd)
+{
+	if (sd->tranfer_len != SD_DEFAULT_BLOCKLEN)
+	{
+		if ((sd->r1 = sd_setBlockLen(sd, SD_DEFAULT_BLOCKLEN)))
+		{
+			LOG_ERR("setBlockLen failed: %04X\n", sd->r1);
+			return false;
+		}
+		sd->tranfer_len = SD_DEFAULT_BLOCKLEN;
+	}
+
+	if (!sd_select(sd, true))
+	{
+		LOG_ERR("card busy\n");
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Stream \a count blocks with a single CMD18, saving the command and
+ * the access time of the card for all the blocks but the first.
+ */
+static block_idx_t sd_readBlocks(KBlock *b, block_idx_t idx, void *buf, block_idx_t count)
+{
+	Sd *sd = SD_CAST(b);
+	block_idx_t i;
+
+	if (count == 1)
+		return sd_readDirect(b, idx, buf, 0, SD_DEFAULT_BLOCKLEN) == SD_DEFAULT_BLOCKLEN;
+
+	LOG_INFO("reading %ld blocks from %ld\n", count, idx);
+	if (!sd_selectBlocks(sd))
+		return 0;
+
+	sd->r1 = sd_sendCommand(sd, SD_READ_MULTIPLEBLOCK, idx * SD_DEFAULT_BLOCKLEN, 0);
+	if (sd->r1)
+	{
+		LOG_ERR("read multiple block failed: %04X\n", sd->r1);
+		sd_select(sd, false);
+		return 0;
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		if (!sd_getBlock(sd, (uint8_t *)buf + i * SD_DEFAULT_BLOCKLEN, SD_DEFAULT_BLOCKLEN))
+			break;
+	}
+
+	/* The card answers after a stuff byte, which may still be data */
+	sd_putCommand(sd, SD_STOP_TRANSMISSION, 0, 0);
+	kfile_getc(sd->ch);
+	if ((sd->r1 = sd_waitR1(sd)))
+		LOG_ERR("stop transmission failed: %04X\n", sd->r1);
+
+	sd_select(sd, false);
+	return i;
+}
+
+/*
+ * Write \a count blocks with a single CMD25. The card is told the
+ * number of blocks in advance (ACMD23) so that it can erase them all
+ * at once instead of one at a time.
+ */
+static block_idx_t sd_writeBlocks(KBlock *b, block_idx_t idx, const void *buf, block_idx_t count)
+{
+	Sd *sd = SD_CAST(b);
+	block_idx_t i;
+
+	if (count == 1)
+		return sd_writeDirect(b, idx, buf, 0, SD_DEFAULT_BLOCKLEN) == SD_DEFAULT_BLOCKLEN;
+
+	LOG_INFO("writing %ld blocks from %ld\n", count, idx);
+	if (!sd_selectBlocks(sd))
+		return 0;
+
+	/* Pre-erase is only a hint, and MMC cards do not have it */
+	if ((sd_sendCommand(sd, SD_APP_CMD, 0, 0) & ~SD_IN_IDLE) == 0)
+		sd_sendCommand(sd, SD_SET_WR_BLK_ERASE_COUNT, count, 0);
+
+	sd->r1 = sd_sendCommand(sd, SD_WRITE_MULTIPLEBLOCK, idx * SD_DEFAULT_BLOCKLEN, 0);
+	if (sd->r1)
+	{
+		LOG_ERR("write multiple block failed: %04X\n", sd->r1);
+		sd_select(sd, false);
+		return 0;
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		if (!sd_putBlock(sd, (const uint8_t *)buf + i * SD_DEFAULT_BLOCKLEN, SD_MULTI_STARTTOKEN))
+		{
+			LOG_ERR("write block %ld failed\n", idx + i);
+			break;
+		}
+	}
+
+	if (!sd_waitReady(sd))
+		LOG_ERR("write multiple block timeout, card busy\n");
+	kfile_putc(SD_STOPTOKEN, sd->ch);
+
+	/* Programming of the last block completes before the next select */
+	sd_select(sd, false);
+	return i;
+}
+
 void sd_writeTest(Sd *sd)
 {
 	uint8_t buf[SD_DEFAULT_BLOCKLEN];
@@ -383,6 +604,8 @@ static const KBlockVTable sd_unbuffered_vt =
     {
         .readDirect = sd_readDirect,
         .writeDirect = sd_writeDirect,
+        .readBlocks = sd_readBlocks,
+        .writeBlocks = sd_writeBlocks,
 
         .error = sd_error,
         .clearerr = sd_clearerr,
@@ -392,6 +615,8 @@ static const KBlockVTable sd_buffered_vt =
     {
         .readDirect = sd_readDirect,
         .writeDirect = sd_writeDirect,
+        .readBlocks = sd_readBlocks,
+        .writeBlocks = sd_writeBlocks,
 
         .readBuf = kblock_swReadBuf,
         .writeBuf = kblock_swWriteBuf,
@@ -487,6 +712,10 @@ static bool sd_blockInit(Sd *sd, KFile *ch)
 	sd->b.blk_cnt = csd.block_num * (csd.block_len / SD_DEFAULT_BLOCKLEN);
 	LOG_INFO("blk_size %d, blk_cnt %ld\n", sd->b.blk_size, sd->b.blk_cnt);
 
+	/* Identification is over, the card can run at its full speed */
+	sd->max_clock = csd.max_clock;
+	SD_SPI_SETCLOCK(sd->max_clock);
+
 #if CONFIG_SD_AUTOASSIGN_FAT
 	disk_assignDrive(&sd->b, 0);
 #endif
@@ -61,6 +61,7 @@ typedef struct Sd
 	KFile *ch;            ///< SPI communication channel
 	uint16_t r1;          ///< Last status data received from SD
 	uint16_t tranfer_len; ///< Lenght for the read/write commands, cached in order to increase speed.
+	uint32_t max_clock;   ///< SPI clock (Hz) requested with SD_SPI_SETCLOCK() after the init, read from the card.
 } Sd;
 
 bool sd_initUnbuf(Sd *sd, KFile *ch);
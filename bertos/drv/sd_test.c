@@ -0,0 +1,463 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2010 Develer S.r.l. (http://www.develer.com/)
+ * -->
+ *
+ * \brief SD driver test, run on a simulated card.
+ *
+ * The SPI channel is a KFile connected to a model of an SD card in SPI
+ * mode, which answers to the commands used by the driver and keeps the
+ * data in RAM. The model also accounts the card access and programming
+ * times as idle bytes on the bus, so that the bus time of a transfer
+ * can be computed from the bytes clocked and the SPI clock.
+ */
+
+#include "cfg/cfg_sd.h"
+
+#include <drv/sd.h>
+#include <drv/timer.h>
+
+#include <io/kblock.h>
+#include <io/kfile.h>
+
+#include <cfg/compiler.h>
+#include <cfg/test.h>
+#include <cfg/debug.h>
+
+#if CONFIG_SD_CRC16
+	#include <algo/crc.h>
+#endif
+
+#include <string.h>
+
+#define CARD_BLOCKS 8192 /* 4MB */
+#define BLOCK_LEN   512
+#define CARD_CLOCK  25000000L
+
+/*
+ * Card timings, in microseconds: access time of a read command, gap
+ * between blocks of a multiple block read, programming time of a block
+ * written alone, in a pre-erased multiple block write and at the end
+ * of a multiple block write.
+ */
+#define CARD_READ_ACCESS  100
+#define CARD_READ_NEXT    2
+#define CARD_WRITE_BUSY   800
+#define CARD_WRITE_ERASED 200
+#define CARD_WRITE_STOP   20
+
+#define BENCH_BLOCKS 256
+#define BENCH_BURST  32
+
+enum CardState
+{
+	CARD_CMD,
+	CARD_READ,
+	CARD_WRITE,
+	CARD_WRITE_DATA,
+};
+
+static struct Card
+{
+	KFile fd;
+
+	enum CardState state;
+	uint8_t cmd[6];
+	size_t cmd_len;
+	bool idle;
+	int op_cond;
+	bool app_cmd;
+	bool multi;
+	uint32_t addr;
+	uint32_t blocklen;
+	uint32_t erase_count;
+	uint32_t last_erase_count;
+	uint8_t wbuf[BLOCK_LEN + 2];
+	size_t wlen;
+	bool corrupt;
+	int crc_errors;
+
+	/* Bytes the card will send, in order */
+	uint8_t out[4096 + BLOCK_LEN];
+	size_t out_head, out_tail;
+
+	/* Bytes clocked on the bus */
+	unsigned long bus;
+} card;
+
+static uint8_t card_mem[CARD_BLOCKS * BLOCK_LEN];
+
+static Sd sd;
+
+static void card_put(uint8_t c)
+{
+	ASSERT(card.out_tail < sizeof(card.out));
+	card.out[card.out_tail++] = c;
+}
+
+/* Keep the bus idle (\a c = 0xFF) or busy (\a c = 0) for \a us microseconds */
+static void card_wait(uint8_t c, unsigned long us)
+{
+	unsigned long n = MAX(us * (CARD_CLOCK / 8) / 1000000L, 1UL);
+
+	while (n--)
+		card_put(c);
+}
+
+static uint16_t card_crc(const uint8_t *buf, size_t len)
+{
+#if CONFIG_SD_CRC16
+	return crc16(CRC16_INIT_VAL, buf, len);
+#else
+	(void)buf;
+	(void)len;
+	return 0;
+#endif
+}
+
+static void card_putBlock(const uint8_t *buf, size_t len, unsigned long access)
+{
+	uint16_t crc = card_crc(buf, len);
+
+	card_wait(0xFF, access);
+	card_put(0xFE);
+	for (size_t i = 0; i < len; i++)
+		card_put(buf[i]);
+	if (card.corrupt)
+		card.out[card.out_tail - len / 2] ^= 0x10;
+	card_put(crc >> 8);
+	card_put(crc & 0xFF);
+}
+
+static void card_putCSD(void)
+{
+	uint8_t csd[16];
+
+	memset(csd, 0, sizeof(csd));
+	csd[3] = 0x32; /* TRAN_SPEED: 25MHz */
+	csd[5] = 0x59; /* READ_BL_LEN: 512 */
+	csd[7] = 0x03; /* C_SIZE: 15 */
+	csd[8] = 0xC0;
+	csd[9] = 0x03; /* C_SIZE_MULT: 7 */
+	csd[10] = 0x80;
+	card_putBlock(csd, sizeof(csd), 0);
+}
+
+static void card_command(void)
+{
+	uint8_t cmd = card.cmd[0] & 0x3F;
+	uint32_t arg = ((uint32_t)card.cmd[1] << 24) | ((uint32_t)card.cmd[2] << 16) | ((uint32_t)card.cmd[3] << 8) | card.cmd[4];
+	bool app_cmd = card.app_cmd;
+	uint8_t r1;
+
+	card.app_cmd = false;
+	if (cmd == 12)
+	{
+		/* Stop the data stream: stuff byte, then R1 */
+		card.out_head = card.out_tail = 0;
+		card.state = CARD_CMD;
+		card_put(0x3F);
+		card_put(0);
+		return;
+	}
+
+	card_put(0xFF);
+	r1 = card.idle ? 0x01 : 0;
+	switch (cmd)
+	{
+	case 0:
+		card.idle = true;
+		card_put(0x01);
+		break;
+	case 1:
+		if (++card.op_cond > 2)
+			card.idle = false;
+		card_put(card.idle ? 0x01 : 0);
+		break;
+	case 9:
+		card_put(r1);
+		card_putCSD();
+		break;
+	case 16:
+		card.blocklen = arg;
+		card_put(r1);
+		break;
+	case 17:
+		card_put(r1);
+		card_putBlock(card_mem + arg, card.blocklen, CARD_READ_ACCESS);
+		break;
+	case 18:
+		card_put(r1);
+		card_putBlock(card_mem + arg, BLOCK_LEN, CARD_READ_ACCESS);
+		card.addr = arg + BLOCK_LEN;
+		card.state = CARD_READ;
+		break;
+	case 23:
+		ASSERT(app_cmd);
+		card.erase_count = card.last_erase_count = arg;
+		card_put(r1);
+		break;
+	case 24:
+	case 25:
+		card_put(r1);
+		card.addr = arg;
+		card.multi = (cmd == 25);
+		card.state = CARD_WRITE;
+		break;
+	case 55:
+		card.app_cmd = true;
+		card_put(r1);
+		break;
+	default:
+		/* Illegal command */
+		card_put(r1 | 0x04);
+		break;
+	}
+}
+
+static void card_receive(uint8_t c)
+{
+	switch (card.state)
+	{
+	case CARD_WRITE:
+		if (c == 0xFE || (card.multi && c == 0xFC))
+		{
+			card.state = CARD_WRITE_DATA;
+			card.wlen = 0;
+		}
+		else if (card.multi && c == 0xFD)
+		{
+			card_put(0xFF);
+			card_wait(0, CARD_WRITE_STOP);
+			card.state = CARD_CMD;
+		}
+		break;
+
+	case CARD_WRITE_DATA:
+		card.wbuf[card.wlen++] = c;
+		if (card.wlen < sizeof(card.wbuf))
+			break;
+
+		if (CONFIG_SD_CRC16 && card_crc(card.wbuf, BLOCK_LEN) != ((card.wbuf[BLOCK_LEN] << 8) | card.wbuf[BLOCK_LEN + 1]))
+			card.crc_errors++;
+		memcpy(card_mem + card.addr, card.wbuf, BLOCK_LEN);
+		card.addr += BLOCK_LEN;
+
+		card_put(0xE5); /* Data accepted */
+		if (card.multi && card.erase_count)
+		{
+			card.erase_count--;
+			card_wait(0, CARD_WRITE_ERASED);
+		}
+		else
+			card_wait(0, CARD_WRITE_BUSY);
+		card.state = card.multi ? CARD_WRITE : CARD_CMD;
+		break;
+
+	default:
+		if (card.cmd_len == 0 && (c & 0xC0) != 0x40)
+			break;
+		card.cmd[card.cmd_len++] = c;
+		if (card.cmd_len == sizeof(card.cmd))
+		{
+			card.cmd_len = 0;
+			card_command();
+		}
+		break;
+	}
+}
+
+/* Clock one byte on the bus: \a c to the card, the result from the card */
+static uint8_t card_xfer(uint8_t c)
+{
+	uint8_t ret = 0xFF;
+
+	if (card.out_head < card.out_tail)
+		ret = card.out[card.out_head++];
+	if (card.out_head == card.out_tail)
+	{
+		card.out_head = card.out_tail = 0;
+		if (card.state == CARD_READ)
+		{
+			card_putBlock(card_mem + card.addr, BLOCK_LEN, CARD_READ_NEXT);
+			card.addr += BLOCK_LEN;
+		}
+	}
+
+	card_receive(c);
+	card.bus++;
+	return ret;
+}
+
+static size_t card_read(UNUSED_ARG(struct KFile *, fd), void *buf, size_t size)
+{
+	uint8_t *p = buf;
+
+	for (size_t i = 0; i < size; i++)
+		p[i] = card_xfer(0xFF);
+	return size;
+}
+
+static size_t card_write(UNUSED_ARG(struct KFile *, fd), const void *buf, size_t size)
+{
+	const uint8_t *p = buf;
+
+	for (size_t i = 0; i < size; i++)
+		card_xfer(p[i]);
+	return size;
+}
+
+static uint8_t pattern(block_idx_t blk, size_t i)
+{
+	return (uint8_t)(blk * 31 + i * 7 + (i >> 8));
+}
+
+static void fill(uint8_t *buf, block_idx_t start, block_idx_t count)
+{
+	for (block_idx_t b = 0; b < count; b++)
+		for (size_t i = 0; i < BLOCK_LEN; i++)
+			buf[b * BLOCK_LEN + i] = pattern(start + b, i);
+}
+
+static bool check(const uint8_t *buf, block_idx_t start, block_idx_t count)
+{
+	for (block_idx_t b = 0; b < count; b++)
+		for (size_t i = 0; i < BLOCK_LEN; i++)
+			if (buf[b * BLOCK_LEN + i] != pattern(start + b, i))
+				return false;
+	return true;
+}
+
+/*
+ * Transfer BENCH_BLOCKS blocks, \a burst at a time, and return the
+ * throughput in KB/s computed from the bus time.
+ */
+static unsigned long sd_testBench(const char *name, bool write, block_idx_t burst)
+{
+	static uint8_t buf[BENCH_BURST * BLOCK_LEN];
+	unsigned long start = card.bus;
+	unsigned long kbs;
+
+	fill(buf, 0, burst);
+	for (block_idx_t b = 0; b < BENCH_BLOCKS; b += burst)
+	{
+		if (burst == 1 && write)
+			ASSERT(kblock_write(&sd.b, b, buf, 0, BLOCK_LEN) == BLOCK_LEN);
+		else if (burst == 1)
+			ASSERT(kblock_read(&sd.b, b, buf, 0, BLOCK_LEN) == BLOCK_LEN);
+		else if (write)
+			ASSERT(kblock_writeBlocks(&sd.b, b, buf, burst) == burst);
+		else
+			ASSERT(kblock_readBlocks(&sd.b, b, buf, burst) == burst);
+	}
+
+	/* payload / (bus bytes * 8 / clock), in KB/s */
+	kbs = (unsigned long)((uint64_t)BENCH_BLOCKS * BLOCK_LEN * (sd.max_clock / 8) / (card.bus - start) / 1024);
+	kprintf("%-24s %4lu.%02lu MB/s (%lu bus bytes)\n", name,
+	        kbs / 1024, kbs % 1024 * 100 / 1024, card.bus - start);
+	return kbs;
+}
+
+int sd_testSetup(void)
+{
+	kdbg_init();
+	timer_init();
+
+	kfile_init(&card.fd);
+	card.fd.read = card_read;
+	card.fd.write = card_write;
+	card.blocklen = BLOCK_LEN;
+	return 0;
+}
+
+int sd_testRun(void)
+{
+	static uint8_t buf[BENCH_BURST * BLOCK_LEN];
+	uint8_t part[16];
+
+	ASSERT(sd_initUnbuf(&sd, &card.fd));
+	ASSERT(sd.b.blk_size == BLOCK_LEN);
+	ASSERT(sd.b.blk_cnt == CARD_BLOCKS);
+	ASSERT(sd.max_clock == CARD_CLOCK);
+
+	/* Multiple block write, read back in every way */
+	fill(buf, 10, BENCH_BURST);
+	ASSERT(kblock_writeBlocks(&sd.b, 10, buf, BENCH_BURST) == BENCH_BURST);
+	ASSERT(card.last_erase_count == BENCH_BURST);
+	ASSERT(check(card_mem + 10 * BLOCK_LEN, 10, BENCH_BURST));
+
+	memset(buf, 0, sizeof(buf));
+	ASSERT(kblock_readBlocks(&sd.b, 10, buf, BENCH_BURST) == BENCH_BURST);
+	ASSERT(check(buf, 10, BENCH_BURST));
+
+	memset(buf, 0, sizeof(buf));
+	for (block_idx_t b = 0; b < BENCH_BURST; b++)
+		ASSERT(kblock_read(&sd.b, 10 + b, buf + b * BLOCK_LEN, 0, BLOCK_LEN) == BLOCK_LEN);
+	ASSERT(check(buf, 10, BENCH_BURST));
+
+	/* Partial reads change the block length, block reads restore it */
+	ASSERT(kblock_read(&sd.b, 12, part, 100, sizeof(part)) == sizeof(part));
+	for (size_t i = 0; i < sizeof(part); i++)
+		ASSERT(part[i] == pattern(12, 100 + i));
+	memset(buf, 0, sizeof(buf));
+	ASSERT(kblock_readBlocks(&sd.b, 11, buf, 2) == 2);
+	ASSERT(check(buf, 11, 2));
+
+	/* Single block write */
+	fill(buf, 100, 1);
+	ASSERT(kblock_write(&sd.b, 100, buf, 0, BLOCK_LEN) == BLOCK_LEN);
+	ASSERT(check(card_mem + 100 * BLOCK_LEN, 100, 1));
+
+#if CONFIG_SD_CRC16
+	ASSERT(card.crc_errors == 0);
+
+	/* A corrupted block is detected */
+	card.corrupt = true;
+	ASSERT(kblock_read(&sd.b, 100, buf, 0, BLOCK_LEN) == 0);
+	ASSERT(kblock_readBlocks(&sd.b, 10, buf, 2) == 0);
+	card.corrupt = false;
+	kblock_clearerr(&sd.b);
+#endif
+
+	unsigned long rd = sd_testBench("single block read", false, 1);
+	unsigned long rdm = sd_testBench("multiple block read", false, BENCH_BURST);
+	unsigned long wr = sd_testBench("single block write", true, 1);
+	unsigned long wrm = sd_testBench("multiple block write", true, BENCH_BURST);
+
+	ASSERT(rdm > rd);
+	ASSERT(wrm > wr);
+	return 0;
+}
+
+int sd_testTearDown(void)
+{
+	return 0;
+}
+
+TEST_MAIN(sd);
@@ -44,6 +44,8 @@
  *  \li \c CONFIG_SER_HWHANDSHAKE - set to 1 to enable RTS/CTS handshake.
  *         Support is incomplete/untested.
  *  \li \c CONFIG_SER_TXTIMEOUT - Enable software serial transmission timeouts
+ *  \li \c CONFIG_SER_EVENTS - sleep on an event triggered by the driver
+ *         interrupt instead of polling the FIFOs.
  *
  *
  * \author Bernie Innocenti <bernie@codewiz.org>
@@ -56,6 +58,7 @@
 
 #include "cfg/cfg_ser.h"
 #include "cfg/cfg_proc.h"
+#include "cfg/cfg_signal.h"
 #include <cfg/debug.h>
 
 #include <mware/formatwr.h>
@@ -79,18 +82,49 @@
 #if !defined(CONFIG_SER_DEFBAUDRATE)
 	#error CONFIG_SER_DEFBAUDRATE missing in cfg_ser.h
 #endif
+#if CONFIG_SER_EVENTS && !(CONFIG_KERN && CONFIG_KERN_SIGNALS)
+	#error CONFIG_SER_EVENTS requires CONFIG_KERN and CONFIG_KERN_SIGNALS
+#endif
 
 struct Serial *ser_handles[SER_CNT];
 
+#if CONFIG_SER_EVENTS
+
+/*
+ * Level a waiting process asks the interrupt handler to wake it up at:
+ * what it needs, but no more than half of the FIFO so that the handler
+ * keeps being fed while the process runs.
+ */
+INLINE size_t ser_wakeLevel(FIFOBuffer *fb, size_t want)
+{
+	return MAX(MIN(want, fifo_len(fb) / 2), (size_t)1);
+}
+
+/*
+ * Sleep on \a e until the interrupt handler triggers it.
+ * \return false if \a timeout ticks from \a start elapsed first.
+ */
+INLINE bool ser_sleep(Event *e, ticks_t start, ticks_t timeout)
+{
+	ticks_t elapsed = timer_clock() - start;
+
+	return elapsed < timeout && event_waitTimeout(e, timeout - elapsed);
+}
+
+#endif /* CONFIG_SER_EVENTS */
+
 /**
- * Insert \a c in tx FIFO buffer.
+ * Wait until the tx FIFO buffer has room for at least one character.
  * \note This function will switch out the calling process
  * if the tx buffer is full. If the buffer is full
  * and \a port->txtimeout is 0 return EOF immediatly.
  *
- * \return EOF on error or timeout, \a c otherwise.
+ * With CONFIG_SER_EVENTS the process sleeps until the FIFO has room
+ * for \a want characters, or is half empty.
+ *
+ * \return EOF on timeout, 0 otherwise.
  */
-static int ser_putchar(int c, struct Serial *port)
+static int ser_waitTx(struct Serial *port, size_t want)
 {
 	if (fifo_isfull_locked(&port->txfifo))
 	{
@@ -102,39 +136,61 @@ static int ser_putchar(int c, struct Serial *port)
 		ticks_t start_time = timer_clock();
 #endif
 
+#if CONFIG_SER_EVENTS
+		size_t level = ser_wakeLevel(&port->txfifo, want);
+
+		port->txwake = level;
+		while (fifo_len(&port->txfifo) - fifo_count_locked(&port->txfifo) < level)
+		{
+	#if CONFIG_SER_TXTIMEOUT != -1
+			if (!ser_sleep(&port->txevent, start_time, port->txtimeout))
+				break;
+	#else
+			event_wait(&port->txevent);
+	#endif
+		}
+		port->txwake = 0;
+
+		if (fifo_isfull_locked(&port->txfifo))
+		{
+			ATOMIC(port->status |= SERRF_TXTIMEOUT);
+			return EOF;
+		}
+#else
+		(void)want;
+
 		/* Wait while buffer is full... */
 		do
 		{
 			cpu_relax();
 
-#if CONFIG_SER_TXTIMEOUT != -1
+	#if CONFIG_SER_TXTIMEOUT != -1
 			if (timer_clock() - start_time >= port->txtimeout)
 			{
 				ATOMIC(port->status |= SERRF_TXTIMEOUT);
 				return EOF;
 			}
-#endif /* CONFIG_SER_TXTIMEOUT */
+	#endif /* CONFIG_SER_TXTIMEOUT */
 		} while (fifo_isfull_locked(&port->txfifo));
+#endif /* !CONFIG_SER_EVENTS */
 	}
-
-	fifo_push_locked(&port->txfifo, (unsigned char)c);
-
-	/* (re)trigger tx interrupt */
-	port->hw->table->txStart(port->hw);
-
-	/* Avoid returning signed extended char */
-	return (int)((unsigned char)c);
+	return 0;
 }
 
 /**
- * Fetch a character from the rx FIFO buffer.
+ * Wait until the rx FIFO buffer holds at least one character
+ * or a receive error is flagged.
  * \note This function will switch out the calling process
  * if the rx buffer is empty. If the buffer is empty
  * and \a port->rxtimeout is 0 return EOF immediatly.
  *
- * \return EOF on error or timeout, \a c otherwise.
+ * With CONFIG_SER_EVENTS the process sleeps until the FIFO holds
+ * \a want characters, or is half full; if the timeout expires with
+ * some data in the FIFO, that data is returned.
+ *
+ * \return EOF on error or timeout, 0 otherwise.
  */
-static int ser_getchar(struct Serial *port)
+static int ser_waitRx(struct Serial *port, size_t want)
 {
 	if (fifo_isempty_locked(&port->rxfifo))
 	{
@@ -146,27 +202,86 @@ static int ser_getchar(struct Serial *port)
 		ticks_t start_time = timer_clock();
 #endif
 
+#if CONFIG_SER_EVENTS
+		size_t level = ser_wakeLevel(&port->rxfifo, want);
+
+		port->rxwake = level;
+		while (fifo_count_locked(&port->rxfifo) < level && (ser_getstatus(port) & SERRF_RX) == 0)
+		{
+	#if CONFIG_SER_RXTIMEOUT != -1
+			if (!ser_sleep(&port->rxevent, start_time, port->rxtimeout))
+				break;
+	#else
+			event_wait(&port->rxevent);
+	#endif
+		}
+		port->rxwake = 0;
+
+		if (fifo_isempty_locked(&port->rxfifo) && (ser_getstatus(port) & SERRF_RX) == 0)
+		{
+			ATOMIC(port->status |= SERRF_RXTIMEOUT);
+			return EOF;
+		}
+#else
+		(void)want;
+
 		/* Wait while buffer is empty */
 		do
 		{
 			cpu_relax();
 
-#if CONFIG_SER_RXTIMEOUT != -1
+	#if CONFIG_SER_RXTIMEOUT != -1
 			if (timer_clock() - start_time >= port->rxtimeout)
 			{
 				ATOMIC(port->status |= SERRF_RXTIMEOUT);
 				return EOF;
 			}
-#endif /* CONFIG_SER_RXTIMEOUT */
+	#endif /* CONFIG_SER_RXTIMEOUT */
 		} while (fifo_isempty_locked(&port->rxfifo) && (ser_getstatus(port) & SERRF_RX) == 0);
+#endif /* !CONFIG_SER_EVENTS */
 	}
 
-	/*
-	 * Get a byte from the FIFO (avoiding sign-extension),
-	 * re-enable RTS, then return result.
-	 */
 	if (ser_getstatus(port) & SERRF_RX)
 		return EOF;
+	return 0;
+}
+
+/**
+ * Insert \a c in tx FIFO buffer.
+ * \note This function will switch out the calling process
+ * if the tx buffer is full. If the buffer is full
+ * and \a port->txtimeout is 0 return EOF immediatly.
+ *
+ * \return EOF on error or timeout, \a c otherwise.
+ */
+static int ser_putchar(int c, struct Serial *port)
+{
+	if (ser_waitTx(port, 1) == EOF)
+		return EOF;
+
+	fifo_push_locked(&port->txfifo, (unsigned char)c);
+
+	/* (re)trigger tx interrupt */
+	port->hw->table->txStart(port->hw);
+
+	/* Avoid returning signed extended char */
+	return (int)((unsigned char)c);
+}
+
+/**
+ * Fetch a character from the rx FIFO buffer.
+ * \note This function will switch out the calling process
+ * if the rx buffer is empty. If the buffer is empty
+ * and \a port->rxtimeout is 0 return EOF immediatly.
+ *
+ * \return EOF on error or timeout, \a c otherwise.
+ */
+static int ser_getchar(struct Serial *port)
+{
+	if (ser_waitRx(port, 1) == EOF)
+		return EOF;
+
+	/* Get a byte from the FIFO (avoiding sign-extension) */
 	return (int)(unsigned char)fifo_pop_locked(&port->rxfifo);
 }
 
@@ -188,21 +303,22 @@ int ser_getchar_nowait(struct Serial *fd)
 /**
  * Read at most \a size bytes from \a port and put them in \a buf
  *
+ * Received data is moved out of the rx FIFO a run at a time,
+ * waiting only when the FIFO is empty.
+ *
  * \return number of bytes actually read.
  */
 static size_t ser_read(struct KFile *fd, void *_buf, size_t size)
 {
 	Serial *fds = SERIAL_CAST(fd);
-
+	unsigned char *buf = (unsigned char *)_buf;
 	size_t i = 0;
-	char *buf = (char *)_buf;
-	int c;
 
 	while (i < size)
 	{
-		if ((c = ser_getchar(fds)) == EOF)
+		if (ser_waitRx(fds, size - i) == EOF)
 			break;
-		buf[i++] = c;
+		i += fifo_popblock_locked(&fds->rxfifo, buf + i, size - i);
 	}
 
 	return i;
@@ -211,21 +327,37 @@ static size_t ser_read(struct KFile *fd, void *_buf, size_t size)
 /**
  * \brief Write a buffer to serial.
  *
- * \return 0 if OK, EOF in case of error.
+ * Data is copied in the tx FIFO a run at a time and the transmitter
+ * is (re)started once for each run.
+ * If the hardware driver supports it, when the FIFO is empty data is
+ * handed directly to the transmitter instead.
  *
- * \todo Optimize with fifo_pushblock()
+ * \return number of bytes actually written.
  */
 static size_t ser_write(struct KFile *fd, const void *_buf, size_t size)
 {
 	Serial *fds = SERIAL_CAST(fd);
-	const char *buf = (const char *)_buf;
-	size_t i = 0;
+	const unsigned char *buf = (const unsigned char *)_buf;
+	size_t i = 0, n;
 
-	while (size--)
+	while (i < size)
 	{
-		if (ser_putchar(*buf++, fds) == EOF)
+		if (fds->hw->table->txPush && fifo_isempty_locked(&fds->txfifo))
+		{
+			n = fds->hw->table->txPush(fds->hw, buf + i, size - i);
+			if (n)
+			{
+				i += n;
+				continue;
+			}
+		}
+
+		if (ser_waitTx(fds, size - i) == EOF)
 			break;
-		i++;
+		i += fifo_pushblock_locked(&fds->txfifo, buf + i, size - i);
+
+		/* (re)trigger tx interrupt */
+		fds->hw->table->txStart(fds->hw);
 	}
 	return i;
 }
@@ -344,6 +476,11 @@ static struct Serial *ser_open(struct Serial *fd, unsigned int unit)
 	ASSERT(fd->hw->rxbuffer);
 	fifo_init(&fd->txfifo, fd->hw->txbuffer, fd->hw->txbuffer_size);
 	fifo_init(&fd->rxfifo, fd->hw->rxbuffer, fd->hw->rxbuffer_size);
+#if CONFIG_SER_EVENTS
+	event_initGeneric(&fd->txevent);
+	event_initGeneric(&fd->rxevent);
+	fd->txwake = fd->rxwake = 0;
+#endif
 
 	fd->hw->table->init(fd->hw, fd);
 
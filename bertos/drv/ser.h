@@ -79,6 +79,10 @@ enum
 
 #include "cfg/cfg_ser.h"
 
+#if CONFIG_SER_EVENTS
+	#include <mware/event.h>
+#endif
+
 /**
  * \name Masks to group TX/RX errors.
  * \{
@@ -170,6 +174,24 @@ typedef struct Serial
 	ticks_t txtimeout;
 #endif
 
+#if CONFIG_SER_EVENTS
+	/**
+	 * \name Wake up of processes waiting for the FIFOs.
+	 *
+	 * A process that finds the tx FIFO full (or the rx FIFO empty) sets
+	 * \a txwake (\a rxwake) to the amount of free space (data) it needs
+	 * and sleeps on the event, which the driver interrupt triggers once
+	 * the FIFO crosses that level. 0 means nobody is waiting.
+	 *
+	 * \{
+	 */
+	Event txevent;
+	Event rxevent;
+	volatile size_t txwake;
+	volatile size_t rxwake;
+	/* \} */
+#endif
+
 	/** Holds the flags defined above.  Will be 0 when no errors have occurred. */
 	volatile serstatus_t status;
 
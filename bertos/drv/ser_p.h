@@ -40,8 +40,12 @@
 #ifndef DRV_SER_P_H
 #define DRV_SER_P_H
 
+#include "cfg/cfg_ser.h"
+
 #include <cfg/compiler.h> /* size_t */
 
+#include <drv/ser.h>
+
 struct SerialHardware;
 struct Serial;
 
@@ -53,6 +57,12 @@ struct SerialHardwareVT
 	void (*setParity)(struct SerialHardware *ctx, int parity);
 	void (*txStart)(struct SerialHardware *ctx);
 	bool (*txSending)(struct SerialHardware *ctx);
+	/**
+	 * Optional: hand \a len bytes from \a buf directly to the transmitter.
+	 * Called only when the tx FIFO is empty.
+	 * \return the number of bytes taken, 0 if the transmitter is busy.
+	 */
+	size_t (*txPush)(struct SerialHardware *ctx, const uint8_t *buf, size_t len);
 };
 
 struct SerialHardware
@@ -66,4 +76,37 @@ struct SerialHardware
 
 struct SerialHardware *ser_hw_getdesc(int unit);
 
+/**
+ * \name Notifications from the interrupt handlers.
+ *
+ * Drivers call ser_rxNotify() after putting data in the rx FIFO or
+ * flagging a receive error, and ser_txNotify() after taking data from
+ * the tx FIFO. With CONFIG_SER_EVENTS they wake up the process waiting
+ * in ser.c once the FIFO crosses the level it asked for; otherwise
+ * they compile to nothing.
+ *
+ * \{
+ */
+#if CONFIG_SER_EVENTS
+
+INLINE void ser_rxNotify(struct Serial *ser)
+{
+	if (ser->rxwake && (fifo_count(&ser->rxfifo) >= ser->rxwake || (ser->status & SERRF_RX)))
+		event_do(&ser->rxevent);
+}
+
+INLINE void ser_txNotify(struct Serial *ser)
+{
+	if (ser->txwake && fifo_len(&ser->txfifo) - fifo_count(&ser->txfifo) >= ser->txwake)
+		event_do(&ser->txevent);
+}
+
+#else /* !CONFIG_SER_EVENTS */
+
+	#define ser_rxNotify(ser) do {} while (0)
+	#define ser_txNotify(ser) do {} while (0)
+
+#endif /* !CONFIG_SER_EVENTS */
+/* \} */
+
 #endif /* DRV_SER_P_H */
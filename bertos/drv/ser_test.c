@@ -0,0 +1,303 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2010 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \brief Serial driver test, run on the emulated serial port.
+ *
+ * The port is connected to a socketpair: data written on the serial
+ * is read on the other end and vice versa.
+ *
+ * With the kernel, a process plays the line at LINE_RATE bytes per tick
+ * while another one measures the CPU left over by a process writing to
+ * or reading from the port.
+ *
+ * $test$: cp bertos/cfg/cfg_ser.h $cfgdir/
+ * $test$: echo  "#undef CONFIG_SER_EVENTS" >> $cfgdir/cfg_ser.h
+ * $test$: echo "#define CONFIG_SER_EVENTS 1" >> $cfgdir/cfg_ser.h
+ * $test$: cp bertos/cfg/cfg_proc.h $cfgdir/
+ * $test$: echo  "#undef CONFIG_KERN" >> $cfgdir/cfg_proc.h
+ * $test$: echo "#define CONFIG_KERN 1" >> $cfgdir/cfg_proc.h
+ * $test$: cp bertos/cfg/cfg_signal.h $cfgdir/
+ * $test$: echo  "#undef CONFIG_KERN_SIGNALS" >> $cfgdir/cfg_signal.h
+ * $test$: echo "#define CONFIG_KERN_SIGNALS 1" >> $cfgdir/cfg_signal.h
+ */
+
+#include "cfg/cfg_proc.h"
+
+#include <drv/ser.h>
+#include <drv/timer.h>
+
+#include <emul/ser_posix.h>
+
+#include <kern/proc.h>
+
+#include <cfg/compiler.h>
+#include <cfg/test.h>
+#include <cfg/debug.h>
+
+#include <sys/socket.h>
+#include <unistd.h>
+#include <string.h>
+
+#define TEST_LEN 1000
+
+static Serial ser;
+static int peer;
+static int port_sock;
+
+static uint8_t pattern(int i)
+{
+	return (uint8_t)(i * 7 + (i >> 8));
+}
+
+/* Feed \a len bytes from the peer and receive them through the serial */
+static bool ser_testRx(int start, size_t len)
+{
+	uint8_t buf[CONFIG_UART0_RXBUFSIZE];
+
+	for (size_t i = 0; i < len; i++)
+		buf[i] = pattern(start + i);
+	if (write(peer, buf, len) != (ssize_t)len)
+		return false;
+
+	ser_posix_rxIrq(SER_UART0);
+	memset(buf, 0, sizeof(buf));
+	if (kfile_read(&ser.fd, buf, len) != len)
+		return false;
+	for (size_t i = 0; i < len; i++)
+		if (buf[i] != pattern(start + i))
+			return false;
+	return true;
+}
+
+#if CONFIG_KERN
+
+#define LINE_RATE 16
+#define LOAD_LEN  8192
+
+PROC_DEFINE_STACK(line_stack, KERN_MINSTACKSIZE * 2);
+PROC_DEFINE_STACK(load_stack, KERN_MINSTACKSIZE * 2);
+
+static volatile int line_tx, line_rx; ///< Bytes the line still has to move.
+static volatile bool line_error;
+static volatile unsigned long load_count;
+
+/*
+ * The other end of the line: every tick take LINE_RATE bytes sent by
+ * the port, or send LINE_RATE bytes to it, raising the interrupt.
+ */
+static void line_entry(void)
+{
+	uint8_t buf[LINE_RATE];
+	int tx_pos = 0, rx_pos = 0;
+
+	for (;;)
+	{
+		timer_delayTicks(1);
+		if (line_tx)
+		{
+			ssize_t len = read(peer, buf, MIN(LINE_RATE, line_tx));
+			for (ssize_t i = 0; i < len; i++)
+				if (buf[i] != pattern(tx_pos++))
+					line_error = true;
+			if (len > 0)
+				line_tx -= len;
+			ser_posix_txIrq(SER_UART0);
+		}
+		if (line_rx)
+		{
+			int len = MIN(LINE_RATE, line_rx);
+			for (int i = 0; i < len; i++)
+				buf[i] = pattern(rx_pos++);
+			if (write(peer, buf, len) != len)
+				line_error = true;
+			line_rx -= len;
+			ser_posix_rxIrq(SER_UART0);
+		}
+	}
+}
+
+/* Any other process that would like to run */
+static void load_entry(void)
+{
+	for (;;)
+	{
+		load_count++;
+		cpu_relax();
+	}
+}
+
+/*
+ * Return the load process iterations per tick since \a start.
+ */
+static unsigned long loadRate(unsigned long count, ticks_t start)
+{
+	return count / MAX(timer_clock() - start, (ticks_t)1);
+}
+
+/*
+ * Write and read LOAD_LEN bytes at the line rate, and print how much of
+ * the CPU the load process got compared to an idle port.
+ */
+static void ser_testLoad(void)
+{
+	static uint8_t buf[LOAD_LEN];
+	ticks_t start;
+
+	/* Keep the socket buffer small, so that the line paces the port */
+	int sndbuf = 1;
+	setsockopt(port_sock, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+	proc_new(line_entry, NULL, sizeof(line_stack), line_stack);
+	proc_new(load_entry, NULL, sizeof(load_stack), load_stack);
+
+	load_count = 0;
+	start = timer_clock();
+	timer_delay(1000);
+	unsigned long idle = loadRate(load_count, start);
+
+	for (int i = 0; i < LOAD_LEN; i++)
+		buf[i] = pattern(i);
+	line_tx = LOAD_LEN;
+	load_count = 0;
+	start = timer_clock();
+	ASSERT(kfile_write(&ser.fd, buf, LOAD_LEN) == LOAD_LEN);
+	unsigned long tx = loadRate(load_count, start);
+	while (line_tx)
+		timer_delayTicks(1);
+
+	line_rx = LOAD_LEN;
+	load_count = 0;
+	start = timer_clock();
+	memset(buf, 0, sizeof(buf));
+	ASSERT(kfile_read(&ser.fd, buf, LOAD_LEN) == LOAD_LEN);
+	unsigned long rx = loadRate(load_count, start);
+	for (int i = 0; i < LOAD_LEN; i++)
+		ASSERT(buf[i] == pattern(i));
+
+	ASSERT(!line_error);
+	ASSERT(ser_getstatus(&ser) == 0);
+	kprintf("CPU left while writing %lu%%, while reading %lu%%\n",
+		tx * 100 / idle, rx * 100 / idle);
+#if CONFIG_SER_EVENTS
+	/* The waiting process sleeps, nearly all the CPU is left to the others */
+	ASSERT(tx * 100 / idle >= 80);
+	ASSERT(rx * 100 / idle >= 80);
+#endif
+}
+
+#endif /* CONFIG_KERN */
+
+int ser_testSetup(void)
+{
+	int sv[2];
+
+	kdbg_init();
+	#if CONFIG_KERN
+		/* Blocking waits sleep on the driver events */
+		timer_init();
+		proc_init();
+	#endif
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+		return -1;
+
+	ser_init(&ser, SER_UART0);
+	ser_posix_setFd(SER_UART0, sv[0]);
+	port_sock = sv[0];
+	peer = sv[1];
+	return 0;
+}
+
+int ser_testRun(void)
+{
+	static uint8_t buf[TEST_LEN];
+	size_t len;
+	int start = 0;
+
+	/* Transmit: everything must come out in order */
+	for (int i = 0; i < TEST_LEN; i++)
+		buf[i] = pattern(i);
+	ASSERT(kfile_write(&ser.fd, buf, TEST_LEN) == TEST_LEN);
+	ASSERT(kfile_flush(&ser.fd) == 0);
+
+	memset(buf, 0, sizeof(buf));
+	for (len = 0; len < TEST_LEN; )
+	{
+		ssize_t ret = read(peer, buf + len, TEST_LEN - len);
+		ASSERT(ret > 0);
+		len += ret;
+	}
+	for (int i = 0; i < TEST_LEN; i++)
+		ASSERT(buf[i] == pattern(i));
+
+	/* Receive frames of every length, crossing the FIFO wrap point */
+	for (len = 1; len < CONFIG_UART0_RXBUFSIZE; len++)
+	{
+		ASSERT(ser_testRx(start, len));
+		start += len;
+	}
+	ASSERT(ser_getstatus(&ser) == 0);
+
+#if CONFIG_SER_DMA
+	/*
+	 * A burst larger than the FIFO overwrites the oldest data:
+	 * the overrun is flagged and the newest bytes are kept.
+	 */
+	for (int i = 0; i < 2 * CONFIG_UART0_RXBUFSIZE; i++)
+		buf[i] = pattern(i);
+	ASSERT(write(peer, buf, 2 * CONFIG_UART0_RXBUFSIZE) == 2 * CONFIG_UART0_RXBUFSIZE);
+	ser_posix_rxIrq(SER_UART0);
+	ASSERT(ser_getstatus(&ser) & SERRF_RXFIFOOVERRUN);
+	ser_setstatus(&ser, 0);
+
+	len = CONFIG_UART0_RXBUFSIZE - 1;
+	memset(buf, 0, sizeof(buf));
+	ASSERT(kfile_read(&ser.fd, buf, len) == len);
+	for (size_t i = 0; i < len; i++)
+		ASSERT(buf[i] == pattern(2 * CONFIG_UART0_RXBUFSIZE - len + i));
+
+	/* The receiver goes on normally afterwards */
+	ASSERT(ser_testRx(start, CONFIG_UART0_RXBUFSIZE / 2));
+#endif
+
+#if CONFIG_KERN
+	ser_testLoad();
+#endif
+	return 0;
+}
+
+int ser_testTearDown(void)
+{
+	close(peer);
+	return kfile_close(&ser.fd);
+}
+
+TEST_MAIN(ser);
@@ -48,6 +48,13 @@
 
 static volatile DSTATUS Stat = STA_NOINIT;
 
+/**
+ * Disk access counters, used by tests and benchmarks to measure the number
+ * of commands (as an SD card would see them) and sectors transferred.
+ */
+unsigned long diskio_emul_read_cmds, diskio_emul_read_sectors;
+unsigned long diskio_emul_write_cmds, diskio_emul_write_sectors;
+
 /**
  * This is an example implementation, used to simulate the the calls to normal filesystem calls
  * It only works for drive 0.
@@ -115,6 +122,8 @@ DRESULT disk_read(
 	if (Stat & STA_NOINIT)
 		return RES_NOTRDY;
 
+	diskio_emul_read_cmds++;
+	diskio_emul_read_sectors += count;
 	fseek(fake_disk, sector * SECTOR_SIZE, SEEK_SET);
 	size_t read_items = fread(buff, SECTOR_SIZE, count, fake_disk);
 	if (read_items == count)
@@ -147,6 +156,8 @@ DRESULT disk_write(
 	if (Stat & STA_PROTECT)
 		return RES_WRPRT;
 
+	diskio_emul_write_cmds++;
+	diskio_emul_write_sectors += count;
 	fseek(fake_disk, sector * SECTOR_SIZE, SEEK_SET);
 	size_t write_items = fwrite(buff, SECTOR_SIZE, count, fake_disk);
 	if (write_items == count)
@@ -35,6 +35,8 @@
  * \author Bernie Innocenti <bernie@codewiz.org>
  */
 
+#include "ser_posix.h"
+
 #include "cfg/cfg_ser.h"
 
 #include <cfg/debug.h>
@@ -48,12 +50,9 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 
-#include <fcntl.h>  /* open() */
+#include <fcntl.h>  /* open(), fcntl() */
 #include <unistd.h> /* read(), write() */
 
-/* From the high-level serial driver */
-extern struct Serial ser_handles[SER_CNT];
-
 /* TX and RX buffers */
 static unsigned char uart0_txbuffer[CONFIG_UART0_TXBUFSIZE];
 static unsigned char uart0_rxbuffer[CONFIG_UART0_RXBUFSIZE];
@@ -68,6 +67,9 @@ struct EmulSerial
 	struct SerialHardware hw;
 	struct Serial *ser;
 	int fd;
+#if CONFIG_SER_DMA
+	unsigned char *dma_rx; ///< Next rx FIFO location written by the simulated DMA.
+#endif
 };
 
 /*
@@ -79,6 +81,9 @@ static void uart_init(struct SerialHardware *_hw, struct Serial *ser)
 
 	hw->ser = ser;
 	hw->fd = open("/dev/ttyS0", O_RDWR);
+#if CONFIG_SER_DMA
+	hw->dma_rx = ser->rxfifo.begin;
+#endif
 }
 
 static void uart_cleanup(UNUSED_ARG(struct SerialHardware *, _hw))
@@ -89,17 +94,33 @@ static void uart_cleanup(UNUSED_ARG(struct SerialHardware *, _hw))
 	hw->fd = -1;
 }
 
+/*
+ * Like a DMA transmitter, send the tx FIFO contents in place
+ * one contiguous run at a time.
+ */
 static void uart_txStart(struct SerialHardware *_hw)
 {
 	struct EmulSerial *hw = (struct EmulSerial *)_hw;
+	unsigned char *data;
+	size_t len;
+	ssize_t ret;
 
-	while (!fifo_isempty(&hw->ser->txfifo))
+	while ((len = fifo_peekblock(&hw->ser->txfifo, &data)) != 0)
 	{
-		char c = fifo_pop(&hw->ser->txfifo);
-		write(hw->fd, &c, 1);
+		if ((ret = write(hw->fd, data, len)) <= 0)
+			break;
+		fifo_skip(&hw->ser->txfifo, ret);
 	}
 }
 
+static size_t uart_txPush(struct SerialHardware *_hw, const uint8_t *buf, size_t len)
+{
+	struct EmulSerial *hw = (struct EmulSerial *)_hw;
+	ssize_t ret = write(hw->fd, buf, len);
+
+	return ret < 0 ? 0 : (size_t)ret;
+}
+
 static bool uart_txSending(UNUSED_ARG(struct SerialHardware *, _hw))
 {
 	return false;
@@ -140,6 +161,7 @@ static const struct SerialHardwareVT uart_vtable =
         C99INIT(setParity, uart_setParity),
         C99INIT(txStart, uart_txStart),
         C99INIT(txSending, uart_txSending),
+        C99INIT(txPush, uart_txPush),
 };
 
 static struct EmulSerial UARTDescs[SER_CNT] =
@@ -168,8 +190,85 @@ static struct EmulSerial UARTDescs[SER_CNT] =
         },
 };
 
+void ser_posix_setFd(int unit, int fd)
+{
+	ASSERT(unit < SER_CNT);
+	struct EmulSerial *hw = &UARTDescs[unit];
+
+	if (hw->fd >= 0)
+		close(hw->fd);
+	hw->fd = fd;
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+#if CONFIG_SER_DMA
+
+void ser_posix_rxIrq(int unit)
+{
+	ASSERT(unit < SER_CNT);
+	struct EmulSerial *hw = &UARTDescs[unit];
+	FIFOBuffer *rxfifo = &hw->ser->rxfifo;
+	size_t half = (rxfifo->end - rxfifo->begin + 1) / 2;
+	unsigned char *limit;
+	ssize_t len;
+
+	for (;;)
+	{
+		/* Stop at the end of the current half, like the real PDC */
+		limit = (hw->dma_rx < rxfifo->begin + half) ?
+			rxfifo->begin + half : rxfifo->end + 1;
+		if ((len = read(hw->fd, hw->dma_rx, limit - hw->dma_rx)) <= 0)
+			break;
+
+		hw->dma_rx += len;
+		if (hw->dma_rx == rxfifo->end + 1)
+			hw->dma_rx = rxfifo->begin;
+		if (hw->dma_rx != rxfifo->begin && hw->dma_rx != rxfifo->begin + half)
+			continue;
+
+		/* End of half buffer interrupt */
+		if (!fifo_fillto(rxfifo, hw->dma_rx))
+			hw->ser->status |= SERRF_RXFIFOOVERRUN;
+	}
+
+	/* Idle line interrupt */
+	if (!fifo_fillto(rxfifo, hw->dma_rx))
+		hw->ser->status |= SERRF_RXFIFOOVERRUN;
+	ser_rxNotify(hw->ser);
+}
+
+#else /* !CONFIG_SER_DMA */
+
+void ser_posix_rxIrq(int unit)
+{
+	ASSERT(unit < SER_CNT);
+	struct EmulSerial *hw = &UARTDescs[unit];
+	FIFOBuffer *rxfifo = &hw->ser->rxfifo;
+	unsigned char c;
+
+	while (read(hw->fd, &c, 1) == 1)
+	{
+		if (fifo_isfull(rxfifo))
+			hw->ser->status |= SERRF_RXFIFOOVERRUN;
+		else
+			fifo_push(rxfifo, c);
+	}
+	ser_rxNotify(hw->ser);
+}
+
+#endif /* !CONFIG_SER_DMA */
+
 struct SerialHardware *ser_hw_getdesc(int unit)
 {
 	ASSERT(unit < SER_CNT);
 	return &UARTDescs[unit].hw;
 }
+
+void ser_posix_txIrq(int unit)
+{
+	ASSERT(unit < SER_CNT);
+	struct EmulSerial *hw = &UARTDescs[unit];
+
+	uart_txStart(&hw->hw);
+	ser_txNotify(hw->ser);
+}
@@ -0,0 +1,72 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2010 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \brief Serial port emulator hooks for hosted environments.
+ *
+ * The emulated ports have no interrupts: these functions let a program
+ * (usually a test) connect a port to an arbitrary file descriptor and
+ * trigger the receiver when data is expected.
+ */
+
+#ifndef SER_POSIX_H
+#define SER_POSIX_H
+
+/**
+ * Connect emulated serial port \a unit to file descriptor \a fd,
+ * for example one end of a socketpair() or a pseudo terminal.
+ *
+ * The port must be already open; its previous descriptor is closed.
+ */
+void ser_posix_setFd(int unit, int fd);
+
+/**
+ * Simulate the receive interrupt of serial port \a unit, moving into its
+ * rx FIFO the data waiting on the file descriptor.
+ *
+ * With CONFIG_SER_DMA the receiver behaves like a circular DMA writing
+ * in the rx FIFO memory: the FIFO is updated every half buffer and when
+ * no more data is available (the idle line interrupt), and unread data
+ * is overwritten if the reader does not keep up.
+ */
+void ser_posix_rxIrq(int unit);
+
+/**
+ * Simulate the transmit interrupt of serial port \a unit, moving into the
+ * file descriptor the tx FIFO data it accepts.
+ *
+ * The emulated transmitter sends data as soon as it is queued: call this
+ * when the descriptor had no room for it, for example because the peer
+ * of a socket reads slower than the port writes.
+ */
+void ser_posix_txIrq(int unit);
+
+#endif /* SER_POSIX_H */
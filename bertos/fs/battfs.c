@@ -50,10 +50,21 @@
 
 #include <string.h> /* memset, memmove */
 
+#if CONFIG_BATTFS_GC
+	#if !CONFIG_BATTFS_WEAR_LEVELING
+		#error "BattFS garbage collector needs CONFIG_BATTFS_WEAR_LEVELING"
+	#endif
+	#include <kern/proc.h>
+	#include <kern/sem.h>
+	#include <kern/signal.h>
+	#include <drv/timer.h>
+	#include <cpu/irq.h>
+#endif
+
 #if LOG_LEVEL >= LOG_LVL_INFO
 static void dumpPageArray(struct BattFsSuper *disk)
 {
-	kprintf("Page array dump, free_page_start %d:", disk->free_page_start);
+	kprintf("Page array dump, free_page_start %d, free_head %d:", disk->free_page_start, disk->free_head);
 	for (pgcnt_t i = 0; i < disk->dev->blk_cnt; i++)
 	{
 		if (!(i % 16))
@@ -174,20 +185,6 @@ static bool writeHdr(struct BattFsSuper *disk, pgcnt_t page, struct BattFsPageHe
 	return true;
 }
 
-/**
- * Count the number of pages from
- * inode 0 to \a inode in \a filelen_table.
- */
-static pgcnt_t countPages(pgoff_t *filelen_table, inode_t inode)
-{
-	pgcnt_t cnt = 0;
-
-	for (inode_t i = 0; i < inode; i++)
-		cnt += filelen_table[i];
-
-	return cnt;
-}
-
 /**
  * Move all pages in page allocation array from \a src to \a src + \a offset.
  * The number of pages moved is page_count - MAX(dst, src).
@@ -207,15 +204,16 @@ static void movePages(struct BattFsSuper *disk, pgcnt_t src, int offset)
 }
 
 /**
- * Count number of pages per file on \a disk.
- * This information is registered in \a filelen_table.
- * Array index represent file inode, while value contained
- * is the number of pages used by that file.
+ * Count number of pages per file on \a disk and
+ * build the per-inode index in disk->file_start.
+ * Once done, file_start[i] is the position of the first
+ * page of file i in the page array and file i uses
+ * file_start[i + 1] - file_start[i] pages.
  *
  * \return true if ok, false on disk read errors.
  * \note The whole disk is scanned once.
  */
-static bool countDiskFilePages(struct BattFsSuper *disk, pgoff_t *filelen_table)
+static bool countDiskFilePages(struct BattFsSuper *disk)
 {
 	BattFsPageHeader hdr;
 	disk->free_page_start = 0;
@@ -235,7 +233,7 @@ static bool countDiskFilePages(struct BattFsSuper *disk, pgoff_t *filelen_table)
 			ASSERT(hdr.fill <= disk->data_size);
 
 			/* Page is valid and is owned by a file */
-			filelen_table[hdr.inode]++;
+			disk->file_start[hdr.inode + 1]++;
 
 			/* Keep trace of free space */
 			disk->free_bytes -= hdr.fill;
@@ -244,12 +242,17 @@ static bool countDiskFilePages(struct BattFsSuper *disk, pgoff_t *filelen_table)
 	}
 	LOG_INFO("free_bytes:%ld, free_page_start:%d\n", (long)disk->free_bytes, disk->free_page_start);
 
+	/* Turn file lengths into start positions */
+	for (int i = 0; i < BATTFS_MAX_FILES; i++)
+		disk->file_start[i + 1] += disk->file_start[i];
+
+	ASSERT(disk->file_start[BATTFS_MAX_FILES] == disk->free_page_start);
 	return true;
 }
 
 /**
  * Fill page allocation array of \a disk
- * using file lenghts in \a filelen_table.
+ * using the file index in disk->file_start.
  *
  * The page allocation array is an array containings all file infos.
  * Is ordered by file, and within each file is ordered by page offset
@@ -261,7 +264,7 @@ static bool countDiskFilePages(struct BattFsSuper *disk, pgoff_t *filelen_table)
  * \return true if ok, false on disk read errors.
  * \note The whole disk is scanned at max twice.
  */
-static bool fillPageArray(struct BattFsSuper *disk, pgoff_t *filelen_table)
+static bool fillPageArray(struct BattFsSuper *disk)
 {
 	BattFsPageHeader hdr;
 	pgcnt_t curr_free_page = disk->free_page_start;
@@ -275,8 +278,7 @@ static bool fillPageArray(struct BattFsSuper *disk, pgoff_t *filelen_table)
 		if (hdr.fcs == computeFcs(&hdr))
 		{
 			/* Compute array position */
-			pgcnt_t array_pos = countPages(filelen_table, hdr.inode);
-			array_pos += hdr.pgoff;
+			pgcnt_t array_pos = disk->file_start[hdr.inode] + hdr.pgoff;
 
 			/* Check if position is already used by another page of the same file */
 			if (disk->page_array[array_pos] == PAGE_UNSET_SENTINEL)
@@ -327,11 +329,10 @@ static bool fillPageArray(struct BattFsSuper *disk, pgoff_t *filelen_table)
 				/* Add free space */
 				disk->free_bytes += old_fill;
 				/* Shift all array one position to the left, overwriting duplicate page */
-				array_pos -= hdr.pgoff;
-				array_pos += filelen_table[hdr.inode];
-				movePages(disk, array_pos, -1);
+				movePages(disk, disk->file_start[hdr.inode + 1], -1);
 				/* Move back all indexes */
-				filelen_table[hdr.inode]--;
+				for (int i = hdr.inode + 1; i <= BATTFS_MAX_FILES; i++)
+					disk->file_start[i]--;
 				disk->free_page_start--;
 				curr_free_page--;
 				/* Set old page as free */
@@ -351,14 +352,11 @@ static bool fillPageArray(struct BattFsSuper *disk, pgoff_t *filelen_table)
 }
 
 /**
- * Initialize and mount disk described by
- * \a disk.
- * \return false on errors, true otherwise.
+ * Init \a disk geometry for device \a dev, using \a page_array
+ * as page allocation array.
  */
-bool battfs_mount(struct BattFsSuper *disk, struct KBlock *dev, pgcnt_t *page_array, size_t array_size)
+static void initSuper(struct BattFsSuper *disk, struct KBlock *dev, pgcnt_t *page_array, size_t array_size)
 {
-	pgoff_t filelen_table[BATTFS_MAX_FILES];
-
 	ASSERT(dev);
 	ASSERT(kblock_partialWrite(dev));
 	disk->dev = dev;
@@ -372,26 +370,44 @@ bool battfs_mount(struct BattFsSuper *disk, struct KBlock *dev, pgcnt_t *page_ar
 	disk->page_array = page_array;
 	ASSERT(array_size >= disk->dev->blk_cnt * sizeof(pgcnt_t));
 
-	memset(filelen_table, 0, BATTFS_MAX_FILES * sizeof(pgoff_t));
+	disk->disk_size = (disk_size_t)disk->data_size * disk->dev->blk_cnt;
 
+#if CONFIG_BATTFS_WEAR_LEVELING
+	disk->erase_cnt = NULL;
+	disk->gc_pos = 0;
+#endif
+#if CONFIG_BATTFS_GC
+	disk->gc_lock = NULL;
+	disk->gc_run = false;
+	disk->gc_waiter = NULL;
+#endif
+}
+
+/**
+ * Build page allocation array of \a disk reading
+ * all page headers.
+ * \return false on errors, true otherwise.
+ */
+static bool scanDisk(struct BattFsSuper *disk)
+{
+	memset(disk->file_start, 0, sizeof(disk->file_start));
 	disk->free_bytes = 0;
-	disk->disk_size = (disk_size_t)disk->data_size * disk->dev->blk_cnt;
 
 	/* Count pages per file */
-	if (!countDiskFilePages(disk, filelen_table))
+	if (!countDiskFilePages(disk))
 	{
 		LOG_ERR("counting file pages\n");
 		return false;
 	}
 
-	/* Once here, we have filelen_table filled with file lengths */
+	/* Once here, we have file_start filled with file positions */
 
 	/* Fill page array with sentinel */
 	for (pgcnt_t page = 0; page < disk->dev->blk_cnt; page++)
 		disk->page_array[page] = PAGE_UNSET_SENTINEL;
 
-	/* Fill page allocation array using filelen_table */
-	if (!fillPageArray(disk, filelen_table))
+	/* Fill page allocation array using file_start */
+	if (!fillPageArray(disk))
 	{
 		LOG_ERR("filling page array\n");
 		return false;
@@ -407,6 +423,544 @@ bool battfs_mount(struct BattFsSuper *disk, struct KBlock *dev, pgcnt_t *page_ar
 	dumpPageArray(disk);
 	#endif
 #endif
+	disk->free_head = disk->free_page_start;
+	return true;
+}
+
+#if CONFIG_BATTFS_CHECKPOINT
+
+#define BATTFS_CKP_MAGIC MAKE_ID('B', 'F', 'C', 'K')
+#define BATTFS_CKP_VALID 0x5A ///< Checkpoint matches the disk.
+#define BATTFS_CKP_STALE 0x00 ///< Disk has been modified after the checkpoint.
+
+/**
+ * Number of page array entries converted at once
+ * when reading or writing the checkpoint.
+ */
+#define CKP_CHUNK 16
+
+/**
+ * Checkpoint header, used to represent the checkpoint
+ * header in memory.
+ * \see ckp_to_disk
+ * \see disk_to_ckp
+ */
+typedef struct BattFsCheckpoint
+{
+	uint32_t magic;             ///< BATTFS_CKP_MAGIC.
+	uint32_t seq;               ///< Checkpoint sequence number, increased at every checkpoint.
+	uint8_t state;              ///< BATTFS_CKP_VALID or BATTFS_CKP_STALE.
+	pgcnt_t blk_cnt;            ///< Number of pages of the disk.
+	uint16_t blk_size;          ///< Size of a disk page.
+	pgcnt_t free_page_start;    ///< Saved BattFsSuper::free_page_start.
+	pgcnt_t free_head;          ///< Saved BattFsSuper::free_head.
+	disk_size_t free_bytes;     ///< Saved BattFsSuper::free_bytes.
+	fcs_t table_fcs;            ///< FCS of the file index and page array.
+	fcs_t fcs;                  ///< FCS of the header.
+} BattFsCheckpoint;
+
+/**
+ * Convert checkpoint header from memory representation to disk structure.
+ * \note filesystem is in little-endian format.
+ */
+INLINE void ckp_to_disk(struct BattFsCheckpoint *ckp, uint8_t *buf)
+{
+	STATIC_ASSERT(BATTFS_CKP_HEADER_LEN == 26);
+	buf[0] = ckp->magic;
+	buf[1] = ckp->magic >> 8;
+	buf[2] = ckp->magic >> 16;
+	buf[3] = ckp->magic >> 24;
+
+	buf[4] = ckp->seq;
+	buf[5] = ckp->seq >> 8;
+	buf[6] = ckp->seq >> 16;
+	buf[7] = ckp->seq >> 24;
+
+	buf[8] = ckp->state;
+	buf[9] = 0;
+
+	buf[10] = ckp->blk_cnt;
+	buf[11] = ckp->blk_cnt >> 8;
+	buf[12] = ckp->blk_size;
+	buf[13] = ckp->blk_size >> 8;
+
+	buf[14] = ckp->free_page_start;
+	buf[15] = ckp->free_page_start >> 8;
+	buf[16] = ckp->free_head;
+	buf[17] = ckp->free_head >> 8;
+
+	buf[18] = ckp->free_bytes;
+	buf[19] = ckp->free_bytes >> 8;
+	buf[20] = ckp->free_bytes >> 16;
+	buf[21] = ckp->free_bytes >> 24;
+
+	buf[22] = ckp->table_fcs;
+	buf[23] = ckp->table_fcs >> 8;
+
+	/* Header FCS must be the last field */
+	buf[24] = ckp->fcs;
+	buf[25] = ckp->fcs >> 8;
+}
+
+/**
+ * Convert checkpoint header from disk structure to memory representation.
+ * \note filesystem is in little-endian format.
+ */
+INLINE void disk_to_ckp(uint8_t *buf, struct BattFsCheckpoint *ckp)
+{
+	STATIC_ASSERT(BATTFS_CKP_HEADER_LEN == 26);
+	ckp->magic = (uint32_t)buf[3] << 24 | (uint32_t)buf[2] << 16 | buf[1] << 8 | buf[0];
+	ckp->seq = (uint32_t)buf[7] << 24 | (uint32_t)buf[6] << 16 | buf[5] << 8 | buf[4];
+	ckp->state = buf[8];
+	ckp->blk_cnt = buf[11] << 8 | buf[10];
+	ckp->blk_size = buf[13] << 8 | buf[12];
+	ckp->free_page_start = buf[15] << 8 | buf[14];
+	ckp->free_head = buf[17] << 8 | buf[16];
+	ckp->free_bytes = (disk_size_t)buf[21] << 24 | (disk_size_t)buf[20] << 16 | buf[19] << 8 | buf[18];
+	ckp->table_fcs = buf[23] << 8 | buf[22];
+	ckp->fcs = buf[25] << 8 | buf[24];
+}
+
+/**
+ * Compute the fcs of the checkpoint header in disk format \a buf.
+ */
+static fcs_t ckpFcs(const uint8_t *buf)
+{
+	fcs_t cks;
+
+	rotating_init(&cks);
+	/* fcs is at the end of whole header */
+	rotating_update(buf, BATTFS_CKP_HEADER_LEN - sizeof(fcs_t), &cks);
+	return cks;
+}
+
+/**
+ * Read \a len bytes at offset \a pos of the checkpoint area in \a buf.
+ * \return true on success, false otherwise.
+ */
+static bool ckpRead(struct BattFsSuper *disk, disk_size_t pos, uint8_t *buf, size_t len)
+{
+	while (len)
+	{
+		block_idx_t blk = pos / disk->ckp->blk_size;
+		size_t offset = pos % disk->ckp->blk_size;
+		size_t size = MIN(len, disk->ckp->blk_size - offset);
+
+		if (kblock_read(disk->ckp, blk, buf, offset, size) != size)
+		{
+			LOG_ERR("reading checkpoint block %ld\n", (long)blk);
+			return false;
+		}
+		pos += size;
+		buf += size;
+		len -= size;
+	}
+	return true;
+}
+
+/**
+ * Write \a len bytes from \a buf at offset \a pos of the checkpoint area.
+ * \return true on success, false otherwise.
+ */
+static bool ckpWrite(struct BattFsSuper *disk, disk_size_t pos, const uint8_t *buf, size_t len)
+{
+	while (len)
+	{
+		block_idx_t blk = pos / disk->ckp->blk_size;
+		size_t offset = pos % disk->ckp->blk_size;
+		size_t size = MIN(len, disk->ckp->blk_size - offset);
+
+		if (kblock_write(disk->ckp, blk, buf, offset, size) != size)
+		{
+			LOG_ERR("writing checkpoint block %ld\n", (long)blk);
+			return false;
+		}
+		pos += size;
+		buf += size;
+		len -= size;
+	}
+	return true;
+}
+
+/**
+ * Read \a count page array entries in \a table from
+ * offset \a pos of the checkpoint area, updating \a fcs.
+ * \a pos is moved after the last entry read.
+ */
+static bool ckpReadTable(struct BattFsSuper *disk, disk_size_t *pos, pgcnt_t *table, disk_size_t count, fcs_t *fcs)
+{
+	uint8_t buf[CKP_CHUNK * sizeof(pgcnt_t)];
+
+	STATIC_ASSERT(sizeof(pgcnt_t) == 2);
+	while (count)
+	{
+		size_t n = MIN(count, (disk_size_t)CKP_CHUNK);
+
+		if (!ckpRead(disk, *pos, buf, n * sizeof(pgcnt_t)))
+			return false;
+		rotating_update(buf, n * sizeof(pgcnt_t), fcs);
+
+		for (size_t i = 0; i < n; i++)
+			table[i] = buf[2 * i + 1] << 8 | buf[2 * i];
+
+		*pos += n * sizeof(pgcnt_t);
+		table += n;
+		count -= n;
+	}
+	return true;
+}
+
+/**
+ * Write \a count page array entries from \a table at
+ * offset \a pos of the checkpoint area, updating \a fcs.
+ * \a pos is moved after the last entry written.
+ */
+static bool ckpWriteTable(struct BattFsSuper *disk, disk_size_t *pos, const pgcnt_t *table, disk_size_t count, fcs_t *fcs)
+{
+	uint8_t buf[CKP_CHUNK * sizeof(pgcnt_t)];
+
+	STATIC_ASSERT(sizeof(pgcnt_t) == 2);
+	while (count)
+	{
+		size_t n = MIN(count, (disk_size_t)CKP_CHUNK);
+
+		for (size_t i = 0; i < n; i++)
+		{
+			buf[2 * i] = table[i];
+			buf[2 * i + 1] = table[i] >> 8;
+		}
+		rotating_update(buf, n * sizeof(pgcnt_t), fcs);
+
+		if (!ckpWrite(disk, *pos, buf, n * sizeof(pgcnt_t)))
+			return false;
+
+		*pos += n * sizeof(pgcnt_t);
+		table += n;
+		count -= n;
+	}
+	return true;
+}
+
+#if CONFIG_BATTFS_WEAR_LEVELING
+/**
+ * Offset of the erase counters section in the checkpoint area.
+ * The section starts with its FCS, followed by the counters.
+ */
+#define CKP_WEAR_POS(disk) (BATTFS_CKP_HEADER_LEN + ((BATTFS_MAX_FILES + 1) + (disk_size_t)(disk)->dev->blk_cnt) * sizeof(pgcnt_t))
+
+/**
+ * Read erase counters of \a disk from the checkpoint area.
+ * \return true if ok, false on errors or if the counters are corrupted.
+ */
+static bool ckpReadWear(struct BattFsSuper *disk)
+{
+	uint8_t buf[CKP_CHUNK * sizeof(erase_t)];
+	disk_size_t pos = CKP_WEAR_POS(disk);
+	fcs_t fcs, saved_fcs;
+
+	STATIC_ASSERT(sizeof(erase_t) == 4);
+	if (!ckpRead(disk, pos, buf, sizeof(fcs_t)))
+		return false;
+	saved_fcs = buf[1] << 8 | buf[0];
+	pos += sizeof(fcs_t);
+
+	rotating_init(&fcs);
+	for (pgcnt_t page = 0; page < disk->dev->blk_cnt;)
+	{
+		pgcnt_t n = MIN((pgcnt_t)(disk->dev->blk_cnt - page), (pgcnt_t)CKP_CHUNK);
+
+		if (!ckpRead(disk, pos, buf, n * sizeof(erase_t)))
+			return false;
+		rotating_update(buf, n * sizeof(erase_t), &fcs);
+
+		for (pgcnt_t i = 0; i < n; i++)
+			disk->erase_cnt[page + i] = (erase_t)buf[4 * i + 3] << 24 | (erase_t)buf[4 * i + 2] << 16
+				| buf[4 * i + 1] << 8 | buf[4 * i];
+
+		pos += n * sizeof(erase_t);
+		page += n;
+	}
+
+	if (fcs != saved_fcs)
+	{
+		LOG_WARN("Erase counters corrupted\n");
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Save erase counters of \a disk in the checkpoint area.
+ * \return true if ok, false on errors.
+ */
+static bool ckpWriteWear(struct BattFsSuper *disk)
+{
+	uint8_t buf[CKP_CHUNK * sizeof(erase_t)];
+	disk_size_t pos = CKP_WEAR_POS(disk) + sizeof(fcs_t);
+	fcs_t fcs;
+
+	rotating_init(&fcs);
+	for (pgcnt_t page = 0; page < disk->dev->blk_cnt;)
+	{
+		pgcnt_t n = MIN((pgcnt_t)(disk->dev->blk_cnt - page), (pgcnt_t)CKP_CHUNK);
+
+		for (pgcnt_t i = 0; i < n; i++)
+		{
+			erase_t cnt = disk->erase_cnt[page + i];
+			buf[4 * i] = cnt;
+			buf[4 * i + 1] = cnt >> 8;
+			buf[4 * i + 2] = cnt >> 16;
+			buf[4 * i + 3] = cnt >> 24;
+		}
+		rotating_update(buf, n * sizeof(erase_t), &fcs);
+
+		if (!ckpWrite(disk, pos, buf, n * sizeof(erase_t)))
+			return false;
+
+		pos += n * sizeof(erase_t);
+		page += n;
+	}
+
+	buf[0] = fcs;
+	buf[1] = fcs >> 8;
+	return ckpWrite(disk, CKP_WEAR_POS(disk), buf, sizeof(fcs_t));
+}
+#endif /* CONFIG_BATTFS_WEAR_LEVELING */
+
+/**
+ * Write the checkpoint header of \a disk with \a state
+ * and \a table_fcs and flush the checkpoint device.
+ */
+static bool ckpWriteHeader(struct BattFsSuper *disk, uint8_t state, fcs_t table_fcs)
+{
+	uint8_t buf[BATTFS_CKP_HEADER_LEN];
+	BattFsCheckpoint ckp;
+
+	ckp.magic = BATTFS_CKP_MAGIC;
+	ckp.seq = disk->ckp_seq;
+	ckp.state = state;
+	ckp.blk_cnt = disk->dev->blk_cnt;
+	ckp.blk_size = disk->dev->blk_size;
+	ckp.free_page_start = disk->free_page_start;
+	ckp.free_head = disk->free_head;
+	ckp.free_bytes = disk->free_bytes;
+	ckp.table_fcs = table_fcs;
+	ckp.fcs = 0;
+
+	ckp_to_disk(&ckp, buf);
+	ckp.fcs = ckpFcs(buf);
+	ckp_to_disk(&ckp, buf);
+
+	return ckpWrite(disk, 0, buf, sizeof(buf)) && kblock_flush(disk->ckp) == 0;
+}
+
+/**
+ * Check the tables loaded from checkpoint \a ckp against the geometry of
+ * \a disk, so that a checkpoint written with a good FCS from a corrupted
+ * page array can't send the filesystem outside the disk.
+ * \return true if every file start, page and the free head are in range.
+ */
+static bool ckpCheckTables(struct BattFsSuper *disk, const BattFsCheckpoint *ckp)
+{
+	pgcnt_t blk_cnt = disk->dev->blk_cnt;
+
+	if (disk->file_start[0] != 0 || disk->file_start[BATTFS_MAX_FILES] != ckp->free_page_start)
+		return false;
+	for (int i = 0; i < BATTFS_MAX_FILES; i++)
+		if (disk->file_start[i] > disk->file_start[i + 1])
+			return false;
+
+	for (pgcnt_t page = 0; page < blk_cnt; page++)
+		if (disk->page_array[page] >= blk_cnt)
+			return false;
+
+	return ckp->free_page_start >= blk_cnt
+		|| (ckp->free_head >= ckp->free_page_start && ckp->free_head < blk_cnt);
+}
+
+/**
+ * Load page allocation array of \a disk from the checkpoint.
+ * \return true if the checkpoint is valid and has been loaded,
+ *         false if a full disk scan is needed.
+ */
+static bool ckpLoad(struct BattFsSuper *disk)
+{
+	uint8_t buf[BATTFS_CKP_HEADER_LEN];
+	BattFsCheckpoint ckp;
+	fcs_t fcs;
+	disk_size_t pos = BATTFS_CKP_HEADER_LEN;
+
+	disk->ckp_seq = 0;
+	disk->ckp_valid = false;
+
+	if (!ckpRead(disk, 0, buf, sizeof(buf)))
+		return false;
+
+	disk_to_ckp(buf, &ckp);
+	if (ckp.magic != BATTFS_CKP_MAGIC || ckp.fcs != ckpFcs(buf))
+	{
+		LOG_INFO("No checkpoint found\n");
+		return false;
+	}
+
+	disk->ckp_seq = ckp.seq;
+	if (ckp.state != BATTFS_CKP_VALID)
+	{
+		LOG_INFO("Checkpoint %ld is stale\n", (long)ckp.seq);
+		return false;
+	}
+
+	if (ckp.blk_cnt != disk->dev->blk_cnt
+		|| ckp.blk_size != disk->dev->blk_size
+		|| ckp.free_page_start > ckp.blk_cnt
+		|| ckp.free_bytes > disk->disk_size)
+	{
+		LOG_WARN("Checkpoint %ld does not match disk geometry\n", (long)ckp.seq);
+		return false;
+	}
+
+	rotating_init(&fcs);
+	if (!ckpReadTable(disk, &pos, disk->file_start, BATTFS_MAX_FILES + 1, &fcs)
+		|| !ckpReadTable(disk, &pos, disk->page_array, disk->dev->blk_cnt, &fcs))
+		return false;
+
+	if (fcs != ckp.table_fcs || !ckpCheckTables(disk, &ckp))
+	{
+		LOG_WARN("Checkpoint %ld corrupted\n", (long)ckp.seq);
+		return false;
+	}
+
+	disk->free_page_start = ckp.free_page_start;
+	disk->free_head = ckp.free_head;
+	disk->free_bytes = ckp.free_bytes;
+	disk->ckp_valid = true;
+
+	LOG_INFO("Mounted from checkpoint %ld\n", (long)ckp.seq);
+#if LOG_LEVEL >= LOG_LVL_INFO
+	dumpPageArray(disk);
+#endif
+	return true;
+}
+
+/**
+ * Mark the checkpoint of \a disk as stale.
+ * Must be called before any change to the disk.
+ * \return true if ok, false on write errors.
+ */
+static bool ckpInvalidate(struct BattFsSuper *disk)
+{
+	if (!disk->ckp || !disk->ckp_valid)
+		return true;
+
+	LOG_INFO("Invalidating checkpoint %ld\n", (long)disk->ckp_seq);
+	if (!ckpWriteHeader(disk, BATTFS_CKP_STALE, 0))
+		return false;
+
+	disk->ckp_valid = false;
+	return true;
+}
+
+/**
+ * Save the page allocation array of \a disk to the checkpoint device.
+ *
+ * Call this when the filesystem is idle to speed up the next mount:
+ * as long as the disk is not written, battfs_mountCheckpoint() will
+ * load the page array from here instead of scanning the whole disk.
+ * It is called automatically by battfs_umount().
+ *
+ * \return true if ok, false on errors.
+ */
+bool battfs_checkpoint(struct BattFsSuper *disk)
+{
+	fcs_t fcs;
+	disk_size_t pos = BATTFS_CKP_HEADER_LEN;
+
+	if (!disk->ckp || disk->ckp_valid)
+		return true;
+
+	if (kblock_flush(disk->dev) != 0)
+		return false;
+
+	/* Table first, the header is written last to validate it */
+	rotating_init(&fcs);
+	if (!ckpWriteTable(disk, &pos, disk->file_start, BATTFS_MAX_FILES + 1, &fcs)
+		|| !ckpWriteTable(disk, &pos, disk->page_array, disk->dev->blk_cnt, &fcs))
+		return false;
+
+#if CONFIG_BATTFS_WEAR_LEVELING
+	if (disk->erase_cnt && !ckpWriteWear(disk))
+		return false;
+#endif
+
+	disk->ckp_seq++;
+	if (!ckpWriteHeader(disk, BATTFS_CKP_VALID, fcs))
+		return false;
+
+	LOG_INFO("Checkpoint %ld written\n", (long)disk->ckp_seq);
+	disk->ckp_valid = true;
+	return true;
+}
+
+/**
+ * Initialize and mount disk described by \a disk,
+ * using the page table checkpoint saved on \a ckp.
+ *
+ * \a ckp is a block device reserved for the checkpoint, usually a window
+ * of the same memory obtained with kblock_trim(), and must be at least
+ * BATTFS_CKP_SIZE(dev->blk_cnt) bytes long.
+ * The disk is fully scanned only if the checkpoint is missing,
+ * corrupted or stale, that is the disk has been modified after it
+ * was written.
+ *
+ * \return false on errors, true otherwise.
+ */
+bool battfs_mountCheckpoint(struct BattFsSuper *disk, struct KBlock *dev, struct KBlock *ckp, pgcnt_t *page_array, size_t array_size)
+{
+	initSuper(disk, dev, page_array, array_size);
+
+	ASSERT(ckp);
+	ASSERT(kblock_partialWrite(ckp));
+	ASSERT((disk_size_t)ckp->blk_size * ckp->blk_cnt >= BATTFS_CKP_SIZE(dev->blk_cnt));
+	disk->ckp = ckp;
+
+	if (!ckpLoad(disk))
+	{
+		LOG_INFO("Scanning disk\n");
+		if (!scanDisk(disk))
+			return false;
+	}
+
+	/* Init list for opened files. */
+	LIST_INIT(&disk->file_opened_list);
+	return true;
+}
+
+#else /* !CONFIG_BATTFS_CHECKPOINT */
+
+INLINE bool ckpInvalidate(UNUSED_ARG(struct BattFsSuper *, disk))
+{
+	return true;
+}
+
+#endif /* CONFIG_BATTFS_CHECKPOINT */
+
+/**
+ * Initialize and mount disk described by
+ * \a disk.
+ * \return false on errors, true otherwise.
+ */
+bool battfs_mount(struct BattFsSuper *disk, struct KBlock *dev, pgcnt_t *page_array, size_t array_size)
+{
+	initSuper(disk, dev, page_array, array_size);
+#if CONFIG_BATTFS_CHECKPOINT
+	disk->ckp = NULL;
+	disk->ckp_seq = 0;
+	disk->ckp_valid = false;
+#endif
+
+	if (!scanDisk(disk))
+		return false;
+
 	/* Init list for opened files. */
 	LIST_INIT(&disk->file_opened_list);
 	return true;
@@ -431,6 +985,9 @@ bool battfs_fsck(struct BattFsSuper *disk)
 	FSCHECK(disk->free_page_start <= disk->dev->blk_cnt);
 	FSCHECK(disk->data_size < disk->dev->blk_size);
 	FSCHECK(disk->free_bytes <= disk->disk_size);
+	FSCHECK(disk->file_start[0] == 0);
+	FSCHECK(disk->file_start[BATTFS_MAX_FILES] == disk->free_page_start);
+	FSCHECK(SPACE_OVER(disk) || (disk->free_head >= disk->free_page_start && disk->free_head < disk->dev->blk_cnt));
 
 	disk_size_t free_bytes = 0;
 	BattFsPageHeader hdr, prev_hdr;
@@ -450,6 +1007,10 @@ bool battfs_fsck(struct BattFsSuper *disk)
 		if (page < disk->free_page_start)
 		{
 			FSCHECK(computeFcs(&hdr) == hdr.fcs);
+			/* Check page against the inode index */
+			FSCHECK(disk->file_start[hdr.inode] <= page);
+			FSCHECK(page < disk->file_start[hdr.inode + 1]);
+			FSCHECK(hdr.pgoff == page - disk->file_start[hdr.inode]);
 			page_used++;
 			free_bytes -= hdr.fill;
 			if (hdr.inode != prev_hdr.inode || start)
@@ -514,7 +1075,60 @@ static int battfs_fileclose(struct KFile *fd)
 
 #define NO_SPACE PAGE_UNSET_SENTINEL
 
-static pgcnt_t allocateNewPage(struct BattFsSuper *disk, pgcnt_t new_pos, inode_t inode)
+/**
+ * Page array element holding page \a off of file \a fdb.
+ */
+#define FILE_PAGE(fdb, off) ((fdb)->disk->page_array[(fdb)->disk->file_start[(fdb)->inode] + (off)])
+
+/**
+ * Advance free ring position \a pos by one, wrapping
+ * around at the end of the page array.
+ */
+INLINE pgcnt_t nextFree(struct BattFsSuper *disk, pgcnt_t pos)
+{
+	pos++;
+	return (pos >= disk->dev->blk_cnt) ? disk->free_page_start : pos;
+}
+
+/**
+ * Get the page at the head of the free ring.
+ * With wear leveling active, the least worn page among the
+ * first CONFIG_BATTFS_WEAR_WINDOW free pages is moved to the head
+ * and its erase counter is increased.
+ */
+static pgcnt_t takeFreePage(struct BattFsSuper *disk)
+{
+#if CONFIG_BATTFS_WEAR_LEVELING
+	if (disk->erase_cnt)
+	{
+		pgcnt_t *page_array = disk->page_array;
+		pgcnt_t best = disk->free_head;
+		pgcnt_t pos = disk->free_head;
+
+		for (int i = 1; i < CONFIG_BATTFS_WEAR_WINDOW; i++)
+		{
+			pos = nextFree(disk, pos);
+			if (pos == disk->free_head)
+				break;
+			if (disk->erase_cnt[page_array[pos]] < disk->erase_cnt[page_array[best]])
+				best = pos;
+		}
+		SWAP(page_array[best], page_array[disk->free_head]);
+		disk->erase_cnt[page_array[disk->free_head]]++;
+	}
+#endif
+	return disk->page_array[disk->free_head];
+}
+
+/**
+ * Allocate a new page at the end of file \a inode.
+ * Only pages of the files following \a inode are
+ * moved in the page array: appending to the last file
+ * does not shift anything, appending to any other file
+ * costs a memmove() of all the pages of the files above it.
+ * \return the new page or NO_SPACE if disk is full.
+ */
+static pgcnt_t allocateNewPage(struct BattFsSuper *disk, inode_t inode)
 {
 	if (SPACE_OVER(disk))
 	{
@@ -522,27 +1136,33 @@ static pgcnt_t allocateNewPage(struct BattFsSuper *disk, pgcnt_t new_pos, inode_
 		return NO_SPACE;
 	}
 
-	LOG_INFO("Getting new page %d, pos %d\n", disk->page_array[disk->free_page_start], new_pos);
-	pgcnt_t new_page = disk->page_array[disk->free_page_start++];
-	memmove(&disk->page_array[new_pos + 1], &disk->page_array[new_pos], (disk->free_page_start - new_pos - 1) * sizeof(pgcnt_t));
+	pgcnt_t new_pos = disk->file_start[inode + 1];
+	pgcnt_t new_page = takeFreePage(disk);
+	LOG_INFO("Getting new page %d, pos %d\n", new_page, new_pos);
 
-	Node *n;
-	/* Move following file start point one position ahead. */
-	FOREACH_NODE(n, &disk->file_opened_list)
-	{
-		BattFs *file = containerof(n, BattFs, link);
-		if (file->inode > inode)
-		{
-			LOG_INFO("Move file %d start pos\n", file->inode);
-			file->start++;
-		}
-	}
+	/* Free ring loses its first slot, move it in place of the taken page */
+	disk->page_array[disk->free_head] = disk->page_array[disk->free_page_start];
+	disk->free_page_start++;
+	if (disk->free_head < disk->free_page_start)
+		disk->free_head = disk->free_page_start;
 
+	memmove(&disk->page_array[new_pos + 1], &disk->page_array[new_pos], (disk->free_page_start - new_pos - 1) * sizeof(pgcnt_t));
 	disk->page_array[new_pos] = new_page;
+
+	/* Move following files start point one position ahead. */
+	for (int i = inode + 1; i <= BATTFS_MAX_FILES; i++)
+		disk->file_start[i]++;
+
 	return new_page;
 }
 
-static pgcnt_t renewPage(struct BattFsSuper *disk, pgcnt_t old_pos)
+/**
+ * Get a free page to replace \a old_page.
+ * \a old_page is released at the tail of the free ring,
+ * so this is done in constant time.
+ * \return the new page or NO_SPACE if disk is full.
+ */
+static pgcnt_t renewPage(struct BattFsSuper *disk, pgcnt_t old_page)
 {
 	if (SPACE_OVER(disk))
 	{
@@ -551,15 +1171,185 @@ static pgcnt_t renewPage(struct BattFsSuper *disk, pgcnt_t old_pos)
 	}
 
 	/* Get a free page */
-	pgcnt_t new_page = disk->page_array[disk->free_page_start];
-	movePages(disk, disk->free_page_start + 1, -1);
+	pgcnt_t new_page = takeFreePage(disk);
 
 	/* Insert previous page in free blocks list */
-	LOG_INFO("Setting page %d as free\n", old_pos);
-	disk->page_array[disk->dev->blk_cnt - 1] = old_pos;
+	LOG_INFO("Setting page %d as free\n", old_page);
+	disk->page_array[disk->free_head] = old_page;
+	disk->free_head = nextFree(disk, disk->free_head);
 	return new_page;
 }
 
+#if CONFIG_BATTFS_WEAR_LEVELING
+
+/**
+ * Move the page at position \a pos of the page array
+ * to a free page.
+ * \return true if ok, false on disk errors.
+ */
+static bool relocatePage(struct BattFsSuper *disk, pgcnt_t pos)
+{
+	BattFsPageHeader hdr;
+	pgcnt_t old_page = disk->page_array[pos];
+	pgcnt_t new_page;
+
+	if (!ckpInvalidate(disk) || !readHdr(disk, old_page, &hdr))
+		return false;
+
+	if ((new_page = renewPage(disk, old_page)) == NO_SPACE)
+		return false;
+
+	LOG_INFO("Moving page %d to %d\n", old_page, new_page);
+	if (kblock_copy(disk->dev, old_page, new_page) != 0)
+		return false;
+	disk->page_array[pos] = new_page;
+
+	/* The new copy must win over the old one at next mount */
+	hdr.seq++;
+	return writeHdr(disk, new_page, &hdr);
+}
+
+/**
+ * Enable wear leveling on the mounted \a disk, using \a erase_cnt
+ * to keep an erase counter for each page.
+ * \a erase_cnt must be at least dev->blk_cnt * sizeof(erase_t) bytes long.
+ *
+ * When the disk is mounted with battfs_mountCheckpoint(), counters
+ * are saved with the checkpoint and reloaded from it, otherwise
+ * they start from 0 at every mount.
+ *
+ * \return true if the counters have been reloaded, false if they start from 0.
+ */
+bool battfs_wearInit(struct BattFsSuper *disk, erase_t *erase_cnt, size_t array_size)
+{
+	ASSERT(erase_cnt);
+	ASSERT(array_size >= disk->dev->blk_cnt * sizeof(erase_t));
+	disk->erase_cnt = erase_cnt;
+	disk->gc_pos = 0;
+
+#if CONFIG_BATTFS_CHECKPOINT
+	if (disk->ckp && ckpReadWear(disk))
+		return true;
+#endif
+	memset(erase_cnt, 0, disk->dev->blk_cnt * sizeof(erase_t));
+	return false;
+}
+
+/**
+ * Run a garbage collector step on \a disk, examining
+ * \a pages pages of the page array.
+ *
+ * A page holding file data is moved to a free page when it has been
+ * erased CONFIG_BATTFS_WEAR_THRESHOLD times less than the next free page,
+ * so that data never rewritten does not keep the least worn pages out
+ * of the free list.
+ * Each call does a bounded amount of work: call it periodically
+ * when the disk is idle, or use battfs_gcStart().
+ *
+ * \return true if ok, false on disk errors.
+ */
+bool battfs_gc(struct BattFsSuper *disk, pgcnt_t pages)
+{
+	if (!disk->erase_cnt)
+		return true;
+
+	while (pages-- && disk->free_page_start && !SPACE_OVER(disk))
+	{
+		if (disk->gc_pos >= disk->free_page_start)
+			disk->gc_pos = 0;
+
+		pgcnt_t page = disk->page_array[disk->gc_pos];
+		if (disk->erase_cnt[page] + CONFIG_BATTFS_WEAR_THRESHOLD < disk->erase_cnt[disk->page_array[disk->free_head]])
+		{
+			if (!relocatePage(disk, disk->gc_pos))
+			{
+				LOG_ERR("moving page %d\n", page);
+				return false;
+			}
+		}
+		disk->gc_pos++;
+	}
+	return true;
+}
+
+#endif /* CONFIG_BATTFS_WEAR_LEVELING */
+
+#if CONFIG_BATTFS_GC
+
+PROC_DEFINE_STACK(battfs_gc_stack, CONFIG_BATTFS_GC_STACK);
+/* True while a garbage collector process is using battfs_gc_stack. */
+static bool battfs_gc_running;
+
+static void battfs_gcProc(void)
+{
+	BattFsSuper *disk = (BattFsSuper *)proc_currentUserData();
+
+	while (1)
+	{
+		timer_delay(CONFIG_BATTFS_GC_INTERVAL);
+
+		sem_obtain(disk->gc_lock);
+		if (!disk->gc_run)
+		{
+			sem_release(disk->gc_lock);
+			break;
+		}
+		battfs_gc(disk, CONFIG_BATTFS_GC_PAGES);
+		sem_release(disk->gc_lock);
+	}
+	LOG_INFO("Garbage collector stopped\n");
+
+	/*
+	 * Wake up battfs_umount() and exit with interrupts disabled: this
+	 * process cannot be preempted until proc_exit() switches away from
+	 * its stack, which is then free for a new battfs_gcStart().
+	 */
+	IRQ_DISABLE;
+	battfs_gc_running = false;
+	sig_post(disk->gc_waiter, SIG_SINGLE);
+	proc_exit();
+}
+
+/**
+ * Start a low priority process running battfs_gc() on \a disk
+ * every CONFIG_BATTFS_GC_INTERVAL ms.
+ *
+ * BattFS is not reentrant: \a lock is obtained by the garbage collector
+ * around each step and must be held by every other process while using
+ * the disk. The process stops at battfs_umount(), which must be called
+ * without holding \a lock and waits for the process to exit, up to
+ * CONFIG_BATTFS_GC_INTERVAL ms.
+ * Only one garbage collector at a time can be running.
+ *
+ * \return true if ok, false if the process cannot be created.
+ */
+bool battfs_gcStart(struct BattFsSuper *disk, struct Semaphore *lock)
+{
+	ASSERT(lock);
+	ASSERT(disk->erase_cnt);
+
+	/* The stack is shared, the previous garbage collector must have exited */
+	ASSERT(!battfs_gc_running);
+	if (battfs_gc_running)
+		return false;
+
+	disk->gc_lock = lock;
+	disk->gc_run = true;
+	battfs_gc_running = true;
+
+	Process *p = proc_new(battfs_gcProc, disk, sizeof(battfs_gc_stack), battfs_gc_stack);
+	if (!p)
+	{
+		disk->gc_run = false;
+		battfs_gc_running = false;
+		return false;
+	}
+	proc_setPri(p, CONFIG_BATTFS_GC_PRI);
+	return true;
+}
+
+#endif /* CONFIG_BATTFS_GC */
+
 /**
  * Write to file \a fd \a size bytes from \a buf.
  * \return The number of bytes written.
@@ -583,9 +1373,15 @@ static size_t battfs_write(struct KFile *fd, const void *_buf, size_t size)
 		return total_write;
 	}
 
+	if (!ckpInvalidate(disk))
+	{
+		fdb->errors |= BATTFS_DISK_WRITE_ERR;
+		return total_write;
+	}
+
 	if (fd->seek_pos > fd->size)
 	{
-		if (!readHdr(disk, fdb->start[fdb->max_off], &curr_hdr))
+		if (!readHdr(disk, FILE_PAGE(fdb, fdb->max_off), &curr_hdr))
 		{
 			fdb->errors |= BATTFS_DISK_READ_ERR;
 			return total_write;
@@ -597,20 +1393,20 @@ static size_t battfs_write(struct KFile *fd, const void *_buf, size_t size)
 		 * if the user code keeps writing in the same portion
 		 * of the file.
 		 */
-		if (kblock_buffered(disk->dev) && ((fdb->start[fdb->max_off] != kblock_cachedBlock(disk->dev)) || !kblock_cacheDirty(disk->dev)))
+		if (kblock_buffered(disk->dev) && ((FILE_PAGE(fdb, fdb->max_off) != kblock_cachedBlock(disk->dev)) || !kblock_cacheDirty(disk->dev)))
 		{
-			new_page = renewPage(disk, fdb->start[fdb->max_off]);
+			new_page = renewPage(disk, FILE_PAGE(fdb, fdb->max_off));
 			if (new_page == NO_SPACE)
 			{
 				fdb->errors |= BATTFS_DISK_SPACEOVER_ERR;
 				return total_write;
 			}
 
-			kblock_copy(disk->dev, fdb->start[fdb->max_off], new_page);
-			fdb->start[fdb->max_off] = new_page;
+			kblock_copy(disk->dev, FILE_PAGE(fdb, fdb->max_off), new_page);
+			FILE_PAGE(fdb, fdb->max_off) = new_page;
 		}
 		else
-			new_page = fdb->start[fdb->max_off];
+			new_page = FILE_PAGE(fdb, fdb->max_off);
 
 		/* Fill unused space of first page with 0s */
 		uint8_t dummy = 0;
@@ -643,7 +1439,7 @@ static size_t battfs_write(struct KFile *fd, const void *_buf, size_t size)
 		{
 			zero_bytes = MIN((kfile_off_t)disk->data_size, fd->seek_pos - fd->size);
 
-			new_page = allocateNewPage(disk, (fdb->start - disk->page_array) + fdb->max_off + 1, fdb->inode);
+			new_page = allocateNewPage(disk, fdb->inode);
 			if (new_page == NO_SPACE)
 			{
 				fdb->errors |= BATTFS_DISK_SPACEOVER_ERR;
@@ -686,9 +1482,10 @@ static size_t battfs_write(struct KFile *fd, const void *_buf, size_t size)
 		/* Handle write outside EOF */
 		if (pg_offset > fdb->max_off)
 		{
-			LOG_INFO("New page needed, pg_offset %d, pos %d\n", pg_offset, (int)((fdb->start - disk->page_array) + pg_offset));
+			LOG_INFO("New page needed, pg_offset %d, pos %d\n", pg_offset, disk->file_start[fdb->inode] + pg_offset);
 
-			new_page = allocateNewPage(disk, (fdb->start - disk->page_array) + pg_offset, fdb->inode);
+			ASSERT(pg_offset == fdb->max_off + 1);
+			new_page = allocateNewPage(disk, fdb->inode);
 			if (new_page == NO_SPACE)
 			{
 				fdb->errors |= BATTFS_DISK_SPACEOVER_ERR;
@@ -703,34 +1500,34 @@ static size_t battfs_write(struct KFile *fd, const void *_buf, size_t size)
 		}
 		else
 		{
-			if (!readHdr(disk, fdb->start[pg_offset], &curr_hdr))
+			if (!readHdr(disk, FILE_PAGE(fdb, pg_offset), &curr_hdr))
 			{
 				fdb->errors |= BATTFS_DISK_READ_ERR;
 				return total_write;
 			}
 
 			/* Renew page only if is not in cache. */
-			if (kblock_buffered(disk->dev) && ((fdb->start[fdb->max_off] != kblock_cachedBlock(disk->dev)) || !kblock_cacheDirty(disk->dev)))
+			if (kblock_buffered(disk->dev) && ((FILE_PAGE(fdb, fdb->max_off) != kblock_cachedBlock(disk->dev)) || !kblock_cacheDirty(disk->dev)))
 			{
-				new_page = renewPage(disk, fdb->start[pg_offset]);
+				new_page = renewPage(disk, FILE_PAGE(fdb, pg_offset));
 				if (new_page == NO_SPACE)
 				{
 					fdb->errors |= BATTFS_DISK_SPACEOVER_ERR;
 					return total_write;
 				}
 
-				LOG_INFO("Re-writing page %d to %d\n", fdb->start[pg_offset], new_page);
-				if (kblock_copy(disk->dev, fdb->start[pg_offset], new_page) != 0)
+				LOG_INFO("Re-writing page %d to %d\n", FILE_PAGE(fdb, pg_offset), new_page);
+				if (kblock_copy(disk->dev, FILE_PAGE(fdb, pg_offset), new_page) != 0)
 				{
 					fdb->errors |= BATTFS_DISK_WRITE_ERR;
 					return total_write;
 				}
-				fdb->start[pg_offset] = new_page;
+				FILE_PAGE(fdb, pg_offset) = new_page;
 			}
 			else
 			{
-				LOG_INFO("Using cached block %d\n", fdb->start[pg_offset]);
-				new_page = fdb->start[pg_offset];
+				LOG_INFO("Using cached block %d\n", FILE_PAGE(fdb, pg_offset));
+				new_page = FILE_PAGE(fdb, pg_offset);
 			}
 
 			curr_hdr.seq++;
@@ -791,9 +1588,9 @@ static size_t battfs_read(struct KFile *fd, void *_buf, size_t size)
 		addr_offset = fd->seek_pos % disk->data_size;
 		read_len = MIN(size, (size_t)(disk->data_size - addr_offset));
 
-		//LOG_INFO("reading from page %d, offset %d, size %d\n", fdb->start[pg_offset], addr_offset, read_len);
+		//LOG_INFO("reading from page %d, offset %d, size %d\n", FILE_PAGE(fdb, pg_offset), addr_offset, read_len);
 		/* Read from disk */
-		if (kblock_read(disk->dev, fdb->start[pg_offset], buf, addr_offset, read_len) != read_len)
+		if (kblock_read(disk->dev, FILE_PAGE(fdb, pg_offset), buf, addr_offset, read_len) != read_len)
 		{
 			fdb->errors |= BATTFS_DISK_READ_ERR;
 			return total_read;
@@ -801,7 +1598,7 @@ static size_t battfs_read(struct KFile *fd, void *_buf, size_t size)
 
 #ifdef _DEBUG
 		BattFsPageHeader hdr;
-		readHdr(disk, fdb->start[pg_offset], &hdr);
+		readHdr(disk, FILE_PAGE(fdb, pg_offset), &hdr);
 		ASSERT(hdr.inode == fdb->inode);
 #endif
 
@@ -814,41 +1611,18 @@ static size_t battfs_read(struct KFile *fd, void *_buf, size_t size)
 }
 
 /**
- * Search file \a inode in \a disk using a binary search.
- * \a last is filled with array offset of file start
+ * Search file \a inode in \a disk using the inode index.
+ * \a pos is filled with array offset of file start
  * in disk->page_array if file is found, otherwise
- * \a last is filled with the correct insert position
+ * \a pos is filled with the correct insert position
  * for creating a file with the given \a inode.
- * \return true if file is found, false otherwisr.
+ * \return true if file is found, false otherwise.
  */
-static bool findFile(BattFsSuper *disk, inode_t inode, pgcnt_t *last)
+static bool findFile(BattFsSuper *disk, inode_t inode, pgcnt_t *pos)
 {
-	BattFsPageHeader hdr;
-	pgcnt_t first = 0, page;
-	*last = disk->free_page_start;
-	fcs_t fcs;
-
-	while (first < *last)
-	{
-		page = (first + *last) / 2;
-		LOG_INFO("first %d, last %d, page %d\n", first, *last, page);
-		if (!readHdr(disk, disk->page_array[page], &hdr))
-			return false;
-		LOG_INFO("inode read: %d\n", hdr.inode);
-		fcs = computeFcs(&hdr);
-		if (hdr.fcs == fcs && hdr.inode == inode)
-		{
-			*last = page - hdr.pgoff;
-			LOG_INFO("Found: %d\n", *last);
-			return true;
-		}
-		else if (hdr.fcs == fcs && hdr.inode < inode)
-			first = page + 1;
-		else
-			*last = page;
-	}
-	LOG_INFO("Not found: last %d\n", *last);
-	return false;
+	*pos = disk->file_start[inode];
+	LOG_INFO("inode %d, pos %d, pages %d\n", inode, *pos, FILE_PAGES(disk, inode));
+	return FILE_PAGES(disk, inode) != 0;
 }
 
 /**
@@ -861,25 +1635,25 @@ bool battfs_fileExists(BattFsSuper *disk, inode_t inode)
 }
 
 /**
- * Count size of file \a inode on \a disk, starting at pointer \a start
- * in disk->page_array. Size is written in \a size.
- * \return true if all s ok, false on disk read errors.
+ * Count size of file \a inode on \a disk.
+ * All file pages but the last one are full, so only
+ * the header of the last page needs to be read.
+ * \return file size or EOF on disk read errors.
  */
-static file_size_t countFileSize(BattFsSuper *disk, pgcnt_t *start, inode_t inode)
+static file_size_t countFileSize(BattFsSuper *disk, inode_t inode)
 {
-	file_size_t size = 0;
+	pgcnt_t pages = FILE_PAGES(disk, inode);
 	BattFsPageHeader hdr;
 
-	while (start < &disk->page_array[disk->free_page_start])
-	{
-		if (!readHdr(disk, *start++, &hdr))
-			return EOF;
-		if (hdr.fcs == computeFcs(&hdr) && hdr.inode == inode)
-			size += hdr.fill;
-		else
-			break;
-	}
-	return size;
+	if (!pages)
+		return 0;
+
+	if (!readHdr(disk, disk->page_array[disk->file_start[inode] + pages - 1], &hdr))
+		return EOF;
+
+	ASSERT(hdr.fcs == computeFcs(&hdr));
+	ASSERT(hdr.inode == inode);
+	return (file_size_t)(pages - 1) * disk->data_size + hdr.fill;
 }
 
 static int battfs_error(struct KFile *fd)
@@ -918,7 +1692,13 @@ bool battfs_fileopen(BattFsSuper *disk, BattFs *fd, inode_t inode, filemode_t mo
 		/* Create the file */
 		BattFsPageHeader hdr;
 
-		if (allocateNewPage(disk, start_pos, inode) == NO_SPACE)
+		if (!ckpInvalidate(disk))
+		{
+			fd->errors |= BATTFS_DISK_WRITE_ERR;
+			return false;
+		}
+
+		if (allocateNewPage(disk, inode) == NO_SPACE)
 		{
 			fd->errors |= BATTFS_DISK_SPACEOVER_ERR;
 			return false;
@@ -934,11 +1714,10 @@ bool battfs_fileopen(BattFsSuper *disk, BattFs *fd, inode_t inode, filemode_t mo
 			return false;
 		}
 	}
-	fd->start = &disk->page_array[start_pos];
 	LOG_INFO("Start pos %d\n", start_pos);
 
 	/* Fill file size */
-	if ((fd->fd.size = countFileSize(disk, fd->start, inode)) == EOF)
+	if ((fd->fd.size = countFileSize(disk, inode)) == EOF)
 	{
 		fd->errors |= BATTFS_DISK_READ_ERR;
 		return false;
@@ -982,16 +1761,38 @@ bool battfs_fileopen(BattFsSuper *disk, BattFs *fd, inode_t inode, filemode_t mo
  */
 bool battfs_umount(struct BattFsSuper *disk)
 {
-	Node *n;
+	Node *n, *next;
 	int res = 0;
 
-	/* Close all open files */
-	FOREACH_NODE(n, &disk->file_opened_list)
+#if CONFIG_BATTFS_GC
+	if (disk->gc_run)
+	{
+		/* Stop the garbage collector at its next step and wait for it to exit */
+		ASSERT(disk->gc_lock->owner != proc_current());
+		sem_obtain(disk->gc_lock);
+		disk->gc_run = false;
+		disk->gc_waiter = proc_current();
+		sem_release(disk->gc_lock);
+		sig_wait(SIG_SINGLE);
+	}
+#endif
+
+	/* Close all open files: closing removes the node, so get the next one first */
+	for (n = LIST_HEAD(&disk->file_opened_list); n->succ; n = next)
 	{
 		BattFs *file = containerof(n, BattFs, link);
+		next = n->succ;
 		res += battfs_fileclose(&file->fd);
 	}
 
+#if CONFIG_BATTFS_CHECKPOINT
+	/* Save page table for the next mount */
+	if (!battfs_checkpoint(disk))
+		res = EOF;
+	if (disk->ckp && kblock_close(disk->ckp) != 0)
+		res = EOF;
+#endif
+
 	/* Close disk */
 	return (kblock_flush(disk->dev) == 0) && (kblock_close(disk->dev) == 0) && (res == 0);
 }
@@ -44,6 +44,8 @@
 #ifndef FS_BATTFS_H
 #define FS_BATTFS_H
 
+#include "cfg/cfg_battfs.h"
+
 #include <cfg/compiler.h> // uintXX_t; STATIC_ASSERT
 #include <cpu/types.h>    // CPU_BITS_PER_CHAR
 #include <algo/rotating_hash.h>
@@ -58,6 +60,7 @@ typedef pgcnt_t pgoff_t;  ///< Type for counting pages inside a file
 typedef uint8_t inode_t;  ///< Type for file inodes
 typedef uint64_t seq_t;   ///< Type for page seq number, at least 40bits wide.
 typedef rotating_t fcs_t; ///< Type for header FCS.
+typedef uint32_t erase_t; ///< Type for page erase counters.
 
 /**
  * BattFS page header, used to represent a page
@@ -112,6 +115,27 @@ typedef struct BattFsPageHeader
 
 typedef uint32_t disk_size_t; ///< Type for disk sizes.
 
+/**
+ * Size of the checkpoint header once saved on disk.
+ * The header is followed by the serialized file index
+ * and page array, see battfs_mountCheckpoint().
+ */
+#define BATTFS_CKP_HEADER_LEN 26
+
+#if CONFIG_BATTFS_WEAR_LEVELING
+	/**
+	 * Size in bytes of the erase counters section of the checkpoint.
+	 */
+	#define BATTFS_CKP_WEAR_SIZE(page_count) (sizeof(fcs_t) + (disk_size_t)(page_count) * sizeof(erase_t))
+#else
+	#define BATTFS_CKP_WEAR_SIZE(page_count) 0
+#endif
+
+/**
+ * Size in bytes of the checkpoint for a disk of \a page_count pages.
+ */
+#define BATTFS_CKP_SIZE(page_count) (BATTFS_CKP_HEADER_LEN + ((BATTFS_MAX_FILES + 1) + (disk_size_t)(page_count)) * sizeof(pgcnt_t) + BATTFS_CKP_WEAR_SIZE(page_count))
+
 /**
  * Context used to describe a disk.
  * This context structure will be used to access disk.
@@ -137,10 +161,54 @@ typedef struct BattFsSuper
 	 */
 	pgcnt_t free_page_start;
 
+	/**
+	 * Head of the free page ring.
+	 * Free pages, from free_page_start to the end of page_array,
+	 * are used as a circular FIFO: a new page is taken from here
+	 * and a released page takes its place, so renewing
+	 * a page does not need to shift the array.
+	 */
+	pgcnt_t free_head;
+
+	/**
+	 * Per-inode page index.
+	 * Pages of file i are stored in page_array starting from
+	 * file_start[i], ordered by page offset, up to file_start[i + 1].
+	 * This allows finding files and computing their length
+	 * without reading the disk.
+	 *
+	 * Appending a page to file i shifts by one slot the pages of all
+	 * the files above i, so only appends to the highest inode in use
+	 * take constant time: give the most written file the highest inode.
+	 */
+	pgcnt_t file_start[BATTFS_MAX_FILES + 1];
+
 	disk_size_t disk_size;  ///< Size of the disk, in bytes (page_count * page_size).
 	disk_size_t free_bytes; ///< Free space on the disk.
 
 	List file_opened_list; ///< List used to keep trace of open files.
+
+#if CONFIG_BATTFS_CHECKPOINT
+	KBlock *ckp;      ///< Block device holding the page table checkpoint, NULL if unused.
+	uint32_t ckp_seq; ///< Sequence number of the last checkpoint written.
+	bool ckp_valid;   ///< True if the checkpoint on disk matches the page table in memory.
+#endif
+
+#if CONFIG_BATTFS_WEAR_LEVELING
+	/**
+	 * Per-page erase counters, indexed by page number.
+	 * NULL if wear leveling is not active.
+	 * \see battfs_wearInit()
+	 */
+	erase_t *erase_cnt;
+	pgcnt_t gc_pos; ///< Page array position of the next garbage collector step.
+#endif
+
+#if CONFIG_BATTFS_GC
+	struct Semaphore *gc_lock; ///< Lock shared by the garbage collector and the disk users.
+	bool gc_run;               ///< False to stop the garbage collector process.
+	struct Process *gc_waiter; ///< Process waiting in battfs_umount() for the garbage collector to exit.
+#endif
 	                       /* TODO add other fields. */
 } BattFsSuper;
 
@@ -149,6 +217,11 @@ typedef struct BattFsSuper
  */
 #define SPACE_OVER(disk) ((disk)->free_page_start >= (disk)->dev->blk_cnt)
 
+/**
+ * Number of pages used by file \a inode on \a disk.
+ */
+#define FILE_PAGES(disk, inode) ((pgcnt_t)((disk)->file_start[(inode) + 1] - (disk)->file_start[(inode)]))
+
 typedef uint8_t filemode_t;  ///< Type for file open modes.
 typedef int32_t file_size_t; ///< Type for file sizes.
 
@@ -183,7 +256,6 @@ typedef struct BattFs
 	inode_t inode;     ///< inode of the opened file
 	BattFsSuper *disk; ///< Disk context
 	filemode_t mode;   ///< File open mode
-	pgcnt_t *start;    ///< Pointer to page_array file start position.
 	pgcnt_t max_off;   ///< Max page offset allocated for the file.
 	int errors;        ///< File status/errors
 } BattFs;
@@ -204,7 +276,19 @@ INLINE BattFs *BATTFS_CAST(KFile *fd)
 }
 
 bool battfs_mount(struct BattFsSuper *disk, struct KBlock *dev, pgcnt_t *page_array, size_t array_size);
+#if CONFIG_BATTFS_CHECKPOINT
+bool battfs_mountCheckpoint(struct BattFsSuper *disk, struct KBlock *dev, struct KBlock *ckp, pgcnt_t *page_array, size_t array_size);
+bool battfs_checkpoint(struct BattFsSuper *disk);
+#endif
 bool battfs_fsck(struct BattFsSuper *disk);
+#if CONFIG_BATTFS_WEAR_LEVELING
+bool battfs_wearInit(struct BattFsSuper *disk, erase_t *erase_cnt, size_t array_size);
+bool battfs_gc(struct BattFsSuper *disk, pgcnt_t pages);
+#endif
+#if CONFIG_BATTFS_GC
+struct Semaphore;
+bool battfs_gcStart(struct BattFsSuper *disk, struct Semaphore *lock);
+#endif
 bool battfs_umount(struct BattFsSuper *disk);
 
 bool battfs_fileExists(BattFsSuper *disk, inode_t inode);
@@ -32,17 +32,42 @@
  * \brief BattFS Test.
  *
  * \author Francesco Sacchi <batt@develer.com>
+ *
+ * $test$: cp bertos/cfg/cfg_battfs.h $cfgdir/
+ * $test$: echo  "#undef CONFIG_BATTFS_GC" >> $cfgdir/cfg_battfs.h
+ * $test$: echo "#define CONFIG_BATTFS_GC 1" >> $cfgdir/cfg_battfs.h
+ * $test$: echo  "#undef CONFIG_BATTFS_GC_STACK" >> $cfgdir/cfg_battfs.h
+ * $test$: echo "#define CONFIG_BATTFS_GC_STACK 131072" >> $cfgdir/cfg_battfs.h
+ * $test$: echo  "#undef CONFIG_BATTFS_GC_INTERVAL" >> $cfgdir/cfg_battfs.h
+ * $test$: echo "#define CONFIG_BATTFS_GC_INTERVAL 10" >> $cfgdir/cfg_battfs.h
+ * $test$: cp bertos/cfg/cfg_proc.h $cfgdir/
+ * $test$: echo  "#undef CONFIG_KERN" >> $cfgdir/cfg_proc.h
+ * $test$: echo "#define CONFIG_KERN 1" >> $cfgdir/cfg_proc.h
+ * $test$: cp bertos/cfg/cfg_sem.h $cfgdir/
+ * $test$: echo  "#undef CONFIG_KERN_SEMAPHORES" >> $cfgdir/cfg_sem.h
+ * $test$: echo "#define CONFIG_KERN_SEMAPHORES 1" >> $cfgdir/cfg_sem.h
+ * $test$: cp bertos/cfg/cfg_signal.h $cfgdir/
+ * $test$: echo  "#undef CONFIG_KERN_SIGNALS" >> $cfgdir/cfg_signal.h
+ * $test$: echo "#define CONFIG_KERN_SIGNALS 1" >> $cfgdir/cfg_signal.h
  */
 
 #include <fs/battfs.h>
 #include <io/kblock_posix.h>
+#include <io/kblock_ram.h>
 
 #include <cfg/debug.h>
 #include <cfg/test.h>
 
+#if CONFIG_BATTFS_GC
+	#include <drv/timer.h>
+	#include <kern/proc.h>
+	#include <kern/sem.h>
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #define FILE_SIZE 32768
 #define PAGE_SIZE 128
@@ -51,12 +76,37 @@
 #define PAGE_COUNT (FILE_SIZE / PAGE_SIZE)
 
 #define HW_PAGEBUF true
+
+#define BIG_PAGE_SIZE  256
+#define BIG_PAGE_COUNT 16384
+#define BIG_DATA_SIZE  (BIG_PAGE_SIZE - BATTFS_HEADER_LEN)
+
+/* 16 MiB disk used for mount time measurements */
+#define CKP_DISK_PAGE_SIZE  512
+#define CKP_DISK_PAGE_COUNT 32768
+
+/* Small disk used for wear leveling simulation */
+#define WEAR_PAGE_SIZE  128
+#define WEAR_PAGE_COUNT 64
+#define WEAR_WRITES     1000000UL
+#define GC_WRITES       100000UL
+
+/* Log record written on the emulated disks */
+#define EMUL_RECORD_LEN 50
 #if UNIT_TEST
 
 const char test_filename[] = "battfs_disk.bin";
 
 static uint8_t page_buffer[PAGE_SIZE];
 static pgcnt_t page_array[PAGE_COUNT];
+static pgcnt_t big_page_array[BIG_PAGE_COUNT];
+#if CONFIG_BATTFS_CHECKPOINT
+static pgcnt_t ckp_page_array[CKP_DISK_PAGE_COUNT];
+#endif
+#if CONFIG_BATTFS_WEAR_LEVELING
+static uint8_t wear_mem[(WEAR_PAGE_COUNT + 1) * WEAR_PAGE_SIZE];
+static erase_t erase_cnt[WEAR_PAGE_COUNT];
+#endif
 
 static void testCheck(BattFsSuper *disk, pgcnt_t *reference)
 {
@@ -324,7 +374,7 @@ static void openFile(BattFsSuper *disk)
 	ASSERT(fd1.fd.seek_pos == 0);
 	ASSERT(fd1.mode == MODE);
 	ASSERT(fd1.inode == INODE);
-	ASSERT(fd1.start == &disk->page_array[0]);
+	ASSERT(disk->file_start[fd1.inode] == 0);
 	ASSERT(fd1.disk == disk);
 	ASSERT(LIST_HEAD(&disk->file_opened_list) == &fd1.link);
 
@@ -333,7 +383,7 @@ static void openFile(BattFsSuper *disk)
 	ASSERT(fd1.fd.seek_pos == 0);
 	ASSERT(fd1.mode == MODE);
 	ASSERT(fd1.inode == INODE);
-	ASSERT(fd1.start == &disk->page_array[0]);
+	ASSERT(disk->file_start[fd1.inode] == 0);
 	ASSERT(fd1.disk == disk);
 	ASSERT(LIST_HEAD(&disk->file_opened_list) == &fd1.link);
 
@@ -343,7 +393,7 @@ static void openFile(BattFsSuper *disk)
 	ASSERT(fd2.fd.seek_pos == 0);
 	ASSERT(fd2.mode == MODE);
 	ASSERT(fd2.inode == INODE2);
-	ASSERT(fd2.start == &disk->page_array[2]);
+	ASSERT(disk->file_start[fd2.inode] == 2);
 	ASSERT(fd2.disk == disk);
 	ASSERT(LIST_HEAD(&disk->file_opened_list)->succ == &fd2.link);
 
@@ -1050,6 +1100,465 @@ static void openAllFiles(BattFsSuper *disk)
 	TRACEMSG("22: passed\n");
 }
 
+static void appendThroughput(BattFsSuper *disk)
+{
+	TRACEMSG("23: append throughput on a large disk, interleaved log files\n");
+
+	#define LOG_FILES  4
+	#define RECORD_LEN 50
+
+	size_t mem_size = (BIG_PAGE_COUNT + 1) * BIG_PAGE_SIZE;
+	uint8_t *mem = (uint8_t *)malloc(mem_size);
+	ASSERT(mem);
+	memset(mem, 0xff, mem_size);
+
+	KBlockRam ram;
+	kblockram_init(&ram, mem, mem_size, BIG_PAGE_SIZE, true, true);
+
+	BattFs fd[LOG_FILES];
+	uint8_t record[RECORD_LEN];
+
+	ASSERT(battfs_mount(disk, &ram.b, big_page_array, sizeof(big_page_array)));
+	ASSERT(battfs_fsck(disk));
+	for (unsigned i = 0; i < countof(fd); i++)
+		ASSERT(battfs_fileopen(disk, &fd[i], i + 1, BATTFS_CREATE));
+
+	/* Fill up to 90% of the disk */
+	unsigned long records = (unsigned long)disk->disk_size / 10 * 9 / RECORD_LEN;
+	clock_t start = clock();
+	for (unsigned long r = 0; r < records; r++)
+	{
+		for (unsigned i = 0; i < sizeof(record); i++)
+			record[i] = r + i;
+		ASSERT(kfile_write(&fd[r % LOG_FILES].fd, record, sizeof(record)) == sizeof(record));
+	}
+	unsigned long ms = (clock() - start) * 1000 / CLOCKS_PER_SEC;
+	unsigned long bytes = records * RECORD_LEN;
+	kprintf("Written %lu bytes in %lu ms, %lu KB/s\n", bytes, ms, ms ? bytes / ms * 1000 / 1024 : 0);
+
+	ASSERT(battfs_fsck(disk));
+
+	for (unsigned i = 0; i < countof(fd); i++)
+	{
+		ASSERT(kfile_seek(&fd[i].fd, 0, KSM_SEEK_SET) == 0);
+		for (unsigned long r = i; r < records; r += LOG_FILES)
+		{
+			ASSERT(kfile_read(&fd[i].fd, record, sizeof(record)) == sizeof(record));
+			for (unsigned j = 0; j < sizeof(record); j++)
+				ASSERT(record[j] == ((r + j) & 0xff));
+		}
+		ASSERT(kfile_close(&fd[i].fd) == 0);
+		ASSERT(kfile_error(&fd[i].fd) == 0);
+	}
+	ASSERT(battfs_umount(disk));
+
+	/* Remount and check that the index is rebuilt correctly */
+	kblockram_init(&ram, mem, mem_size, BIG_PAGE_SIZE, true, true);
+	ASSERT(battfs_mount(disk, &ram.b, big_page_array, sizeof(big_page_array)));
+	ASSERT(battfs_fsck(disk));
+	for (unsigned i = 0; i < countof(fd); i++)
+	{
+		ASSERT(battfs_fileopen(disk, &fd[i], i + 1, 0));
+		ASSERT(fd[i].fd.size == (kfile_off_t)((records - i + LOG_FILES - 1) / LOG_FILES * RECORD_LEN));
+		ASSERT(kfile_close(&fd[i].fd) == 0);
+	}
+	ASSERT(battfs_umount(disk));
+	free(mem);
+
+	#undef LOG_FILES
+	#undef RECORD_LEN
+	TRACEMSG("23: passed\n");
+}
+
+#if CONFIG_BATTFS_CHECKPOINT
+static unsigned long timedMount(BattFsSuper *disk, KBlockRam *ram, uint8_t *mem, size_t mem_size, KBlockRam *ckp, uint8_t *ckp_mem, size_t ckp_size)
+{
+	kblockram_init(ram, mem, mem_size, CKP_DISK_PAGE_SIZE, true, true);
+	if (ckp)
+		kblockram_init(ckp, ckp_mem, ckp_size, CKP_DISK_PAGE_SIZE, true, true);
+
+	clock_t start = clock();
+	if (ckp)
+		ASSERT(battfs_mountCheckpoint(disk, &ram->b, &ckp->b, ckp_page_array, sizeof(ckp_page_array)));
+	else
+		ASSERT(battfs_mount(disk, &ram->b, ckp_page_array, sizeof(ckp_page_array)));
+	return (clock() - start) * 1000000 / CLOCKS_PER_SEC;
+}
+
+static void checkpointMount(BattFsSuper *disk)
+{
+	TRACEMSG("24: mount from page table checkpoint on a 16 MiB disk\n");
+
+	#define CKP_FILES 8
+	#define CKP_DATA  1000
+
+	size_t mem_size = (CKP_DISK_PAGE_COUNT + 1) * CKP_DISK_PAGE_SIZE;
+	size_t ckp_size = (BATTFS_CKP_SIZE(CKP_DISK_PAGE_COUNT) / CKP_DISK_PAGE_SIZE + 2) * CKP_DISK_PAGE_SIZE;
+	uint8_t *mem = (uint8_t *)malloc(mem_size);
+	uint8_t *ckp_mem = (uint8_t *)malloc(ckp_size);
+	ASSERT(mem);
+	ASSERT(ckp_mem);
+	memset(mem, 0xff, mem_size);
+	memset(ckp_mem, 0xff, ckp_size);
+
+	KBlockRam ram, ckp;
+	BattFs fd;
+	uint8_t buf[CKP_DATA];
+	unsigned long scan_us, ckp_us;
+
+	/* New disk: no checkpoint, full scan */
+	timedMount(disk, &ram, mem, mem_size, &ckp, ckp_mem, ckp_size);
+	ASSERT(!disk->ckp_valid);
+	ASSERT(battfs_fsck(disk));
+	for (unsigned i = 0; i < CKP_FILES; i++)
+	{
+		ASSERT(battfs_fileopen(disk, &fd, i, BATTFS_CREATE));
+		for (unsigned j = 0; j < (i + 1) * 10; j++)
+		{
+			memset(buf, i + j, sizeof(buf));
+			ASSERT(kfile_write(&fd.fd, buf, sizeof(buf)) == sizeof(buf));
+		}
+		ASSERT(kfile_close(&fd.fd) == 0);
+	}
+	ASSERT(battfs_fsck(disk));
+	/* Umount writes the checkpoint */
+	ASSERT(battfs_umount(disk));
+	ASSERT(disk->ckp_valid);
+	uint32_t seq = disk->ckp_seq;
+
+	/* Mount from checkpoint and compare with a full scan */
+	ckp_us = timedMount(disk, &ram, mem, mem_size, &ckp, ckp_mem, ckp_size);
+	ASSERT(disk->ckp_valid);
+	ASSERT(disk->ckp_seq == seq);
+	ASSERT(battfs_fsck(disk));
+	disk_size_t free_bytes = disk->free_bytes;
+	pgcnt_t free_page_start = disk->free_page_start;
+	pgcnt_t file_start[BATTFS_MAX_FILES + 1];
+	memcpy(file_start, disk->file_start, sizeof(file_start));
+	/* Read only use does not invalidate the checkpoint */
+	ASSERT(battfs_fileopen(disk, &fd, 3, 0));
+	ASSERT(fd.fd.size == 40 * CKP_DATA);
+	ASSERT(kfile_read(&fd.fd, buf, sizeof(buf)) == sizeof(buf));
+	ASSERT(kfile_close(&fd.fd) == 0);
+	ASSERT(battfs_umount(disk));
+	ASSERT(disk->ckp_seq == seq);
+
+	scan_us = timedMount(disk, &ram, mem, mem_size, NULL, NULL, 0);
+	ASSERT(battfs_fsck(disk));
+	ASSERT(disk->free_bytes == free_bytes);
+	ASSERT(disk->free_page_start == free_page_start);
+	ASSERT(memcmp(file_start, disk->file_start, sizeof(file_start)) == 0);
+	ASSERT(battfs_umount(disk));
+
+	kprintf("Mount time: full scan %lu us, checkpoint %lu us\n", scan_us, ckp_us);
+
+	/* Write without umount: checkpoint must be stale */
+	timedMount(disk, &ram, mem, mem_size, &ckp, ckp_mem, ckp_size);
+	ASSERT(disk->ckp_valid);
+	ASSERT(battfs_fileopen(disk, &fd, 0, 0));
+	memset(buf, 0xAA, sizeof(buf));
+	ASSERT(kfile_write(&fd.fd, buf, sizeof(buf)) == sizeof(buf));
+	ASSERT(!disk->ckp_valid);
+	ASSERT(kfile_flush(&fd.fd) == 0);
+
+	timedMount(disk, &ram, mem, mem_size, &ckp, ckp_mem, ckp_size);
+	ASSERT(!disk->ckp_valid);
+	ASSERT(disk->ckp_seq == seq);
+	ASSERT(battfs_fsck(disk));
+	ASSERT(battfs_fileopen(disk, &fd, 0, 0));
+	ASSERT(kfile_read(&fd.fd, buf, sizeof(buf)) == sizeof(buf));
+	for (unsigned i = 0; i < sizeof(buf); i++)
+		ASSERT(buf[i] == 0xAA);
+	ASSERT(kfile_close(&fd.fd) == 0);
+	ASSERT(battfs_umount(disk));
+	ASSERT(disk->ckp_seq == seq + 1);
+
+	/* Corrupted checkpoint: full scan */
+	ckp_mem[CKP_DISK_PAGE_SIZE + BATTFS_CKP_HEADER_LEN + 100] ^= 0x01;
+	timedMount(disk, &ram, mem, mem_size, &ckp, ckp_mem, ckp_size);
+	ASSERT(!disk->ckp_valid);
+	ASSERT(battfs_fsck(disk));
+	ASSERT(battfs_umount(disk));
+
+	timedMount(disk, &ram, mem, mem_size, &ckp, ckp_mem, ckp_size);
+	ASSERT(disk->ckp_valid);
+	ASSERT(battfs_fsck(disk));
+	ASSERT(battfs_umount(disk));
+
+	/* Checkpoints with a good FCS but pages or free head out of the disk: full scan */
+	for (int i = 0; i < 2; i++)
+	{
+		timedMount(disk, &ram, mem, mem_size, &ckp, ckp_mem, ckp_size);
+		ASSERT(disk->ckp_valid);
+		if (i == 0)
+			disk->page_array[CKP_DISK_PAGE_COUNT / 2] = CKP_DISK_PAGE_COUNT + 7;
+		else
+			disk->free_head = CKP_DISK_PAGE_COUNT;
+		disk->ckp_valid = false;
+		ASSERT(battfs_checkpoint(disk));
+
+		timedMount(disk, &ram, mem, mem_size, &ckp, ckp_mem, ckp_size);
+		ASSERT(!disk->ckp_valid);
+		ASSERT(battfs_fsck(disk));
+		ASSERT(battfs_umount(disk));
+		ASSERT(disk->ckp_valid);
+	}
+
+	free(mem);
+	free(ckp_mem);
+
+	#undef CKP_FILES
+	#undef CKP_DATA
+	TRACEMSG("24: passed\n");
+}
+#endif
+
+#if CONFIG_BATTFS_WEAR_LEVELING
+static void wearLeveling(BattFsSuper *disk)
+{
+	TRACEMSG("25: wear leveling, %lu synchronous writes with half disk of static data\n", WEAR_WRITES);
+
+	#define COLD_PAGES 32
+
+	KBlockRam ram;
+	BattFs cold, hot;
+	uint8_t buf[WEAR_PAGE_SIZE - BATTFS_HEADER_LEN];
+
+	memset(wear_mem, 0xff, sizeof(wear_mem));
+	kblockram_init(&ram, wear_mem, sizeof(wear_mem), WEAR_PAGE_SIZE, true, true);
+	ASSERT(battfs_mount(disk, &ram.b, page_array, sizeof(page_array)));
+	ASSERT(!battfs_wearInit(disk, erase_cnt, sizeof(erase_cnt)));
+
+	/* Static data, written once */
+	ASSERT(battfs_fileopen(disk, &cold, 1, BATTFS_CREATE));
+	for (unsigned i = 0; i < COLD_PAGES; i++)
+	{
+		memset(buf, i, sizeof(buf));
+		ASSERT(kfile_write(&cold.fd, buf, sizeof(buf)) == sizeof(buf));
+	}
+	ASSERT(kfile_flush(&cold.fd) == 0);
+
+	/* Data rewritten continuously */
+	ASSERT(battfs_fileopen(disk, &hot, 2, BATTFS_CREATE));
+	for (unsigned long i = 0; i < WEAR_WRITES; i++)
+	{
+		ASSERT(kfile_seek(&hot.fd, (i * 16) % sizeof(buf), KSM_SEEK_SET) == (kfile_off_t)((i * 16) % sizeof(buf)));
+		memset(buf, i, 16);
+		ASSERT(kfile_write(&hot.fd, buf, 16) == 16);
+		ASSERT(kfile_flush(&hot.fd) == 0);
+
+		if (!(i % 16))
+			ASSERT(battfs_gc(disk, 4));
+	}
+
+	erase_t min_erase = erase_cnt[0], max_erase = erase_cnt[0];
+	for (unsigned i = 1; i < WEAR_PAGE_COUNT; i++)
+	{
+		min_erase = MIN(min_erase, erase_cnt[i]);
+		max_erase = MAX(max_erase, erase_cnt[i]);
+	}
+	kprintf("Erase count min %lu, max %lu\n", (unsigned long)min_erase, (unsigned long)max_erase);
+	ASSERT(max_erase - min_erase <= 2 * CONFIG_BATTFS_WEAR_THRESHOLD);
+
+	ASSERT(battfs_fsck(disk));
+	ASSERT(kfile_seek(&cold.fd, 0, KSM_SEEK_SET) == 0);
+	for (unsigned i = 0; i < COLD_PAGES; i++)
+	{
+		ASSERT(kfile_read(&cold.fd, buf, sizeof(buf)) == sizeof(buf));
+		for (unsigned j = 0; j < sizeof(buf); j++)
+			ASSERT(buf[j] == i);
+	}
+	ASSERT(kfile_close(&cold.fd) == 0);
+	ASSERT(kfile_close(&hot.fd) == 0);
+	ASSERT(battfs_umount(disk));
+
+	kblockram_init(&ram, wear_mem, sizeof(wear_mem), WEAR_PAGE_SIZE, true, true);
+	ASSERT(battfs_mount(disk, &ram.b, page_array, sizeof(page_array)));
+	ASSERT(battfs_fsck(disk));
+	ASSERT(battfs_fileopen(disk, &cold, 1, 0));
+	ASSERT(cold.fd.size == COLD_PAGES * (kfile_off_t)sizeof(buf));
+	ASSERT(kfile_seek(&cold.fd, (COLD_PAGES - 1) * sizeof(buf), KSM_SEEK_SET) == (COLD_PAGES - 1) * (kfile_off_t)sizeof(buf));
+	ASSERT(kfile_read(&cold.fd, buf, sizeof(buf)) == sizeof(buf));
+	ASSERT(buf[0] == COLD_PAGES - 1);
+	ASSERT(kfile_close(&cold.fd) == 0);
+	ASSERT(battfs_umount(disk));
+
+	#undef COLD_PAGES
+	TRACEMSG("25: passed\n");
+}
+#endif
+
+#if CONFIG_BATTFS_GC
+static void gcProcess(BattFsSuper *disk)
+{
+	TRACEMSG("27: background garbage collector, %lu synchronous writes\n", GC_WRITES);
+
+	#define COLD_PAGES 32
+
+	KBlockRam ram;
+	BattFs cold, hot;
+	Semaphore lock;
+	uint8_t buf[WEAR_PAGE_SIZE - BATTFS_HEADER_LEN];
+
+	sem_init(&lock);
+	memset(wear_mem, 0xff, sizeof(wear_mem));
+	kblockram_init(&ram, wear_mem, sizeof(wear_mem), WEAR_PAGE_SIZE, true, true);
+	ASSERT(battfs_mount(disk, &ram.b, page_array, sizeof(page_array)));
+	ASSERT(!battfs_wearInit(disk, erase_cnt, sizeof(erase_cnt)));
+
+	ASSERT(battfs_fileopen(disk, &cold, 1, BATTFS_CREATE));
+	for (unsigned i = 0; i < COLD_PAGES; i++)
+	{
+		memset(buf, i, sizeof(buf));
+		ASSERT(kfile_write(&cold.fd, buf, sizeof(buf)) == sizeof(buf));
+	}
+	ASSERT(kfile_flush(&cold.fd) == 0);
+	ASSERT(battfs_fileopen(disk, &hot, 2, BATTFS_CREATE));
+
+	/* Only the garbage collector process moves the static data */
+	ASSERT(battfs_gcStart(disk, &lock));
+	for (unsigned long i = 0; i < GC_WRITES; i++)
+	{
+		sem_obtain(&lock);
+		ASSERT(kfile_seek(&hot.fd, (i * 16) % sizeof(buf), KSM_SEEK_SET) == (kfile_off_t)((i * 16) % sizeof(buf)));
+		memset(buf, i, 16);
+		ASSERT(kfile_write(&hot.fd, buf, 16) == 16);
+		ASSERT(kfile_flush(&hot.fd) == 0);
+		sem_release(&lock);
+
+		if (!(i % 256))
+			timer_delay(CONFIG_BATTFS_GC_INTERVAL * 2);
+	}
+
+	erase_t min_erase = erase_cnt[0], max_erase = erase_cnt[0];
+	for (unsigned i = 1; i < WEAR_PAGE_COUNT; i++)
+	{
+		min_erase = MIN(min_erase, erase_cnt[i]);
+		max_erase = MAX(max_erase, erase_cnt[i]);
+	}
+	kprintf("Erase count min %lu, max %lu\n", (unsigned long)min_erase, (unsigned long)max_erase);
+	ASSERT(min_erase > 0);
+	ASSERT(max_erase - min_erase <= 2 * CONFIG_BATTFS_WEAR_THRESHOLD);
+
+	/* Umount stops the process and waits for it to exit */
+	ASSERT(battfs_umount(disk));
+	ASSERT(!disk->gc_run);
+
+	kblockram_init(&ram, wear_mem, sizeof(wear_mem), WEAR_PAGE_SIZE, true, true);
+	ASSERT(battfs_mount(disk, &ram.b, page_array, sizeof(page_array)));
+	ASSERT(battfs_fsck(disk));
+	ASSERT(battfs_fileopen(disk, &cold, 1, 0));
+	for (unsigned i = 0; i < COLD_PAGES; i++)
+	{
+		ASSERT(kfile_read(&cold.fd, buf, sizeof(buf)) == sizeof(buf));
+		for (unsigned j = 0; j < sizeof(buf); j++)
+			ASSERT(buf[j] == i);
+	}
+	ASSERT(kfile_close(&cold.fd) == 0);
+
+	/* The stack is free again: a new process can start and stop right away */
+	ASSERT(!battfs_wearInit(disk, erase_cnt, sizeof(erase_cnt)));
+	ASSERT(battfs_gcStart(disk, &lock));
+	ASSERT(battfs_umount(disk));
+	ASSERT(battfs_gcStart(disk, &lock));
+	ASSERT(battfs_umount(disk));
+
+	#undef COLD_PAGES
+	TRACEMSG("27: passed\n");
+}
+#endif
+
+/* Write a log file on an emulated disk, return the time elapsed in us */
+static unsigned long emulatedLog(BattFsSuper *disk, KBlockPosix *f, unsigned long records)
+{
+	BattFs fd;
+	uint8_t record[EMUL_RECORD_LEN];
+
+	clock_t start = clock();
+	ASSERT(battfs_mount(disk, &f->b, big_page_array, sizeof(big_page_array)));
+	ASSERT(battfs_fileopen(disk, &fd, 0, BATTFS_CREATE));
+	for (unsigned long r = 0; r < records; r++)
+	{
+		for (unsigned i = 0; i < sizeof(record); i++)
+			record[i] = r + i;
+		ASSERT(kfile_write(&fd.fd, record, sizeof(record)) == sizeof(record));
+	}
+	ASSERT(kfile_close(&fd.fd) == 0);
+	ASSERT(battfs_umount(disk));
+	return (clock() - start) * 1000000 / CLOCKS_PER_SEC;
+}
+
+static FILE *emulatedDisk(size_t size)
+{
+	FILE *fp = fopen(test_filename, "w+");
+	ASSERT(fp);
+	for (size_t i = 0; i < size; i++)
+		fputc(0xff, fp);
+	return fp;
+}
+
+static void emulatedTiming(BattFsSuper *disk)
+{
+	TRACEMSG("26: memory mapped disk with DataFlash timing model\n");
+
+	#define EMUL_PAGE_COUNT 4096
+
+	static uint8_t emul_buf[BIG_PAGE_SIZE];
+	size_t size = (size_t)EMUL_PAGE_COUNT * BIG_PAGE_SIZE;
+	unsigned long records = size / 2 / EMUL_RECORD_LEN;
+	KBlockPosix f;
+
+	/* Same workload through stdio and through the file mapping */
+	kblockposix_init(&f, emulatedDisk(size), HW_PAGEBUF, emul_buf, BIG_PAGE_SIZE, EMUL_PAGE_COUNT);
+	unsigned long stdio_us = emulatedLog(disk, &f, records);
+	KBlockPosixStats stdio_stats = f.stats;
+
+	ASSERT(kblockposix_mmapInit(&f, emulatedDisk(size), HW_PAGEBUF, emul_buf, BIG_PAGE_SIZE, EMUL_PAGE_COUNT) == 0);
+	ASSERT(kblockposix_setTiming(&f, &kblockposix_dataflash_timing) == 0);
+	unsigned long mmap_us = emulatedLog(disk, &f, records);
+
+	ASSERT(f.stats.reads == stdio_stats.reads);
+	ASSERT(f.stats.writes == stdio_stats.writes);
+	ASSERT(f.stats.erases <= f.stats.writes);
+	kprintf("Log of %lu bytes: stdio %lu us, mmap %lu us\n", records * EMUL_RECORD_LEN, stdio_us, mmap_us);
+	kprintf("DataFlash model: %lu reads, %lu writes, %lu erases, %lu ms\n",
+		f.stats.reads, f.stats.writes, f.stats.erases, (unsigned long)(f.stats.time_ns / 1000000));
+
+	/* The mapped file must hold the same data when read back through stdio */
+	FILE *fp = fopen(test_filename, "r+");
+	ASSERT(fp);
+	kblockposix_init(&f, fp, HW_PAGEBUF, emul_buf, BIG_PAGE_SIZE, EMUL_PAGE_COUNT);
+	ASSERT(battfs_mount(disk, &f.b, big_page_array, sizeof(big_page_array)));
+	ASSERT(battfs_fsck(disk));
+
+	BattFs fd;
+	uint8_t record[EMUL_RECORD_LEN];
+	ASSERT(battfs_fileopen(disk, &fd, 0, 0));
+	ASSERT(fd.fd.size == (kfile_off_t)(records * EMUL_RECORD_LEN));
+	for (unsigned long r = 0; r < records; r++)
+	{
+		ASSERT(kfile_read(&fd.fd, record, sizeof(record)) == sizeof(record));
+		for (unsigned i = 0; i < sizeof(record); i++)
+			ASSERT(record[i] == ((r + i) & 0xff));
+	}
+	ASSERT(kfile_close(&fd.fd) == 0);
+	ASSERT(battfs_umount(disk));
+
+	/* Programming a page twice needs an erase in between */
+	ASSERT(kblockposix_mmapInit(&f, fopen(test_filename, "r+"), HW_PAGEBUF, emul_buf, BIG_PAGE_SIZE, EMUL_PAGE_COUNT) == 0);
+	ASSERT(kblockposix_setTiming(&f, &kblockposix_dataflash_timing) == 0);
+	ASSERT(kblock_write(&f.b, 1, record, 0, sizeof(record)) == sizeof(record));
+	ASSERT(kblock_flush(&f.b) == 0);
+	ASSERT(f.stats.erases == 0);
+	ASSERT(kblock_write(&f.b, 1, record, 0, sizeof(record)) == sizeof(record));
+	ASSERT(kblock_flush(&f.b) == 0);
+	ASSERT(f.stats.erases == 1);
+	ASSERT(kblock_close(&f.b) == 0);
+
+	#undef EMUL_PAGE_COUNT
+	TRACEMSG("26: passed\n");
+}
+
 int battfs_testRun(void)
 {
 	BattFsSuper disk;
@@ -1074,6 +1583,17 @@ int battfs_testRun(void)
 	endOfSpace(&disk);
 	multipleFilesRW(&disk);
 	openAllFiles(&disk);
+	appendThroughput(&disk);
+#if CONFIG_BATTFS_CHECKPOINT
+	checkpointMount(&disk);
+#endif
+#if CONFIG_BATTFS_WEAR_LEVELING
+	wearLeveling(&disk);
+#endif
+	emulatedTiming(&disk);
+#if CONFIG_BATTFS_GC
+	gcProcess(&disk);
+#endif
 
 	kprintf("All tests passed!\n");
 
@@ -1082,6 +1602,10 @@ int battfs_testRun(void)
 
 int battfs_testSetup(void)
 {
+#if CONFIG_BATTFS_GC
+	timer_init();
+	proc_init();
+#endif
 	return 0;
 }
 
@@ -138,5 +138,27 @@ FRESULT fatfile_open(FatFile *file, const char *file_path, BYTE mode)
 	file->fd.flush = fatfile_flush;
 	file->fd.error = fatfile_error;
 	file->fd.clearerr = fatfile_clearerr;
+#if _USE_FASTSEEK
+	FRESULT res = f_open(&file->fat_file, file_path, mode);
+	if (res != FR_OK)
+		return res;
+
+	/*
+	 * Map the cluster chain once at open time; FatFs keeps the map
+	 * up to date when the file grows or is truncated.
+	 */
+	file->clmt[0] = countof(file->clmt);
+	file->fat_file.cltbl = file->clmt;
+	return f_lseek(&file->fat_file, CREATE_LINKMAP);
+#else
 	return f_open(&file->fat_file, file_path, mode);
+#endif
+}
+
+#if _USE_EXPAND
+FRESULT fatfile_expand(FatFile *file, DWORD size)
+{
+	file->error_code = f_expand(&file->fat_file, size, 1);
+	return file->error_code;
 }
+#endif
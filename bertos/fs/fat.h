@@ -55,6 +55,9 @@ typedef struct FatFile
 	KFile fd;
 	FIL fat_file;
 	FRESULT error_code; ///< error code for calls like kfile_read
+#if _USE_FASTSEEK
+	DWORD clmt[CONFIG_FAT_FASTSEEK_SIZE]; ///< cluster link map used for fast seek
+#endif
 } FatFile;
 
 #define KFT_FATFILE MAKE_ID('F', 'A', 'T', 'F')
@@ -80,4 +83,21 @@ INLINE FatFile *FATFILE_CAST(KFile *fd)
  */
 FRESULT fatfile_open(FatFile *file, const char *file_path, BYTE mode);
 
+#if _USE_EXPAND
+/**
+ * Pre-allocate \a size bytes of contiguous clusters to \a file.
+ *
+ * The file must be open for writing and still be empty: after the call its
+ * size is \a size and the data clusters are consecutive on the disk, so
+ * sequential writes never have to look for free clusters and seeks inside the
+ * file are resolved without FAT accesses.
+ * Contents of the pre-allocated area are undefined until written; use
+ * kfile_seek() and f_truncate() to trim the unused tail when done.
+ *
+ * \return FR_OK on success, FR_DENIED if the file is not empty or no free
+ *         contiguous area is large enough, other FRESULT codes on disk errors.
+ */
+FRESULT fatfile_expand(FatFile *file, DWORD size);
+#endif
+
 #endif /* FS_FAT_H */
@@ -46,6 +46,10 @@
 #include "fatfs/diskio.h"
 
 #include <cfg/test.h>
+#include <cfg/debug.h>
+
+#include <string.h>
+#include <time.h>
 
 /* avoid compiler warnings... */
 int fatfile_testSetup(void);
@@ -54,6 +58,198 @@ int fatfile_testRun(void);
 
 static FATFS file_system;
 
+/* Access counters of the emulated disk (emul/diskio_emul.c) */
+extern unsigned long diskio_emul_read_cmds, diskio_emul_write_cmds;
+
+#define BENCH_FILE_SIZE  (4UL * 1024 * 1024)
+#define BENCH_CHUNK      8192
+#define BENCH_SEEKS      2000
+
+#define FRAG_FILE_SIZE   (128UL * 1024)
+#define FRAG_CHUNK       2048
+
+static uint32_t bench_buf[BENCH_CHUNK / sizeof(uint32_t)];
+
+/* Fill the buffer with the pattern expected at file offset \a ofs */
+static void fillPattern(uint32_t ofs, uint32_t seed)
+{
+	for (size_t i = 0; i < countof(bench_buf); i++)
+		bench_buf[i] = (ofs / sizeof(uint32_t) + i) ^ seed;
+}
+
+static void checkPattern(uint32_t ofs, uint32_t seed, size_t len)
+{
+	for (size_t i = 0; i < len / sizeof(uint32_t); i++)
+		ASSERT(bench_buf[i] == ((ofs / sizeof(uint32_t) + i) ^ seed));
+}
+
+static void writePattern(FatFile *f, uint32_t ofs, uint32_t size, uint32_t seed, size_t chunk)
+{
+	for (uint32_t end = ofs + size; ofs < end; ofs += chunk)
+	{
+		fillPattern(ofs, seed);
+		ASSERT(kfile_write(&f->fd, bench_buf, chunk) == chunk);
+	}
+}
+
+/* Seek to a word of the file and check its content */
+static void checkWord(FatFile *f, uint32_t word, uint32_t seed)
+{
+	uint32_t val;
+
+	ASSERT(kfile_seek(&f->fd, word * sizeof(uint32_t), KSM_SEEK_SET) == (kfile_off_t)(word * sizeof(uint32_t)));
+	ASSERT(kfile_read(&f->fd, &val, sizeof(val)) == sizeof(val));
+	ASSERT(val == (word ^ seed));
+}
+
+static void randomSeeks(FatFile *f, uint32_t size, uint32_t seed, unsigned count)
+{
+	uint32_t rnd = 1;
+
+	for (unsigned i = 0; i < count; i++)
+	{
+		rnd = rnd * 1103515245 + 12345;
+		checkWord(f, (rnd >> 8) % (size / sizeof(uint32_t)), seed);
+	}
+}
+
+static void sequentialRead(FatFile *f, uint32_t size, uint32_t seed)
+{
+	ASSERT(kfile_seek(&f->fd, 0, KSM_SEEK_SET) == 0);
+	for (uint32_t ofs = 0; ofs < size; ofs += BENCH_CHUNK)
+	{
+		ASSERT(kfile_read(&f->fd, bench_buf, BENCH_CHUNK) == BENCH_CHUNK);
+		checkPattern(ofs, seed, BENCH_CHUNK);
+	}
+}
+
+/*
+ * Seek and sequential read throughput on the emulated disk, with and without
+ * the cluster link map.
+ * Disk commands are counted as well as time, since on a real SD card
+ * each command costs far more than on the host file backing the emulation.
+ */
+static void fastSeekBench(void)
+{
+	FatFile f;
+	unsigned long cmds[2][2], us[2][2];
+	clock_t start;
+
+	ASSERT(fatfile_open(&f, "log.bin", FA_WRITE | FA_CREATE_ALWAYS) == FR_OK);
+	writePattern(&f, 0, BENCH_FILE_SIZE, 0, BENCH_CHUNK);
+	ASSERT(kfile_close(&f.fd) == 0);
+
+	for (int map = 1; map >= 0; map--)
+	{
+		ASSERT(fatfile_open(&f, "log.bin", FA_READ) == FR_OK);
+		/* A file written on an empty disk is a single fragment */
+		ASSERT(f.clmt[1] * f.fat_file.fs->csize * 512 == BENCH_FILE_SIZE);
+		ASSERT(f.clmt[3] == 0);
+		if (!map)
+			f.fat_file.cltbl = NULL;
+
+		diskio_emul_read_cmds = 0;
+		start = clock();
+		randomSeeks(&f, BENCH_FILE_SIZE, 0, BENCH_SEEKS);
+		us[map][0] = (clock() - start) * 1000000 / CLOCKS_PER_SEC;
+		cmds[map][0] = diskio_emul_read_cmds;
+
+		diskio_emul_read_cmds = 0;
+		start = clock();
+		sequentialRead(&f, BENCH_FILE_SIZE, 0);
+		us[map][1] = (clock() - start) * 1000000 / CLOCKS_PER_SEC;
+		cmds[map][1] = diskio_emul_read_cmds;
+
+		ASSERT(kfile_close(&f.fd) == 0);
+	}
+
+	kprintf("%d random seeks: FAT chain %lu reads %lu us, link map %lu reads %lu us\n",
+		BENCH_SEEKS, cmds[0][0], us[0][0], cmds[1][0], us[1][0]);
+	kprintf("Sequential read %lu KiB: FAT chain %lu reads %lu us, link map %lu reads %lu us\n",
+		BENCH_FILE_SIZE / 1024, cmds[0][1], us[0][1], cmds[1][1], us[1][1]);
+	ASSERT(cmds[1][0] < cmds[0][0]);
+	ASSERT(cmds[1][1] < cmds[0][1]);
+}
+
+/*
+ * Interleave two files to fragment them more than the link map can hold,
+ * then check seeks, appends and truncation across mapped and unmapped parts.
+ */
+static void fastSeekFragmented(void)
+{
+	FatFile a, b;
+
+	ASSERT(fatfile_open(&a, "a.bin", FA_READ | FA_WRITE | FA_CREATE_ALWAYS) == FR_OK);
+	ASSERT(fatfile_open(&b, "b.bin", FA_WRITE | FA_CREATE_ALWAYS) == FR_OK);
+	for (uint32_t ofs = 0; ofs < FRAG_FILE_SIZE; ofs += FRAG_CHUNK)
+	{
+		writePattern(&a, ofs, FRAG_CHUNK, 0xA5A5A5A5, FRAG_CHUNK);
+		writePattern(&b, ofs, FRAG_CHUNK, 0x5A5A5A5A, FRAG_CHUNK);
+		ASSERT(kfile_flush(&a.fd) == 0);
+		ASSERT(kfile_flush(&b.fd) == 0);
+	}
+	ASSERT(kfile_close(&b.fd) == 0);
+
+	/* The map has been kept up to date while writing, but it is full now */
+	randomSeeks(&a, FRAG_FILE_SIZE, 0xA5A5A5A5, 500);
+	ASSERT(kfile_close(&a.fd) == 0);
+
+	ASSERT(fatfile_open(&a, "a.bin", FA_READ | FA_WRITE) == FR_OK);
+	ASSERT(a.clmt[CONFIG_FAT_FASTSEEK_SIZE - 3] != 0);
+	randomSeeks(&a, FRAG_FILE_SIZE, 0xA5A5A5A5, 500);
+	checkWord(&a, 0, 0xA5A5A5A5);
+	checkWord(&a, FRAG_FILE_SIZE / sizeof(uint32_t) - 1, 0xA5A5A5A5);
+
+	/* Truncate inside the mapped part and append again */
+	ASSERT(kfile_seek(&a.fd, 3 * FRAG_CHUNK + 512, KSM_SEEK_SET) == 3 * FRAG_CHUNK + 512);
+	ASSERT(f_truncate(&a.fat_file) == FR_OK);
+	writePattern(&a, 3 * FRAG_CHUNK + 512, FRAG_FILE_SIZE - 3 * FRAG_CHUNK - 512, 0xA5A5A5A5, 512);
+	randomSeeks(&a, FRAG_FILE_SIZE, 0xA5A5A5A5, 500);
+	sequentialRead(&a, FRAG_FILE_SIZE, 0xA5A5A5A5);
+	ASSERT(kfile_close(&a.fd) == 0);
+
+	ASSERT(fatfile_open(&b, "b.bin", FA_READ) == FR_OK);
+	sequentialRead(&b, FRAG_FILE_SIZE, 0x5A5A5A5A);
+	ASSERT(kfile_close(&b.fd) == 0);
+}
+
+/*
+ * Pre-allocate a contiguous log file and fill it: the link map must
+ * describe it as a single fragment and sequential writes must go out
+ * in multi-sector commands.
+ */
+static void expandFile(void)
+{
+	FatFile f;
+	unsigned long cmds;
+
+	ASSERT(fatfile_open(&f, "pre.bin", FA_WRITE | FA_CREATE_ALWAYS) == FR_OK);
+	ASSERT(fatfile_expand(&f, BENCH_FILE_SIZE) == FR_OK);
+	ASSERT(f.fat_file.fsize == BENCH_FILE_SIZE);
+	ASSERT(f.clmt[1] * f.fat_file.fs->csize * 512 == BENCH_FILE_SIZE);
+	ASSERT(f.clmt[3] == 0);
+	/* Only empty files can be expanded */
+	ASSERT(fatfile_expand(&f, BENCH_FILE_SIZE) == FR_DENIED);
+
+	diskio_emul_write_cmds = 0;
+	writePattern(&f, 0, BENCH_FILE_SIZE, 0x12345678, BENCH_CHUNK);
+	cmds = diskio_emul_write_cmds;
+	kprintf("Sequential write %lu KiB to a pre-allocated file: %lu write commands\n",
+		BENCH_FILE_SIZE / 1024, cmds);
+	ASSERT(cmds <= BENCH_FILE_SIZE / BENCH_CHUNK + 1);
+	ASSERT(kfile_close(&f.fd) == 0);
+
+	ASSERT(fatfile_open(&f, "pre.bin", FA_READ) == FR_OK);
+	ASSERT(f.clmt[3] == 0);
+	sequentialRead(&f, BENCH_FILE_SIZE, 0x12345678);
+	ASSERT(kfile_close(&f.fd) == 0);
+
+	/* Larger than the free space */
+	ASSERT(fatfile_open(&f, "big.bin", FA_WRITE | FA_CREATE_ALWAYS) == FR_OK);
+	ASSERT(fatfile_expand(&f, 0x7FFFFFFF) == FR_DENIED);
+	ASSERT(kfile_close(&f.fd) == 0);
+}
+
 int fatfile_testSetup(void)
 {
 	FRESULT err;
@@ -119,6 +315,11 @@ int fatfile_testRun(void)
 	fatfile_open(&file_handler, "foo.txt", FA_READ | FA_WRITE);
 	ASSERT((size_t)kfile_seek(&file_handler.fd, sizeof(int), KSM_SEEK_END) == sizeof(int) * (SIZE + 1));
 	ASSERT(kfile_seek(&file_handler.fd, -SIZE, KSM_SEEK_SET) == 0);
+	ASSERT(kfile_close(&file_handler.fd) == 0);
+
+	fastSeekFragmented();
+	expandFile();
+	fastSeekBench();
 
 	return 0;
 }
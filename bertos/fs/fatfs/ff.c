@@ -502,6 +502,162 @@ DWORD clust2sect (	/* !=0: sector number, 0: failed - invalid cluster# */
 
 
 
+#if _USE_FASTSEEK
+/*-----------------------------------------------------------------------*/
+/* Get cluster# from the cluster link map table                          */
+/*-----------------------------------------------------------------------*/
+
+static
+DWORD clmt_clust (	/* 0:Not mapped, >=2:Cluster# */
+	FIL *fp,		/* Pointer to the file object */
+	DWORD ofs		/* File offset to be converted to cluster# */
+)
+{
+	DWORD cl, ncl, *tbl;
+
+
+	tbl = fp->cltbl + 1;	/* Top of the CLMT */
+	cl = ofs / SS(fp->fs) / fp->fs->csize;	/* Cluster order from top of the file */
+	for (;;) {
+		ncl = *tbl++;			/* Number of clusters in the fragment */
+		if (!ncl) return 0;		/* End of table (the offset is not mapped) */
+		if (cl < ncl) break;	/* In this fragment? */
+		cl -= ncl; tbl++;		/* Next fragment */
+	}
+	return cl + *tbl;			/* Return the cluster# */
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Get number of sectors that can be transferred at once                 */
+/*-----------------------------------------------------------------------*/
+
+static
+UINT clmt_sectors (	/* Number of contiguous sectors from the current one (<= cc) */
+	FIL *fp,		/* Pointer to the file object (fptr on the current sector) */
+	UINT cc			/* Number of sectors requested */
+)
+{
+	DWORD cl, ncl, n, *tbl;
+
+
+	n = fp->fs->csize - fp->csect;			/* Sectors left in the current cluster */
+	if (fp->cltbl && cc > n) {				/* Add the following clusters of the fragment */
+		tbl = fp->cltbl + 1;
+		cl = fp->fptr / SS(fp->fs) / fp->fs->csize;
+		while ((ncl = *tbl++) != 0 && cl >= ncl) {
+			cl -= ncl; tbl++;
+		}
+		if (ncl) n += (ncl - cl - 1) * fp->fs->csize;
+		if (n > 255) n = 255;				/* Sector count is a BYTE on the disk interface */
+	}
+	return (cc > n) ? (UINT)n : cc;
+}
+
+
+
+
+#if !_FS_READONLY
+/*-----------------------------------------------------------------------*/
+/* Add a cluster linked at the end of the mapped chain to the CLMT       */
+/*-----------------------------------------------------------------------*/
+
+static
+void clmt_append (
+	FIL *fp,		/* Pointer to the file object */
+	DWORD pcl,		/* Cluster# the new one is linked to (0:new chain) */
+	DWORD clst		/* New cluster# */
+)
+{
+	DWORD *tbl, *last;
+
+
+	tbl = fp->cltbl + 1; last = 0;
+	while (*tbl) { last = tbl; tbl += 2; }	/* Find the last fragment */
+	if (last) {
+		if (last[1] + last[0] - 1 != pcl) return;	/* The map does not reach pcl */
+		if (clst == pcl + 1) {						/* Contiguous: stretch the last fragment */
+			last[0]++;
+			return;
+		}
+	} else {
+		if (pcl) return;	/* Empty map but not a new chain */
+	}
+	if ((DWORD)(tbl - fp->cltbl) + 3 > fp->cltbl[0]) return;	/* No room for a new fragment */
+	tbl[0] = 1; tbl[1] = clst; tbl[2] = 0;
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Drop the clusters beyond the first ncl from the CLMT                  */
+/*-----------------------------------------------------------------------*/
+
+static
+void clmt_trim (
+	FIL *fp,		/* Pointer to the file object */
+	DWORD ncl		/* Number of clusters to be kept */
+)
+{
+	DWORD *tbl;
+
+
+	tbl = fp->cltbl + 1;
+	while (*tbl) {
+		if (tbl[0] >= ncl) {
+			if (ncl) {
+				tbl[0] = ncl; tbl += 2;
+			}
+			*tbl = 0;
+			break;
+		}
+		ncl -= tbl[0]; tbl += 2;
+	}
+}
+#endif /* !_FS_READONLY */
+#endif /* _USE_FASTSEEK */
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Get the cluster following the current one of a file                   */
+/*-----------------------------------------------------------------------*/
+
+static
+DWORD next_cluster (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk error, >=2:Cluster# */
+	FIL *fp,		/* Pointer to the file object (fptr on the cluster boundary) */
+	BYTE stretch	/* 1:Stretch the chain if needed (write mode) */
+)
+{
+	DWORD clst;
+
+
+#if _USE_FASTSEEK
+	if (fp->cltbl) {			/* Look up the CLMT first */
+		clst = clmt_clust(fp, fp->fptr);
+		if (clst) return clst;
+	}
+#endif
+#if !_FS_READONLY
+	if (stretch) {
+		clst = create_chain(fp->fs, fp->curr_clust);
+#if _USE_FASTSEEK
+		if (fp->cltbl && clst >= 2 && clst != 0xFFFFFFFF)
+			clmt_append(fp, fp->curr_clust, clst);
+#endif
+		return clst;
+	}
+#endif
+	return get_cluster(fp->fs, fp->curr_clust);
+}
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Seek directory index                                                  */
 /*-----------------------------------------------------------------------*/
@@ -1627,6 +1783,9 @@ FRESULT f_open (
 	fp->fsize = LD_DWORD(dir+DIR_FileSize);	/* File size */
 	fp->fptr = 0; fp->csect = 255;		/* File pointer */
 	fp->dsect = 0;
+#if _USE_FASTSEEK
+	fp->cltbl = 0;						/* No cluster link map table */
+#endif
 	fp->fs = dj.fs; fp->id = dj.fs->id;	/* Owner file system object of the file */
 
 	LEAVE_FF(dj.fs, FR_OK);
@@ -1668,7 +1827,7 @@ FRESULT f_read (
 		if ((fp->fptr % SS(fp->fs)) == 0) {			/* On the sector boundary? */
 			if (fp->csect >= fp->fs->csize) {		/* On the cluster boundary? */
 				clst = (fp->fptr == 0) ?			/* On the top of the file? */
-					fp->org_clust : get_cluster(fp->fs, fp->curr_clust);
+					fp->org_clust : next_cluster(fp, 0);
 				if (clst <= 1) ABORT(fp->fs, FR_INT_ERR);
 				if (clst == 0xFFFFFFFF) ABORT(fp->fs, FR_DISK_ERR);
 				fp->curr_clust = clst;				/* Update current cluster */
@@ -1679,11 +1838,20 @@ FRESULT f_read (
 			sect += fp->csect;
 			cc = btr / SS(fp->fs);					/* When remaining bytes >= sector size, */
 			if (cc) {								/* Read maximum contiguous sectors directly */
+#if _USE_FASTSEEK
+				cc = clmt_sectors(fp, cc);			/* Clip at fragment boundary */
+#else
 				if (fp->csect + cc > fp->fs->csize)	/* Clip at cluster boundary */
 					cc = fp->fs->csize - fp->csect;
+#endif
 				if (disk_read(fp->fs->drive, rbuff, sect, (BYTE)cc) != RES_OK)
 					ABORT(fp->fs, FR_DISK_ERR);
+#if _USE_FASTSEEK
+				fp->curr_clust += (fp->csect + cc - 1) / fp->fs->csize;	/* Last cluster read */
+				fp->csect = (BYTE)((fp->csect + cc - 1) % fp->fs->csize + 1);
+#else
 				fp->csect += (BYTE)cc;				/* Next sector address in the cluster */
+#endif
 				rcnt = SS(fp->fs) * cc;				/* Number of bytes transferred */
 				continue;
 			}
@@ -1755,10 +1923,15 @@ FRESULT f_write (
 			if (fp->csect >= fp->fs->csize) {		/* On the cluster boundary? */
 				if (fp->fptr == 0) {				/* On the top of the file? */
 					clst = fp->org_clust;			/* Follow from the origin */
-					if (clst == 0)					/* When there is no cluster chain, */
+					if (clst == 0) {				/* When there is no cluster chain, */
 						fp->org_clust = clst = create_chain(fp->fs, 0);	/* Create a new cluster chain */
+#if _USE_FASTSEEK
+						if (fp->cltbl && clst >= 2 && clst != 0xFFFFFFFF)
+							clmt_append(fp, 0, clst);
+#endif
+					}
 				} else {							/* Middle or end of the file */
-					clst = create_chain(fp->fs, fp->curr_clust);			/* Follow or streach cluster chain */
+					clst = next_cluster(fp, 1);		/* Follow or streach cluster chain */
 				}
 				if (clst == 0) break;				/* Could not allocate a new cluster (disk full) */
 				if (clst == 1) ABORT(fp->fs, FR_INT_ERR);
@@ -1781,8 +1954,12 @@ FRESULT f_write (
 			sect += fp->csect;
 			cc = btw / SS(fp->fs);					/* When remaining bytes >= sector size, */
 			if (cc) {								/* Write maximum contiguous sectors directly */
+#if _USE_FASTSEEK
+				cc = clmt_sectors(fp, cc);			/* Clip at fragment boundary */
+#else
 				if (fp->csect + cc > fp->fs->csize)	/* Clip at cluster boundary */
 					cc = fp->fs->csize - fp->csect;
+#endif
 				if (disk_write(fp->fs->drive, wbuff, sect, (BYTE)cc) != RES_OK)
 					ABORT(fp->fs, FR_DISK_ERR);
 #if _FS_TINY
@@ -1796,7 +1973,12 @@ FRESULT f_write (
 					fp->flag &= ~FA__DIRTY;
 				}
 #endif			
+#if _USE_FASTSEEK
+				fp->curr_clust += (fp->csect + cc - 1) / fp->fs->csize;	/* Last cluster written */
+				fp->csect = (BYTE)((fp->csect + cc - 1) % fp->fs->csize + 1);
+#else
 				fp->csect += (BYTE)cc;				/* Next sector address in the cluster */
+#endif
 				wcnt = SS(fp->fs) * cc;				/* Number of bytes transferred */
 				continue;
 			}
@@ -1922,12 +2104,36 @@ FRESULT f_lseek (
 {
 	FRESULT res;
 	DWORD clst, bcs, nsect, ifptr;
+#if _USE_FASTSEEK
+	DWORD *tbl, tlen, ulen, pcl, scl, ncl;
+#endif
 
 
 	res = validate(fp->fs, fp->id);		/* Check validity of the object */
 	if (res != FR_OK) LEAVE_FF(fp->fs, res);
 	if (fp->flag & FA__ERROR)			/* Check abort flag */
 		LEAVE_FF(fp->fs, FR_INT_ERR);
+#if _USE_FASTSEEK
+	if (fp->cltbl && ofs == CREATE_LINKMAP) {	/* Create the CLMT */
+		tbl = fp->cltbl;
+		tlen = *tbl++; ulen = 2;		/* Given table size and required table size */
+		if (tlen < ulen) LEAVE_FF(fp->fs, FR_INVALID_OBJECT);
+		clst = fp->org_clust;			/* Top of the chain */
+		while (clst && clst < fp->fs->max_clust && ulen + 2 <= tlen) {
+			scl = clst; ncl = 0;
+			do {						/* Get a fragment */
+				pcl = clst; ncl++;
+				clst = get_cluster(fp->fs, clst);
+				if (clst <= 1) ABORT(fp->fs, FR_INT_ERR);
+				if (clst == 0xFFFFFFFF) ABORT(fp->fs, FR_DISK_ERR);
+			} while (clst == pcl + 1);
+			*tbl++ = ncl; *tbl++ = scl;	/* Store the fragment */
+			ulen += 2;
+		}
+		*tbl = 0;						/* Terminate the table (a full table maps only the top of the file) */
+		LEAVE_FF(fp->fs, FR_OK);
+	}
+#endif
 	if (ofs > fp->fsize					/* In read-only mode, clip offset with the file size */
 #if !_FS_READONLY
 		 && !(fp->flag & FA_WRITE)
@@ -1939,6 +2145,14 @@ FRESULT f_lseek (
 	nsect = 0;
 	if (ofs > 0) {
 		bcs = (DWORD)fp->fs->csize * SS(fp->fs);	/* Cluster size (byte) */
+#if _USE_FASTSEEK
+		clst = fp->cltbl ? clmt_clust(fp, ofs - 1) : 0;
+		if (clst) {									/* When the offset is mapped, */
+			fp->fptr = (ofs - 1) & ~(bcs - 1);		/* get the cluster from the CLMT */
+			ofs -= fp->fptr;
+			fp->curr_clust = clst;
+		} else
+#endif
 		if (ifptr > 0 &&
 			(ofs - 1) / bcs >= (ifptr - 1) / bcs) {	/* When seek to same or following cluster, */
 			fp->fptr = (ifptr - 1) & ~(bcs - 1);	/* start from the current cluster */
@@ -1952,6 +2166,9 @@ FRESULT f_lseek (
 				if (clst == 1) ABORT(fp->fs, FR_INT_ERR);
 				if (clst == 0xFFFFFFFF) ABORT(fp->fs, FR_DISK_ERR);
 				fp->org_clust = clst;
+#if _USE_FASTSEEK
+				if (fp->cltbl && clst) clmt_append(fp, 0, clst);
+#endif
 			}
 #endif
 			fp->curr_clust = clst;
@@ -1964,6 +2181,10 @@ FRESULT f_lseek (
 					if (clst == 0) {				/* When disk gets full, clip file size */
 						ofs = bcs; break;
 					}
+#if _USE_FASTSEEK
+					if (fp->cltbl && clst >= 2 && clst != 0xFFFFFFFF)
+						clmt_append(fp, fp->curr_clust, clst);
+#endif
 				} else
 #endif
 					clst = get_cluster(fp->fs, clst);	/* Follow cluster chain if not in write mode */
@@ -2148,6 +2369,12 @@ FRESULT f_truncate (
 	if (fp->fsize > fp->fptr) {
 		fp->fsize = fp->fptr;	/* Set file size to current R/W point */
 		fp->flag |= FA__WRITTEN;
+#if _USE_FASTSEEK
+		if (fp->cltbl) {		/* Drop the removed clusters from the CLMT */
+			ncl = fp->fs->csize * SS(fp->fs);
+			clmt_trim(fp, (fp->fptr + ncl - 1) / ncl);
+		}
+#endif
 		if (fp->fptr == 0) {	/* When set file size to zero, remove entire cluster chain */
 			res = remove_chain(fp->fs, fp->org_clust);
 			fp->org_clust = 0;
@@ -2170,6 +2397,89 @@ FRESULT f_truncate (
 
 
 
+#if _USE_EXPAND
+/*-----------------------------------------------------------------------*/
+/* Allocate a Contiguous Block to the File                               */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_expand (
+	FIL *fp,		/* Pointer to the file object */
+	DWORD fsz,		/* File size to be expanded to */
+	BYTE opt		/* Operation mode 0:Find and prepare, 1:Find and allocate */
+)
+{
+	FRESULT res;
+	DWORD n, clst, stcl, scl, ncl, tcl;
+
+
+	res = validate(fp->fs, fp->id);		/* Check validity of the object */
+	if (res != FR_OK) LEAVE_FF(fp->fs, res);
+	if (fp->flag & FA__ERROR)			/* Check abort flag */
+		LEAVE_FF(fp->fs, FR_INT_ERR);
+	if (!(fp->flag & FA_WRITE))			/* Check access mode */
+		LEAVE_FF(fp->fs, FR_DENIED);
+	if (fsz == 0 || fp->fsize != 0 || fp->org_clust != 0)	/* Only an empty file can be expanded */
+		LEAVE_FF(fp->fs, FR_DENIED);
+
+	n = (DWORD)fp->fs->csize * SS(fp->fs);	/* Cluster size */
+	tcl = (fsz + n - 1) / n;				/* Number of clusters required */
+	stcl = fp->fs->last_clust;				/* Search from the last allocated cluster */
+	if (stcl < 2 || stcl >= fp->fs->max_clust) stcl = 2;
+
+	scl = clst = stcl; ncl = 0;
+	for (;;) {								/* Find a contiguous block of free clusters */
+		n = get_cluster(fp->fs, clst);
+		if (n == 1) { res = FR_INT_ERR; break; }
+		if (n == 0xFFFFFFFF) { res = FR_DISK_ERR; break; }
+		if (n == 0) {						/* Free cluster: grow the block */
+			if (++ncl == tcl) break;
+		} else {							/* Used cluster: restart the block */
+			ncl = 0;
+		}
+		if (++clst >= fp->fs->max_clust) {	/* Wrap around (a block cannot cross the end) */
+			clst = 2; ncl = 0;
+		}
+		if (!ncl) scl = clst;
+		if (clst == stcl) { res = FR_DENIED; break; }	/* No contiguous block found */
+	}
+
+	if (res == FR_OK) {
+		if (opt) {							/* Allocate the block to the file */
+			for (clst = scl, n = tcl; n; clst++, n--) {
+				res = put_cluster(fp->fs, clst, (n == 1) ? 0x0FFFFFFF : clst + 1);
+				if (res != FR_OK) break;
+			}
+			if (res == FR_OK) {
+				fp->fs->last_clust = scl + tcl - 1;
+				if (fp->fs->free_clust != 0xFFFFFFFF) {	/* Update FSInfo */
+					fp->fs->free_clust -= tcl;
+					fp->fs->fsi_flag = 1;
+				}
+				fp->org_clust = scl;
+				fp->fsize = fsz;
+				fp->flag |= FA__WRITTEN;
+#if _USE_FASTSEEK
+				if (fp->cltbl && fp->cltbl[0] >= 4) {	/* The whole file is a single fragment */
+					fp->cltbl[1] = tcl; fp->cltbl[2] = scl; fp->cltbl[3] = 0;
+				}
+#endif
+			} else {
+				fp->flag |= FA__ERROR;
+			}
+		} else {							/* Make the next allocation start at the block */
+			fp->fs->last_clust = scl - 1;
+		}
+	} else if (res != FR_DENIED) {
+		fp->flag |= FA__ERROR;
+	}
+
+	LEAVE_FF(fp->fs, res);
+}
+#endif /* _USE_EXPAND */
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Get Number of Free Clusters                                           */
 /*-----------------------------------------------------------------------*/
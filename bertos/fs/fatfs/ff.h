@@ -82,6 +82,21 @@
 /* To enable f_forward function, set _USE_FORWARD to 1 and set _FS_TINY to 1. */
 
 
+#ifndef _USE_FASTSEEK
+#define	_USE_FASTSEEK	0
+#endif
+/* To enable fast seek feature, set _USE_FASTSEEK to 1. The application must
+/  then provide a cluster link map table (FIL.cltbl) and create it with
+/  f_lseek(fp, CREATE_LINKMAP) after the file has been opened. The map is
+/  used by f_lseek, f_read and f_write instead of following the FAT chain and
+/  it is kept up to date when the file is stretched or truncated. */
+
+#ifndef _USE_EXPAND
+#define	_USE_EXPAND		0
+#endif
+/* To enable f_expand function, set _USE_EXPAND to 1 and set _FS_READONLY to 0. */
+
+
 #ifndef _DRIVES
 #define _DRIVES		1
 #endif
@@ -246,6 +261,9 @@ typedef struct _FIL {
 	DWORD	dir_sect;	/* Sector containing the directory entry */
 	BYTE*	dir_ptr;	/* Ponter to the directory entry in the window */
 #endif
+#if _USE_FASTSEEK
+	DWORD*	cltbl;		/* Pointer to the cluster link map table (0:Not used) */
+#endif
 #if !_FS_TINY
 	BYTE	buf[_MAX_SS];/* File R/W buffer */
 #endif
@@ -411,6 +429,7 @@ FRESULT f_utime (const char*, const FILINFO*);		/* Change timestamp of the file/
 FRESULT f_rename (const char*, const char*);		/* Rename/Move a file or directory */
 FRESULT f_forward (FIL*, UINT(*)(const BYTE*,UINT), UINT, UINT*);	/* Forward data to the stream */
 FRESULT f_mkfs (BYTE, BYTE, WORD);					/* Create a file system on the drive */
+FRESULT f_expand (FIL*, DWORD, BYTE);				/* Allocate a contiguous block to the file */
 
 #if _USE_STRFUNC
 int f_putc (int, FIL*);								/* Put a character to the file */
@@ -468,6 +487,10 @@ void ff_rel_grant(_SYNC_t);
 #endif
 #define FA__ERROR			0x80
 
+/* Offset value of f_lseek to create the cluster link map table */
+
+#define CREATE_LINKMAP		0xFFFFFFFF
+
 
 /* FAT sub type (FATFS.fs_type) */
 
@@ -84,6 +84,12 @@ void gfx_bitmapInit(Bitmap *bm, uint8_t *raster, coord_t w, coord_t h)
 	bm->cr.xmax = w;
 	bm->cr.ymax = h;
 #endif /* CONFIG_GFX_CLIPPING */
+
+#if CONFIG_GFX_DIRTY_RECTS
+	/* Raster contents are unknown to the display */
+	gfx_dirtyClear(bm);
+	GFX_DIRTY(bm, 0, 0, w, h);
+#endif
 }
 
 /**
@@ -95,6 +101,7 @@ void gfx_bitmapInit(Bitmap *bm, uint8_t *raster, coord_t w, coord_t h)
 void gfx_bitmapClear(Bitmap *bm)
 {
 	memset(bm->raster, 0, RAST_SIZE(bm->width, bm->height));
+	GFX_DIRTY(bm, 0, 0, bm->width, bm->height);
 }
 
 #if CPU_HARVARD
@@ -110,6 +117,7 @@ void gfx_bitmapClear(Bitmap *bm)
 void gfx_blit_P(Bitmap *bm, const pgm_uint8_t *raster)
 {
 	memcpy_P(bm->raster, raster, RAST_SIZE(bm->width, bm->height));
+	GFX_DIRTY(bm, 0, 0, bm->width, bm->height);
 }
 #endif /* CPU_HARVARD */
 
@@ -181,6 +189,8 @@ void gfx_blit(Bitmap *dst, const Rect *rect, const Bitmap *src, coord_t srcx, co
 	//kprintf("dxmin=%d, sxmin=%d, dxmax=%d; ", dxmin, sxmin, dxmax);
 	//kprintf("dymin=%d, symin=%d, dymax=%d\n", dymin, symin, dymax);
 
+	GFX_DIRTY(dst, dxmin, dymin, dxmax, dymax);
+
 	/* TODO: make it not as dog slow as this */
 	for (dx = dxmin, sx = srcx; dx < dxmax; ++dx, ++sx)
 		for (dy = dymin, sy = srcy; dy < dymax; ++dy, ++sy)
@@ -208,6 +218,8 @@ void gfx_blitRaster(Bitmap *dst, coord_t dxmin, coord_t dymin,
 	//kprintf("dxmin=%d, sxmin=%d, dxmax=%d; ", dxmin, sxmin, dxmax);
 	//kprintf("dymin=%d, symin=%d, dymax=%d\n", dymin, symin, dymax);
 
+	GFX_DIRTY(dst, dxmin, dymin, dxmax, dymax);
+
 	/* TODO: make it not as dog slow as this */
 	for (dx = dxmin, sx = sxmin; dx < dxmax; ++dx, ++sx)
 		for (dy = dymin, sy = symin; dy < dymax; ++dy, ++sy)
@@ -263,3 +275,119 @@ void gfx_setClipRect(Bitmap *bm, coord_t minx, coord_t miny, coord_t maxx, coord
 }
 
 #endif /* CONFIG_GFX_CLIPPING */
+
+/**
+ * Convert the pixels from \a xmin to \a xmax (excluded) of row \a y
+ * of \a bm to 16 bit colors.
+ *
+ * Each pixel indexes \a palette: palette[0] is the color of clear
+ * pixels and palette[1] the color of set ones. Color display drivers
+ * use it to feed the panel one row at a time, so the lookup replaces
+ * a test and a branch for each pixel.
+ */
+void gfx_expandRow(const Bitmap *bm, coord_t y, coord_t xmin, coord_t xmax,
+                   const uint16_t *palette, uint16_t *dst)
+{
+	ASSERT(y >= 0 && y < bm->height);
+	ASSERT(xmin >= 0 && xmin <= xmax && xmax <= bm->width);
+
+	const uint8_t *src = BM_ADDR(bm, xmin, y);
+
+#if CONFIG_BITMAP_FMT == BITMAP_FMT_PLANAR_V_LSB
+	/* The same bit of consecutive bytes */
+	unsigned shift = (ucoord_t)y % 8;
+
+	for (coord_t x = xmin; x < xmax; ++x)
+		*dst++ = palette[(*src++ >> shift) & 1];
+#elif CONFIG_BITMAP_FMT == BITMAP_FMT_PLANAR_H_MSB
+	/* Consecutive bits of the same byte */
+	unsigned shift = 7 - (ucoord_t)xmin % 8;
+
+	for (coord_t x = xmin; x < xmax; ++x)
+	{
+		*dst++ = palette[(*src >> shift) & 1];
+		if (shift-- == 0)
+		{
+			shift = 7;
+			src++;
+		}
+	}
+#else
+	#error Unknown value of CONFIG_BITMAP_FMT
+#endif /* CONFIG_BITMAP_FMT */
+}
+
+#if CONFIG_GFX_DIRTY_RECTS
+
+/* Area of rectangle \a r */
+static long gfx_rectArea(const Rect *r)
+{
+	return (long)RECT_WIDTH(r) * RECT_HEIGHT(r);
+}
+
+/* Enlarge \a dst to contain \a r too */
+static void gfx_rectUnion(Rect *dst, const Rect *r)
+{
+	dst->xmin = MIN(dst->xmin, r->xmin);
+	dst->ymin = MIN(dst->ymin, r->ymin);
+	dst->xmax = MAX(dst->xmax, r->xmax);
+	dst->ymax = MAX(dst->ymax, r->ymax);
+}
+
+/**
+ * Record that the area (xmin;ymin)-(xmax;ymax) of \a bm has changed.
+ *
+ * Drawing primitives call it by themselves, call it only after
+ * writing the raster directly.
+ *
+ * An area touching one of the tracked rectangles is merged with it.
+ * When all the CONFIG_GFX_DIRTY_RECTS slots are in use, the area is
+ * merged with the rectangle that grows less.
+ *
+ * \note Following the convention used for all other operations, the
+ *       bottom-right borders are outside the area.
+ */
+void gfx_dirtyAdd(Bitmap *bm, coord_t xmin, coord_t ymin, coord_t xmax, coord_t ymax)
+{
+	Rect r;
+
+	r.xmin = MAX(xmin, (coord_t)0);
+	r.ymin = MAX(ymin, (coord_t)0);
+	r.xmax = MIN(xmax, bm->width);
+	r.ymax = MIN(ymax, bm->height);
+
+	if (r.xmin >= r.xmax || r.ymin >= r.ymax)
+		return;
+
+	int best = 0;
+	long best_cost = 0;
+
+	for (int i = 0; i < bm->dirty_cnt; ++i)
+	{
+		Rect *d = &bm->dirty[i];
+
+		if (r.xmin <= d->xmax && r.xmax >= d->xmin && r.ymin <= d->ymax && r.ymax >= d->ymin)
+		{
+			gfx_rectUnion(d, &r);
+			return;
+		}
+
+		/* Area that would be refreshed without having changed */
+		Rect u = *d;
+		gfx_rectUnion(&u, &r);
+		long cost = gfx_rectArea(&u) - gfx_rectArea(d) - gfx_rectArea(&r);
+
+		if (i == 0 || cost < best_cost)
+		{
+			best = i;
+			best_cost = cost;
+		}
+	}
+
+	if (bm->dirty_cnt < CONFIG_GFX_DIRTY_RECTS)
+		bm->dirty[bm->dirty_cnt++] = r;
+	else
+		gfx_rectUnion(&bm->dirty[best], &r);
+}
+
+#endif /* CONFIG_GFX_DIRTY_RECTS */
@@ -72,6 +72,9 @@
 #if !defined(CONFIG_GFX_TEXT) || (CONFIG_GFX_TEXT != 0 && CONFIG_GFX_TEXT != 1)
 	#error CONFIG_GFX_TEXT must be defined to either 0 or 1
 #endif
+#if !defined(CONFIG_GFX_DIRTY_RECTS) || CONFIG_GFX_DIRTY_RECTS < 0
+	#error CONFIG_GFX_DIRTY_RECTS must be defined to 0 or to the number of tracked rectangles
+#endif
 
 EXTERN_C_BEGIN
 
@@ -145,6 +148,16 @@ typedef struct Bitmap
 	Rect cr; /**< Clip drawing inside this rectangle */
 #endif
 
+#if CONFIG_GFX_DIRTY_RECTS
+	/**
+	 * Areas changed since the last gfx_dirtyClear().
+	 *
+	 * Display drivers read them to refresh only what has changed.
+	 */
+	Rect dirty[CONFIG_GFX_DIRTY_RECTS];
+	int dirty_cnt; /**< Number of valid rectangles in dirty[] */
+#endif
+
 #if CONFIG_GFX_TEXT
 	const struct Font *font; /**< Current font for text rendering. */
 
@@ -216,6 +229,19 @@ void gfx_rectClear(Bitmap *bm, coord_t x1, coord_t y1, coord_t x2, coord_t y2);
 void gfx_moveTo(Bitmap *bm, coord_t x, coord_t y);
 void gfx_lineTo(Bitmap *bm, coord_t x, coord_t y);
 void gfx_setClipRect(Bitmap *bm, coord_t xmin, coord_t ymin, coord_t xmax, coord_t ymax);
+void gfx_expandRow(const Bitmap *bm, coord_t y, coord_t xmin, coord_t xmax, const uint16_t *palette, uint16_t *dst);
+
+#if CONFIG_GFX_DIRTY_RECTS
+void gfx_dirtyAdd(Bitmap *bm, coord_t xmin, coord_t ymin, coord_t xmax, coord_t ymax);
+
+/**
+ * Forget the changed areas, usually after the display has been refreshed.
+ */
+INLINE void gfx_dirtyClear(Bitmap *bm)
+{
+	bm->dirty_cnt = 0;
+}
+#endif
 
 #if CPU_HARVARD
 	#include <cpu/pgm.h>
@@ -87,6 +87,17 @@
 	#error Unknown value of CONFIG_BITMAP_FMT
 #endif /* CONFIG_BITMAP_FMT */
 
+#if CONFIG_GFX_DIRTY_RECTS
+	/** Record that drawing changed the area (xmin;ymin)-(xmax;ymax) of \a bm. */
+	#define GFX_DIRTY(bm, xmin, ymin, xmax, ymax) \
+		gfx_dirtyAdd((bm), (xmin), (ymin), (xmax), (ymax))
+#else
+	#define GFX_DIRTY(bm, xmin, ymin, xmax, ymax) \
+		do                                         \
+		{                                          \
+		} while (0)
+#endif
+
 #define BM_ADDR(bm, x, y) RAST_ADDR((bm)->raster, (x), (y), (bm)->stride)
 #define BM_MASK(bm, x, y) RAST_MASK((bm)->raster, (x), (y))
 
@@ -97,6 +97,9 @@ static void gfx_lineUnclipped(Bitmap *bm, coord_t x1, coord_t y1, coord_t x2, co
 		ady = y1 - y2;
 	}
 
+	/* The last point is not drawn, the bounding box is conservative */
+	GFX_DIRTY(bm, MIN(x1, x2), MIN(y1, y2), MAX(x1, x2) + 1, MAX(y1, y2) + 1);
+
 	x = x1;
 	y = y1;
 
@@ -324,6 +327,8 @@ void gfx_rectFillC(Bitmap *bm, coord_t x1, coord_t y1, coord_t x2, coord_t y2, u
 		y2 = bm->cr.ymax;
 #endif /* CONFIG_GFX_CLIPPING */
 
+	GFX_DIRTY(bm, x1, y1, x2, y2);
+
 	/* NOTE: Code paths are duplicated for efficiency */
 	if (color) /* fill */
 	{
@@ -47,6 +47,8 @@
  * The adc should be configured to have a continuos stream of convertions.
  * For every convertion there must be an ISR that read the sample
  * and call afsk_adc_isr(), passing the context and the sample.
+ * Alternatively the samples can be moved by DMA and passed in blocks
+ * to afsk_adc_block(), e.g. from an adc_scanStart() hook.
  *
  * \param ch channel to be used for AFSK demodulation.
  * \param ctx AFSK context (\see Afsk). This parameter must be saved and
@@ -73,6 +73,32 @@ INLINE uint16_t hx8347_read(void)
 	return 0;
 }
 
+/*
+ * Optional: move a buffer of pixels to the LCD with DMA.
+ *
+ * When HX8347_HW_WRITE_BUF is defined the driver sends whole rows with
+ * hx8347_writeBuf() instead of calling hx8347_write() for each pixel.
+ * The transfer may still be running when hx8347_writeBuf() returns: the
+ * driver alternates two row buffers, so an implementation must only
+ * wait for the previous transfer before starting the next one.
+ * hx8347_writeBufWait() waits for the last transfer to be completed.
+ */
+#if 0
+	#define HX8347_HW_WRITE_BUF 1
+
+INLINE void hx8347_writeBuf(const uint16_t *buf, size_t len)
+{
+	/* Implement me */
+	(void)buf;
+	(void)len;
+}
+
+INLINE void hx8347_writeBufWait(void)
+{
+	/* Implement me */
+}
+#endif
+
 /**
  * Bus initialization: setup hardware where LCD is connected.
  */
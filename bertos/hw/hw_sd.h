@@ -54,6 +54,15 @@
 	{ /* implement me */ \
 	} while (0)
 
+/*
+ * Switch the SPI channel to \a rate Hz (or the highest clock below it)
+ * once the card is initialized: up to then it must run at 400kHz at most.
+ */
+#define SD_SPI_SETCLOCK(rate) \
+	do                        \
+	{ /* implement me */      \
+	} while (0)
+
 #define SD_PIN_INIT()    \
 	do                   \
 	{ /* implement me */ \
@@ -149,4 +149,13 @@
 	SCK_OUT();        \
 	CS_OUT();
 
+/**
+ * Receive \a len bytes in \a buf on \a lines (2 or 4) data lines.
+ *
+ * Only needed by flash25 dual and quad reads, see
+ * CONFIG_FLASH25_READ_LINES; leave undefined if the SPI
+ * controller cannot do it.
+ */
+/* #define SPI_HW_READ_LINES(lines, buf, len) do { Implement me! } while (0) */
+
 #endif /* HW_SPI_H */
@@ -187,6 +187,59 @@ size_t kblock_write(struct KBlock *b, block_idx_t idx, const void *buf, size_t o
 	}
 }
 
+block_idx_t kblock_readBlocks(struct KBlock *b, block_idx_t idx, void *buf, block_idx_t count)
+{
+	ASSERT(b);
+	ASSERT(buf);
+	ASSERT(idx + count <= b->blk_cnt);
+	LOG_INFO("blk_idx %ld, count %ld\n", idx, count);
+
+	if (b->priv.vt->readBlocks)
+	{
+		/* The device must see the cached modifications */
+		if (kblock_flush(b) != 0)
+			return 0;
+		return b->priv.vt->readBlocks(b, b->priv.blk_start + idx, buf, count);
+	}
+
+	block_idx_t i;
+	for (i = 0; i < count; i++)
+	{
+		if (kblock_read(b, idx + i, (uint8_t *)buf + i * b->blk_size, 0, b->blk_size) != b->blk_size)
+			break;
+	}
+	return i;
+}
+
+block_idx_t kblock_writeBlocks(struct KBlock *b, block_idx_t idx, const void *buf, block_idx_t count)
+{
+	ASSERT(b);
+	ASSERT(buf);
+	ASSERT(idx + count <= b->blk_cnt);
+	LOG_INFO("blk_idx %ld, count %ld\n", idx, count);
+
+	if (b->priv.vt->writeBlocks)
+	{
+		if (kblock_flush(b) != 0)
+			return 0;
+
+		block_idx_t done = b->priv.vt->writeBlocks(b, b->priv.blk_start + idx, buf, count);
+
+		/* Keep the cache coherent with the device */
+		if (kblock_buffered(b) && b->priv.curr_blk >= idx && b->priv.curr_blk < idx + done)
+			kblock_writeBuf(b, (const uint8_t *)buf + (b->priv.curr_blk - idx) * b->blk_size, 0, b->blk_size);
+		return done;
+	}
+
+	block_idx_t i;
+	for (i = 0; i < count; i++)
+	{
+		if (kblock_write(b, idx + i, (const uint8_t *)buf + i * b->blk_size, 0, b->blk_size) != b->blk_size)
+			break;
+	}
+	return i;
+}
+
 int kblock_copy(struct KBlock *b, block_idx_t src, block_idx_t dest)
 {
 	ASSERT(b);
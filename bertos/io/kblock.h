@@ -101,6 +101,8 @@ struct KBlock;
  */
 typedef size_t (*kblock_read_direct_t)(struct KBlock *b, block_idx_t index, void *buf, size_t offset, size_t size);
 typedef size_t (*kblock_write_direct_t)(struct KBlock *b, block_idx_t index, const void *buf, size_t offset, size_t size);
+typedef block_idx_t (*kblock_read_blocks_t)(struct KBlock *b, block_idx_t index, void *buf, block_idx_t count);
+typedef block_idx_t (*kblock_write_blocks_t)(struct KBlock *b, block_idx_t index, const void *buf, block_idx_t count);
 
 typedef size_t (*kblock_read_t)(struct KBlock *b, void *buf, size_t offset, size_t size);
 typedef size_t (*kblock_write_t)(struct KBlock *b, const void *buf, size_t offset, size_t size);
@@ -119,6 +121,8 @@ typedef struct KBlockVTable
 {
 	kblock_read_direct_t readDirect;
 	kblock_write_direct_t writeDirect;
+	kblock_read_blocks_t readBlocks;   // Optional, \sa kblock_readBlocks()
+	kblock_write_blocks_t writeBlocks; // Optional, \sa kblock_writeBlocks()
 
 	kblock_read_t readBuf;
 	kblock_write_t writeBuf;
@@ -362,6 +366,42 @@ size_t kblock_read(struct KBlock *b, block_idx_t idx, void *buf, size_t offset,
  */
 size_t kblock_write(struct KBlock *b, block_idx_t idx, const void *buf, size_t offset, size_t size);
 
+/**
+ * Read \a count consecutive whole blocks starting from block \a idx.
+ *
+ * Devices that can stream several blocks with a single command (like SD
+ * cards) provide the readBlocks method and are much faster this way than
+ * reading one block at a time; on the others this is just a loop on
+ * kblock_read().
+ *
+ * \param b KBlock device.
+ * \param idx the first block to read.
+ * \param buf a buffer of \a count * blk_size bytes.
+ * \param count the number of blocks to read.
+ *
+ * \return the number of blocks read.
+ *
+ * \sa kblock_writeBlocks().
+ */
+block_idx_t kblock_readBlocks(struct KBlock *b, block_idx_t idx, void *buf, block_idx_t count);
+
+/**
+ * Write \a count consecutive whole blocks starting from block \a idx.
+ *
+ * \note On buffered devices the cached block is written back first and,
+ *       if it is in the written range, updated with the new data.
+ *
+ * \param b KBlock device.
+ * \param idx the first block to write.
+ * \param buf the \a count * blk_size bytes to be written.
+ * \param count the number of blocks to write.
+ *
+ * \return the number of blocks written.
+ *
+ * \sa kblock_readBlocks().
+ */
+block_idx_t kblock_writeBlocks(struct KBlock *b, block_idx_t idx, const void *buf, block_idx_t count);
+
 /**
  * Copy one block to another.
  *
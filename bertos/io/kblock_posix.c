@@ -34,6 +34,13 @@
  *
  * \brief KBlock interface over libc files.
  *
+ * Files can be accessed with stdio calls or mapped in memory; a mapped
+ * file avoids a syscall for each block access, which is what makes large
+ * emulator benchmarks practical.
+ * Both backends can account device timings with a simple model of command
+ * overhead, transfer speed, program and erase times, so benchmarks report
+ * how long the same access pattern would take on the real memory.
+ *
  * notest: avr
  * notest: arm
  */
@@ -41,10 +48,95 @@
 #include "kblock_posix.h"
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * SD card in SPI mode at 25 MHz, typical figures for a class 4 card:
+ * the card erases internally, so no erase cost is modelled.
+ */
+const KBlockPosixTiming kblockposix_sd_timing =
+{
+	.cmd_ns = 100000,
+	.byte_ns = 320,
+	.prog_ns = 250000,
+	.erase_ns = 0,
+	.erase_blocks = 0,
+	.realtime = false,
+};
+
+/*
+ * Atmel AT45 DataFlash on a 20 MHz SPI bus, page sized blocks:
+ * main memory page to buffer transfer, page program and page erase times
+ * from the datasheet.
+ */
+const KBlockPosixTiming kblockposix_dataflash_timing =
+{
+	.cmd_ns = 200000,
+	.byte_ns = 400,
+	.prog_ns = 3000000,
+	.erase_ns = 13000000,
+	.erase_blocks = 1,
+	.realtime = false,
+};
+
+static void kblockposix_delay(KBlockPosix *f, uint32_t ns)
+{
+	f->stats.time_ns += ns;
+	if (f->timing->realtime)
+	{
+		struct timespec ts = { ns / 1000000000UL, ns % 1000000000UL };
+		nanosleep(&ts, NULL);
+	}
+}
+
+static void kblockposix_timeRead(KBlockPosix *f, size_t size)
+{
+	f->stats.reads++;
+	if (f->timing)
+		kblockposix_delay(f, f->timing->cmd_ns + size * f->timing->byte_ns);
+}
+
+/*
+ * Programming a block which has already been programmed since the last
+ * erase of its erase unit costs an erase of the whole unit first.
+ */
+static void kblockposix_timeWrite(KBlockPosix *f, block_idx_t index, size_t size)
+{
+	const KBlockPosixTiming *t = f->timing;
+
+	f->stats.writes++;
+	if (!t)
+		return;
+
+	uint32_t ns = t->cmd_ns + size * t->byte_ns + t->prog_ns;
+	if (f->programmed)
+	{
+		if (f->programmed[index / 8] & BV(index % 8))
+		{
+			block_idx_t first = index - index % t->erase_blocks;
+			for (block_idx_t i = first; i < first + t->erase_blocks && i < f->b.blk_cnt; i++)
+				f->programmed[i / 8] &= ~BV(i % 8);
+			f->stats.erases++;
+			ns += t->erase_ns;
+		}
+		f->programmed[index / 8] |= BV(index % 8);
+	}
+	kblockposix_delay(f, ns);
+}
 
 static int kblockposix_load(KBlock *b, block_idx_t index)
 {
 	KBlockPosix *f = KBLOCKPOSIX_CAST(b);
+	kblockposix_timeRead(f, b->blk_size);
+	if (f->mem)
+	{
+		memcpy(f->b.priv.buf, f->mem + index * b->blk_size, b->blk_size);
+		return 0;
+	}
 	fseek(f->fp, index * b->blk_size, SEEK_SET);
 	return (fread(f->b.priv.buf, 1, b->blk_size, f->fp) == b->blk_size) ? 0 : EOF;
 }
@@ -52,6 +144,12 @@ static int kblockposix_load(KBlock *b, block_idx_t index)
 static int kblockposix_store(struct KBlock *b, block_idx_t index)
 {
 	KBlockPosix *f = KBLOCKPOSIX_CAST(b);
+	kblockposix_timeWrite(f, index, b->blk_size);
+	if (f->mem)
+	{
+		memcpy(f->mem + index * b->blk_size, f->b.priv.buf, b->blk_size);
+		return 0;
+	}
 	fseek(f->fp, index * b->blk_size, SEEK_SET);
 	return (fwrite(f->b.priv.buf, 1, b->blk_size, f->fp) == b->blk_size) ? 0 : EOF;
 }
@@ -66,6 +164,12 @@ static size_t kblockposix_readBuf(struct KBlock *b, void *buf, size_t offset, si
 static size_t kblockposix_readDirect(struct KBlock *b, block_idx_t index, void *buf, size_t offset, size_t size)
 {
 	KBlockPosix *f = KBLOCKPOSIX_CAST(b);
+	kblockposix_timeRead(f, size);
+	if (f->mem)
+	{
+		memcpy(buf, f->mem + index * b->blk_size + offset, size);
+		return size;
+	}
 	fseek(f->fp, index * b->blk_size + offset, SEEK_SET);
 	return fread(buf, 1, size, f->fp);
 }
@@ -82,6 +186,12 @@ static size_t kblockposix_writeDirect(struct KBlock *b, block_idx_t index, const
 	KBlockPosix *f = KBLOCKPOSIX_CAST(b);
 	ASSERT(buf);
 	ASSERT(index < b->blk_cnt);
+	kblockposix_timeWrite(f, index, size);
+	if (f->mem)
+	{
+		memcpy(f->mem + index * b->blk_size + offset, buf, size);
+		return size;
+	}
 	fseek(f->fp, index * b->blk_size + offset, SEEK_SET);
 	return fwrite(buf, 1, size, f->fp);
 }
@@ -101,8 +211,16 @@ static void kblockposix_claererr(struct KBlock *b)
 static int kblockposix_close(struct KBlock *b)
 {
 	KBlockPosix *f = KBLOCKPOSIX_CAST(b);
+	int err = 0;
 
-	return fflush(f->fp) | fclose(f->fp);
+	free(f->programmed);
+	f->programmed = NULL;
+	if (f->mem)
+	{
+		err = munmap(f->mem, b->blk_size * b->blk_cnt);
+		f->mem = NULL;
+	}
+	return err | fflush(f->fp) | fclose(f->fp);
 }
 
 static const KBlockVTable kblockposix_hwbuffered_vt =
@@ -144,7 +262,7 @@ static const KBlockVTable kblockposix_unbuffered_vt =
         .close = kblockposix_close,
 };
 
-void kblockposix_init(KBlockPosix *f, FILE *fp, bool hwbuf, void *buf, size_t block_size, block_idx_t block_count)
+static void kblockposix_setup(KBlockPosix *f, FILE *fp, uint8_t *mem, bool hwbuf, void *buf, size_t block_size, block_idx_t block_count)
 {
 	ASSERT(f);
 	ASSERT(fp);
@@ -155,6 +273,7 @@ void kblockposix_init(KBlockPosix *f, FILE *fp, bool hwbuf, void *buf, size_t bl
 	DB(f->b.priv.type = KBT_KBLOCKPOSIX);
 
 	f->fp = fp;
+	f->mem = mem;
 	f->b.blk_size = block_size;
 	f->b.blk_cnt = block_count;
 
@@ -172,4 +291,57 @@ void kblockposix_init(KBlockPosix *f, FILE *fp, bool hwbuf, void *buf, size_t bl
 	}
 	else
 		f->b.priv.vt = &kblockposix_unbuffered_vt;
+
+	/* Do not account the initial load */
+	memset(&f->stats, 0, sizeof(f->stats));
+}
+
+void kblockposix_init(KBlockPosix *f, FILE *fp, bool hwbuf, void *buf, size_t block_size, block_idx_t block_count)
+{
+	kblockposix_setup(f, fp, NULL, hwbuf, buf, block_size, block_count);
+}
+
+int kblockposix_mmapInit(KBlockPosix *f, FILE *fp, bool hwbuf, void *buf, size_t block_size, block_idx_t block_count)
+{
+	size_t size = block_size * block_count;
+	struct stat st;
+	int fd;
+
+	ASSERT(fp);
+	ASSERT(size);
+
+	/* Pending stdio writes must reach the file before mapping it */
+	fflush(fp);
+	fd = fileno(fp);
+	if (fstat(fd, &st) < 0)
+		return EOF;
+	if ((size_t)st.st_size < size && ftruncate(fd, size) < 0)
+		return EOF;
+
+	void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (mem == MAP_FAILED)
+		return EOF;
+
+	kblockposix_setup(f, fp, (uint8_t *)mem, hwbuf, buf, block_size, block_count);
+	return 0;
+}
+
+int kblockposix_setTiming(KBlockPosix *f, const KBlockPosixTiming *timing)
+{
+	free(f->programmed);
+	f->programmed = NULL;
+	f->timing = timing;
+
+	if (timing && timing->erase_blocks)
+	{
+		/* All blocks start erased */
+		f->programmed = (uint8_t *)calloc((f->b.blk_cnt + 7) / 8, 1);
+		if (!f->programmed)
+		{
+			f->timing = NULL;
+			return EOF;
+		}
+	}
+	memset(&f->stats, 0, sizeof(f->stats));
+	return 0;
 }
@@ -47,12 +47,51 @@
 
 #include <stdio.h>
 
+/**
+ * Timing model of the emulated memory.
+ *
+ * Each read or write costs \a cmd_ns plus \a byte_ns for every byte
+ * transferred; writes also cost \a prog_ns.
+ * When \a erase_blocks is not 0 the memory is erased in units of that many
+ * blocks, and writing a block already programmed since the last erase of its
+ * unit costs \a erase_ns more.
+ */
+typedef struct KBlockPosixTiming
+{
+	uint32_t cmd_ns;          ///< Command overhead of each access.
+	uint32_t byte_ns;         ///< Transfer time of a byte.
+	uint32_t prog_ns;         ///< Program time of a write.
+	uint32_t erase_ns;        ///< Erase time of an erase unit.
+	block_idx_t erase_blocks; ///< Blocks in an erase unit, 0 if no erase is needed.
+	bool realtime;            ///< Sleep for the modelled time instead of only accounting it.
+} KBlockPosixTiming;
+
+/**
+ * Access counters and modelled device time.
+ */
+typedef struct KBlockPosixStats
+{
+	uint64_t time_ns;     ///< Time spent by the emulated memory.
+	unsigned long reads;  ///< Read commands.
+	unsigned long writes; ///< Write commands.
+	unsigned long erases; ///< Erase unit erases.
+} KBlockPosixStats;
+
 typedef struct KBlockPosix
 {
 	KBlock b;
 	FILE *fp;
+	uint8_t *mem;                    ///< File mapping, NULL when using stdio.
+	const KBlockPosixTiming *timing; ///< Timing model, NULL if disabled.
+	uint8_t *programmed;             ///< Programmed blocks bitmap for the erase model.
+	KBlockPosixStats stats;          ///< Access statistics.
 } KBlockPosix;
 
+/// Typical SD card timings in SPI mode.
+extern const KBlockPosixTiming kblockposix_sd_timing;
+/// Typical Atmel DataFlash timings, page sized blocks.
+extern const KBlockPosixTiming kblockposix_dataflash_timing;
+
 #define KBT_KBLOCKPOSIX MAKE_ID('K', 'B', 'F', 'L')
 
 INLINE KBlockPosix *KBLOCKPOSIX_CAST(KBlock *b)
@@ -63,4 +102,21 @@ INLINE KBlockPosix *KBLOCKPOSIX_CAST(KBlock *b)
 
 void kblockposix_init(KBlockPosix *f, FILE *fp, bool hwbuf, void *buf, size_t block_size, block_idx_t block_count);
 
+/**
+ * Initialize \a f like kblockposix_init(), but map the file in memory.
+ *
+ * Block accesses become memory copies instead of stdio calls; the file
+ * is grown to \a block_size * \a block_count bytes if shorter.
+ * \return 0 on success, EOF if the file cannot be mapped.
+ */
+int kblockposix_mmapInit(KBlockPosix *f, FILE *fp, bool hwbuf, void *buf, size_t block_size, block_idx_t block_count);
+
+/**
+ * Set the timing model of \a f and reset its statistics.
+ *
+ * \param timing Timing model, NULL to only count accesses.
+ * \return 0 on success, EOF if the erase model cannot be allocated.
+ */
+int kblockposix_setTiming(KBlockPosix *f, const KBlockPosixTiming *timing);
+
 #endif /* KBLOCK_POSIX_H */
@@ -232,6 +232,32 @@ INLINE uint8_t sin_sample(uint16_t idx)
 #define BIT_DIFFER(bitline1, bitline2) (((bitline1) ^ (bitline2)) & 0x01)
 #define EDGE_FOUND(bitline)            BIT_DIFFER((bitline), (bitline) >> 1)
 
+/**
+ * Push a received character in the rx fifo, escaping it if needed.
+ *
+ * \return true if all is ok, false if the fifo is full.
+ */
+static bool hdlc_push(Hdlc *hdlc, uint8_t c, FIFOBuffer *fifo)
+{
+	if (c == HDLC_FLAG || c == HDLC_RESET || c == AX25_ESC)
+	{
+		if (fifo_isfull(fifo))
+		{
+			hdlc->rxstart = false;
+			return false;
+		}
+		fifo_push(fifo, AX25_ESC);
+	}
+
+	if (fifo_isfull(fifo))
+	{
+		hdlc->rxstart = false;
+		return false;
+	}
+	fifo_push(fifo, c);
+	return true;
+}
+
 /**
  * High-Level Data Link Control parsing function.
  * Parse bitstream in order to find characters.
@@ -283,49 +309,281 @@ static bool hdlc_parse(Hdlc *hdlc, bool bit, FIFOBuffer *fifo)
 		return ret;
 
 	if (hdlc->demod_bits & 0x01)
-		hdlc->currchar |= 0x80;
+		hdlc->currchar |= BV(hdlc->bit_idx);
 
 	if (++hdlc->bit_idx >= 8)
 	{
-		if ((hdlc->currchar == HDLC_FLAG || hdlc->currchar == HDLC_RESET || hdlc->currchar == AX25_ESC))
+		ret = hdlc_push(hdlc, hdlc->currchar, fifo);
+		hdlc->currchar = 0;
+		hdlc->bit_idx = 0;
+	}
+
+	return ret;
+}
+
+#if CONFIG_AFSK_HDLC_TABLE
+
+/**
+ * \name HDLC decoding table.
+ *
+ * For every 8 bit window of the bitstream (first received bit in the MSB)
+ * the table holds the data bits left after removing the stuffed zero,
+ * assuming that the window is not preceded by ones.
+ * \{
+ */
+#define HDLC_TAB_STUFFED  BV(0)               ///< A stuffed zero was removed, 7 data bits.
+#define HDLC_TAB_LEAD(i)  (((i) >> 1) & 0x07) ///< Ones at the start of the window.
+#define HDLC_TAB_TRAIL(i) (((i) >> 4) & 0x07) ///< Ones at the end of the window.
+#define HDLC_TAB_SPECIAL  BV(7)               ///< Six or more ones in a row: flag or reset.
+
+typedef struct HdlcTab
+{
+	uint8_t data; ///< Destuffed data bits, first received in the LSB.
+	uint8_t info; ///< See HDLC_TAB_* macros.
+} HdlcTab;
+
+static HdlcTab hdlc_tab[256];
+static bool hdlc_tab_ready;
+/* \} */
+
+static void hdlc_tabInit(void)
+{
+	for (int b = 0; b < 256; b++)
+	{
+		uint8_t data = 0, n = 0, ones = 0, lead = 0, info = 0;
+
+		for (int i = 7; i >= 0; i--)
 		{
-			if (!fifo_isfull(fifo))
-				fifo_push(fifo, AX25_ESC);
+			if (b & BV(i))
+			{
+				if (++ones >= 6)
+					info |= HDLC_TAB_SPECIAL;
+				data |= BV(n);
+				n++;
+			}
 			else
 			{
-				hdlc->rxstart = false;
-				ret = false;
+				if (ones == 5)
+					info |= HDLC_TAB_STUFFED;
+				else
+					n++;
+				ones = 0;
 			}
 		}
 
-		if (!fifo_isfull(fifo))
-			fifo_push(fifo, hdlc->currchar);
-		else
+		while (lead < 8 && (b & BV(7 - lead)))
+			lead++;
+
+		info |= MIN(lead, (uint8_t)7) << 1;
+		info |= MIN(ones, (uint8_t)7) << 4;
+		hdlc_tab[b].data = data;
+		hdlc_tab[b].info = info;
+	}
+	hdlc_tab_ready = true;
+}
+
+/**
+ * Parse 8 bits of the bitstream at once.
+ *
+ * When the window can not contain a flag, a reset or a stuffed bit
+ * depending on the previous bits, the data bits are taken from the
+ * decoding table; otherwise the bits are parsed one by one.
+ *
+ * \param hdlc HDLC context.
+ * \param bits 8 bits of the bitstream, first received in the MSB.
+ * \param fifo FIFO buffer used to push characters.
+ *
+ * \return true if all is ok, false if the fifo is full.
+ */
+static bool hdlc_parseByte(Hdlc *hdlc, uint8_t bits, FIFOBuffer *fifo)
+{
+	uint8_t info = hdlc_tab[bits].info;
+	uint8_t ones = HDLC_TAB_TRAIL(hdlc_tab[hdlc->demod_bits].info);
+	uint8_t lead = HDLC_TAB_LEAD(info);
+
+	if (!(info & HDLC_TAB_SPECIAL))
+	{
+		if (!hdlc->rxstart && ones + lead < 6)
 		{
-			hdlc->rxstart = false;
-			ret = false;
+			hdlc->demod_bits = bits;
+			return true;
 		}
 
-		hdlc->currchar = 0;
-		hdlc->bit_idx = 0;
+		if (hdlc->rxstart && (ones == 0 || ones + lead < 5))
+		{
+			hdlc->demod_bits = bits;
+			hdlc->currchar |= (uint16_t)hdlc_tab[bits].data << hdlc->bit_idx;
+			hdlc->bit_idx += (info & HDLC_TAB_STUFFED) ? 7 : 8;
+
+			if (hdlc->bit_idx >= 8)
+			{
+				if (!hdlc_push(hdlc, hdlc->currchar, fifo))
+				{
+					hdlc->currchar = 0;
+					hdlc->bit_idx = 0;
+					return false;
+				}
+				hdlc->currchar >>= 8;
+				hdlc->bit_idx -= 8;
+			}
+			return true;
+		}
 	}
-	else
-		hdlc->currchar >>= 1;
 
+	bool ret = true;
+	for (uint8_t mask = 0x80; mask; mask >>= 1)
+		ret &= hdlc_parse(hdlc, bits & mask, fifo);
+	return ret;
+}
+
+#else /* !CONFIG_AFSK_HDLC_TABLE */
+
+static bool hdlc_parseByte(Hdlc *hdlc, uint8_t bits, FIFOBuffer *fifo)
+{
+	bool ret = true;
+	for (uint8_t mask = 0x80; mask; mask >>= 1)
+		ret &= hdlc_parse(hdlc, bits & mask, fifo);
 	return ret;
 }
 
+#endif /* CONFIG_AFSK_HDLC_TABLE */
+
+#if CONFIG_AFSK_DEMOD == AFSK_DEMOD_CORRELATOR
+
 /**
- * ADC ISR callback.
- * This function has to be called by the ADC ISR when a sample of the configured
- * channel is available.
+ * Mark reference, 1200 Hz at 9600 samples/s.
+ * One period is one bit long; the quadrature reference is read
+ * a quarter of period ahead.
+ */
+#define CORR_MARK_QUARTER 2
+static const int8_t corr_mark[SAMPLEPERBIT + CORR_MARK_QUARTER] =
+{
+	127, 90, 0, -90, -127, -90, 0, 90, 127, 90,
+};
+
+/**
+ * Space reference, 2200 Hz at 9600 samples/s.
+ * The period is 48 samples long (11 cycles); the quadrature reference
+ * is read 12 samples ahead, which is a quarter of cycle modulo 2 pi.
+ */
+#define CORR_SPACE_LEN     48
+#define CORR_SPACE_QUARTER 12
+static const int8_t corr_space[CORR_SPACE_LEN + CORR_SPACE_QUARTER] =
+{
+	127, 17, -123, -49, 110, 77, -90, -101, 64, 117, -33, -126,
+	0, 126, 33, -117, -63, 101, 90, -77, -110, 49, 123, -17,
+	-127, -17, 123, 49, -110, -77, 90, 101, -64, -117, 33, 126,
+	0, -126, -33, 117, 63, -101, -90, 77, 110, -49, -123, 17,
+	127, 17, -123, -49, 110, 77, -90, -101, 64, 117, -33, -126,
+};
+
+/**
+ * Magnitude of a correlator output, approximated as
+ * max + 3/8 min of the absolute values of its components.
+ */
+INLINE int32_t corr_mag(int32_t i, int32_t q)
+{
+	i = ABS(i);
+	q = ABS(q);
+	if (i < q)
+		SWAP(i, q);
+	return i + (q >> 2) + (q >> 3);
+}
+
+/** Bit clock PLL increment, it wraps once per bit */
+#define PLL_STEP ((uint16_t)(0x10000UL / SAMPLEPERBIT))
+
+/**
+ * Demodulate one sample.
+ *
  * \param af Afsk context to operate on.
+ * \param delayed sample received AFSK_DELAY samples ago.
  * \param curr_sample current sample from the ADC.
+ *
+ * \return -1 if no bit has been sampled, otherwise the NRZI decoded bit.
  */
-void afsk_adc_isr(Afsk *af, int8_t curr_sample)
+INLINE int afsk_demod(Afsk *af, int8_t delayed, int8_t curr_sample)
 {
-	AFSK_STROBE_ON();
+	STATIC_ASSERT(SAMPLERATE == 9600);
+	STATIC_ASSERT(BITRATE == 1200);
+	STATIC_ASSERT(AFSK_DELAY == SAMPLEPERBIT);
+
+	/*
+	 * Correlate the last bit of samples with the mark and space
+	 * references. The windows slide one sample at a time: the sample
+	 * leaving the window is subtracted with the same reference value
+	 * it was added with, so the integer sums never drift.
+	 * The mark period is one bit long, so its leaving sample
+	 * shares the reference value with the entering one.
+	 */
+	uint8_t idx = af->corr_idx;
+	uint8_t old = (idx >= SAMPLEPERBIT) ? idx - SAMPLEPERBIT : idx + CORR_SPACE_LEN - SAMPLEPERBIT;
+	uint8_t m = idx % SAMPLEPERBIT;
+	int16_t diff = curr_sample - delayed;
+
+	af->mark_i += diff * corr_mark[m];
+	af->mark_q += diff * corr_mark[m + CORR_MARK_QUARTER];
+	af->space_i += curr_sample * corr_space[idx] - delayed * corr_space[old];
+	af->space_q += curr_sample * corr_space[idx + CORR_SPACE_QUARTER] - delayed * corr_space[old + CORR_SPACE_QUARTER];
+
+	if (++idx >= CORR_SPACE_LEN)
+		idx = 0;
+	af->corr_idx = idx;
+
+	/* Save the prevailing tone in a delay line, 1 for mark */
+	af->sampled_bits <<= 1;
+	af->sampled_bits |= (corr_mag(af->mark_i, af->mark_q) > corr_mag(af->space_i, af->space_q)) ? 1 : 0;
+
+	/*
+	 * Bit clock recovery.
+	 * The tone changes when the window is half into the new bit,
+	 * so the PLL is pulled to be at half scale there and the bit is
+	 * sampled when it wraps, with the window filled by a single bit.
+	 * Out of a frame the PLL is pulled harder to lock quickly.
+	 */
+	if (EDGE_FOUND(af->sampled_bits))
+	{
+		int16_t err = (int16_t)(af->pll - 0x8000);
+
+		err -= af->hdlc.rxstart ? (err >> 2) : (err >> 1);
+		af->pll = (uint16_t)err + 0x8000;
+	}
+
+	uint16_t prev = af->pll;
+	af->pll += PLL_STEP;
+	if (af->pll >= prev)
+		return -1;
+
+	/* Shift 1 position in the shift register of the found bits */
+	af->found_bits <<= 1;
+	af->found_bits |= af->sampled_bits & 1;
 
+	/*
+	 * NRZI coding: if 2 consecutive bits have the same value
+	 * a 1 is received, otherwise it's a 0.
+	 */
+	return !EDGE_FOUND(af->found_bits);
+}
+
+#else /* CONFIG_AFSK_DEMOD == AFSK_DEMOD_DELAY */
+
+/**
+ * Majority of the last 3 sampled bits, indexed by the 3 bits:
+ * 011, 101, 110 and 111 give a 1.
+ */
+#define MAJORITY3_MASK 0xE8
+
+/**
+ * Demodulate one sample.
+ *
+ * \param af Afsk context to operate on.
+ * \param delayed sample received AFSK_DELAY samples ago.
+ * \param curr_sample current sample from the ADC.
+ *
+ * \return -1 if no bit has been sampled, otherwise the NRZI decoded bit.
+ */
+INLINE int afsk_demod(Afsk *af, int8_t delayed, int8_t curr_sample)
+{
 	/*
 	 * Frequency discriminator and LP IIR filter.
 	 * This filter is designed to work
@@ -345,11 +603,11 @@ void afsk_adc_isr(Afsk *af, int8_t curr_sample)
 	af->iir_x[0] = af->iir_x[1];
 
 #if (CONFIG_AFSK_FILTER == AFSK_BUTTERWORTH)
-	af->iir_x[1] = ((int8_t)fifo_pop(&af->delay_fifo) * curr_sample) >> 2;
-	//af->iir_x[1] = ((int8_t)fifo_pop(&af->delay_fifo) * curr_sample) / 6.027339492;
+	af->iir_x[1] = (delayed * curr_sample) >> 2;
+	//af->iir_x[1] = (delayed * curr_sample) / 6.027339492;
 #elif (CONFIG_AFSK_FILTER == AFSK_CHEBYSHEV)
-	af->iir_x[1] = ((int8_t)fifo_pop(&af->delay_fifo) * curr_sample) >> 2;
-	//af->iir_x[1] = ((int8_t)fifo_pop(&af->delay_fifo) * curr_sample) / 3.558147322;
+	af->iir_x[1] = (delayed * curr_sample) >> 2;
+	//af->iir_x[1] = (delayed * curr_sample) / 3.558147322;
 #else
 	#error Filter type not found!
 #endif
@@ -379,9 +637,6 @@ void afsk_adc_isr(Afsk *af, int8_t curr_sample)
 	af->sampled_bits <<= 1;
 	af->sampled_bits |= (af->iir_y[1] > 0) ? 1 : 0;
 
-	/* Store current ADC sample in the af->delay_fifo */
-	fifo_push(&af->delay_fifo, curr_sample);
-
 	/* If there is an edge, adjust phase sampling */
 	if (EDGE_FOUND(af->sampled_bits))
 	{
@@ -393,35 +648,111 @@ void afsk_adc_isr(Afsk *af, int8_t curr_sample)
 	af->curr_phase += PHASE_BIT;
 
 	/* sample the bit */
-	if (af->curr_phase >= PHASE_MAX)
-	{
-		af->curr_phase %= PHASE_MAX;
+	if (af->curr_phase < PHASE_MAX)
+		return -1;
 
-		/* Shift 1 position in the shift register of the found bits */
-		af->found_bits <<= 1;
+	af->curr_phase %= PHASE_MAX;
 
-		/*
-		 * Determine bit value by reading the last 3 sampled bits.
-		 * If the number of ones is two or greater, the bit value is a 1,
-		 * otherwise is a 0.
-		 * This algorithm presumes that there are 8 samples per bit.
-		 */
-		STATIC_ASSERT(SAMPLEPERBIT == 8);
-		uint8_t bits = af->sampled_bits & 0x07;
-		if (bits == 0x07    // 111, 3 bits set to 1
-		    || bits == 0x06 // 110, 2 bits
-		    || bits == 0x05 // 101, 2 bits
-		    || bits == 0x03 // 011, 2 bits
-		)
-			af->found_bits |= 1;
-
-		/*
-		 * NRZI coding: if 2 consecutive bits have the same value
-		 * a 1 is received, otherwise it's a 0.
-		 */
-		if (!hdlc_parse(&af->hdlc, !EDGE_FOUND(af->found_bits), &af->rx_fifo))
+	/* Shift 1 position in the shift register of the found bits */
+	af->found_bits <<= 1;
+
+	/*
+	 * Determine bit value by reading the last 3 sampled bits.
+	 * If the number of ones is two or greater, the bit value is a 1,
+	 * otherwise is a 0.
+	 * This algorithm presumes that there are 8 samples per bit.
+	 */
+	STATIC_ASSERT(SAMPLEPERBIT == 8);
+	af->found_bits |= (MAJORITY3_MASK >> (af->sampled_bits & 0x07)) & 1;
+
+	/*
+	 * NRZI coding: if 2 consecutive bits have the same value
+	 * a 1 is received, otherwise it's a 0.
+	 */
+	return !EDGE_FOUND(af->found_bits);
+}
+
+#endif /* CONFIG_AFSK_DEMOD */
+
+/**
+ * ADC ISR callback.
+ * This function has to be called by the ADC ISR when a sample of the configured
+ * channel is available.
+ * \param af Afsk context to operate on.
+ * \param curr_sample current sample from the ADC.
+ */
+void afsk_adc_isr(Afsk *af, int8_t curr_sample)
+{
+	AFSK_STROBE_ON();
+
+	int bit = afsk_demod(af, (int8_t)fifo_pop(&af->delay_fifo), curr_sample);
+
+	/* Store current ADC sample in the af->delay_fifo */
+	fifo_push(&af->delay_fifo, curr_sample);
+
+	if (bit >= 0 && !hdlc_parse(&af->hdlc, bit, &af->rx_fifo))
+		af->status |= AFSK_RXFIFO_OVERRUN;
+
+	AFSK_STROBE_OFF();
+}
+
+INLINE void afsk_rxBit(Afsk *af, int bit)
+{
+	Hdlc *hdlc = &af->hdlc;
+
+	hdlc->in_bits = (hdlc->in_bits << 1) | bit;
+	if (++hdlc->in_cnt >= 8)
+	{
+		hdlc->in_cnt = 0;
+		if (!hdlc_parseByte(hdlc, hdlc->in_bits, &af->rx_fifo))
 			af->status |= AFSK_RXFIFO_OVERRUN;
 	}
+}
+
+/**
+ * ADC block callback.
+ * Demodulate a block of samples of the configured channel, typically
+ * half of a DMA ring, instead of calling afsk_adc_isr() for each one.
+ * The delay line is read straight from the block and the received bits
+ * are decoded 8 at a time, so up to 7 bits stay pending until the next
+ * block.
+ *
+ * Samples of several channels converted in scan mode can be demodulated
+ * in place, one Afsk context per channel, using \a stride.
+ * Do not mix afsk_adc_isr() and afsk_adc_block() on the same context.
+ *
+ * \param af Afsk context to operate on.
+ * \param buf samples from the ADC.
+ * \param len number of samples of this channel in \a buf.
+ * \param stride distance between two samples of this channel in \a buf,
+ *               1 for a single channel buffer.
+ */
+void afsk_adc_block(Afsk *af, const int8_t *buf, size_t len, size_t stride)
+{
+	size_t delay = MIN(len, (size_t)AFSK_DELAY);
+	const int8_t *curr = buf;
+	size_t i;
+
+	ASSERT(stride);
+	AFSK_STROBE_ON();
+
+	for (i = 0; i < delay; i++, curr += stride)
+	{
+		int bit = afsk_demod(af, (int8_t)fifo_pop(&af->delay_fifo), *curr);
+		if (bit >= 0)
+			afsk_rxBit(af, bit);
+	}
+
+	for (const int8_t *old = buf; i < len; i++, curr += stride, old += stride)
+	{
+		int bit = afsk_demod(af, *old, *curr);
+		if (bit >= 0)
+			afsk_rxBit(af, bit);
+	}
+
+	/* Keep the last samples for the next block */
+	for (curr -= delay * stride; delay; delay--, curr += stride)
+		fifo_push(&af->delay_fifo, *curr);
 
 	AFSK_STROBE_OFF();
 }
@@ -659,11 +990,16 @@ void afsk_init(Afsk *af, int adc_ch, int dac_ch)
 	fifo_init(&af->rx_fifo, af->rx_buf, sizeof(af->rx_buf));
 
 	/* Fill sample FIFO with 0 */
-	for (int i = 0; i < SAMPLEPERBIT / 2; i++)
+	for (int i = 0; i < AFSK_DELAY; i++)
 		fifo_push(&af->delay_fifo, 0);
 
 	fifo_init(&af->tx_fifo, af->tx_buf, sizeof(af->tx_buf));
 
+#if CONFIG_AFSK_HDLC_TABLE
+	if (!hdlc_tab_ready)
+		hdlc_tabInit();
+#endif
+
 	AFSK_ADC_INIT(adc_ch, af);
 	AFSK_DAC_INIT(dac_ch, af);
 	AFSK_STROBE_INIT();
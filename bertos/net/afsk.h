@@ -68,6 +68,26 @@
 
 #define SAMPLEPERBIT (SAMPLERATE / BITRATE)
 
+/**
+ * \name Afsk demodulator types.
+ * $WIZ$ afsk_demod_list = "AFSK_DEMOD_DELAY", "AFSK_DEMOD_CORRELATOR"
+ * \{
+ */
+#define AFSK_DEMOD_DELAY      0 ///< Delay line discriminator and IIR filter.
+#define AFSK_DEMOD_CORRELATOR 1 ///< Mark/space quadrature correlators and PLL.
+/* \} */
+
+/**
+ * Length of the demodulator delay line.
+ * The discriminator multiplies each sample by the one received half a bit
+ * before, the correlators drop the sample received one bit before.
+ */
+#if CONFIG_AFSK_DEMOD == AFSK_DEMOD_CORRELATOR
+	#define AFSK_DELAY SAMPLEPERBIT
+#else
+	#define AFSK_DELAY (SAMPLEPERBIT / 2)
+#endif
+
 /**
  * HDLC (High-Level Data Link Control) context.
  * Maybe to be moved in a separate HDLC module one day.
@@ -76,8 +96,10 @@ typedef struct Hdlc
 {
 	uint8_t demod_bits; ///< Bitstream from the demodulator.
 	uint8_t bit_idx;    ///< Current received bit.
-	uint8_t currchar;   ///< Current received character.
+	uint16_t currchar;  ///< Current received character, LSB first.
 	bool rxstart;       ///< True if an HDLC_FLAG char has been found in the bitstream.
+	uint8_t in_bits;    ///< Bits collected by afsk_adc_block(), decoded 8 at a time.
+	uint8_t in_cnt;     ///< Number of bits in in_bits.
 } Hdlc;
 
 /**
@@ -121,15 +143,15 @@ typedef struct Afsk
 	/** Current phase increment for current modulated bit */
 	uint16_t phase_inc;
 
-	/** Delay line used to delay samples by (SAMPLEPERBIT / 2) */
+	/** Delay line used to delay samples by AFSK_DELAY */
 	FIFOBuffer delay_fifo;
 
 	/**
 	 * Buffer for delay FIFO.
 	 * The 1 is added because the FIFO macros need
-	 * 1 byte more to handle a buffer (SAMPLEPERBIT / 2) bytes long.
+	 * 1 byte more to handle a buffer AFSK_DELAY bytes long.
 	 */
-	int8_t delay_buf[SAMPLEPERBIT / 2 + 1];
+	int8_t delay_buf[AFSK_DELAY + 1];
 
 	/** FIFO for received data */
 	FIFOBuffer rx_fifo;
@@ -143,6 +165,23 @@ typedef struct Afsk
 	/** FIFO tx buffer */
 	uint8_t tx_buf[CONFIG_AFSK_TX_BUFLEN];
 
+#if CONFIG_AFSK_DEMOD == AFSK_DEMOD_CORRELATOR
+	/** Mark correlator, in phase and quadrature, over the last bit */
+	int32_t mark_i, mark_q;
+
+	/** Space correlator, in phase and quadrature, over the last bit */
+	int32_t space_i, space_q;
+
+	/** Index of the current sample in the correlators reference tables */
+	uint8_t corr_idx;
+
+	/**
+	 * Bit clock PLL.
+	 * A bit is sampled when it wraps, tone changes pull it towards half scale.
+	 */
+	uint16_t pll;
+#endif
+
 	/** IIR filter X cells, used to filter sampled data by the demodulator */
 	int16_t iir_x[2];
 
@@ -203,6 +242,7 @@ INLINE Afsk *AFSK_CAST(KFile *fd)
 }
 
 void afsk_adc_isr(Afsk *af, int8_t sample);
+void afsk_adc_block(Afsk *af, const int8_t *buf, size_t len, size_t stride);
 uint8_t afsk_dac_isr(Afsk *af);
 void afsk_init(Afsk *af, int adc_ch, int dac_ch);
 
@@ -53,8 +53,11 @@
 
 #include <cpu/byteorder.h>
 
+#include <struct/kfile_mem.h>
+
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 FILE *fp_adc;
 FILE *fp_dac;
@@ -152,10 +155,10 @@ int afsk_testSetup(void)
 
 static void messageout_hook(struct AX25Msg *msg)
 {
-	ASSERT(strncmp(msg->dst.call, "ABCDEF", 6) == 0);
-	ASSERT(strncmp(msg->src.call, "123456", 6) == 0);
-	ASSERT(msg->src.ssid == 1);
-	ASSERT(msg->dst.ssid == 0);
+	ASSERT(strncmp(msg->dst->call, "ABCDEF", 6) == 0);
+	ASSERT(strncmp(msg->src->call, "123456", 6) == 0);
+	ASSERT(msg->src->ssid == 1);
+	ASSERT(msg->dst->ssid == 0);
 	ASSERT(msg->ctrl == AX25_CTRL_UI);
 	ASSERT(msg->pid == AX25_PID_NOLAYER3);
 	ASSERT(msg->len == 256);
@@ -163,6 +166,205 @@ static void messageout_hook(struct AX25Msg *msg)
 		ASSERT(msg->info[i] == i);
 }
 
+#define BENCH_LEN   (256 * 1024L)
+#define BENCH_BLOCK 64
+#define BENCH_CH    2
+
+static int8_t bench_sig[BENCH_LEN];
+static int8_t bench_multi[BENCH_LEN * BENCH_CH];
+static uint8_t bench_rx[BENCH_CH + 1][BENCH_LEN / 16];
+static int bench_msgs;
+
+static void bench_hook(struct AX25Msg *msg)
+{
+	ASSERT(msg->len == 64);
+	bench_msgs++;
+}
+
+/*
+ * Modulate some frames with random payloads, separated by noise,
+ * to be used as demodulator input.
+ */
+static size_t bench_generate(int *frames)
+{
+	static Afsk tx;
+	AX25Ctx ax25_tx;
+	uint8_t payload[64];
+	uint32_t seed = 1;
+	size_t len = 0;
+
+	afsk_init(&tx, 0, 0);
+	ax25_init(&ax25_tx, &tx.fd, NULL);
+	*frames = 0;
+
+	while (len + 16384 < BENCH_LEN)
+	{
+		for (int i = 0; i < 1000; i++)
+		{
+			seed = seed * 1103515245UL + 12345;
+			bench_sig[len++] = seed >> 16;
+		}
+
+		for (unsigned i = 0; i < sizeof(payload); i++)
+		{
+			seed = seed * 1103515245UL + 12345;
+			payload[i] = seed >> 16;
+		}
+
+		ax25_send(&ax25_tx, AX25_CALL("abcdef", 0), AX25_CALL("123456", 1), payload, sizeof(payload));
+		do
+			bench_sig[len++] = afsk_dac_isr(&tx) - 128;
+		while (tx.sending);
+		(*frames)++;
+	}
+	return len;
+}
+
+static size_t bench_drain(Afsk *af, uint8_t *out, size_t n)
+{
+	while (!fifo_isempty(&af->rx_fifo))
+	{
+		ASSERT(n < sizeof(bench_rx[0]));
+		out[n++] = fifo_pop(&af->rx_fifo);
+	}
+	return n;
+}
+
+/*
+ * Decode the frames with increasing levels of white noise added
+ * to the signal, and report the frame decode rate and the cost per
+ * sample of the configured demodulator.
+ */
+static void afsk_benchNoise(size_t len, int frames)
+{
+	static Afsk rx;
+	uint32_t seed = 1;
+
+	for (int noise = 0; noise <= 64; noise += 8)
+	{
+		for (size_t i = 0; i < len; i++)
+		{
+			/* Sum of 4 uniform values, close enough to gaussian noise */
+			int n = 0;
+			for (int k = 0; k < 4; k++)
+			{
+				seed = seed * 1103515245UL + 12345;
+				n += (int8_t)(seed >> 16);
+			}
+			bench_multi[i] = MINMAX(-128, bench_sig[i] / 2 + n * noise / 256, 127);
+		}
+
+		size_t rx_len = 0;
+		afsk_init(&rx, 0, 0);
+		clock_t t0 = clock();
+		for (size_t i = 0; i < len; i += BENCH_BLOCK)
+		{
+			afsk_adc_block(&rx, bench_multi + i, MIN((size_t)BENCH_BLOCK, len - i), 1);
+			rx_len = bench_drain(&rx, bench_rx[0], rx_len);
+		}
+		double t = (double)(clock() - t0) / CLOCKS_PER_SEC;
+
+		KFileMem mem;
+		AX25Ctx ax25_rx;
+
+		bench_msgs = 0;
+		if (rx_len)
+		{
+			kfilemem_init(&mem, bench_rx[0], rx_len);
+			ax25_init(&ax25_rx, &mem.fd, bench_hook);
+			ax25_poll(&ax25_rx);
+			ax25_dispatch(&ax25_rx);
+		}
+		kprintf("Noise %3d: %2d/%d frames, %.1f ns/sample\n",
+			noise, bench_msgs, frames, t * 1e9 / len);
+
+		if (noise == 0)
+			ASSERT(bench_msgs == frames);
+	}
+}
+
+/*
+ * Compare the per sample and the block demodulators on the same signal,
+ * also with several channels interleaved in one buffer, and measure
+ * their throughput.
+ */
+static void afsk_bench(void)
+{
+	static Afsk rx[BENCH_CH];
+	size_t rx_len[BENCH_CH + 1];
+	int frames;
+	size_t len = bench_generate(&frames);
+	clock_t t0;
+
+	afsk_init(&rx[0], 0, 0);
+	rx_len[BENCH_CH] = 0;
+	t0 = clock();
+	for (size_t i = 0; i < len; i += BENCH_BLOCK)
+	{
+		for (size_t j = i; j < MIN(i + BENCH_BLOCK, (size_t)len); j++)
+			afsk_adc_isr(&rx[0], bench_sig[j]);
+		rx_len[BENCH_CH] = bench_drain(&rx[0], bench_rx[BENCH_CH], rx_len[BENCH_CH]);
+	}
+	double t_isr = (double)(clock() - t0) / CLOCKS_PER_SEC;
+
+	afsk_init(&rx[0], 0, 0);
+	rx_len[0] = 0;
+	t0 = clock();
+	for (size_t i = 0; i < len; i += BENCH_BLOCK)
+	{
+		afsk_adc_block(&rx[0], bench_sig + i, MIN((size_t)BENCH_BLOCK, len - i), 1);
+		rx_len[0] = bench_drain(&rx[0], bench_rx[0], rx_len[0]);
+	}
+	double t_block = (double)(clock() - t0) / CLOCKS_PER_SEC;
+
+	kprintf("afsk_adc_isr: %.0f samples/s, afsk_adc_block: %.0f samples/s\n",
+		len / (t_isr > 0 ? t_isr : 1e-9), len / (t_block > 0 ? t_block : 1e-9));
+
+	/* Up to 7 bits can be left pending by the block demodulator */
+	ASSERT(rx_len[0] <= rx_len[BENCH_CH]);
+	ASSERT(rx_len[BENCH_CH] - rx_len[0] <= 2);
+	ASSERT(memcmp(bench_rx[0], bench_rx[BENCH_CH], rx_len[0]) == 0);
+
+	for (size_t i = 0; i < len; i++)
+		for (int ch = 0; ch < BENCH_CH; ch++)
+			bench_multi[i * BENCH_CH + ch] = bench_sig[i];
+
+	for (int ch = 0; ch < BENCH_CH; ch++)
+	{
+		afsk_init(&rx[ch], ch, ch);
+		rx_len[ch] = 0;
+	}
+
+	/* Odd block length, to cross the delay line at every offset */
+	for (size_t i = 0; i < len; i += BENCH_BLOCK - 1)
+	{
+		for (int ch = 0; ch < BENCH_CH; ch++)
+		{
+			afsk_adc_block(&rx[ch], bench_multi + i * BENCH_CH + ch,
+				MIN((size_t)BENCH_BLOCK - 1, len - i), BENCH_CH);
+			rx_len[ch] = bench_drain(&rx[ch], bench_rx[ch], rx_len[ch]);
+		}
+	}
+
+	for (int ch = 0; ch < BENCH_CH; ch++)
+	{
+		ASSERT(rx_len[BENCH_CH] - rx_len[ch] <= 2);
+		ASSERT(memcmp(bench_rx[ch], bench_rx[BENCH_CH], rx_len[ch]) == 0);
+	}
+
+	KFileMem mem;
+	AX25Ctx ax25_rx;
+
+	kfilemem_init(&mem, bench_rx[0], rx_len[0]);
+	ax25_init(&ax25_rx, &mem.fd, bench_hook);
+	ax25_poll(&ax25_rx);
+	ax25_dispatch(&ax25_rx);
+	kprintf("Frames sent: %d, received: %d\n", frames, bench_msgs);
+	ASSERT(bench_msgs == frames);
+
+	afsk_benchNoise(len, frames);
+}
+
 int afsk_testRun(void)
 {
 	int c;
@@ -171,6 +373,7 @@ int afsk_testRun(void)
 		afsk_adc_isr(&afsk_fd, (int8_t)c);
 
 		ax25_poll(&ax25);
+		ax25_dispatch(&ax25);
 	}
 	kprintf("Messages correctly received: %d\n", msg_cnt);
 	ASSERT(msg_cnt >= 15);
@@ -206,8 +409,10 @@ int afsk_testRun(void)
 		afsk_adc_isr(&afsk_fd, (int8_t)c);
 
 		ax25_poll(&ax25);
+		ax25_dispatch(&ax25);
 	}
 
+	afsk_bench();
 	return 0;
 }
 
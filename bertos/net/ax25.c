@@ -31,8 +31,9 @@
  * -->
  * \brief Simple AX25 data link layer implementation.
  *
- * For now, only UI frames without any Layer 3 protocol are handled.
- * This however is enough to send/receive APRS packets.
+ * UI frames without any Layer 3 protocol are handled here, this
+ * is enough to send/receive APRS packets. Other frames are passed to
+ * the data link layer set with ax25_setLinkHook(), see ax25_lapb.h.
  *
  * \author Francesco Sacchi <batt@develer.com>
  *
@@ -43,11 +44,14 @@
 
 #include <algo/crc_ccitt.h>
 
+#include <cpu/irq.h>
+
 #define LOG_LEVEL  AX25_LOG_LEVEL
 #define LOG_FORMAT AX25_LOG_FORMAT
 #include <cfg/log.h>
 
 #include <string.h> //memset, memcmp
+#include <stddef.h> //ptrdiff_t
 #include <ctype.h>  //isalnum, toupper
 
 #if CONFIG_AX25_RPT_LST
@@ -61,33 +65,62 @@
 		} while (0)
 #endif
 
-#define DECODE_CALL(buf, addr)                    \
-	for (unsigned i = 0; i < sizeof((addr)); i++) \
-	{                                             \
-		char c = (*(buf)++ >> 1);                 \
-		(addr)[i] = (c == ' ') ? '\x0' : c;       \
+/*
+ * Decode an address field in place: characters are shifted back,
+ * padding spaces become terminators and the SSID byte is replaced by
+ * the SSID, so that the field can be accessed as an AX25Call.
+ */
+static const AX25Call *ax25_decodeCall(uint8_t *buf)
+{
+	AX25Call *addr = (AX25Call *)buf;
+
+	for (unsigned i = 0; i < sizeof(addr->call); i++)
+	{
+		char c = buf[i] >> 1;
+		addr->call[i] = (c == ' ') ? '\x0' : c;
 	}
+	addr->ssid = (addr->ssid >> 1) & 0x0F;
+	return addr;
+}
+
+#define ADDR_LEN       sizeof(AX25Call)
+#define ADDR_LAST(buf) ((buf)[ADDR_LEN - 1] & 0x01)
 
-static void ax25_decode(AX25Ctx *ctx)
+static void ax25_decode(AX25Ctx *ctx, AX25Frame *frm)
 {
 	AX25Msg msg;
-	uint8_t *buf = ctx->buf;
+	uint8_t *buf = frm->buf;
+	const uint8_t *end = frm->buf + frm->len - 2;
+	bool last;
 
-	DECODE_CALL(buf, msg.dst.call);
-	msg.dst.ssid = (*buf++ >> 1) & 0x0F;
+	/* AX25 v1 frames have both C bits equal, take them as commands */
+	msg.cmd = (buf[ADDR_LEN - 1] & 0x80) || !(buf[2 * ADDR_LEN - 1] & 0x80);
 
-	DECODE_CALL(buf, msg.src.call);
-	msg.src.ssid = (*buf >> 1) & 0x0F;
+	msg.dst = ax25_decodeCall(buf);
+	buf += ADDR_LEN;
 
-	LOG_INFO("SRC[%.6s-%d], DST[%.6s-%d]\n", msg.src.call, msg.src.ssid, msg.dst.call, msg.dst.ssid);
+	last = ADDR_LAST(buf);
+	msg.src = ax25_decodeCall(buf);
+	buf += ADDR_LEN;
+
+	LOG_INFO("SRC[%.6s-%d], DST[%.6s-%d]\n", msg.src->call, msg.src->ssid, msg.dst->call, msg.dst->ssid);
 
 /* Repeater addresses */
 #if CONFIG_AX25_RPT_LST
-	for (msg.rpt_cnt = 0; !(*buf++ & 0x01) && (msg.rpt_cnt < countof(msg.rpt_lst)); msg.rpt_cnt++)
+	msg.rpt_lst = (const AX25Call *)buf;
+	msg.rpt_flags = 0;
+	for (msg.rpt_cnt = 0; !last; msg.rpt_cnt++)
 	{
-		DECODE_CALL(buf, msg.rpt_lst[msg.rpt_cnt].call);
-		msg.rpt_lst[msg.rpt_cnt].ssid = (*buf >> 1) & 0x0F;
-		AX25_SET_REPEATED(&msg, msg.rpt_cnt, (*buf & 0x80));
+		if (msg.rpt_cnt >= AX25_MAX_RPT || end - buf < (ptrdiff_t)ADDR_LEN + 2)
+		{
+			LOG_WARN("Bad repeater list\n");
+			return;
+		}
+
+		last = ADDR_LAST(buf);
+		AX25_SET_REPEATED(&msg, msg.rpt_cnt, (buf[ADDR_LEN - 1] & 0x80));
+		ax25_decodeCall(buf);
+		buf += ADDR_LEN;
 
 		LOG_INFO("RPT%d[%.6s-%d]%c\n", msg.rpt_cnt,
 		         msg.rpt_lst[msg.rpt_cnt].call,
@@ -95,20 +128,41 @@ static void ax25_decode(AX25Ctx *ctx)
 		         (AX25_REPEATED(&msg, msg.rpt_cnt) ? '*' : ' '));
 	}
 #else
-	while (!(*buf++ & 0x01))
+	while (!last)
 	{
-		char rpt[6];
-		uint8_t ssid;
-		DECODE_CALL(buf, rpt);
-		ssid = (*buf >> 1) & 0x0F;
-		LOG_INFO("RPT[%.6s-%d]\n", rpt, ssid);
+		if (end - buf < (ptrdiff_t)ADDR_LEN + 2)
+		{
+			LOG_WARN("Bad repeater list\n");
+			return;
+		}
+
+		last = ADDR_LAST(buf);
+		const AX25Call *rpt = ax25_decodeCall(buf);
+		buf += ADDR_LEN;
+		LOG_INFO("RPT[%.6s-%d]\n", rpt->call, rpt->ssid);
+		(void)rpt;
 	}
 #endif
 
 	msg.ctrl = *buf++;
 	if (msg.ctrl != AX25_CTRL_UI)
 	{
-		LOG_WARN("Only UI frames are handled, got [%02X]\n", msg.ctrl);
+		if (ctx->link_hook)
+		{
+			/* The link layer parses the rest of the frame */
+			msg.pid = 0;
+			msg.len = end - buf;
+			msg.info = buf;
+			ctx->link_hook(ctx->link, &msg);
+		}
+		else
+			LOG_WARN("Only UI frames are handled, got [%02X]\n", msg.ctrl);
+		return;
+	}
+
+	if (buf >= end)
+	{
+		LOG_WARN("UI frame without PID\n");
 		return;
 	}
 
@@ -119,7 +173,7 @@ static void ax25_decode(AX25Ctx *ctx)
 		return;
 	}
 
-	msg.len = ctx->frm_len - 2 - (buf - ctx->buf);
+	msg.len = end - buf;
 	msg.info = buf;
 	LOG_INFO("DATA: %.*s\n", msg.len, msg.info);
 
@@ -127,11 +181,62 @@ static void ax25_decode(AX25Ctx *ctx)
 		ctx->hook(&msg);
 }
 
+/**
+ * Call the hook for the frames queued by ax25_poll().
+ * With CONFIG_AX25_RX_QUEUE enabled ax25_poll() only receives frames
+ * into a ring of buffers: this function can be called by a different
+ * process, so that a slow hook does not stall the reception.
+ * Frames received while the ring is full are dropped and counted
+ * in AX25Stats.overflows.
+ *
+ * \param ctx AX25 context to operate on.
+ *
+ * \return the number of frames handled.
+ */
+int ax25_dispatch(AX25Ctx *ctx)
+{
+	int n = 0;
+
+#if CONFIG_AX25_RX_QUEUE
+	while (ctx->rx_cnt)
+	{
+		ax25_decode(ctx, &ctx->rx[ctx->rx_tail]);
+		if (++ctx->rx_tail >= AX25_RX_FRAMES)
+			ctx->rx_tail = 0;
+
+		/* Give the buffer back to ax25_poll() */
+		ATOMIC(ctx->rx_cnt--);
+		n++;
+	}
+#else
+	(void)ctx;
+#endif
+	return n;
+}
+
+/*
+ * A frame with a correct FCS has been received in the head buffer.
+ */
+static void ax25_rxFrame(AX25Ctx *ctx)
+{
+	ctx->stats.frames++;
+	ctx->rx[ctx->rx_head].len = ctx->frm_len;
+
+#if CONFIG_AX25_RX_QUEUE
+	if (++ctx->rx_head >= AX25_RX_FRAMES)
+		ctx->rx_head = 0;
+	ATOMIC(ctx->rx_cnt++);
+#else
+	ax25_decode(ctx, &ctx->rx[ctx->rx_head]);
+#endif
+}
+
 /**
  * Check if there are any AX25 messages to be processed.
  * This function read available characters from the medium and search for
  * any AX25 messages.
- * If a message is found it is decoded and the linked callback executed.
+ * If a message is found it is decoded and the linked callback executed,
+ * or queued for ax25_dispatch() if CONFIG_AX25_RX_QUEUE is enabled.
  * This function may be blocking if there are no available chars and the KFile
  * used in \a ctx to access the medium is configured in blocking mode.
  *
@@ -150,11 +255,12 @@ void ax25_poll(AX25Ctx *ctx)
 				if (ctx->crc_in == AX25_CRC_CORRECT)
 				{
 					LOG_INFO("Frame found!\n");
-					ax25_decode(ctx);
+					ax25_rxFrame(ctx);
 				}
 				else
 				{
 					LOG_INFO("CRC error, computed [%04X]\n", ctx->crc_in);
+					ctx->stats.fcs_errors++;
 				}
 			}
 			ctx->sync = true;
@@ -178,14 +284,15 @@ void ax25_poll(AX25Ctx *ctx)
 
 		if (ctx->sync)
 		{
-			if (ctx->frm_len < CONFIG_AX25_FRAME_BUF_LEN)
+			if (ctx->frm_len < CONFIG_AX25_FRAME_BUF_LEN && ctx->rx_cnt < AX25_RX_FRAMES)
 			{
-				ctx->buf[ctx->frm_len++] = c;
+				ctx->rx[ctx->rx_head].buf[ctx->frm_len++] = c;
 				ctx->crc_in = updcrc_ccitt(c, ctx->crc_in);
 			}
 			else
 			{
 				LOG_INFO("Buffer overrun");
+				ctx->stats.overflows++;
 				ctx->sync = false;
 			}
 		}
@@ -207,9 +314,13 @@ static void ax25_putchar(AX25Ctx *ctx, uint8_t c)
 	kfile_putc(c, ctx->ch);
 }
 
-static void ax25_sendCall(AX25Ctx *ctx, const AX25Call *addr, bool last)
+static void ax25_sendCall(AX25Ctx *ctx, const AX25Call *addr, bool c_bit, bool last)
 {
-	unsigned len = MIN(sizeof(addr->call), strlen(addr->call));
+	unsigned len = 0;
+
+	/* Calls 6 characters long are not terminated */
+	while (len < sizeof(addr->call) && addr->call[len])
+		len++;
 
 	for (unsigned i = 0; i < len; i++)
 	{
@@ -224,23 +335,31 @@ static void ax25_sendCall(AX25Ctx *ctx, const AX25Call *addr, bool last)
 		for (unsigned i = 0; i < sizeof(addr->call) - len; i++)
 			ax25_putchar(ctx, ' ' << 1);
 
-	/* The bit7 "has-been-repeated" flag is not implemented here */
+	/*
+	 * The bit7 is the command/response bit for destination and source,
+	 * the "has-been-repeated" flag for repeaters (not implemented here).
+	 */
 	/* Bits6:5 should be set to 1 for all SSIDs (0x60) */
 	/* The bit0 of last call SSID should be set to 1 */
-	uint8_t ssid = 0x60 | (addr->ssid << 1) | (last ? 0x01 : 0);
+	uint8_t ssid = 0x60 | ((addr->ssid & 0x0F) << 1) | (c_bit ? 0x80 : 0) | (last ? 0x01 : 0);
 	ax25_putchar(ctx, ssid);
 }
 
 /**
- * Send an AX25 frame on the channel through a specific path.
+ * Send an AX25 frame of any type on the channel.
+ * Used by data link layers to build frames other than UI.
+ *
  * \param ctx AX25 context to operate on.
- * \param path An array of callsigns used as path, \see AX25_PATH for
- *        an handy way to create a path.
+ * \param path An array of callsigns used as path, \see AX25_PATH.
  * \param path_len callsigns path lenght.
+ * \param cmd true to send a command, false to send a response.
+ * \param hdr control field, followed by the PID if the frame has one.
+ * \param hdr_len length of \a hdr.
  * \param _buf payload buffer.
  * \param len length of the payload.
  */
-void ax25_sendVia(AX25Ctx *ctx, const AX25Call *path, size_t path_len, const void *_buf, size_t len)
+void ax25_sendFrame(AX25Ctx *ctx, const AX25Call *path, size_t path_len, bool cmd,
+	const uint8_t *hdr, size_t hdr_len, const void *_buf, size_t len)
 {
 	const uint8_t *buf = (const uint8_t *)_buf;
 	ASSERT(path);
@@ -251,10 +370,10 @@ void ax25_sendVia(AX25Ctx *ctx, const AX25Call *path, size_t path_len, const voi
 
 	/* Send call */
 	for (size_t i = 0; i < path_len; i++)
-		ax25_sendCall(ctx, &path[i], (i == path_len - 1));
+		ax25_sendCall(ctx, &path[i], (i == 0 && cmd) || (i == 1 && !cmd), (i == path_len - 1));
 
-	ax25_putchar(ctx, AX25_CTRL_UI);
-	ax25_putchar(ctx, AX25_PID_NOLAYER3);
+	while (hdr_len--)
+		ax25_putchar(ctx, *hdr++);
 
 	while (len--)
 		ax25_putchar(ctx, *buf++);
@@ -273,6 +392,22 @@ void ax25_sendVia(AX25Ctx *ctx, const AX25Call *path, size_t path_len, const voi
 	kfile_putc(HDLC_FLAG, ctx->ch);
 }
 
+/**
+ * Send an AX25 frame on the channel through a specific path.
+ * \param ctx AX25 context to operate on.
+ * \param path An array of callsigns used as path, \see AX25_PATH for
+ *        an handy way to create a path.
+ * \param path_len callsigns path lenght.
+ * \param _buf payload buffer.
+ * \param len length of the payload.
+ */
+void ax25_sendVia(AX25Ctx *ctx, const AX25Call *path, size_t path_len, const void *_buf, size_t len)
+{
+	static const uint8_t hdr[] = { AX25_CTRL_UI, AX25_PID_NOLAYER3 };
+
+	ax25_sendFrame(ctx, path, path_len, true, hdr, sizeof(hdr), _buf, len);
+}
+
 static void print_call(KFile *ch, const AX25Call *call)
 {
 	kfile_printf(ch, "%.6s", call->call);
@@ -287,9 +422,9 @@ static void print_call(KFile *ch, const AX25Call *call)
  */
 void ax25_print(KFile *ch, const AX25Msg *msg)
 {
-	print_call(ch, &msg->src);
+	print_call(ch, msg->src);
 	kfile_putc('>', ch);
-	print_call(ch, &msg->dst);
+	print_call(ch, msg->dst);
 
 #if CONFIG_AX25_RPT_LST
 	for (int i = 0; i < msg->rpt_cnt; i++)
@@ -306,6 +441,22 @@ void ax25_print(KFile *ch, const AX25Msg *msg)
 	kfile_printf(ch, ":%.*s\n", msg->len, msg->info);
 }
 
+/**
+ * Set the data link layer callback.
+ * Received frames other than UI are passed to \a hook, with the first
+ * byte of the control field in AX25Msg.ctrl and the rest of the frame
+ * in AX25Msg.info; UI frames still go to the hook set by ax25_init().
+ *
+ * \param ctx AX25 context to operate on.
+ * \param hook data link callback, NULL to drop frames other than UI.
+ * \param link data link context, passed back to \a hook.
+ */
+void ax25_setLinkHook(AX25Ctx *ctx, ax25_link_hook_t hook, void *link)
+{
+	ctx->link_hook = hook;
+	ctx->link = link;
+}
+
 /**
  * Init the AX25 protocol decoder.
  *
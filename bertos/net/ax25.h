@@ -50,9 +50,9 @@
 #include <io/kfile.h>
 
 /**
- * Maximum size of a AX25 frame.
+ * Minimum size of a AX25 frame: addresses, control field and FCS.
  */
-#define AX25_MIN_FRAME_LEN 18
+#define AX25_MIN_FRAME_LEN 17
 
 /**
  * CRC computation on correct AX25 packets should
@@ -67,23 +67,62 @@ struct AX25Msg; // fwd declaration
  */
 typedef void (*ax25_callback_t)(struct AX25Msg *msg);
 
+/**
+ * Type for the data link callback, receiving frames other than UI.
+ * \see ax25_setLinkHook()
+ */
+typedef void (*ax25_link_hook_t)(void *link, struct AX25Msg *msg);
+
+/**
+ * Number of receive frame buffers.
+ */
+#define AX25_RX_FRAMES (CONFIG_AX25_RX_QUEUE ? CONFIG_AX25_RX_QUEUE : 1)
+
+/**
+ * AX25 received frame buffer.
+ * Messages passed to the hook point into it.
+ */
+typedef struct AX25Frame
+{
+	uint8_t buf[CONFIG_AX25_FRAME_BUF_LEN]; ///< Frame, FCS included.
+	size_t len;                             ///< Frame length.
+} AX25Frame;
+
+/**
+ * AX25 receive statistics.
+ */
+typedef struct AX25Stats
+{
+	uint32_t frames;     ///< Frames received with a correct FCS.
+	uint32_t fcs_errors; ///< Frames discarded because of a wrong FCS.
+	uint32_t overflows;  ///< Frames discarded because too long or with the receive queue full.
+} AX25Stats;
+
 /**
  * AX25 Protocol context.
  */
 typedef struct AX25Ctx
 {
-	uint8_t buf[CONFIG_AX25_FRAME_BUF_LEN]; ///< buffer for received chars
-	KFile *ch;                              ///< KFile used to access the physical medium
-	size_t frm_len;                         ///< received frame length.
-	uint16_t crc_in;                        ///< CRC for current received frame
-	uint16_t crc_out;                       ///< CRC of current sent frame
-	ax25_callback_t hook;                   ///< Hook function to be called when a message is received
-	bool sync;                              ///< True if we have received a HDLC flag.
-	bool escape;                            ///< True when we have to escape the following char.
+	AX25Frame rx[AX25_RX_FRAMES]; ///< Receive frame buffers, used as a ring.
+	uint8_t rx_head;              ///< Frame buffer being received.
+	uint8_t rx_tail;              ///< Next frame buffer to be dispatched.
+	volatile uint8_t rx_cnt;      ///< Frames waiting to be dispatched.
+	KFile *ch;                    ///< KFile used to access the physical medium
+	size_t frm_len;               ///< received frame length.
+	uint16_t crc_in;              ///< CRC for current received frame
+	uint16_t crc_out;             ///< CRC of current sent frame
+	ax25_callback_t hook;         ///< Hook function to be called when a message is received
+	ax25_link_hook_t link_hook;   ///< Hook function for frames other than UI
+	void *link;                   ///< Data link context passed to link_hook
+	bool sync;                    ///< True if we have received a HDLC flag.
+	bool escape;                  ///< True when we have to escape the following char.
+	AX25Stats stats;              ///< Receive statistics.
 } AX25Ctx;
 
 /**
  * AX25 Call sign.
+ * It has the same size of an address field of a frame, so that
+ * received addresses can be decoded in place and accessed through it.
  */
 typedef struct AX25Call
 {
@@ -91,6 +130,8 @@ typedef struct AX25Call
 	uint8_t ssid; ///< SSID (secondary station ID) for the call
 } AX25Call;
 
+STATIC_ASSERT(sizeof(AX25Call) == 7);
+
 /**
  * Create an AX25Call structure on the fly.
  * \param str callsign, can be 6 characters or shorter.
@@ -115,17 +156,20 @@ STATIC_ASSERT(AX25_MAX_RPT <= 8);
 /**
  * AX25 Message.
  * Used to handle AX25 sent/received messages.
+ * A received message points into its frame buffer and is valid
+ * only until the hook returns.
  */
 typedef struct AX25Msg
 {
-	AX25Call src; ///< Source adress
-	AX25Call dst; ///< Destination address
+	const AX25Call *src; ///< Source adress
+	const AX25Call *dst; ///< Destination address
 #if CONFIG_AX25_RPT_LST
-	AX25Call rpt_lst[AX25_MAX_RPT]; ///< List of repeaters
-	uint8_t rpt_cnt;                ///< Number of repeaters in this message
-	uint8_t rpt_flags;              ///< Has-been-repeated flags for each repeater (bit-mapped)
+	const AX25Call *rpt_lst; ///< List of repeaters
+	uint8_t rpt_cnt;         ///< Number of repeaters in this message
+	uint8_t rpt_flags;       ///< Has-been-repeated flags for each repeater (bit-mapped)
 	#define AX25_REPEATED(msg, idx) ((msg)->rpt_flags & BV(idx))
 #endif
+	bool cmd;            ///< True for commands, false for responses (AX25 v2 C bits)
 	uint16_t ctrl;       ///< AX25 control field
 	uint8_t pid;         ///< AX25 PID field
 	const uint8_t *info; ///< Pointer to the info field (payload) of the message
@@ -170,7 +214,11 @@ typedef struct AX25Msg
 	}
 
 void ax25_poll(AX25Ctx *ctx);
+int ax25_dispatch(AX25Ctx *ctx);
+void ax25_sendFrame(AX25Ctx *ctx, const AX25Call *path, size_t path_len, bool cmd,
+	const uint8_t *hdr, size_t hdr_len, const void *_buf, size_t len);
 void ax25_sendVia(AX25Ctx *ctx, const AX25Call *path, size_t path_len, const void *_buf, size_t len);
+void ax25_setLinkHook(AX25Ctx *ctx, ax25_link_hook_t hook, void *link);
 
 /**
  * Send an AX25 frame on the channel.
@@ -0,0 +1,821 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2011 Develer S.r.l. (http://www.develer.com/)
+ * -->
+ *
+ *
+ * \brief AX25 connected mode (LAPB data link).
+ *
+ * Send side: lapb_send() fills a ring of frame buffers starting at
+ * V(A); the pump sends them while the window is open, retransmits from
+ * V(A) after a REJ or a T1 poll and a single frame on SREJ.
+ * Receive side: frames in sequence go to the stream fifo, the ones
+ * following a missing frame are kept in a second ring starting at V(R)
+ * and delivered as soon as the gap is filled.
+ *
+ * Timers are deadlines on timer_clock(), checked by lapb_poll().
+ */
+
+#include "ax25_lapb.h"
+#include "cfg/cfg_ax25_lapb.h"
+
+#define LOG_LEVEL  AX25_LAPB_LOG_LEVEL
+#define LOG_FORMAT AX25_LAPB_LOG_FORMAT
+#include <cfg/log.h>
+#include <cfg/macros.h>
+
+#include <cpu/power.h>
+
+#include <string.h> //memset, memcpy
+#include <ctype.h>  //toupper
+
+/* The stream fifo must hold at least a full I frame */
+STATIC_ASSERT(CONFIG_AX25_LAPB_RXBUF > CONFIG_AX25_LAPB_N1);
+
+/*
+ * Control field.
+ * With modulo 8 I and S frames have a single byte, N(R) in bits 7:5,
+ * P/F in bit 4 and N(S) in bits 3:1. With modulo 128 they have two
+ * bytes: N(S) or the S frame type first, then N(R) << 1 | P/F.
+ * U frames have a single byte in both cases.
+ */
+#define CTRL_PF   0x10
+#define CTRL_U    0x03
+
+#define S_RR      0x01
+#define S_RNR     0x05
+#define S_REJ     0x09
+#define S_SREJ    0x0D
+
+#define U_SABM    0x2F
+#define U_SABME   0x6F
+#define U_DISC    0x43
+#define U_DM      0x0F
+#define U_UA      0x63
+#define U_FRMR    0x87
+
+#define REMOTE(l) (&(l)->path[0])
+#define LOCAL(l)  (&(l)->path[1])
+
+#define TX_SLOT(l, i) (&(l)->tx[((l)->tx_base + (i)) % CONFIG_AX25_LAPB_WINDOW])
+#define RX_SLOT(l, i) (&(l)->rx[((l)->rx_base + (i)) % CONFIG_AX25_LAPB_WINDOW])
+
+INLINE uint8_t seq_sub(const Lapb *l, uint8_t a, uint8_t b)
+{
+	return (a - b) & (l->mod - 1);
+}
+
+INLINE uint8_t seq_inc(const Lapb *l, uint8_t a)
+{
+	return (a + 1) & (l->mod - 1);
+}
+
+/*
+ * Max frames outstanding. With selective reject the window is at most
+ * half the modulus, otherwise a frame sent again because its
+ * acknowledgement was lost could not be told from a new one.
+ */
+#if CONFIG_AX25_LAPB_SREJ
+	#define SEQ_WINDOW(l) ((uint8_t)((l)->mod / 2))
+#else
+	#define SEQ_WINDOW(l) ((uint8_t)((l)->mod - 1))
+#endif
+
+INLINE uint8_t lapb_window(const Lapb *l)
+{
+	uint8_t k = MIN(l->k, (uint8_t)CONFIG_AX25_LAPB_WINDOW);
+	return MIN(k, SEQ_WINDOW(l));
+}
+
+INLINE size_t lapb_rxFree(Lapb *l)
+{
+	return fifo_len(&l->rx_fifo) - fifo_count(&l->rx_fifo);
+}
+
+INLINE void lapb_startT1(Lapb *l)
+{
+	l->t1_start = timer_clock();
+	l->t1_run = true;
+}
+
+INLINE bool lapb_expired(ticks_t start, mtime_t ms)
+{
+	return timer_clock() - start >= ms_to_ticks(ms);
+}
+
+static bool lapb_callEq(const AX25Call *a, const AX25Call *b)
+{
+	for (unsigned i = 0; i < sizeof(a->call); i++)
+	{
+		if (toupper((unsigned char)a->call[i]) != toupper((unsigned char)b->call[i]))
+			return false;
+		if (!a->call[i])
+			break;
+	}
+	return (a->ssid & 0x0F) == (b->ssid & 0x0F);
+}
+
+static void lapb_sendU(Lapb *l, uint8_t type, bool cmd, bool pf)
+{
+	uint8_t ctrl = type | (pf ? CTRL_PF : 0);
+
+	ax25_sendFrame(l->ax25, l->path, countof(l->path), cmd, &ctrl, 1, NULL, 0);
+}
+
+static void lapb_sendS(Lapb *l, uint8_t type, uint8_t nr, bool cmd, bool pf)
+{
+	uint8_t hdr[2];
+	size_t hdr_len;
+
+	if (l->mod == 128)
+	{
+		hdr[0] = type;
+		hdr[1] = (nr << 1) | (pf ? 1 : 0);
+		hdr_len = 2;
+	}
+	else
+	{
+		hdr[0] = (nr << 5) | (pf ? CTRL_PF : 0) | type;
+		hdr_len = 1;
+	}
+	ax25_sendFrame(l->ax25, l->path, countof(l->path), cmd, hdr, hdr_len, NULL, 0);
+}
+
+/*
+ * Acknowledge up to V(R) with RR, or RNR if there is no room for
+ * another I frame.
+ */
+static void lapb_sendAck(Lapb *l, bool cmd, bool pf)
+{
+	l->own_busy = lapb_rxFree(l) < CONFIG_AX25_LAPB_N1;
+	lapb_sendS(l, l->own_busy ? S_RNR : S_RR, l->vr, cmd, pf);
+	l->ack_pending = false;
+	l->t2_run = false;
+}
+
+/*
+ * Send the I frame \a ns, which must be in the send ring.
+ * I frames are always commands and acknowledge up to V(R).
+ */
+static void lapb_sendI(Lapb *l, uint8_t ns, bool p)
+{
+	uint8_t idx = seq_sub(l, ns, l->va);
+	const LapbSlot *s = TX_SLOT(l, idx);
+	uint8_t hdr[3];
+	size_t hdr_len;
+
+	ASSERT(idx < l->tx_cnt);
+
+	if (l->mod == 128)
+	{
+		hdr[0] = ns << 1;
+		hdr[1] = (l->vr << 1) | (p ? 1 : 0);
+		hdr_len = 2;
+	}
+	else
+	{
+		hdr[0] = (l->vr << 5) | (p ? CTRL_PF : 0) | (ns << 1);
+		hdr_len = 1;
+	}
+	hdr[hdr_len++] = AX25_PID_NOLAYER3;
+	ax25_sendFrame(l->ax25, l->path, countof(l->path), true, hdr, hdr_len, s->buf, s->len);
+
+	l->stats.i_sent++;
+	if (idx < l->tx_sent)
+		l->stats.i_resent++;
+	else
+		l->tx_sent = idx + 1;
+
+	l->ack_pending = false;
+	l->t2_run = false;
+	if (!l->t1_run)
+		lapb_startT1(l);
+}
+
+static void lapb_reset(Lapb *l, bool mod128)
+{
+	l->mod = mod128 ? 128 : 8;
+	l->vs = l->va = l->vr = 0;
+	l->retry = 0;
+	l->peer_busy = l->own_busy = false;
+	l->recovery = l->rej_sent = l->ack_pending = false;
+	l->t1_run = l->t2_run = false;
+	l->tx_base = l->tx_cnt = l->tx_sent = 0;
+	l->rx_base = 0;
+	for (unsigned i = 0; i < countof(l->rx); i++)
+	{
+		l->rx[i].len = 0;
+		l->rx[i].srej = false;
+	}
+	fifo_flush(&l->rx_fifo);
+}
+
+static void lapb_down(Lapb *l)
+{
+	l->state = LAPB_DISCONNECTED;
+	l->t1_run = l->t2_run = false;
+}
+
+/*
+ * Release the frames acknowledged by \a nr.
+ */
+static void lapb_ack(Lapb *l, uint8_t nr)
+{
+	uint8_t n = seq_sub(l, nr, l->va);
+
+	if (!n)
+		return;
+
+	/* V(S) may be behind N(R) when going back after a REJ */
+	if (seq_sub(l, l->vs, l->va) < n)
+		l->vs = nr;
+
+	l->va = nr;
+	l->tx_base = (l->tx_base + n) % CONFIG_AX25_LAPB_WINDOW;
+	l->tx_cnt -= n;
+	l->tx_sent -= n;
+	l->retry = 0;
+
+	if (l->vs == l->va && !l->recovery)
+		l->t1_run = false;
+	else
+		lapb_startT1(l);
+}
+
+/*
+ * Move the frames received in sequence to the stream fifo.
+ */
+static void lapb_rxDeliver(Lapb *l)
+{
+	LapbSlot *s;
+
+	while ((s = RX_SLOT(l, 0))->len && lapb_rxFree(l) >= s->len)
+	{
+		fifo_pushblock(&l->rx_fifo, s->buf, s->len);
+		s->len = 0;
+		s->srej = false;
+		l->rx_base = (l->rx_base + 1) % CONFIG_AX25_LAPB_WINDOW;
+		l->vr = seq_inc(l, l->vr);
+		l->stats.i_recv++;
+		l->ack_pending = true;
+	}
+}
+
+static void lapb_inputI(Lapb *l, uint8_t ns, bool p, const uint8_t *buf, size_t len)
+{
+	uint8_t off = seq_sub(l, ns, l->vr);
+
+	/* Skip the PID */
+	if (!len || len - 1 > CONFIG_AX25_LAPB_N1)
+	{
+		LOG_WARN("Bad I frame len %d\n", (int)len);
+		return;
+	}
+	buf++;
+	len--;
+
+	if (off == 0)
+	{
+		LapbSlot *s = RX_SLOT(l, 0);
+
+		if (lapb_rxFree(l) < len)
+		{
+			/* No room, the frame will be sent again */
+			lapb_sendAck(l, false, p);
+			return;
+		}
+		fifo_pushblock(&l->rx_fifo, buf, len);
+		s->len = 0;
+		s->srej = false;
+		l->rx_base = (l->rx_base + 1) % CONFIG_AX25_LAPB_WINDOW;
+		l->vr = seq_inc(l, l->vr);
+		l->stats.i_recv++;
+		l->rej_sent = false;
+		lapb_rxDeliver(l);
+		l->ack_pending = true;
+	}
+	else if (off < MIN((uint8_t)CONFIG_AX25_LAPB_WINDOW, SEQ_WINDOW(l)))
+	{
+		/* A frame is missing before this one */
+	#if CONFIG_AX25_LAPB_SREJ
+		LapbSlot *s = RX_SLOT(l, off);
+
+		if (!s->len)
+		{
+			memcpy(s->buf, buf, len);
+			s->len = len;
+		}
+
+		for (uint8_t i = 0; i < off; i++)
+		{
+			s = RX_SLOT(l, i);
+			if (!s->len && !s->srej)
+			{
+				lapb_sendS(l, S_SREJ, (l->vr + i) & (l->mod - 1), false, false);
+				s->srej = true;
+				l->stats.rej_sent++;
+			}
+		}
+	#else
+		if (!l->rej_sent)
+		{
+			lapb_sendS(l, S_REJ, l->vr, false, p);
+			l->rej_sent = true;
+			l->ack_pending = false;
+			l->stats.rej_sent++;
+			return;
+		}
+	#endif
+	}
+	else
+	{
+		/* Duplicate, acknowledge it again */
+		l->ack_pending = true;
+	}
+
+	if (p)
+		lapb_sendAck(l, false, true);
+	else if (l->ack_pending && !l->t2_run)
+	{
+		l->t2_start = timer_clock();
+		l->t2_run = true;
+	}
+}
+
+static void lapb_inputU(Lapb *l, const AX25Msg *msg, uint8_t type, bool pf)
+{
+	switch (type)
+	{
+	case U_SABM:
+	case U_SABME:
+		if (!msg->cmd)
+			break;
+
+		if (l->state == LAPB_DISCONNECTED && !l->listen)
+		{
+			lapb_sendU(l, U_DM, false, pf);
+			break;
+		}
+		if (l->state == LAPB_DISCONNECTING)
+		{
+			lapb_sendU(l, U_DM, false, pf);
+			break;
+		}
+
+		LOG_INFO("Connected to %.6s-%d\n", REMOTE(l)->call, REMOTE(l)->ssid);
+		if (l->state == LAPB_DISCONNECTED)
+			l->status = 0;
+		lapb_reset(l, type == U_SABME);
+		l->state = LAPB_CONNECTED;
+		lapb_sendU(l, U_UA, false, pf);
+		break;
+
+	case U_DISC:
+		if (!msg->cmd)
+			break;
+
+		if (l->state == LAPB_DISCONNECTED)
+		{
+			lapb_sendU(l, U_DM, false, pf);
+			break;
+		}
+		lapb_sendU(l, U_UA, false, pf);
+		lapb_down(l);
+		break;
+
+	case U_UA:
+		if (msg->cmd)
+			break;
+
+		if (l->state == LAPB_CONNECTING)
+		{
+			l->state = LAPB_CONNECTED;
+			l->retry = 0;
+			l->t1_run = false;
+		}
+		else if (l->state == LAPB_DISCONNECTING)
+			lapb_down(l);
+		break;
+
+	case U_DM:
+		if (msg->cmd)
+			break;
+
+		if (l->state == LAPB_CONNECTING)
+			l->status |= LAPB_ERR_REFUSED;
+		if (l->state != LAPB_DISCONNECTED)
+			lapb_down(l);
+		break;
+
+	case U_FRMR:
+		if (l->state == LAPB_CONNECTED)
+		{
+			LOG_WARN("Frame reject\n");
+			l->status |= LAPB_ERR_FRMR;
+			lapb_down(l);
+		}
+		break;
+
+	default:
+		LOG_INFO("Unhandled U frame [%02X]\n", type);
+		break;
+	}
+}
+
+/*
+ * AX25 link hook: frames other than UI.
+ */
+static void lapb_input(void *link, AX25Msg *msg)
+{
+	Lapb *l = (Lapb *)link;
+	const uint8_t *buf = msg->info;
+	size_t len = msg->len;
+	uint8_t ctrl = msg->ctrl;
+	uint8_t nr, ns = 0;
+	bool pf;
+
+	if (!lapb_callEq(msg->dst, LOCAL(l)))
+		return;
+
+	if (l->state == LAPB_DISCONNECTED)
+		l->path[0] = *msg->src;
+	else if (!lapb_callEq(msg->src, REMOTE(l)))
+	{
+		LOG_INFO("Busy, frame from %.6s-%d dropped\n", msg->src->call, msg->src->ssid);
+		return;
+	}
+
+	if ((ctrl & CTRL_U) == CTRL_U)
+	{
+		lapb_inputU(l, msg, ctrl & ~CTRL_PF, ctrl & CTRL_PF);
+		return;
+	}
+
+	if (l->state != LAPB_CONNECTED)
+	{
+		if (l->state == LAPB_DISCONNECTED && msg->cmd)
+			lapb_sendU(l, U_DM, false, ctrl & CTRL_PF);
+		return;
+	}
+
+	if (l->mod == 128)
+	{
+		if (!len)
+			return;
+		ns = ctrl >> 1;
+		nr = *buf >> 1;
+		pf = *buf & 1;
+		buf++;
+		len--;
+	}
+	else
+	{
+		ns = (ctrl >> 1) & 0x07;
+		nr = ctrl >> 5;
+		pf = ctrl & CTRL_PF;
+	}
+
+	/* N(R) must be between V(A) and the last frame sent */
+	if (seq_sub(l, nr, l->va) > l->tx_sent)
+	{
+		LOG_WARN("Bad N(R) %d, V(A) %d\n", nr, l->va);
+		return;
+	}
+
+	if (!(ctrl & 0x01))
+	{
+		lapb_ack(l, nr);
+		lapb_inputI(l, ns, pf, buf, len);
+		return;
+	}
+
+	switch (ctrl & 0x0F)
+	{
+	case S_RR:
+		l->peer_busy = false;
+		lapb_ack(l, nr);
+		break;
+
+	case S_RNR:
+		l->peer_busy = true;
+		lapb_ack(l, nr);
+		break;
+
+	case S_REJ:
+		l->peer_busy = false;
+		lapb_ack(l, nr);
+		/* Go back to the rejected frame */
+		l->vs = l->va;
+		break;
+
+	case S_SREJ:
+		if (seq_sub(l, nr, l->va) < l->tx_sent)
+			lapb_sendI(l, nr, false);
+		break;
+
+	default:
+		LOG_WARN("Bad S frame [%02X]\n", ctrl);
+		return;
+	}
+
+	if (msg->cmd && pf)
+		lapb_sendAck(l, false, true);
+	else if (!msg->cmd && pf && l->recovery)
+	{
+		/* Answer to our poll: resend what is still outstanding */
+		l->recovery = false;
+		l->retry = 0;
+		l->vs = l->va;
+		l->t1_run = false;
+	}
+}
+
+/*
+ * Send the I frames in the window and the pending acknowledgements.
+ */
+static void lapb_pump(Lapb *l)
+{
+	if (l->state != LAPB_CONNECTED)
+		return;
+
+	while (!l->peer_busy && !l->recovery
+		&& seq_sub(l, l->vs, l->va) < lapb_window(l)
+		&& seq_sub(l, l->vs, l->va) < l->tx_cnt)
+	{
+		lapb_sendI(l, l->vs, false);
+		l->vs = seq_inc(l, l->vs);
+	}
+
+	/* Room again in the stream fifo */
+	if (l->own_busy && lapb_rxFree(l) >= CONFIG_AX25_LAPB_N1)
+		lapb_sendAck(l, false, false);
+
+	/* Keep polling a busy station */
+	if (l->peer_busy && !l->t1_run)
+		lapb_startT1(l);
+}
+
+static void lapb_timers(Lapb *l)
+{
+	if (l->t2_run && lapb_expired(l->t2_start, l->t2))
+	{
+		l->t2_run = false;
+		if (l->ack_pending && l->state == LAPB_CONNECTED)
+			lapb_sendAck(l, false, false);
+	}
+
+	if (!l->t1_run || !lapb_expired(l->t1_start, l->t1))
+		return;
+
+	l->stats.t1_expiry++;
+	if (++l->retry > l->n2)
+	{
+		LOG_WARN("Link to %.6s-%d failed\n", REMOTE(l)->call, REMOTE(l)->ssid);
+		l->status |= LAPB_ERR_TIMEOUT;
+		lapb_down(l);
+		return;
+	}
+	lapb_startT1(l);
+
+	switch (l->state)
+	{
+	case LAPB_CONNECTING:
+		lapb_sendU(l, l->mod == 128 ? U_SABME : U_SABM, true, true);
+		break;
+
+	case LAPB_DISCONNECTING:
+		lapb_sendU(l, U_DISC, true, true);
+		break;
+
+	case LAPB_CONNECTED:
+		/* Poll the remote station, with the oldest frame if possible */
+		l->recovery = true;
+		if (l->tx_sent && !l->peer_busy)
+			lapb_sendI(l, l->va, true);
+		else
+			lapb_sendAck(l, true, true);
+		break;
+
+	default:
+		l->t1_run = false;
+		break;
+	}
+}
+
+/**
+ * Poll the channel and run the link: decode the received frames,
+ * send the pending I frames and acknowledgements, check the timers.
+ * Call it often, the KFile interface does it while waiting.
+ */
+void lapb_poll(Lapb *l)
+{
+	ax25_poll(l->ax25);
+	ax25_dispatch(l->ax25);
+	lapb_pump(l);
+	lapb_timers(l);
+}
+
+/**
+ * Queue \a len bytes from \a _buf for sending, without blocking.
+ * Data is split in I frames of up to CONFIG_AX25_LAPB_N1 bytes; small
+ * writes between two lapb_poll() calls are merged in one frame.
+ *
+ * \return the number of bytes queued, less than \a len when the send
+ *         buffers are full, 0 if the link is not connected.
+ */
+size_t lapb_send(Lapb *l, const void *_buf, size_t len)
+{
+	const uint8_t *buf = (const uint8_t *)_buf;
+	size_t done = 0;
+
+	if (l->state != LAPB_CONNECTED)
+		return 0;
+
+	while (len)
+	{
+		LapbSlot *s;
+
+		/* Only frames never sent may grow */
+		if (l->tx_cnt > l->tx_sent && TX_SLOT(l, l->tx_cnt - 1)->len < CONFIG_AX25_LAPB_N1)
+			s = TX_SLOT(l, l->tx_cnt - 1);
+		else if (l->tx_cnt < CONFIG_AX25_LAPB_WINDOW)
+		{
+			s = TX_SLOT(l, l->tx_cnt);
+			s->len = 0;
+			l->tx_cnt++;
+		}
+		else
+			break;
+
+		size_t n = MIN(len, (size_t)(CONFIG_AX25_LAPB_N1 - s->len));
+		memcpy(s->buf + s->len, buf, n);
+		s->len += n;
+		buf += n;
+		len -= n;
+		done += n;
+	}
+	return done;
+}
+
+/**
+ * Read up to \a len received bytes in \a _buf, without blocking.
+ * \return the number of bytes read.
+ */
+size_t lapb_recv(Lapb *l, void *_buf, size_t len)
+{
+	size_t n = fifo_popblock(&l->rx_fifo, (uint8_t *)_buf, len);
+
+	/* Frames kept while the fifo was full */
+	if (n && l->state == LAPB_CONNECTED)
+		lapb_rxDeliver(l);
+	return n;
+}
+
+/**
+ * Connect to \a remote.
+ * The link is in LAPB_CONNECTING state until the remote station
+ * answers, call lapb_poll() and check lapb_state().
+ */
+void lapb_connect(Lapb *l, const AX25Call *remote)
+{
+	l->path[0] = *remote;
+	l->status = 0;
+	lapb_reset(l, l->mod128);
+	l->state = LAPB_CONNECTING;
+	lapb_sendU(l, l->mod128 ? U_SABME : U_SABM, true, true);
+	lapb_startT1(l);
+}
+
+/**
+ * Disconnect the link.
+ * Data not yet acknowledged is dropped: flush the KFile first.
+ * The link is in LAPB_DISCONNECTING state until the remote station
+ * answers or N2 retries expire.
+ */
+void lapb_disconnect(Lapb *l)
+{
+	if (l->state == LAPB_DISCONNECTED)
+		return;
+
+	l->state = LAPB_DISCONNECTING;
+	l->retry = 0;
+	l->recovery = false;
+	l->t2_run = false;
+	lapb_sendU(l, U_DISC, true, true);
+	lapb_startT1(l);
+}
+
+/*
+ * KFile interface.
+ */
+static size_t lapb_read(KFile *fd, void *buf, size_t size)
+{
+	Lapb *l = LAPB_CAST(fd);
+
+	lapb_poll(l);
+	return lapb_recv(l, buf, size);
+}
+
+static size_t lapb_write(KFile *fd, const void *_buf, size_t size)
+{
+	Lapb *l = LAPB_CAST(fd);
+	const uint8_t *buf = (const uint8_t *)_buf;
+	size_t done = 0;
+
+	while (l->state == LAPB_CONNECTED)
+	{
+		done += lapb_send(l, buf + done, size - done);
+		lapb_poll(l);
+		if (done >= size)
+			break;
+		cpu_relax();
+	}
+	return done;
+}
+
+static int lapb_flush(KFile *fd)
+{
+	Lapb *l = LAPB_CAST(fd);
+
+	while (l->tx_cnt && l->state == LAPB_CONNECTED)
+	{
+		lapb_poll(l);
+		cpu_relax();
+	}
+	return l->tx_cnt ? EOF : 0;
+}
+
+static int lapb_error(KFile *fd)
+{
+	Lapb *l = LAPB_CAST(fd);
+
+	return l->status;
+}
+
+static void lapb_clearerr(KFile *fd)
+{
+	Lapb *l = LAPB_CAST(fd);
+
+	l->status = 0;
+}
+
+/**
+ * Init a link bound to \a ax25, with local address \a local.
+ * Timers, window and retries take the values in cfg_ax25_lapb.h and
+ * may be changed in the Lapb structure while disconnected.
+ */
+void lapb_init(Lapb *l, AX25Ctx *ax25, const AX25Call *local)
+{
+	ASSERT(l);
+	ASSERT(ax25);
+	ASSERT(local);
+
+	memset(l, 0, sizeof(*l));
+	l->ax25 = ax25;
+	l->path[1] = *local;
+
+	l->mod128 = CONFIG_AX25_LAPB_MOD128;
+	l->k = CONFIG_AX25_LAPB_WINDOW;
+	l->t1 = CONFIG_AX25_LAPB_T1;
+	l->t2 = CONFIG_AX25_LAPB_T2;
+	l->n2 = CONFIG_AX25_LAPB_N2;
+	l->mod = 8;
+	l->state = LAPB_DISCONNECTED;
+	fifo_init(&l->rx_fifo, l->rx_buf, sizeof(l->rx_buf));
+
+	kfile_init(&l->fd);
+	DB(l->fd._type = KFT_LAPB);
+	l->fd.read = lapb_read;
+	l->fd.write = lapb_write;
+	l->fd.flush = lapb_flush;
+	l->fd.error = lapb_error;
+	l->fd.clearerr = lapb_clearerr;
+
+	ax25_setLinkHook(ax25, lapb_input, l);
+}
@@ -0,0 +1,193 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2011 Develer S.r.l. (http://www.develer.com/)
+ * -->
+ *
+ * \brief AX25 connected mode (LAPB data link).
+ *
+ * Reliable byte stream between two stations over an AX25 channel, with
+ * modulo 8 or 128 sequence numbers, a window of up to
+ * CONFIG_AX25_LAPB_WINDOW outstanding I frames, selective reject and
+ * the T1, T2 and N2 timers of the AX25 2.2 data link.
+ *
+ * A link is bound to an AX25Ctx, receives its frames other than UI
+ * and is driven by lapb_poll(), which also polls the channel.
+ * Usage:
+ * \code
+ * AX25Call local = AX25_CALL("n0call", 1);
+ * AX25Call remote = AX25_CALL("n0peer", 0);
+ *
+ * ax25_init(&ax25, &afsk.fd, ui_hook);
+ * lapb_init(&link, &ax25, &local);
+ * lapb_connect(&link, &remote);
+ * while (lapb_state(&link) == LAPB_CONNECTING)
+ *	lapb_poll(&link);
+ * kfile_write(&link.fd, buf, len);
+ * \endcode
+ * The KFile interface calls lapb_poll() while waiting; lapb_send()
+ * and lapb_recv() never block.
+ *
+ * $WIZ$ module_name = "ax25_lapb"
+ * $WIZ$ module_configuration = "bertos/cfg/cfg_ax25_lapb.h"
+ * $WIZ$ module_depends = "ax25", "timer", "kfile"
+ */
+
+#ifndef NET_AX25_LAPB_H
+#define NET_AX25_LAPB_H
+
+#include "cfg/cfg_ax25_lapb.h"
+
+#include <net/ax25.h>
+
+#include <cfg/compiler.h>
+#include <drv/timer.h>
+#include <io/kfile.h>
+#include <struct/fifobuf.h>
+
+/* Addresses, control (2), PID and FCS must fit the frame buffer */
+STATIC_ASSERT(CONFIG_AX25_LAPB_N1 + 2 * sizeof(AX25Call) + 5 <= CONFIG_AX25_FRAME_BUF_LEN);
+
+/**
+ * Link states.
+ */
+typedef enum LapbState
+{
+	LAPB_DISCONNECTED,
+	LAPB_CONNECTING,
+	LAPB_CONNECTED,
+	LAPB_DISCONNECTING,
+} LapbState;
+
+/**
+ * \name Link errors, see kfile_error().
+ * \{
+ */
+#define LAPB_ERR_REFUSED BV(0) ///< Connection refused (DM).
+#define LAPB_ERR_TIMEOUT BV(1) ///< No answer after N2 retries.
+#define LAPB_ERR_FRMR    BV(2) ///< Link reset by a frame reject.
+/* \} */
+
+/**
+ * I frame buffer.
+ */
+typedef struct LapbSlot
+{
+	uint8_t buf[CONFIG_AX25_LAPB_N1];
+	uint16_t len;
+	bool srej; ///< Receive side: SREJ already sent for this frame.
+} LapbSlot;
+
+/**
+ * Link statistics.
+ */
+typedef struct LapbStats
+{
+	uint32_t i_sent;    ///< I frames sent, retransmissions included.
+	uint32_t i_resent;  ///< I frames retransmitted.
+	uint32_t i_recv;    ///< I frames received in sequence.
+	uint32_t rej_sent;  ///< REJ and SREJ frames sent.
+	uint32_t t1_expiry; ///< T1 expirations.
+} LapbStats;
+
+/**
+ * AX25 connected mode link context.
+ */
+typedef struct Lapb
+{
+	KFile fd;          ///< Stream interface.
+	AX25Ctx *ax25;     ///< Channel.
+	AX25Call path[2];  ///< Remote and local address.
+
+	/*
+	 * Parameters, may be changed while disconnected.
+	 */
+	bool listen;       ///< Accept incoming connections.
+	bool mod128;       ///< Use modulo 128 (SABME) for outgoing connections.
+	uint8_t k;         ///< Window, max CONFIG_AX25_LAPB_WINDOW.
+	mtime_t t1;        ///< Acknowledgement timer, in ms.
+	mtime_t t2;        ///< Response delay timer, in ms.
+	uint8_t n2;        ///< Max retries.
+
+	LapbState state;
+	int status;        ///< LAPB_ERR_* flags.
+	uint8_t mod;       ///< Sequence numbers modulus of the current link.
+	uint8_t vs;        ///< Send state variable.
+	uint8_t va;        ///< Acknowledge state variable.
+	uint8_t vr;        ///< Receive state variable.
+	uint8_t retry;     ///< Retries since the last answer.
+	bool peer_busy;    ///< Remote station receiver busy (RNR).
+	bool own_busy;     ///< RNR sent.
+	bool recovery;     ///< Waiting for the answer to a T1 poll.
+	bool rej_sent;     ///< REJ sent, waiting for the missing frame.
+	bool ack_pending;  ///< I frames received and not yet acknowledged.
+	bool t1_run, t2_run;
+	ticks_t t1_start, t2_start;
+
+	LapbSlot tx[CONFIG_AX25_LAPB_WINDOW]; ///< Frames from va, a ring starting at tx_base.
+	uint8_t tx_base;   ///< Buffer of frame va.
+	uint8_t tx_cnt;    ///< Buffers in use.
+	uint8_t tx_sent;   ///< Buffers sent at least once.
+
+	LapbSlot rx[CONFIG_AX25_LAPB_WINDOW]; ///< Frames received after vr, a ring starting at rx_base.
+	uint8_t rx_base;   ///< Buffer of frame vr.
+
+	FIFOBuffer rx_fifo;
+	uint8_t rx_buf[CONFIG_AX25_LAPB_RXBUF];
+
+	LapbStats stats;
+} Lapb;
+
+#define KFT_LAPB MAKE_ID('L', 'A', 'P', 'B')
+
+INLINE Lapb *LAPB_CAST(KFile *fd)
+{
+	ASSERT(fd->_type == KFT_LAPB);
+	return (Lapb *)fd;
+}
+
+/**
+ * Current state of the link.
+ */
+INLINE LapbState lapb_state(Lapb *l)
+{
+	return l->state;
+}
+
+void lapb_init(Lapb *l, AX25Ctx *ax25, const AX25Call *local);
+void lapb_connect(Lapb *l, const AX25Call *remote);
+void lapb_disconnect(Lapb *l);
+void lapb_poll(Lapb *l);
+size_t lapb_send(Lapb *l, const void *buf, size_t len);
+size_t lapb_recv(Lapb *l, void *buf, size_t len);
+
+int ax25_lapb_testSetup(void);
+int ax25_lapb_testRun(void);
+int ax25_lapb_testTearDown(void);
+
+#endif /* NET_AX25_LAPB_H */
@@ -0,0 +1,257 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2011 Develer S.r.l. (http://www.develer.com/)
+ * -->
+ *
+ *
+ * \brief AX25 connected mode test.
+ *
+ * Two stations linked by a pair of memory pipes that corrupt one byte
+ * every LOSS_RATE: a stream is sent both ways with modulo 8 and modulo
+ * 128 sequence numbers, the receiver reads slowly to exercise RNR.
+ *
+ * $test$: cp bertos/cfg/cfg_ax25_lapb.h $cfgdir/
+ * $test$: echo "#undef CONFIG_AX25_LAPB_WINDOW" >> $cfgdir/cfg_ax25_lapb.h
+ * $test$: echo "#define CONFIG_AX25_LAPB_WINDOW 16" >> $cfgdir/cfg_ax25_lapb.h
+ */
+
+#include "ax25_lapb.h"
+
+#include <cfg/debug.h>
+#include <cfg/test.h>
+
+#include <drv/timer.h>
+
+#include <struct/fifobuf.h>
+
+#include <string.h> //memset
+
+#define LOSS_RATE   997
+#define DATA_LEN    8192
+#define REPLY_LEN   2048
+#define TEST_TIME   30000
+
+/*
+ * One way of the channel: bytes written to a pipe are read by its peer.
+ */
+typedef struct Pipe
+{
+	KFile fd;
+	struct Pipe *peer;
+	FIFOBuffer fifo;
+	uint8_t buf[4096];
+	uint32_t cnt;
+} Pipe;
+
+static Pipe pipe_a, pipe_b;
+static AX25Ctx ax25_a, ax25_b;
+static Lapb lapb_a, lapb_b;
+static AX25Call call_a = AX25_CALL("n0a", 1);
+static AX25Call call_b = AX25_CALL("N0B", 2);
+static uint8_t data[DATA_LEN];
+
+static size_t pipe_read(KFile *fd, void *buf, size_t size)
+{
+	Pipe *p = (Pipe *)fd;
+
+	return fifo_popblock(&p->fifo, (uint8_t *)buf, size);
+}
+
+static size_t pipe_write(KFile *fd, const void *_buf, size_t size)
+{
+	Pipe *p = (Pipe *)fd;
+	const uint8_t *buf = (const uint8_t *)_buf;
+
+	for (size_t i = 0; i < size; i++)
+	{
+		uint8_t c = buf[i];
+
+		if (++p->cnt % LOSS_RATE == 0)
+			c ^= 0x10;
+		/* A full pipe drops bytes, like a busy channel */
+		if (!fifo_isfull(&p->peer->fifo))
+			fifo_push(&p->peer->fifo, c);
+	}
+	return size;
+}
+
+static int pipe_error(UNUSED_ARG(KFile *, fd))
+{
+	return 0;
+}
+
+static void pipe_init(Pipe *p, Pipe *peer)
+{
+	kfile_init(&p->fd);
+	p->fd.read = pipe_read;
+	p->fd.write = pipe_write;
+	p->fd.error = pipe_error;
+	p->peer = peer;
+	p->cnt = 0;
+	fifo_init(&p->fifo, p->buf, sizeof(p->buf));
+}
+
+static void ui_hook(UNUSED_ARG(AX25Msg *, msg))
+{
+	ASSERT(0);
+}
+
+static void setup(bool listen)
+{
+	pipe_init(&pipe_a, &pipe_b);
+	pipe_init(&pipe_b, &pipe_a);
+	ax25_init(&ax25_a, &pipe_a.fd, ui_hook);
+	ax25_init(&ax25_b, &pipe_b.fd, ui_hook);
+	lapb_init(&lapb_a, &ax25_a, &call_a);
+	lapb_init(&lapb_b, &ax25_b, &call_b);
+	lapb_a.t1 = lapb_b.t1 = 50;
+	lapb_a.t2 = lapb_b.t2 = 10;
+	lapb_b.listen = listen;
+}
+
+static bool poll_until(LapbState a, LapbState b)
+{
+	ticks_t start = timer_clock();
+
+	while (lapb_state(&lapb_a) != a || lapb_state(&lapb_b) != b)
+	{
+		if (timer_clock() - start > ms_to_ticks(TEST_TIME))
+			return false;
+		lapb_poll(&lapb_a);
+		lapb_poll(&lapb_b);
+	}
+	return true;
+}
+
+static int lapb_testTransfer(bool mod128, uint8_t k)
+{
+	size_t sent = 0, recv = 0, reply_sent = 0, reply_recv = 0;
+	ticks_t start;
+	uint8_t buf[50];
+
+	kprintf("Modulo %d, window %d\n", mod128 ? 128 : 8, k);
+	setup(true);
+	lapb_a.mod128 = mod128;
+	lapb_a.k = lapb_b.k = k;
+
+	lapb_connect(&lapb_a, &call_b);
+	if (!poll_until(LAPB_CONNECTED, LAPB_CONNECTED))
+		goto timeout;
+	ASSERT(lapb_b.mod == lapb_a.mod);
+	ASSERT(!kfile_error(&lapb_b.fd));
+
+	start = timer_clock();
+	while (recv < DATA_LEN || reply_recv < REPLY_LEN)
+	{
+		if (timer_clock() - start > ms_to_ticks(TEST_TIME))
+			goto timeout;
+
+		sent += lapb_send(&lapb_a, data + sent, MIN((size_t)300, DATA_LEN - sent));
+		reply_sent += lapb_send(&lapb_b, data + reply_sent, MIN((size_t)7, REPLY_LEN - reply_sent));
+		lapb_poll(&lapb_a);
+
+		/* The KFile interface polls the link, read slowly */
+		size_t n = kfile_read(&lapb_b.fd, buf, sizeof(buf));
+		for (size_t i = 0; i < n; i++, recv++)
+			if (buf[i] != data[recv])
+			{
+				kprintf("Data mismatch at %d\n", (int)recv);
+				return -1;
+			}
+
+		n = lapb_recv(&lapb_a, buf, sizeof(buf));
+		for (size_t i = 0; i < n; i++, reply_recv++)
+			if (buf[i] != data[reply_recv])
+			{
+				kprintf("Reply mismatch at %d\n", (int)reply_recv);
+				return -1;
+			}
+		ASSERT(recv <= DATA_LEN && reply_recv <= REPLY_LEN);
+	}
+
+	kprintf("Sent %ld I frames, %ld resent, %ld REJ, %ld T1 expired\n",
+		(long)lapb_a.stats.i_sent, (long)lapb_a.stats.i_resent,
+		(long)lapb_b.stats.rej_sent, (long)lapb_a.stats.t1_expiry);
+	/* Lost frames must have been recovered */
+	ASSERT(lapb_a.stats.i_resent);
+	ASSERT(lapb_b.stats.i_recv + lapb_b.stats.rej_sent >= DATA_LEN / CONFIG_AX25_LAPB_N1);
+
+	ASSERT(kfile_flush(&lapb_b.fd) == 0 || lapb_state(&lapb_b) != LAPB_CONNECTED);
+	lapb_disconnect(&lapb_a);
+	if (!poll_until(LAPB_DISCONNECTED, LAPB_DISCONNECTED))
+		goto timeout;
+	ASSERT(!kfile_error(&lapb_a.fd));
+	ASSERT(lapb_send(&lapb_a, data, 1) == 0);
+	return 0;
+
+timeout:
+	kprintf("Timeout, state %d %d, %d/%d bytes\n", lapb_state(&lapb_a), lapb_state(&lapb_b),
+		(int)recv, (int)reply_recv);
+	return -1;
+}
+
+static int lapb_testRefused(void)
+{
+	setup(false);
+	lapb_connect(&lapb_a, &call_b);
+	if (!poll_until(LAPB_DISCONNECTED, LAPB_DISCONNECTED))
+		return -1;
+	ASSERT(kfile_error(&lapb_a.fd) == LAPB_ERR_REFUSED);
+	kfile_clearerr(&lapb_a.fd);
+	ASSERT(!kfile_error(&lapb_a.fd));
+	return 0;
+}
+
+int ax25_lapb_testSetup(void)
+{
+	kdbg_init();
+	timer_init();
+
+	for (size_t i = 0; i < sizeof(data); i++)
+		data[i] = i * 7 + (i >> 8);
+	return 0;
+}
+
+int ax25_lapb_testRun(void)
+{
+	if (lapb_testRefused())
+		return -1;
+	if (lapb_testTransfer(false, 7))
+		return -1;
+	if (lapb_testTransfer(true, CONFIG_AX25_LAPB_WINDOW))
+		return -1;
+	return 0;
+}
+
+int ax25_lapb_testTearDown(void)
+{
+	return 0;
+}
+
+TEST_MAIN(ax25_lapb);
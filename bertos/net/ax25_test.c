@@ -33,6 +33,9 @@
  * \brief AX25 test.
  *
  * \author Francesco Sacchi <batt@develer.com>
+ * $test$: cp bertos/cfg/cfg_ax25.h $cfgdir/
+ * $test$: echo "#undef CONFIG_AX25_RX_QUEUE" >> $cfgdir/cfg_ax25.h
+ * $test$: echo "#define CONFIG_AX25_RX_QUEUE 4" >> $cfgdir/cfg_ax25.h
  */
 
 #include "ax25.h"
@@ -81,20 +84,90 @@ uint8_t aprs_packet[] =
 };
 
 uint8_t buf[] = {APRS_MSG};
+static int msg_cnt;
 KFileMem mem1;
 uint8_t aprs_packet_check[256];
 
 static void msg_callback(AX25Msg *msg)
 {
 	ax25_print(&dbg.fd, msg);
-	ASSERT(strncmp(msg->dst.call, "APRS\x0\x0", 6) == 0);
-	ASSERT(strncmp(msg->src.call, "S57LN\x0", 6) == 0);
-	ASSERT(msg->src.ssid == 0);
-	ASSERT(msg->dst.ssid == 0);
+	ASSERT(strncmp(msg->dst->call, "APRS\x0\x0", 6) == 0);
+	ASSERT(strncmp(msg->src->call, "S57LN\x0", 6) == 0);
+	ASSERT(msg->src->ssid == 0);
+	ASSERT(msg->dst->ssid == 0);
 	ASSERT(msg->ctrl == AX25_CTRL_UI);
 	ASSERT(msg->pid == AX25_PID_NOLAYER3);
 	ASSERT(msg->len == 30);
 	ASSERT(strncmp((const char *)msg->info, "=4603.63N/01431.26E-Op. Andrej", 30) == 0);
+
+	/* Messages point into the frame buffers */
+	ASSERT((const uint8_t *)msg->src > (const uint8_t *)ax25.rx);
+	ASSERT(msg->info < (const uint8_t *)(ax25.rx + AX25_RX_FRAMES));
+	msg_cnt++;
+}
+
+/*
+ * Receive a burst of frames, one with a wrong FCS, and check
+ * queueing and statistics.
+ */
+static void ax25_testQueue(void)
+{
+	static uint8_t burst[sizeof(aprs_packet) * (AX25_RX_FRAMES + 3)];
+	uint8_t *p = burst;
+	int frames = AX25_RX_FRAMES + 2;
+
+	for (int i = 0; i < frames; i++, p += sizeof(aprs_packet))
+		memcpy(p, aprs_packet, sizeof(aprs_packet));
+
+	/* Corrupt the payload of the last frame */
+	memcpy(p, aprs_packet, sizeof(aprs_packet));
+	p[20] ^= 0x01;
+
+	kfilemem_init(&mem, burst, sizeof(burst));
+	ax25_init(&ax25, &mem.fd, msg_callback);
+	msg_cnt = 0;
+	ax25_poll(&ax25);
+	ax25_dispatch(&ax25);
+
+	kprintf("frames %ld, fcs errors %ld, overflows %ld\n",
+		(long)ax25.stats.frames, (long)ax25.stats.fcs_errors, (long)ax25.stats.overflows);
+
+#if CONFIG_AX25_RX_QUEUE
+	/* The hook is not called while receiving, so the queue fills up */
+	ASSERT(msg_cnt == AX25_RX_FRAMES);
+	ASSERT(ax25.stats.frames == AX25_RX_FRAMES);
+	ASSERT(ax25.stats.fcs_errors == 0);
+	ASSERT(ax25.stats.overflows == 3);
+
+	/* With the queue drained frames are received again, up to the bad one */
+	kfilemem_init(&mem, burst + sizeof(aprs_packet) * 3, sizeof(aprs_packet) * AX25_RX_FRAMES);
+	ax25_poll(&ax25);
+	ASSERT(ax25_dispatch(&ax25) == AX25_RX_FRAMES - 1);
+	ASSERT(ax25.stats.fcs_errors == 1);
+	ASSERT(msg_cnt == 2 * AX25_RX_FRAMES - 1);
+#else
+	ASSERT(msg_cnt == frames);
+	ASSERT(ax25.stats.frames == (uint32_t)frames);
+	ASSERT(ax25.stats.fcs_errors == 1);
+	ASSERT(ax25.stats.overflows == 0);
+#endif
+}
+
+static void rpt_callback(AX25Msg *msg)
+{
+	ax25_print(&dbg.fd, msg);
+	ASSERT(strncmp(msg->dst->call, "ABCDEF", 6) == 0);
+	ASSERT(strncmp(msg->src->call, "GHJKLM", 6) == 0);
+#if CONFIG_AX25_RPT_LST
+	ASSERT(msg->rpt_cnt == 2);
+	ASSERT(strncmp(msg->rpt_lst[0].call, "WIDE1\x0", 6) == 0);
+	ASSERT(msg->rpt_lst[0].ssid == 1);
+	ASSERT(strncmp(msg->rpt_lst[1].call, "WIDE2\x0", 6) == 0);
+	ASSERT(msg->rpt_lst[1].ssid == 2);
+#endif
+	ASSERT(msg->len == sizeof(buf));
+	ASSERT(memcmp(msg->info, buf, sizeof(buf)) == 0);
+	msg_cnt++;
 }
 
 int ax25_testSetup(void)
@@ -115,9 +188,26 @@ int ax25_testTearDown(void)
 int ax25_testRun(void)
 {
 	ax25_poll(&ax25);
+	ax25_dispatch(&ax25);
+	ASSERT(msg_cnt == 1);
+	ASSERT(ax25.stats.frames == 1);
+
+	ax25_testQueue();
+
 	ax25_init(&ax25, &mem1.fd, NULL);
 	ax25_send(&ax25, AX25_CALL("aprs", 0x70), AX25_CALL("s57ln", 0x30), buf, sizeof(buf));
 	ASSERT(memcmp(aprs_packet, aprs_packet_check, sizeof(aprs_packet)) == 0);
+
+	/* Round trip through a path with repeaters */
+	AX25Call path[] = AX25_PATH(AX25_CALL("abcdef", 0), AX25_CALL("ghjklm", 0), AX25_CALL("wide1", 1), AX25_CALL("wide2", 2));
+	kfilemem_init(&mem1, aprs_packet_check, sizeof(aprs_packet_check));
+	ax25_sendVia(&ax25, path, countof(path), buf, sizeof(buf));
+	kfilemem_init(&mem1, aprs_packet_check, mem1.fd.seek_pos);
+	ax25_init(&ax25, &mem1.fd, rpt_callback);
+	msg_cnt = 0;
+	ax25_poll(&ax25);
+	ax25_dispatch(&ax25);
+	ASSERT(msg_cnt == 1);
 	return 0;
 }
 
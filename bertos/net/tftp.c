@@ -47,8 +47,13 @@
 #include <lwip/inet.h>
 #include <lwip/sockets.h>
 #include <string.h> //memset
+#include <strings.h> //strcasecmp
+#include <stdlib.h> //strtoul
+#include <stdio.h> //sprintf
 
-#define TFTP_PACKET_SIZE 516
+/* Block size and window size when the client asks for no options. */
+#define TFTP_DEF_BLKSIZE    512
+#define TFTP_DEF_WINDOWSIZE 1
 
 #define DECLARE_TIMEOUT(name, timeout) \
 	struct timeval name;               \
@@ -65,42 +70,101 @@ INLINE TftpSession *TFTP_CAST(KFile *fd)
 #define CHECK_OK  0
 #define CHECK_ERR -1
 #define CHECK_DUP -2
+
 /*
- * Check if received data is correct and send ACK if ok.
+ * Append a "name\0value\0" option pair to an OACK packet.
  */
-static int checkPacket(TftpSession *ctx, const Tftpframe *frame)
+static size_t appendOption(char *buf, const char *name, unsigned long val)
 {
-	bool dup = false;
+	size_t len = sprintf(buf, "%s", name) + 1;
+	return len + sprintf(buf + len, "%lu", val) + 1;
+}
+
+/*
+ * Acknowledge the last block received in sequence.
+ * The write request is acknowledged with an OACK if options were accepted.
+ * \return 0 if ok, -1 on errors
+ */
+static int tftp_sendAck(TftpSession *ctx)
+{
+	char buf[sizeof("blksize") + sizeof("65535") + sizeof("windowsize") + sizeof("65535") + 2];
+	size_t len;
+
+	if (ctx->block == 0 && ctx->oack)
+	{
+		// OACK is already in network order
+		short opcode = TFTP_OACK;
+		memcpy(buf, &opcode, sizeof(opcode));
+		len = sizeof(opcode);
+		if (ctx->blksize != TFTP_DEF_BLKSIZE)
+			len += appendOption(buf + len, "blksize", ctx->blksize);
+		if (ctx->windowsize != TFTP_DEF_WINDOWSIZE)
+			len += appendOption(buf + len, "windowsize", ctx->windowsize);
+	}
+	else
+	{
+		// ACK is already in network order
+		struct ackframe *ack = (struct ackframe *)buf;
+		ack->opcode = TFTP_ACK;
+		ack->block_num = htons(ctx->block);
+		len = sizeof(*ack);
+	}
+
+	ssize_t rc = lwip_sendto(ctx->sock, buf, len, 0, (struct sockaddr *)&ctx->addr, ctx->addr_len);
+	if (rc == (ssize_t)len)
+		return 0;
 
+	LOG_ERR("error sending ACK, rc %zd, errno %d\n", rc, errno);
+	return -1;
+}
+
+/*
+ * Check if received data is correct and send ACK if needed.
+ *
+ * Blocks in sequence are acknowledged once every window, or when the
+ * last block of the transfer is received.
+ * Out of order blocks are discarded: the last block received in sequence
+ * is acknowledged once, so that the client restarts sending from there.
+ */
+static int checkPacket(TftpSession *ctx, const Tftpframe *frame, ssize_t rlen)
+{
 	LOG_INFO("Checking block %hd\n", ctx->block);
 
 	// Check for duplicate WRQ packets
 
-	if (ntohs(frame->hdr.opcode) == TFTP_DATA)
+	if (ntohs(frame->hdr.opcode) == TFTP_DATA && rlen >= (ssize_t)sizeof(struct TftpHeader))
 	{
 		unsigned short received_block = ntohs(frame->hdr.th_u.block);
+		// Block numbers wrap around on long transfers
+		int16_t diff = (int16_t)(received_block - (unsigned short)(ctx->block + 1));
 
-		if (received_block > ctx->block + 1)
+		if (diff == 0)
 		{
-			LOG_ERR("Error, received block %hd, waiting for %hd\n", ntohs(frame->hdr.th_u.block), ctx->block + 1);
-			return CHECK_ERR;
-		}
-		else if (received_block < ctx->block + 1)
-		{
-			// Duplicate block
-			dup = true;
-			//LOG_WARN("Duplicate block %hd, waiting %hd\n", received_block, ctx->block + 1);
-		}
-		else
-		{
-			// received_block == ctx->block + 1, OK!
 			ctx->block++;
+			ctx->resync = false;
+			if (++ctx->window_cnt < ctx->windowsize
+				&& (size_t)rlen == ctx->blksize + sizeof(struct TftpHeader))
+				return CHECK_OK;
+			ctx->window_cnt = 0;
+			return tftp_sendAck(ctx) ? CHECK_ERR : CHECK_OK;
 		}
+
+		if (diff > 0)
+			LOG_WARN("Lost block %hu, received %hu\n", (unsigned short)(ctx->block + 1), received_block);
+
+		/*
+		 * A block was lost, or the client is sending again a window
+		 * whose acknowledge was lost. With lock-step acknowledges every
+		 * duplicate is answered, like plain TFTP does.
+		 */
+		if (ctx->resync && ctx->windowsize > 1)
+			return CHECK_DUP;
+		ctx->resync = true;
+		ctx->window_cnt = 0;
 	}
 	else if (frame->hdr.opcode == TFTP_WRQ && ctx->block == 0)
 	{
 		//Duplicate WRQ packet
-		dup = true;
 	}
 	else
 	{
@@ -108,17 +172,7 @@ static int checkPacket(TftpSession *ctx, const Tftpframe *frame)
 		return CHECK_ERR;
 	}
 
-	// if everything was ok, send ACK
-	// ACK is already in network order
-	struct ackframe ack;
-	ack.opcode = TFTP_ACK;
-	ack.block_num = htons(ctx->block);
-	ssize_t rc = lwip_sendto(ctx->sock, &ack, sizeof(ack), 0, (struct sockaddr *)&ctx->addr, ctx->addr_len);
-	if (rc == sizeof(ack))
-		return (dup ? CHECK_DUP : CHECK_OK);
-
-	LOG_ERR("error sending ACK, rc %d, errno %d\n", rc, errno);
-	return CHECK_ERR;
+	return tftp_sendAck(ctx) ? CHECK_ERR : CHECK_DUP;
 }
 
 /*
@@ -135,18 +189,31 @@ static int tftp_waitEvent(TftpSession *ctx, struct timeval *timeout)
 
 /*
  * Read a block from TFTP.
- * \param size Must be exactly 516 bytes
- * \param timeout Time to wait the network connection, may be NULL to wait forever
+ *
+ * If nothing is received, the last acknowledge is sent again up to
+ * CONFIG_TFTP_RETRIES times, spread over \a timeout.
+ *
+ * \param timeout Time to wait the network connection
  * \return Number of bytes read if success, TFTP_ERR_TIMEOUT on timeout, TFTP_ERR otherwise
  */
 static ssize_t tftp_readPacket(TftpSession *ctx, Tftpframe *frame, mtime_t timeout)
 {
-	DECLARE_TIMEOUT(wait_tm, timeout);
+	DECLARE_TIMEOUT(wait_tm, timeout / (CONFIG_TFTP_RETRIES + 1));
+	int retries = CONFIG_TFTP_RETRIES;
 	while (1)
 	{
 		int res = tftp_waitEvent(ctx, &wait_tm);
 		if (res == 0)
-			return TFTP_ERR_TIMEOUT;
+		{
+			if (retries-- <= 0)
+				return TFTP_ERR_TIMEOUT;
+
+			LOG_INFO("Timeout, acknowledge block %hu again\n", ctx->block);
+			ctx->window_cnt = 0;
+			if (tftp_sendAck(ctx))
+				return TFTP_ERR;
+			continue;
+		}
 		if (res == -1)
 		{
 			LOG_ERR("select error %d\n", errno);
@@ -157,7 +224,7 @@ static ssize_t tftp_readPacket(TftpSession *ctx, Tftpframe *frame, mtime_t timeo
 		LOG_INFO("Received %zd bytes\n", rlen);
 		if (rlen > 0)
 		{
-			int check = checkPacket(ctx, frame);
+			int check = checkPacket(ctx, frame, rlen);
 			if (check == CHECK_OK)
 				return rlen;
 			else if (check == CHECK_DUP)
@@ -177,70 +244,55 @@ static size_t tftp_read(struct KFile *fd, void *buf, size_t size)
 	TftpSession *fds = TFTP_CAST(fd);
 	uint8_t *_buf = (uint8_t *)buf;
 	size_t read_bytes = 0;
-	size_t offset = fds->valid_data - fds->bytes_available;
 
 	if (fds->pending_ack)
 	{
 		ASSERT(fds->block == 0);
-		struct ackframe ack;
-		ack.opcode = TFTP_ACK;
-		ack.block_num = fds->block;
-		lwip_sendto(fds->sock, &ack, 4, 0, (struct sockaddr *)&fds->addr, fds->addr_len);
+		tftp_sendAck(fds);
 		fds->pending_ack = false;
 	}
 
-	if (fds->bytes_available < size)
+	/* blocks smaller than size take more than one packet */
+	while (size > 0)
 	{
-		/* check if we were called again after an error */
-		if (fds->bytes_available > 0)
+		if (fds->bytes_available == 0)
 		{
-			memcpy(_buf, fds->frame.data + offset, fds->bytes_available);
-			LOG_INFO("ba < size. Copied %zd bytes from offset %zd\n", fds->bytes_available, offset);
-			/* adjust buf and size */
-			_buf += fds->bytes_available;
-			size -= fds->bytes_available;
-			read_bytes += fds->bytes_available;
-		}
+			if (fds->is_xfer_end)
+			{
+				LOG_INFO("Transfer finished\n");
+				fds->valid_data = 0;
+				break;
+			}
 
-		if (!fds->is_xfer_end)
-		{
 			LOG_INFO("Waiting for new TFTP packet\n");
 			/* get more data, we can wait since the function is blocking */
 			ssize_t rd = tftp_readPacket(fds, &fds->frame, fds->timeout);
 			if (rd < 0)
 			{
-				fds->bytes_available = 0;
 				/* Get actual lwIP error from errno */
 				fds->error = errno;
 				return 0;
 			}
-			else
+
+			if ((size_t)rd < fds->blksize + sizeof(struct TftpHeader))
 			{
-				if (rd < TFTP_PACKET_SIZE)
-				{
-					fds->is_xfer_end = true;
-					LOG_INFO("Received the last packet\n");
-				}
-				fds->bytes_available = (size_t)rd - sizeof(struct TftpHeader);
-				fds->valid_data = fds->bytes_available;
-				offset = 0;
+				fds->is_xfer_end = true;
+				LOG_INFO("Received the last packet\n");
 			}
+			fds->bytes_available = (size_t)rd - sizeof(struct TftpHeader);
+			fds->valid_data = fds->bytes_available;
 		}
-		else
-		{
-			LOG_INFO("Transfer finished\n");
-			fds->bytes_available -= fds->bytes_available;
-			fds->valid_data = 0;
-			return read_bytes;
-		}
-	}
 
-	/* check how many bytes we need to copy */
-	size_t res = MIN(fds->bytes_available, size);
-	LOG_INFO("Copying %zd bytes from offset %zd\n", res, offset);
-	memcpy(_buf, fds->frame.data + offset, res);
-	fds->bytes_available -= res;
-	read_bytes += res;
+		/* check how many bytes we need to copy */
+		size_t offset = fds->valid_data - fds->bytes_available;
+		size_t res = MIN(fds->bytes_available, size);
+		LOG_INFO("Copying %zd bytes from offset %zd\n", res, offset);
+		memcpy(_buf, fds->frame.data + offset, res);
+		fds->bytes_available -= res;
+		_buf += res;
+		size -= res;
+		read_bytes += res;
+	}
 	return read_bytes;
 }
 
@@ -280,12 +332,58 @@ static void resetTftpState(TftpSession *ctx)
 	ctx->valid_data = 0;
 	ctx->is_xfer_end = false;
 	ctx->pending_ack = false;
+	ctx->blksize = TFTP_DEF_BLKSIZE;
+	ctx->windowsize = TFTP_DEF_WINDOWSIZE;
+	ctx->window_cnt = 0;
+	ctx->oack = false;
+	ctx->resync = false;
+}
+
+/*
+ * Parse the options following file name and mode in a write request.
+ * Unknown options and invalid values are ignored, values greater than
+ * the configured ones are lowered.
+ */
+static void parseOptions(TftpSession *ctx, const char *opt, const char *end)
+{
+	// Skip file name and mode
+	for (int i = 0; i < 2; i++)
+	{
+		opt = memchr(opt, '\0', end - opt);
+		if (!opt)
+			return;
+		opt++;
+	}
+
+	while (opt < end)
+	{
+		const char *val = memchr(opt, '\0', end - opt);
+		if (!val)
+			break;
+		val++;
+		const char *next = memchr(val, '\0', end - val);
+		if (!next)
+			break;
+
+		unsigned long n = strtoul(val, NULL, 10);
+		LOG_INFO("Option %s = %s\n", opt, val);
+		if (!strcasecmp(opt, "blksize") && n >= 8)
+			ctx->blksize = MIN(n, (unsigned long)CONFIG_TFTP_BLKSIZE);
+		else if (!strcasecmp(opt, "windowsize") && n >= 1)
+			ctx->windowsize = MIN(n, (unsigned long)CONFIG_TFTP_WINDOWSIZE);
+
+		opt = next + 1;
+	}
+
+	ctx->oack = ctx->blksize != TFTP_DEF_BLKSIZE || ctx->windowsize != TFTP_DEF_WINDOWSIZE;
 }
 
 /**
  * Listen for incoming tftp sessions.
  *
  * \note Only write requests are accepted.
+ * \note The blksize and windowsize options are negotiated here, the OACK is
+ *       sent with the first read from the returned KFile.
  *
  * \param ctx Initialized TftpChannel
  * \param filename String to be filled with file name to be written
@@ -322,6 +420,7 @@ KFile *tftp_listen(TftpSession *ctx, char *filename, size_t len, TftpOpenMode *m
 			ctx->pending_ack = true;
 			strncpy(filename, (char *)&ctx->frame.hdr.th_u, len);
 			filename[len - 1] = '\0';
+			parseOptions(ctx, ctx->frame.hdr.th_u.stuff, (const char *)&ctx->frame + rd);
 			ctx->error = 0;
 			return &ctx->kfile_request;
 		}
@@ -55,6 +55,14 @@
  * kfile_close(f);
  * \endcode
  *
+ * The server accepts the blksize (RFC 2348) and windowsize (RFC 7440)
+ * options, up to CONFIG_TFTP_BLKSIZE and CONFIG_TFTP_WINDOWSIZE, and
+ * answers with an OACK listing the accepted values.
+ * With a window, only one acknowledge is sent every \a windowsize blocks;
+ * when a block is lost, the last block received in sequence is
+ * acknowledged and the client restarts sending from there.
+ * Plain TFTP clients get 512 bytes blocks and lock-step acknowledges.
+ *
  *
  * \author Luca Ottaviano <lottaviano@develer.com>
  *
@@ -66,6 +74,8 @@
 #ifndef TFTP_H
 #define TFTP_H
 
+#include "cfg/cfg_tftp.h"
+
 #include <cfg/compiler.h>
 #include <lwip/sockets.h> // sockaddr_in, socklen_t
 #include <io/kfile.h>
@@ -75,6 +85,7 @@
 #define TFTP_DATA     03     /* TFTP data packet. */
 #define TFTP_ACK      0x0400 /* TFTP acknowledgement packet (already in net endianess). */
 #define TFTP_PROTOERR 0x0500 /* TFTP acknowledgement packet (already in net endianess). */
+#define TFTP_OACK     0x0600 /* TFTP option acknowledgement packet (already in net endianess). */
 
 /* TFTP protocol error codes */
 #define TFTP_PROTOERR_ACCESS_VIOLATION 0x0200
@@ -100,7 +111,7 @@ struct PACKED TftpHeader
 typedef struct PACKED Tftpframe
 {
 	struct TftpHeader hdr;
-	char data[512]; /* data or error string */
+	char data[CONFIG_TFTP_BLKSIZE]; /* data or error string */
 } Tftpframe;
 
 struct PACKED ackframe
@@ -128,6 +139,9 @@ typedef struct TftpSession
 	socklen_t addr_len;
 	int sock;
 	unsigned short block;
+	size_t blksize;            ///< Negotiated block size.
+	unsigned short windowsize; ///< Negotiated window size.
+	unsigned short window_cnt; ///< Blocks received since the last acknowledge.
 	mtime_t timeout;
 	int error;
 	Tftpframe frame;
@@ -135,6 +149,8 @@ typedef struct TftpSession
 	size_t valid_data;
 	bool is_xfer_end;
 	bool pending_ack;
+	bool oack;   ///< Options were accepted, acknowledge the request with an OACK.
+	bool resync; ///< An acknowledge was sent after a lost block.
 	char error_msg[32];
 	KFile kfile_request;
 } TftpSession;
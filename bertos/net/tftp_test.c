@@ -0,0 +1,299 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2011 Develer S.r.l. (http://www.develer.com/)
+ * -->
+ *
+ *
+ * \brief TFTP server test.
+ *
+ * The server in tftp.c runs on host UDP sockets on a local port; the
+ * test forks a client that sends an image with the options given, and
+ * losing and reordering blocks on purpose if requested. The server
+ * stores what it receives in a temporary file, which is then compared
+ * with the image.
+ * The client waits LINK_RTT ms after every window, to model the round
+ * trip time of a real link: the transfer times show the gain of the
+ * blksize and windowsize options over lock-step 512 bytes blocks.
+ */
+
+/*
+ * Use the host sockets in place of the lwIP ones.
+ */
+#define LWIP_HDR_SOCKETS_H
+#define LWIP_HDR_INET_H
+
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <unistd.h>
+
+#define lwip_socket   socket
+#define lwip_bind     bind
+#define lwip_select   select
+#define lwip_sendto   sendto
+#define lwip_recvfrom recvfrom
+
+#include "tftp.c"
+
+#include <cfg/debug.h>
+#include <cfg/test.h>
+
+#include <os/hptime.h>
+
+#include <stdio.h>
+
+#define LINK_RTT     5
+#define IMAGE_SIZE   100000
+#define SERVER_TIMEOUT 1000
+
+static TftpSession server;
+static struct sockaddr_in server_addr;
+static uint8_t image[IMAGE_SIZE];
+static uint8_t pkt[CONFIG_TFTP_BLKSIZE + 4];
+static char tmp_name[] = "/tmp/tftp_testXXXXXX";
+static FILE *tmp;
+static uint32_t seed = 1;
+
+static unsigned rnd(unsigned n)
+{
+	seed = seed * 1103515245UL + 12345;
+	return (seed >> 16) % n;
+}
+
+/*
+ * Wait for a packet from the server.
+ * \return Packet length, 0 on timeout
+ */
+static ssize_t recvPacket(int sock, long ms)
+{
+	fd_set inset;
+	FD_ZERO(&inset);
+	FD_SET(sock, &inset);
+	struct timeval tm = { ms / 1000, (ms % 1000) * 1000 };
+	if (select(sock + 1, &inset, NULL, NULL, &tm) <= 0)
+		return 0;
+
+	socklen_t len = sizeof(server_addr);
+	return recvfrom(sock, pkt, sizeof(pkt), 0, (struct sockaddr *)&server_addr, &len);
+}
+
+/*
+ * Wait for the acknowledges of a window and return the highest block
+ * acknowledged, -1 on timeout or errors.
+ */
+static int waitAck(int sock, int last_acked)
+{
+	int acked = -1;
+	ssize_t len;
+
+	for (long ms = 200; (len = recvPacket(sock, ms)) > 0; ms = 2)
+	{
+		if (len != 4 || ntohs(*(uint16_t *)pkt) != (TFTP_ACK >> 8))
+			return -1;
+		int n = last_acked + (int16_t)(ntohs(*(uint16_t *)(pkt + 2)) - (uint16_t)last_acked);
+		acked = MAX(acked, n);
+	}
+	return acked;
+}
+
+static bool sendBlock(int sock, int n, size_t blksize, int nblocks)
+{
+	size_t off = (size_t)(n - 1) * blksize;
+	size_t len = n == nblocks ? sizeof(image) - off : blksize;
+
+	*(uint16_t *)pkt = htons(TFTP_DATA);
+	*(uint16_t *)(pkt + 2) = htons((uint16_t)n);
+	memcpy(pkt + 4, image + off, len);
+	return sendto(sock, pkt, len + 4, 0, (struct sockaddr *)&server_addr, sizeof(server_addr)) == (ssize_t)(len + 4);
+}
+
+/*
+ * Send the image to the server, asking for \a blksize and \a windowsize
+ * if not 0, and losing some blocks if \a lossy.
+ * \return true if all the image was acknowledged.
+ */
+static bool client(size_t blksize, int win, bool lossy)
+{
+	char wrq[64];
+	size_t len = 2 + sprintf(wrq + 2, "fw.bin") + 1;
+	len += sprintf(wrq + len, "octet") + 1;
+	if (blksize)
+		len += appendOption(wrq + len, "blksize", blksize);
+	if (win)
+		len += appendOption(wrq + len, "windowsize", win);
+	*(uint16_t *)wrq = htons(TFTP_WRQ >> 8);
+
+	int sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if (sock < 0 || sendto(sock, wrq, len, 0, (struct sockaddr *)&server_addr, sizeof(server_addr)) != (ssize_t)len)
+		return false;
+
+	/* Options are confirmed by an OACK, a plain ACK refuses them all */
+	ssize_t rlen = recvPacket(sock, SERVER_TIMEOUT);
+	if (rlen < 4)
+		return false;
+	blksize = 512;
+	win = 1;
+	if (ntohs(*(uint16_t *)pkt) == (TFTP_OACK >> 8))
+	{
+		for (char *opt = (char *)pkt + 2; opt < (char *)pkt + rlen; opt += strlen(opt) + 1)
+		{
+			char *val = opt + strlen(opt) + 1;
+			if (!strcmp(opt, "blksize"))
+				blksize = atoi(val);
+			else if (!strcmp(opt, "windowsize"))
+				win = atoi(val);
+			opt = val;
+		}
+	}
+
+	int nblocks = sizeof(image) / blksize + 1;
+	int base = 1;
+
+	while (base <= nblocks)
+	{
+		int last = MIN(base + win - 1, nblocks);
+		for (int n = base; n <= last; n++)
+		{
+			if (lossy && rnd(20) == 0)
+				continue;
+			// Swap with the following block now and then
+			if (lossy && n < last && rnd(15) == 0)
+			{
+				if (!sendBlock(sock, n + 1, blksize, nblocks))
+					return false;
+				n++;
+			}
+			if (!sendBlock(sock, n, blksize, nblocks))
+				return false;
+		}
+
+		int acked = waitAck(sock, base - 1);
+		if (acked > nblocks)
+			return false;
+		base = MAX(base, acked + 1);
+		usleep(LINK_RTT * 1000);
+	}
+	close(sock);
+	return true;
+}
+
+/*
+ * Receive the image with the server, while a child process sends it.
+ * \return The transfer time in ms.
+ */
+static long tftp_testTransfer(const char *name, size_t blksize, int win, bool lossy)
+{
+	pid_t pid = fork();
+	ASSERT(pid >= 0);
+	if (pid == 0)
+		_exit(client(blksize, win, lossy) ? 0 : 1);
+
+	char filename[16];
+	TftpOpenMode mode;
+	KFile *f = tftp_listen(&server, filename, sizeof(filename), &mode);
+	ASSERT(f);
+	ASSERT(mode == TFTP_WRITE);
+	ASSERT(!strcmp(filename, "fw.bin"));
+
+	hptime_t start = hptime_get();
+	size_t len, total = 0;
+	ASSERT(fseek(tmp, 0, SEEK_SET) == 0);
+	do
+	{
+		len = kfile_read(f, pkt, sizeof(pkt));
+		ASSERT(!kfile_error(f));
+		ASSERT(fwrite(pkt, 1, len, tmp) == len);
+		total += len;
+	}
+	while (len == sizeof(pkt));
+	long ms = (hptime_get() - start) / HPTIME_TICKS_PER_MILLISEC;
+	kfile_close(f);
+
+	int status;
+	ASSERT(waitpid(pid, &status, 0) == pid);
+	ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+	/* Check the temporary file against the image */
+	ASSERT(total == sizeof(image));
+	ASSERT(fflush(tmp) == 0);
+	ASSERT(fseek(tmp, 0, SEEK_SET) == 0);
+	for (size_t off = 0; off < sizeof(image); off += sizeof(pkt))
+	{
+		size_t bytes = MIN(sizeof(pkt), sizeof(image) - off);
+		ASSERT(fread(pkt, 1, bytes, tmp) == bytes);
+		ASSERT(!memcmp(pkt, image + off, bytes));
+	}
+
+	kprintf("%-20s %5ld ms\n", name, ms);
+	return ms;
+}
+
+int tftp_testSetup(void)
+{
+	kdbg_init();
+
+	for (size_t i = 0; i < sizeof(image); i++)
+		image[i] = rnd(256);
+
+	int fd = mkstemp(tmp_name);
+	ASSERT(fd >= 0);
+	tmp = fdopen(fd, "w+");
+	ASSERT(tmp);
+
+	/* Any free port will do */
+	ASSERT(tftp_init(&server, 0, SERVER_TIMEOUT) == 0);
+	socklen_t len = sizeof(server_addr);
+	ASSERT(getsockname(server.sock, (struct sockaddr *)&server_addr, &len) == 0);
+	server_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	return 0;
+}
+
+int tftp_testTearDown(void)
+{
+	close(server.sock);
+	fclose(tmp);
+	unlink(tmp_name);
+	return 0;
+}
+
+int tftp_testRun(void)
+{
+	long t_plain = tftp_testTransfer("512, lock-step", 0, 0, false);
+	long t_window = tftp_testTransfer("1468, window 8", 1468, 8, false);
+	tftp_testTransfer("1468, window 8, lossy", 1468, 8, true);
+	tftp_testTransfer("512, lock-step, lossy", 0, 0, true);
+
+	ASSERT(t_window * 5 < t_plain);
+	return 0;
+}
+
+TEST_MAIN(tftp);
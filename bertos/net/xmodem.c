@@ -33,11 +33,10 @@
  *
  * \brief X-Modem serial transmission protocol (implementation)
  *
- * Supports the CRC-16 and 1K-blocks variants of the standard.
+ * Supports the CRC-16 and 1K-blocks variants of the standard, YMODEM
+ * batch transfers and the YMODEM-G streaming variant.
  * \see ymodem.txt for the protocol description.
  *
- * \todo Break xmodem_send() and xmodem_recv() in smaller functions.
- *
  * \author Bernie Innocenti <bernie@codewiz.org>
  * \author Francesco Sacchi <batt@develer.com>
  */
@@ -66,6 +65,7 @@
 #define XM_ACK 0x06 /**< Acknowledge block */
 #define XM_NAK 0x15 /**< Negative Acknowledge */
 #define XM_C   0x43 /**< Request CRC-16 transmission */
+#define XM_G   0x47 /**< Request CRC-16 streaming transmission (YMODEM-G) */
 #define XM_CAN 0x18 /**< CANcel transmission */
 /*\}*/
 
@@ -75,28 +75,82 @@
 	#define XM_BUFSIZE 128 /**< 128 bytes of block buffer */
 #endif
 
+/** Block buffer, with room for the CRC */
+#define XM_BLOCK_BUFSIZE (XM_BUFSIZE + 2)
+
+static void xm_cancel(KFile *ch)
+{
+	kfile_putc(XM_CAN, ch);
+	kfile_putc(XM_CAN, ch);
+	LOG_INFO("Transfer aborted\n");
+}
+
 #if CONFIG_XMODEM_RECV
-/**
- * \brief Receive a file using the XModem protocol.
+/*
+ * Receive a block after its SOH/STX header byte and check it.
+ * The CRC is computed on the whole block with the table driven crc16().
  *
- * \param ch Channel to use for transfer
- * \param fd Destination file
+ * \return the block number, -1 on error.
+ */
+static int xm_recvBlock(KFile *ch, uint8_t *buf, size_t blocksize, bool usecrc)
+{
+	uint8_t hdr[2];
+	size_t len = blocksize + (usecrc ? 2 : 1);
+
+	/* Get block number and check the complemented one */
+	if (kfile_read(ch, hdr, sizeof(hdr)) != sizeof(hdr) || (hdr[0] ^ hdr[1]) != 0xFF)
+	{
+		LOG_WARN("Bad blk (%d)\n", hdr[0]);
+		return -1;
+	}
+
+	if (kfile_read(ch, buf, len) != len)
+		return -1;
+
+	if (usecrc)
+	{
+		/* The CRC of a block followed by its CRC is zero */
+		uint16_t crc = crc16(CRC16_INIT_VAL, buf, len);
+		if (crc)
+		{
+			LOG_ERR("Bad CRC: %04x\n", crc);
+			return -1;
+		}
+	}
+	else
+	{
+		uint8_t checksum = 0;
+		for (size_t i = 0; i < blocksize; i++)
+			checksum += buf[i];
+
+		if (buf[blocksize] != checksum)
+		{
+			LOG_ERR("Bad sum: %04x/%04x\n", checksum, buf[blocksize]);
+			return -1;
+		}
+	}
+	return hdr[0];
+}
+
+/*
+ * Receive blocks from 1 up to the EOT and write them to \a fd.
  *
- * \note This function allocates a large amount of stack (\see XM_BUFSIZE).
+ * \param start char sent to start the transfer: XM_C, falling back to
+ *        checksums after CONFIG_XMODEM_MAXCRCRETRIES, or XM_G to receive
+ *        without acknowledging every block.
+ * \param size bytes to write, the padding of the last block is dropped.
+ *        0 to write whole blocks.
  */
-bool xmodem_recv(KFile *ch, KFile *fd)
+static bool xm_recvFile(KFile *ch, KFile *fd, uint8_t *buf, int start, size_t size)
 {
-	char block_buffer[XM_BUFSIZE]; /* Buffer to hold a block of data */
-	int c, i, blocksize;
-	int blocknr = 0, last_block_done = 0, retries = 0;
-	char *buf;
-	uint8_t checksum;
-	uint16_t crc;
-	bool purge = false;
+	int c, nr, blocksize;
+	int blocknr = 0, retries = 0;
+	size_t done = 0;
+	bool purge = true;
 	bool usecrc = true;
+	bool stream = (start == XM_G);
 
 	LOG_INFO("Starting Transfer...\n");
-	purge = true;
 	kfile_clearerr(ch);
 
 	/* Send initial NAK to start transmission */
@@ -104,9 +158,7 @@ bool xmodem_recv(KFile *ch, KFile *fd)
 	{
 		if (XMODEM_CHECK_ABORT)
 		{
-			kfile_putc(XM_CAN, ch);
-			kfile_putc(XM_CAN, ch);
-			LOG_INFO("Transfer aborted\n");
+			xm_cancel(ch);
 			return false;
 		}
 
@@ -123,24 +175,34 @@ bool xmodem_recv(KFile *ch, KFile *fd)
 				LOG_ERR("Retries %d\n", retries);
 			}
 
-			kfile_resync(ch, 200);
+			/* Streaming transfers can not recover a block */
+			if (stream && blocknr)
+			{
+				xm_cancel(ch);
+				return false;
+			}
+
+			/*
+			 * The transmitter only talks after our request: there is
+			 * nothing to discard before the first one.
+			 */
+			if (retries || blocknr)
+				kfile_resync(ch, 200);
 			retries++;
 
 			if (retries >= CONFIG_XMODEM_MAXRETRIES)
 			{
-				kfile_putc(XM_CAN, ch);
-				kfile_putc(XM_CAN, ch);
-				LOG_INFO("Transfer aborted\n");
+				xm_cancel(ch);
 				return false;
 			}
 
 			/* Transmission start? */
 			if (blocknr == 0)
 			{
-				if (retries < CONFIG_XMODEM_MAXCRCRETRIES)
+				if (start != XM_C || retries < CONFIG_XMODEM_MAXCRCRETRIES)
 				{
-					LOG_INFO("Request Tx (CRC)\n");
-					kfile_putc(XM_C, ch);
+					LOG_INFO("Request Tx (%c)\n", start);
+					kfile_putc(start, ch);
 				}
 				else
 				{
@@ -154,130 +216,63 @@ bool xmodem_recv(KFile *ch, KFile *fd)
 				kfile_putc(XM_NAK, ch);
 		}
 
-		switch (kfile_getc(ch))
+		switch (c = kfile_getc(ch))
 		{
-	#if XM_BUFSIZE >= 1024
 		case XM_STX: /* Start of header (1024-byte block) */
-			blocksize = 1024;
-			goto getblock;
-	#endif
-
 		case XM_SOH: /* Start of header (128-byte block) */
-			blocksize = 128;
-			/* Needed to avoid warning if XM_BUFSIZE < 1024 */
-
-		getblock:
-			/* Get block number */
-			c = kfile_getc(ch);
-
-			/* Check complemented block number */
-			if ((~c & 0xff) != kfile_getc(ch))
+			blocksize = (c == XM_STX) ? 1024 : 128;
+			if (blocksize > XM_BUFSIZE)
 			{
-				LOG_WARN("Bad blk (%d)\n", c);
+				LOG_WARN("1K blocks not supported\n");
 				purge = true;
 				break;
 			}
 
-			/* Determine which block is being sent */
-			if (c == (blocknr & 0xff))
+			nr = xm_recvBlock(ch, buf, blocksize, usecrc);
+			if (nr < 0)
 			{
-				/* Last block repeated */
-				LOG_INFO("Repeat blk %d\n", blocknr);
-			}
-			else if (c == ((blocknr + 1) & 0xff))
-			{
-				/* Next block */
-				LOG_INFO("Recv blk %d\n", ++blocknr);
-			}
-			else
-			{
-				/* Sync lost */
-				LOG_WARN("Sync lost (%d/%d)\n", c, blocknr);
 				purge = true;
 				break;
 			}
 
-			buf = block_buffer; /* Reset pointer to start of buffer */
-			checksum = 0;
-			crc = 0;
-			for (i = 0; i < blocksize; i++)
+			/* Determine which block is being sent */
+			if (nr == (blocknr & 0xff))
 			{
-				if ((c = kfile_getc(ch)) == EOF)
-				{
-					purge = true;
-					break;
-				}
-
-				/* Store in buffer */
-				*buf++ = (char)c;
-
-				/* Calculate block checksum or CRC */
-				if (usecrc)
-					crc = UPDCRC16(c, crc);
-				else
-					checksum += (char)c;
-			}
-
-			if (purge)
+				/*
+				 * Last block repeated: the sender lost our acknowledge,
+				 * do not write it again.
+				 */
+				LOG_INFO("Repeat blk %d\n", blocknr);
+				if (!stream)
+					kfile_putc(XM_ACK, ch);
 				break;
-
-			/* Get the checksum byte or the CRC-16 MSB */
-			if ((c = kfile_getc(ch)) == EOF)
+			}
+			else if (nr != ((blocknr + 1) & 0xff))
 			{
+				/* Sync lost */
+				LOG_WARN("Sync lost (%d/%d)\n", nr, blocknr);
 				purge = true;
 				break;
 			}
+			LOG_INFO("Recv blk %d\n", ++blocknr);
 
-			if (usecrc)
-			{
-				crc = UPDCRC16(c, crc);
-
-				/* Get CRC-16 LSB */
-				if ((c = kfile_getc(ch)) == EOF)
-				{
-					purge = true;
-					break;
-				}
-
-				crc = UPDCRC16(c, crc);
+			/* Drop the padding past the file size */
+			size_t len = blocksize;
+			if (size)
+				len = MIN(len, size - done);
 
-				if (crc)
-				{
-					LOG_ERR("Bad CRC: %04x\n", crc);
-					purge = true;
-					break;
-				}
-			}
-			/* Compare the checksum */
-			else if (c != checksum)
+			if (kfile_write(fd, buf, len) != len)
 			{
-				LOG_ERR("Bad sum: %04x/%04x\n", checksum, c);
-				purge = true;
-				break;
+				/* User callback failed: abort transfer immediately */
+				xm_cancel(ch);
+				return false;
 			}
+			done += len;
 
-			/*
-			 * Avoid flushing the same block twice.
-			 * This could happen when the sender does not receive our
-			 * acknowledge and resends the same block.
-			 */
-			if (last_block_done < blocknr)
-			{
-				/* Call user function to flush the buffer */
-				if (kfile_write(fd, block_buffer, blocksize) == (size_t)blocksize)
-				{
-					/* Acknowledge block and clear error counter */
-					kfile_putc(XM_ACK, ch);
-					retries = 0;
-					last_block_done = blocknr;
-				}
-				else
-				{
-					/* User callback failed: abort transfer immediately */
-					retries = CONFIG_XMODEM_MAXRETRIES;
-					purge = true;
-				}
-			}
+			/* Acknowledge block and clear error counter */
+			if (!stream)
+				kfile_putc(XM_ACK, ch);
+			retries = 0;
 			break;
 
 		case XM_EOT: /* End of transmission */
@@ -285,6 +280,10 @@ bool xmodem_recv(KFile *ch, KFile *fd)
 			LOG_INFO("Transfer completed\n");
 			return true;
 
+		case XM_CAN:
+			LOG_INFO("Transfer cancelled\n");
+			return false;
+
 		case EOF: /* Timeout or serial error */
 			purge = true;
 			break;
@@ -296,135 +295,408 @@ bool xmodem_recv(KFile *ch, KFile *fd)
 		}
 	} /* End forever */
 }
-#endif
 
-#if CONFIG_XMODEM_SEND
 /**
- * \brief Transmit some data using the XModem protocol.
+ * \brief Receive a file using the XModem protocol.
  *
  * \param ch Channel to use for transfer
- * \param fd Source file
+ * \param fd Destination file
  *
- * \note This function allocates a large amount of stack for
- *       the XModem transfer buffer (\see XM_BUFSIZE).
+ * \note This function allocates a large amount of stack (\see XM_BUFSIZE).
  */
-bool xmodem_send(KFile *ch, KFile *fd)
+bool xmodem_recv(KFile *ch, KFile *fd)
 {
-	char block_buffer[XM_BUFSIZE]; /* Buffer to hold a block of data */
-	size_t size = -1;
-	int blocknr = 1, retries = 0, c, i;
-	bool proceed, usecrc = false;
-	uint16_t crc;
-	uint8_t sum;
-
-	/*
-	 * Reading a block can be very slow, so we read the first block early
-	 * to avoid receiving double XM_C char.
-	 * This could happen if we check for XM_C and then read the block, giving
-	 * the receiving device time to send another XM_C char misinterpretating
-	 * the blocks sent.
-	 */
-	size = kfile_read(fd, block_buffer, XM_BUFSIZE);
+	uint8_t block_buffer[XM_BLOCK_BUFSIZE]; /* Buffer to hold a block of data */
 
-	kfile_clearerr(ch);
-	LOG_INFO("Wait remote host\n");
+	return xm_recvFile(ch, fd, block_buffer, XM_C, 0);
+}
+
+/*
+ * Receive the YMODEM header (block 0).
+ * \return true if a header has been received in \a buf.
+ */
+static bool ym_recvHeader(KFile *ch, uint8_t *buf, int start)
+{
+	int c;
+
+	for (int retries = 0; retries < CONFIG_XMODEM_MAXRETRIES; retries++)
+	{
+		if (XMODEM_CHECK_ABORT)
+			break;
+
+		if (retries)
+			kfile_resync(ch, 200);
+		kfile_putc(start, ch);
+
+		switch (c = kfile_getc(ch))
+		{
+		case XM_STX:
+		case XM_SOH:
+			if (c == XM_STX && XM_BUFSIZE < 1024)
+				break;
+			if (xm_recvBlock(ch, buf, (c == XM_STX) ? 1024 : 128, true) == 0)
+				return true;
+			break;
+
+		case XM_EOT:
+			/* The sender lost the acknowledge of the previous file */
+			kfile_putc(XM_ACK, ch);
+			break;
+
+		case XM_CAN:
+			return false;
+
+		default:
+			break;
+		}
+	}
+	return false;
+}
+
+/**
+ * \brief Receive a batch of files using the YModem protocol.
+ *
+ * For every file \a open is called with the name and size sent by the
+ * transmitter and returns the destination file. The data written is
+ * truncated to the file size, when the transmitter sends it.
+ *
+ * \param ch Channel to use for transfer
+ * \param open Callback returning the destination of each file
+ * \param stream true to use the YMODEM-G variant: blocks are not
+ *        acknowledged, so the transmitter sends them without waiting,
+ *        but any error aborts the transfer. Use it only on error free
+ *        channels.
+ *
+ * \return true when the whole batch has been received.
+ *
+ * \note This function allocates a large amount of stack (\see XM_BUFSIZE).
+ */
+bool ymodem_recv(KFile *ch, ymodem_open_t open, bool stream)
+{
+	uint8_t block_buffer[XM_BLOCK_BUFSIZE];
+	int start = stream ? XM_G : XM_C;
 
 	for (;;)
 	{
-		proceed = false;
-		do
+		if (!ym_recvHeader(ch, block_buffer, start))
 		{
-			if (XMODEM_CHECK_ABORT)
-				return false;
+			xm_cancel(ch);
+			return false;
+		}
+
+		/* An empty file name ends the batch */
+		if (!block_buffer[0])
+		{
+			kfile_putc(XM_ACK, ch);
+			LOG_INFO("Batch completed\n");
+			return true;
+		}
 
-			switch (c = kfile_getc(ch))
+		/* File name, then the size in decimal, all in the first 128 bytes */
+		block_buffer[127] = '\0';
+		const char *name = (const char *)block_buffer;
+		const char *end = name + 128;
+		const char *p = name + strlen(name) + 1;
+		size_t size = 0;
+
+		for (; p < end && *p >= '0' && *p <= '9'; p++)
+		{
+			size_t digit = *p - '0';
+
+			if (size > ((size_t)-1 - digit) / 10)
 			{
-			case XM_NAK:
-				LOG_INFO("Resend blk %d\n", blocknr);
-				proceed = true;
-				break;
+				LOG_ERR("Bad file size\n");
+				xm_cancel(ch);
+				return false;
+			}
+			size = size * 10 + digit;
+		}
 
-			case XM_C:
-				if (c == XM_C)
-				{
-					LOG_INFO("Tx start (CRC)\n");
-					usecrc = true;
-				}
-				else
-				{
-					LOG_INFO("Tx start (BCC)\n");
-				}
+		LOG_INFO("File %s, %ld bytes\n", name, (long)size);
+		if (!stream)
+			kfile_putc(XM_ACK, ch);
 
-				proceed = true;
+		KFile *fd = open(name, size);
+		if (!fd)
+		{
+			xm_cancel(ch);
+			return false;
+		}
+
+		if (!xm_recvFile(ch, fd, block_buffer, start, size))
+			return false;
+		kfile_flush(fd);
+	}
+}
+#endif
+
+#if CONFIG_XMODEM_SEND
+/*
+ * Send a block padded with 0xFF, followed by its CRC or checksum.
+ * \a buf must have room for the CRC after \a blocksize bytes.
+ */
+static void xm_sendBlock(KFile *ch, uint8_t *buf, size_t len, size_t blocksize, int blocknr, bool usecrc)
+{
+	uint8_t hdr[3];
+
+	/* Pad block with 0xFF if it's partially full */
+	memset(buf + len, 0xFF, blocksize - len);
+
+	/* Send block header (SOH/STX, blocknr, ~blocknr) */
+	hdr[0] = (blocksize == 128) ? XM_SOH : XM_STX;
+	hdr[1] = blocknr & 0xFF;
+	hdr[2] = ~blocknr & 0xFF;
+	kfile_write(ch, hdr, sizeof(hdr));
+
+	/* Send block followed by CRC/Checksum */
+	if (usecrc)
+	{
+		uint16_t crc = crc16(CRC16_INIT_VAL, buf, blocksize);
+		buf[blocksize] = crc >> 8;
+		buf[blocksize + 1] = crc & 0xFF;
+		kfile_write(ch, buf, blocksize + 2);
+	}
+	else
+	{
+		uint8_t sum = 0;
+		for (size_t i = 0; i < blocksize; i++)
+			sum += buf[i];
+		buf[blocksize] = sum;
+		kfile_write(ch, buf, blocksize + 1);
+	}
+}
+
+/*
+ * Wait for the receiver to request a transfer.
+ * \return XM_C, XM_G or XM_NAK (checksum transfer), EOF on error.
+ */
+static int xm_waitStart(KFile *ch, bool stream_ok)
+{
+	int retries = 0;
+
+	LOG_INFO("Wait remote host\n");
+	for (;;)
+	{
+		if (XMODEM_CHECK_ABORT)
+			return EOF;
+
+		switch (kfile_getc(ch))
+		{
+		case XM_G:
+			if (!stream_ok)
 				break;
+			LOG_INFO("Tx start (streaming)\n");
+			return XM_G;
 
-			case XM_ACK:
-				/* End of transfer? */
-				if (!size)
-					return true;
-
-				/* Call user function to read in one block */
-				size = kfile_read(fd, block_buffer, XM_BUFSIZE);
-				LOG_INFO("Send blk %d\n", blocknr);
-				blocknr++;
-				retries = 0;
-				proceed = true;
+		case XM_C:
+			LOG_INFO("Tx start (CRC)\n");
+			return XM_C;
+
+		case XM_NAK:
+			LOG_INFO("Tx start (BCC)\n");
+			return XM_NAK;
+
+		case EOF:
+			kfile_clearerr(ch);
+			if (++retries <= CONFIG_XMODEM_MAXRETRIES)
 				break;
+			/* fall through */
 
-			case EOF:
-				kfile_clearerr(ch);
-				retries++;
-				LOG_INFO("Retries %d\n", retries);
-				if (retries <= CONFIG_XMODEM_MAXRETRIES)
-					break;
-				/* falling through! */
+		case XM_CAN:
+			LOG_INFO("Transfer aborted\n");
+			return EOF;
 
-			case XM_CAN:
-				LOG_INFO("Transfer aborted\n");
-				return false;
+		default:
+			LOG_INFO("Skipping garbage\n");
+			break;
+		}
+	}
+}
+
+/*
+ * Wait for the acknowledge of a block.
+ * \return XM_ACK, XM_NAK to send it again, EOF to abort.
+ */
+static int xm_waitAck(KFile *ch)
+{
+	int retries = 0;
 
-			default:
-				LOG_INFO("Skipping garbage\n");
+	for (;;)
+	{
+		if (XMODEM_CHECK_ABORT)
+			return EOF;
+
+		switch (kfile_getc(ch))
+		{
+		case XM_ACK:
+			return XM_ACK;
+
+		/* The receiver may still be asking to start */
+		case XM_C:
+		case XM_G:
+		case XM_NAK:
+			return XM_NAK;
+
+		case EOF:
+			kfile_clearerr(ch);
+			if (++retries <= CONFIG_XMODEM_MAXRETRIES)
 				break;
-			}
-		} while (!proceed);
+			/* fall through */
+
+		case XM_CAN:
+			LOG_INFO("Transfer aborted\n");
+			return EOF;
+
+		default:
+			LOG_INFO("Skipping garbage\n");
+			break;
+		}
+	}
+}
+
+/*
+ * Send \a fd from block 1 up to the EOT.
+ * \param start request of the receiver, see xm_waitStart().
+ */
+static bool xm_sendFile(KFile *ch, KFile *fd, uint8_t *buf, int start)
+{
+	int blocknr = 1, c;
+	bool usecrc = (start != XM_NAK);
+	bool stream = (start == XM_G);
+	size_t size = kfile_read(fd, buf, XM_BUFSIZE);
 
+	for (;;)
+	{
 		if (!size)
 		{
 			kfile_putc(XM_EOT, ch);
+			c = xm_waitAck(ch);
+			if (c == XM_ACK)
+				return true;
+			if (c == EOF)
+				return false;
 			continue;
 		}
 
-		/* Pad block with 0xFF if it's partially full */
-		memset(block_buffer + size, 0xFF, XM_BUFSIZE - size);
-
-	/* Send block header (STX, blocknr, ~blocknr) */
-	#if XM_BUFSIZE == 128
-		kfile_putc(XM_SOH, ch);
-	#else
-		kfile_putc(XM_STX, ch);
-	#endif
-		kfile_putc(blocknr & 0xFF, ch);
-		kfile_putc(~blocknr & 0xFF, ch);
-
-		/* Send block and compute its CRC/checksum */
-		sum = 0;
-		crc = 0;
-		for (i = 0; i < XM_BUFSIZE; i++)
+		/* Use a short block for the tail of the file */
+		size_t blocksize = (size <= 128) ? 128 : XM_BUFSIZE;
+		LOG_INFO("Send blk %d\n", blocknr);
+		xm_sendBlock(ch, buf, size, blocksize, blocknr, usecrc);
+
+		if (!stream)
 		{
-			kfile_putc(block_buffer[i], ch);
-			crc = UPDCRC16(block_buffer[i], crc);
-			sum += block_buffer[i];
+			c = xm_waitAck(ch);
+			if (c == EOF)
+				return false;
+			if (c == XM_NAK)
+			{
+				LOG_INFO("Resend blk %d\n", blocknr);
+				continue;
+			}
 		}
 
-		/* Send CRC/Checksum */
-		if (usecrc)
+		/* Call user function to read in one block */
+		size = kfile_read(fd, buf, XM_BUFSIZE);
+		blocknr++;
+	}
+}
+
+/**
+ * \brief Transmit some data using the XModem protocol.
+ *
+ * \param ch Channel to use for transfer
+ * \param fd Source file
+ *
+ * \note This function allocates a large amount of stack for
+ *       the XModem transfer buffer (\see XM_BUFSIZE).
+ */
+bool xmodem_send(KFile *ch, KFile *fd)
+{
+	uint8_t block_buffer[XM_BLOCK_BUFSIZE]; /* Buffer to hold a block of data */
+	int start;
+
+	kfile_clearerr(ch);
+	start = xm_waitStart(ch, false);
+	if (start == EOF)
+		return false;
+
+	return xm_sendFile(ch, fd, block_buffer, start);
+}
+
+/**
+ * \brief Transmit a batch of files using the YModem protocol.
+ *
+ * Every file is preceded by a header with its name and size, the size
+ * of a KFile is its length from the current position.
+ * The transfer is streamed (YMODEM-G) if the receiver asks for it.
+ *
+ * \param ch Channel to use for transfer
+ * \param files Files to send
+ * \param cnt Number of files
+ *
+ * \note This function allocates a large amount of stack for
+ *       the XModem transfer buffer (\see XM_BUFSIZE).
+ */
+bool ymodem_send(KFile *ch, const YModemFile *files, size_t cnt)
+{
+	uint8_t block_buffer[XM_BLOCK_BUFSIZE];
+	int start, c;
+
+	kfile_clearerr(ch);
+
+	for (size_t i = 0; i <= cnt; i++)
+	{
+		/* Header: file name and size, empty after the last file */
+		memset(block_buffer, 0, 128);
+		if (i < cnt)
+		{
+			KFile *fd = files[i].fd;
+			size_t len = MIN(strlen(files[i].name), (size_t)100);
+			size_t size = (fd->size > fd->seek_pos) ? (size_t)(fd->size - fd->seek_pos) : 0;
+			char digits[10];
+			int n = 0;
+
+			memcpy(block_buffer, files[i].name, len);
+			len++;
+
+			do
+			{
+				digits[n++] = '0' + size % 10;
+				size /= 10;
+			} while (size && n < (int)sizeof(digits));
+
+			while (n)
+				block_buffer[len++] = digits[--n];
+		}
+
+		start = xm_waitStart(ch, true);
+		for (;;)
 		{
-			kfile_putc(crc >> 8, ch);
-			kfile_putc(crc & 0xFF, ch);
+			if (start == EOF)
+				return false;
+
+			xm_sendBlock(ch, block_buffer, 128, 128, 0, true);
+			/* Streaming receivers do not acknowledge the header */
+			if (start == XM_G && i < cnt)
+				break;
+
+			c = xm_waitAck(ch);
+			if (c == XM_ACK)
+				break;
+			if (c == EOF)
+				return false;
 		}
-		else
-			kfile_putc(sum, ch);
+
+		if (i == cnt)
+			break;
+
+		/* The receiver asks again to start the data */
+		start = xm_waitStart(ch, true);
+		if (start == EOF || !xm_sendFile(ch, files[i].fd, block_buffer, start))
+			return false;
 	}
+
+	LOG_INFO("Batch completed\n");
+	return true;
 }
 #endif
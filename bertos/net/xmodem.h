@@ -32,6 +32,10 @@
  * -->
  * \brief X-Modem serial transmission protocol.
  *
+ * XModem (checksum, CRC-16 and 1K blocks) and YModem batch transfers.
+ * YModem-G streams the blocks without waiting for acknowledges, which
+ * keeps high latency links busy, but needs an error free channel.
+ *
  * \author Bernie Innocenti <bernie@codewiz.org>
  * \author Francesco Sacchi <batt@develer.com>
  *
@@ -56,7 +60,30 @@
 #endif
 /*\}*/
 
+/**
+ * Called by ymodem_recv() for every file of a batch.
+ * \param name file name, valid only during the call.
+ * \param size file size, 0 if unknown.
+ * \return the file where to write the data, NULL to abort the transfer.
+ */
+typedef KFile *(*ymodem_open_t)(const char *name, size_t size);
+
+/**
+ * A file of a YModem batch.
+ */
+typedef struct YModemFile
+{
+	const char *name; ///< File name, sent in the header.
+	KFile *fd;        ///< Data, sent from the current position.
+} YModemFile;
+
 bool xmodem_recv(KFile *ch, KFile *fd);
 bool xmodem_send(KFile *ch, KFile *fd);
+bool ymodem_recv(KFile *ch, ymodem_open_t open, bool stream);
+bool ymodem_send(KFile *ch, const YModemFile *files, size_t cnt);
+
+int xmodem_testSetup(void);
+int xmodem_testRun(void);
+int xmodem_testTearDown(void);
 
 #endif /* NET_XMODEM_H */
@@ -0,0 +1,320 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2011 Develer S.r.l. (http://www.develer.com/)
+ * -->
+ *
+ *
+ * \brief XModem and YModem test.
+ *
+ * A process sends and the test receives, then the other way round,
+ * over a pair of kfile_fifo. A write after more than LINE_IDLE ms of
+ * silence starts a new transmission burst, which can be read only
+ * LINE_DELAY ms later, like a radio keying up: stop and wait transfers
+ * pay it twice for every block, streamed ones only at the start of
+ * each file.
+ *
+ * $test$: cp bertos/cfg/cfg_proc.h $cfgdir/
+ * $test$: echo  "#undef CONFIG_KERN" >> $cfgdir/cfg_proc.h
+ * $test$: echo "#define CONFIG_KERN 1" >> $cfgdir/cfg_proc.h
+ */
+
+#include "xmodem.h"
+
+#include <cfg/debug.h>
+#include <cfg/test.h>
+
+#include <drv/timer.h>
+
+#include <cpu/power.h>
+
+#include <kern/proc.h>
+
+#include <struct/fifobuf.h>
+#include <struct/kfile_fifo.h>
+#include <struct/kfile_mem.h>
+
+#include <string.h> //memcmp
+
+#define LINE_DELAY   20
+#define LINE_IDLE    8
+#define LINE_TIMEOUT 100
+
+#define FILE1_LEN 20000
+#define FILE2_LEN 100
+
+/*
+ * One direction of the line.
+ */
+typedef struct Wire
+{
+	FIFOBuffer fifo;
+	uint8_t buf[512];
+	KFileFifo kf;
+	ticks_t ready;  ///< Bytes can not be read before this time.
+	ticks_t last;   ///< Last write.
+} Wire;
+
+/*
+ * Line end, reading from a wire and writing to the other one.
+ */
+typedef struct Port
+{
+	KFile fd;
+	Wire *rx, *tx;
+} Port;
+
+static Wire wire_a, wire_b;
+static Port port_a, port_b;
+
+static uint8_t file1[FILE1_LEN], file2[FILE2_LEN];
+static uint8_t recv1[FILE1_LEN + 1024], recv2[FILE2_LEN + 1024];
+static KFileMem src1, src2, dst1, dst2;
+static size_t size1, size2;
+
+static PROC_DEFINE_STACK(peer_stack, KERN_MINSTACKSIZE * 2);
+static volatile bool peer_done;
+static volatile bool peer_ok;
+static bool stream;
+
+static size_t port_read(KFile *fd, void *_buf, size_t size)
+{
+	Port *p = (Port *)fd;
+	uint8_t *buf = (uint8_t *)_buf;
+	ticks_t start = timer_clock();
+	size_t n = 0;
+
+	while (n < size)
+	{
+		if (fifo_isempty(&p->rx->fifo) || timer_clock() - p->rx->ready < 0)
+		{
+			if (timer_clock() - start > ms_to_ticks(LINE_TIMEOUT))
+				break;
+			/* Let the peer run, a 1 ms delay is 0 ticks on the host */
+			cpu_relax();
+			continue;
+		}
+		n += kfile_read(&p->rx->kf.fd, buf + n, size - n);
+		start = timer_clock();
+	}
+	return n;
+}
+
+static size_t port_write(KFile *fd, const void *_buf, size_t size)
+{
+	Port *p = (Port *)fd;
+	const uint8_t *buf = (const uint8_t *)_buf;
+	size_t n = 0;
+
+	/* Key up the line if it has been idle for more than LINE_IDLE ms */
+	if (timer_clock() - p->tx->last > ms_to_ticks(LINE_IDLE))
+		p->tx->ready = timer_clock() + ms_to_ticks(LINE_DELAY);
+
+	while (n < size)
+	{
+		n += kfile_write(&p->tx->kf.fd, buf + n, size - n);
+		if (n < size)
+			cpu_relax();
+	}
+	p->tx->last = timer_clock();
+	return n;
+}
+
+static int port_error(UNUSED_ARG(KFile *, fd))
+{
+	return 0;
+}
+
+static void wire_init(Wire *w)
+{
+	fifo_init(&w->fifo, w->buf, sizeof(w->buf));
+	kfilefifo_init(&w->kf, &w->fifo);
+	/* The line starts idle: the first burst keys it up */
+	w->ready = timer_clock();
+	w->last = w->ready - ms_to_ticks(LINE_IDLE) - 1;
+}
+
+static void port_init(Port *p, Wire *rx, Wire *tx)
+{
+	kfile_init(&p->fd);
+	p->fd.read = port_read;
+	p->fd.write = port_write;
+	p->fd.error = port_error;
+	p->rx = rx;
+	p->tx = tx;
+}
+
+static void line_init(void)
+{
+	wire_init(&wire_a);
+	wire_init(&wire_b);
+	port_init(&port_a, &wire_a, &wire_b);
+	port_init(&port_b, &wire_b, &wire_a);
+
+	kfilemem_init(&src1, file1, sizeof(file1));
+	kfilemem_init(&src2, file2, sizeof(file2));
+	memset(recv1, 0, sizeof(recv1));
+	memset(recv2, 0, sizeof(recv2));
+	kfilemem_init(&dst1, recv1, sizeof(recv1));
+	kfilemem_init(&dst2, recv2, sizeof(recv2));
+	size1 = size2 = 0;
+}
+
+static KFile *open_file(const char *name, size_t size)
+{
+	if (!strcmp(name, "file1.bin"))
+	{
+		size1 = size;
+		return &dst1.fd;
+	}
+	if (!strcmp(name, "file2.txt"))
+	{
+		size2 = size;
+		return &dst2.fd;
+	}
+	return NULL;
+}
+
+static bool send_batch(KFile *ch)
+{
+	const YModemFile files[] = {
+		{ "file1.bin", &src1.fd },
+		{ "file2.txt", &src2.fd },
+	};
+
+	return ymodem_send(ch, files, countof(files));
+}
+
+static void xmodem_sender(void)
+{
+	peer_ok = xmodem_send(&port_b.fd, &src1.fd);
+	peer_done = true;
+}
+
+static void ymodem_sender(void)
+{
+	peer_ok = send_batch(&port_b.fd);
+	peer_done = true;
+}
+
+static void ymodem_receiver(void)
+{
+	peer_ok = ymodem_recv(&port_b.fd, open_file, stream);
+	peer_done = true;
+}
+
+static bool peer_wait(void)
+{
+	while (!peer_done)
+		timer_delay(10);
+	return peer_ok;
+}
+
+static void peer_start(void (*entry)(void))
+{
+	peer_done = false;
+	proc_new(entry, NULL, sizeof(peer_stack), peer_stack);
+}
+
+static bool check_batch(void)
+{
+	return size1 == FILE1_LEN && size2 == FILE2_LEN
+		&& !memcmp(recv1, file1, FILE1_LEN) && !memcmp(recv2, file2, FILE2_LEN)
+		&& recv1[FILE1_LEN] == 0 && recv2[FILE2_LEN] == 0;
+}
+
+static int xmodem_testXmodem(void)
+{
+	line_init();
+	peer_start(xmodem_sender);
+	ASSERT(xmodem_recv(&port_a.fd, &dst1.fd));
+	ASSERT(peer_wait());
+
+	/* Whole blocks, padded with 0xFF */
+	ASSERT(!memcmp(recv1, file1, FILE1_LEN));
+	ASSERT(recv1[FILE1_LEN] == 0xFF);
+	return 0;
+}
+
+static mtime_t xmodem_testYmodem(bool _stream)
+{
+	ticks_t start;
+
+	kprintf("YModem%s receive\n", _stream ? "-G" : "");
+	line_init();
+	start = timer_clock();
+	peer_start(ymodem_sender);
+	ASSERT(ymodem_recv(&port_a.fd, open_file, _stream));
+	ASSERT(peer_wait());
+	ASSERT(check_batch());
+
+	kprintf("YModem%s send\n", _stream ? "-G" : "");
+	line_init();
+	stream = _stream;
+	peer_start(ymodem_receiver);
+	ASSERT(send_batch(&port_a.fd));
+	ASSERT(peer_wait());
+	ASSERT(check_batch());
+
+	return ticks_to_ms(timer_clock() - start);
+}
+
+int xmodem_testSetup(void)
+{
+	kdbg_init();
+	timer_init();
+	proc_init();
+
+	for (size_t i = 0; i < sizeof(file1); i++)
+		file1[i] = i * 13 + (i >> 8);
+	for (size_t i = 0; i < sizeof(file2); i++)
+		file2[i] = 'a' + i % 26;
+	return 0;
+}
+
+int xmodem_testRun(void)
+{
+	mtime_t t_ack, t_stream;
+
+	if (xmodem_testXmodem())
+		return -1;
+
+	t_ack = xmodem_testYmodem(false);
+	t_stream = xmodem_testYmodem(true);
+	kprintf("YModem %ld ms, YModem-G %ld ms\n", (long)t_ack, (long)t_stream);
+	/* The acknowledges cost 2 * LINE_DELAY per block */
+	ASSERT(t_stream * 2 < t_ack);
+	return 0;
+}
+
+int xmodem_testTearDown(void)
+{
+	return 0;
+}
+
+TEST_MAIN(xmodem);
@@ -72,7 +72,11 @@
 
 #include <cpu/types.h>
 #include <cpu/irq.h>
+#include <cfg/compiler.h>
 #include <cfg/debug.h>
+#include <cfg/macros.h>
+
+#include <string.h> /* memcpy() */
 
 typedef struct FIFOBuffer
 {
@@ -206,6 +210,182 @@ INLINE void fifo_flush(FIFOBuffer *fb)
 	fb->head = fb->tail;
 }
 
+/**
+ * Push up to \a len bytes from \a block on the fifo buffer.
+ *
+ * The bytes are copied with at most two memcpy() calls and the tail
+ * pointer is moved after the data has been written, so a concurrent
+ * fifo_pop() never sees bytes that are not there yet.
+ *
+ * \note Like fifo_push(), this is safe against a concurrent consumer
+ *       only if the CPU can update a pointer atomically.
+ *
+ * \return number of bytes pushed, less than \a len if the fifo gets full.
+ *
+ * \sa fifo_pushblock_locked
+ */
+INLINE size_t fifo_pushblock(FIFOBuffer *fb, const unsigned char *block, size_t len)
+{
+	size_t count = 0;
+
+	while (count < len)
+	{
+		unsigned char *head = fb->head;
+		unsigned char *tail = fb->tail;
+		size_t chunk;
+
+		if (tail >= head)
+			/* Up to the end of the buffer, keeping a slot free before head */
+			chunk = fb->end - tail + (head != fb->begin);
+		else
+			chunk = head - tail - 1;
+		if (!chunk)
+			break;
+
+		chunk = MIN(chunk, len - count);
+		memcpy(tail, block + count, chunk);
+		count += chunk;
+
+		MEMORY_BARRIER;
+		if (tail + chunk > fb->end)
+			fb->tail = fb->begin;
+		else
+			fb->tail = tail + chunk;
+	}
+	return count;
+}
+
+/**
+ * Pop up to \a len bytes from the fifo buffer into \a block.
+ *
+ * \note Like fifo_pop(), this is safe against a concurrent producer
+ *       only if the CPU can update a pointer atomically.
+ *
+ * \return number of bytes popped, less than \a len if the fifo gets empty.
+ *
+ * \sa fifo_popblock_locked
+ */
+INLINE size_t fifo_popblock(FIFOBuffer *fb, unsigned char *block, size_t len)
+{
+	size_t count = 0;
+
+	while (count < len)
+	{
+		unsigned char *head = fb->head;
+		unsigned char *tail = fb->tail;
+		size_t chunk;
+
+		if (head <= tail)
+			chunk = tail - head;
+		else
+			/* Up to the end of the buffer */
+			chunk = fb->end - head + 1;
+		if (!chunk)
+			break;
+
+		chunk = MIN(chunk, len - count);
+		memcpy(block + count, head, chunk);
+		count += chunk;
+
+		MEMORY_BARRIER;
+		if (head + chunk > fb->end)
+			fb->head = fb->begin;
+		else
+			fb->head = head + chunk;
+	}
+	return count;
+}
+
+/**
+ * Return the number of bytes in the fifo buffer.
+ *
+ * \sa fifo_count_locked
+ */
+INLINE size_t fifo_count(const FIFOBuffer *fb)
+{
+	unsigned char *head = fb->head;
+	unsigned char *tail = fb->tail;
+
+	if (tail >= head)
+		return tail - head;
+	else
+		return (fb->end - head + 1) + (tail - fb->begin);
+}
+
+/**
+ * Return in \a data the head of the fifo buffer and the number of bytes
+ * that can be read from there without wrapping around.
+ *
+ * This lets a DMA transmitter read the data in place: the bytes stay
+ * in the fifo until they are released with fifo_skip().
+ *
+ * \return number of contiguous bytes at \a data, 0 if the fifo is empty.
+ */
+INLINE size_t fifo_peekblock(FIFOBuffer *fb, unsigned char **data)
+{
+	unsigned char *head = fb->head;
+	unsigned char *tail = fb->tail;
+
+	*data = head;
+	if (head <= tail)
+		return tail - head;
+	else
+		return fb->end - head + 1;
+}
+
+/**
+ * Discard \a len bytes from the head of the fifo buffer.
+ *
+ * \note \a len must not exceed the number of bytes in the fifo.
+ *
+ * \sa fifo_peekblock()
+ */
+INLINE void fifo_skip(FIFOBuffer *fb, size_t len)
+{
+	unsigned char *head = fb->head + len;
+
+	if (head > fb->end)
+		head -= fb->end - fb->begin + 1;
+	fb->head = head;
+}
+
+/**
+ * Move the tail of the fifo buffer to \a pos.
+ *
+ * This is meant for DMA receivers using the fifo memory as a circular
+ * buffer: \a pos is the address the DMA controller is going to write
+ * next, so all the bytes up to it become available to the reader.
+ * A \a pos one past the end of the buffer is the same as its beginning.
+ *
+ * Since the DMA controller can't know where the reader is, it may have
+ * overwritten data not yet popped: in that case the oldest bytes are
+ * dropped, leaving the fifo full of the most recent ones.
+ *
+ * \return true if no data has been lost, false on overrun.
+ */
+INLINE bool fifo_fillto(FIFOBuffer *fb, unsigned char *pos)
+{
+	size_t size = fb->end - fb->begin + 1;
+	unsigned char *head = fb->head;
+	unsigned char *tail = fb->tail;
+	size_t used, added;
+
+	if (pos > fb->end)
+		pos = fb->begin;
+
+	used = (tail >= head) ? (size_t)(tail - head) : (size_t)(tail - head) + size;
+	added = (pos >= tail) ? (size_t)(pos - tail) : (size_t)(pos - tail) + size;
+
+	MEMORY_BARRIER;
+	fb->tail = pos;
+	if (used + added >= size)
+	{
+		fb->head = (pos == fb->end) ? fb->begin : pos + 1;
+		return false;
+	}
+	return true;
+}
+
 #if CPU_REG_BITS >= CPU_BITS_PER_PTR
 
 	/*
@@ -216,6 +396,8 @@ INLINE void fifo_flush(FIFOBuffer *fb)
 	#define fifo_push_locked(fb, c) fifo_push((fb), (c))
 	#define fifo_pop_locked(fb)     fifo_pop((fb))
 	#define fifo_flush_locked(fb)   fifo_flush((fb))
+	#define fifo_pushblock_locked(fb, block, len) fifo_pushblock((fb), (block), (len))
+	#define fifo_count_locked(fb)                 fifo_count((fb))
 
 #else /* CPU_REG_BITS < CPU_BITS_PER_PTR */
 
@@ -268,8 +450,51 @@ INLINE void fifo_flush_locked(FIFOBuffer *fb)
 	ATOMIC(fifo_flush(fb));
 }
 
+/**
+	 * Similar to fifo_pushblock(), but the whole block is copied
+	 * in a single critical section.
+	 *
+	 * \sa fifo_pushblock()
+	 */
+INLINE size_t fifo_pushblock_locked(FIFOBuffer *fb, const unsigned char *block, size_t len)
+{
+	size_t count;
+	ATOMIC(count = fifo_pushblock(fb, block, len));
+	return count;
+}
+
+/**
+	 * Similar to fifo_count(), but with stronger guarantees for
+	 * concurrent access between user and interrupt code.
+	 *
+	 * \sa fifo_count()
+	 */
+INLINE size_t fifo_count_locked(const FIFOBuffer *fb)
+{
+	size_t count;
+	ATOMIC(count = fifo_count(fb));
+	return count;
+}
+
 #endif /* CPU_REG_BITS < BITS_PER_PTR */
 
+/**
+ * Similar to fifo_popblock(), but the whole block is copied
+ * in a single critical section.
+ *
+ * This is needed on every CPU: fifo_fillto() may move the head
+ * from interrupt context on overrun, and the copy must not read
+ * or release bytes the interrupt has already dropped.
+ *
+ * \sa fifo_popblock()
+ */
+INLINE size_t fifo_popblock_locked(FIFOBuffer *fb, unsigned char *block, size_t len)
+{
+	size_t count;
+	ATOMIC(count = fifo_popblock(fb, block, len));
+	return count;
+}
+
 /**
  * Thread safe version of fifo_isfull()
  */
@@ -300,63 +525,6 @@ INLINE size_t fifo_len(FIFOBuffer *fb)
 	return fb->end - fb->begin;
 }
 
-#if 0
-
-/*
- * UNTESTED: if uncommented, to be moved in fifobuf.c
- */
-void fifo_pushblock(FIFOBuffer *fb, unsigned char *block, size_t len)
-{
-	size_t freelen;
-
-	/* Se c'e' spazio da tail alla fine del buffer */
-	if (fb->tail >= fb->head)
-	{
-		freelen = fb->end - fb->tail + 1;
-
-		/* C'e' abbastanza spazio per scrivere tutto il blocco? */
-		if (freelen < len)
-		{
-			/* Scrivi quello che entra fino alla fine del buffer */
-			memcpy(fb->tail, block, freelen);
-			block += freelen;
-			len -= freelen;
-			fb->tail = fb->begin;
-		}
-		else
-		{
-			/* Scrivi tutto il blocco */
-			memcpy(fb->tail, block, len);
-			fb->tail += len;
-			return;
-		}
-	}
-
-	for(;;)
-	{
-		while (!(freelen = fb->head - fb->tail - 1))
-			Delay(FIFO_POLLDELAY);
-
-		/* C'e' abbastanza spazio per scrivere tutto il blocco? */
-		if (freelen < len)
-		{
-			/* Scrivi quello che entra fino alla fine del buffer */
-			memcpy(fb->tail, block, freelen);
-			block += freelen;
-			len -= freelen;
-			fb->tail += freelen;
-		}
-		else
-		{
-			/* Scrivi tutto il blocco */
-			memcpy(fb->tail, block, len);
-			fb->tail += len;
-			return;
-		}
-	}
-}
-#endif
-
 /** \} */ /* defgroup fifobuf */
 
 #endif /* STRUCT_FIFOBUF_H */
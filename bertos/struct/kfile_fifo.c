@@ -42,26 +42,18 @@
 
 #include <string.h>
 
-static size_t kfilefifo_read(struct KFile *_fd, void *_buf, size_t size)
+static size_t kfilefifo_read(struct KFile *_fd, void *buf, size_t size)
 {
 	KFileFifo *fd = KFILEFIFO_CAST(_fd);
-	uint8_t *buf = (uint8_t *)_buf;
 
-	while (size-- && !fifo_isempty_locked(fd->fifo))
-		*buf++ = fifo_pop_locked(fd->fifo);
-
-	return buf - (uint8_t *)_buf;
+	return fifo_popblock_locked(fd->fifo, (uint8_t *)buf, size);
 }
 
-static size_t kfilefifo_write(struct KFile *_fd, const void *_buf, size_t size)
+static size_t kfilefifo_write(struct KFile *_fd, const void *buf, size_t size)
 {
 	KFileFifo *fd = KFILEFIFO_CAST(_fd);
-	const uint8_t *buf = (const uint8_t *)_buf;
-
-	while (size-- && !fifo_isfull_locked(fd->fifo))
-		fifo_push_locked(fd->fifo, *buf++);
 
-	return buf - (const uint8_t *)_buf;
+	return fifo_pushblock_locked(fd->fifo, (const uint8_t *)buf, size);
 }
 
 void kfilefifo_init(KFileFifo *kf, FIFOBuffer *fifo)
@@ -134,6 +134,34 @@ int kfilefifo_testRun(void)
 	ASSERT(!fifo_isfull(&fifo));
 	ASSERT(fifo_isempty(&fifo));
 	ASSERT(kfile_getc(&kfifo.fd) == EOF);
+
+	/* Block copies must match byte operations across the wrap point */
+	for (int i = 0; i < FIFOBUF_LEN; i++)
+		test_buf[i] = i * 7;
+	for (size_t start = 1; start < FIFOBUF_LEN; start += 37)
+	{
+		uint8_t out[FIFOBUF_LEN];
+
+		fifo_flush(&fifo);
+		for (size_t i = 0; i < start; i++)
+			fifo_push(&fifo, 0);
+		for (size_t i = 0; i < start; i++)
+			fifo_pop(&fifo);
+
+		ASSERT(fifo_pushblock(&fifo, test_buf, FIFOBUF_LEN) == FIFOBUF_LEN - 1);
+		ASSERT(fifo_isfull(&fifo));
+		ASSERT(fifo_pushblock(&fifo, test_buf, 1) == 0);
+
+		ASSERT(fifo_popblock(&fifo, out, 10) == 10);
+		ASSERT(fifo_pushblock(&fifo, test_buf + FIFOBUF_LEN - 1, 10) == 10);
+		for (int i = 0; i < FIFOBUF_LEN - 11; i++)
+			ASSERT(fifo_pop(&fifo) == test_buf[i + 10]);
+		ASSERT(fifo_popblock(&fifo, out, FIFOBUF_LEN) == 10);
+		for (int i = 0; i < 10; i++)
+			ASSERT(out[i] == test_buf[(FIFOBUF_LEN - 1 + i) % FIFOBUF_LEN]);
+		ASSERT(fifo_isempty(&fifo));
+		ASSERT(fifo_popblock(&fifo, out, 1) == 0);
+	}
 	return 0;
 }
 
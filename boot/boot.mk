@@ -20,6 +20,7 @@ boot_HW_PATH = boot/hw
 # Files automatically generated by the wizard. DO NOT EDIT, USE boot_USER_CSRC INSTEAD!
 boot_WIZARD_CSRC = \
 	bertos/algo/crc_ccitt.c \
+	bertos/algo/crc32.c \
 	bertos/mware/event.c \
 	bertos/drv/eeprom.c \
 	bertos/io/kfile.c \
@@ -38,7 +39,10 @@ boot_WIZARD_CSRC = \
 	bertos/cpu/cortex-m3/hw/switch_ctx_cm3.c \
 	bertos/cpu/cortex-m3/drv/eth_stm32.c \
 	bertos/cpu/cortex-m3/drv/flash_stm32.c \
+	bertos/cpu/cortex-m3/drv/crc32_stm32.c \
 	bertos/net/tftp.c \
+	bertos/sec/hash/sha1.c \
+	bertos/sec/mac/hmac.c \
 	$(LWIP_BERTOS_FILES) \
 	#
 
@@ -10,8 +10,8 @@ boot_PROGRAMMER_PORT = none
 # Files included by the user.
 boot_USER_CSRC = \
     $(boot_SRC_PATH)/main.c \
-    $(boot_SRC_PATH)/crc32.c \
     $(boot_SRC_PATH)/telnet.c \
+    $(boot_SRC_PATH)/fwcheck.c \
     common/heartbeat.c \
     common/state.c \
     common/mac.c \
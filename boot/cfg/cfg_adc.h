@@ -102,6 +102,30 @@
  */
 #define CONFIG_ADC_AVR_DIVISOR 2
 
+/**
+ * Enable continuous multi-channel scanning (adc_scanStart()).
+ *
+ * Conversions run in background and are stored by DMA (or by the
+ * sequencer ISR when no DMA is available) in a double buffered ring.
+ *
+ * $WIZ$ type = "boolean"
+ * $WIZ$ supports = "stm32 or lm3s"
+ */
+#define CONFIG_ADC_SCAN 0
+
+/**
+ * Hardware oversampling while scanning, as a power of two (0 = off, 6 = 64x).
+ *
+ * The sequencer averages the conversions before storing them in the FIFO,
+ * reducing the interrupt rate of the scan by the same factor.
+ *
+ * $WIZ$ type = "int"
+ * $WIZ$ min = 0
+ * $WIZ$ max = 6
+ * $WIZ$ supports = "lm3s"
+ */
+#define CONFIG_ADC_SCAN_HW_AVG 6
+
 /**
  * Enable ADC strobe for debugging ADC ISR.
  *
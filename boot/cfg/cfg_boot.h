@@ -1,2 +1,13 @@
 #define BOOT_LOG_LEVEL  LOG_LVL_INFO
 #define BOOT_LOG_FORMAT LOG_FMT_VERBOSE
+
+/**
+ * Check an HMAC-SHA1 signature appended to the firmware image, besides
+ * the CRC. The key is BOOT_HMAC_KEY in hw/hw_boot.h, sign the image with
+ * create-firmware-header.py passing the same key.
+ * Needs the sha1 and hmac modules (bertos/sec/hash/sha1.c,
+ * bertos/sec/mac/hmac.c) in the build.
+ *
+ * $WIZ$ type = "boolean"
+ */
+#define CONFIG_BOOT_HMAC 0
@@ -17,4 +17,34 @@
  */
 #define TFTP_LOG_FORMAT LOG_FMT_VERBOSE
 
+/**
+ * Max block size accepted with the blksize option (RFC 2348), in bytes.
+ * 1468 is the largest block fitting an Ethernet frame; every session
+ * keeps a block in RAM.
+ *
+ * $WIZ$ type = "int"
+ * $WIZ$ min = 512
+ * $WIZ$ max = 65464
+ */
+#define CONFIG_TFTP_BLKSIZE 1468
+
+/**
+ * Max blocks the client sends before waiting for an acknowledge,
+ * accepted with the windowsize option (RFC 7440).
+ *
+ * $WIZ$ type = "int"
+ * $WIZ$ min = 1
+ * $WIZ$ max = 65535
+ */
+#define CONFIG_TFTP_WINDOWSIZE 16
+
+/**
+ * Acknowledges sent again while waiting for data, before giving up.
+ * They are spread over the session timeout.
+ *
+ * $WIZ$ type = "int"
+ * $WIZ$ min = 0
+ */
+#define CONFIG_TFTP_RETRIES 4
+
 #endif /* CFG_TFTP_H */
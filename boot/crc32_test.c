@@ -1,6 +1,7 @@
-#include "crc32.h"
 #include "tftp.h"
 
+#include <algo/crc32.h>
+
 #include <cfg/debug.h>
 #include <cfg/test.h>
 #include <stdio.h>
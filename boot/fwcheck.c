@@ -0,0 +1,114 @@
+#include "fwcheck.h"
+
+#define LOG_LEVEL  BOOT_LOG_LEVEL
+#define LOG_FORMAT BOOT_LOG_FORMAT
+#include <cfg/log.h>
+
+#include <cfg/macros.h>
+#include <algo/crc32.h>
+
+#include <string.h>
+
+void fwCheckInit(FwCheck *c, const FwCheckCfg *cfg)
+{
+	memset(c, 0, sizeof(*c));
+	c->cfg = cfg;
+	for (int i = 0; i < FW_TAG_CNT; i++)
+		c->crc[i] = crc32(cfg->tags[i], strlen(cfg->tags[i]), 0);
+#if CONFIG_BOOT_HMAC
+	SHA1_init(&c->sha1);
+	hmac_init(&c->hmac, &c->sha1.h);
+	mac_set_key(&c->hmac.m, cfg->key, cfg->key_len);
+	mac_begin(&c->hmac.m);
+#endif
+}
+
+void fwCheckUpdate(FwCheck *c, const uint8_t *data, size_t len)
+{
+	while (len && c->pos < FW_HDR_SIZE)
+	{
+		c->hdr[c->pos++] = *data++;
+		len--;
+#if CONFIG_BOOT_HMAC
+		mac_update(&c->hmac.m, data - 1, 1);
+#endif
+		if (c->pos == FW_HDR_SIZE)
+		{
+			memcpy(&c->size, c->hdr, sizeof(c->size));
+			memcpy(&c->crc_check, c->hdr + sizeof(c->size), sizeof(c->crc_check));
+			LOG_INFO("Firmware size: %lu, crc: %08lx\n", (unsigned long)c->size, (unsigned long)c->crc_check);
+		}
+	}
+
+	size_t img_end = FW_HDR_SIZE + (size_t)c->size;
+	if (len && c->pos < img_end)
+	{
+		size_t bytes = MIN(len, img_end - c->pos);
+		for (int i = 0; i < FW_TAG_CNT; i++)
+			c->crc[i] = crc32(data, bytes, c->crc[i]);
+#if CONFIG_BOOT_HMAC
+		mac_update(&c->hmac.m, data, bytes);
+#endif
+		c->pos += bytes;
+		data += bytes;
+		len -= bytes;
+	}
+
+#if CONFIG_BOOT_HMAC
+	while (len && c->pos < img_end + FW_SIG_SIZE)
+	{
+		c->sig[c->pos++ - img_end] = *data++;
+		len--;
+	}
+#endif
+	/* Anything after the image is ignored */
+}
+
+bool fwCheckSizeOk(FwCheck *c)
+{
+	// If memory is not initialized, size is bogus.
+	if (c->pos < FW_HDR_SIZE || c->size > c->cfg->max_size || c->size < c->cfg->min_size)
+	{
+		LOG_ERR("Wrong fw size %lu\n", (unsigned long)c->size);
+		return false;
+	}
+	return true;
+}
+
+bool fwCheckOk(FwCheck *c)
+{
+	if (!fwCheckSizeOk(c))
+		return false;
+
+	if (c->pos < FW_HDR_SIZE + c->size + FW_SIG_SIZE)
+	{
+		LOG_ERR("Firmware truncated, %zu bytes\n", c->pos);
+		return false;
+	}
+
+	bool crc_ok = false;
+	for (int i = 0; i < FW_TAG_CNT; i++)
+	{
+		LOG_INFO("Computed CRC(%s): %08lx\n", c->cfg->tags[i], (unsigned long)c->crc[i]);
+		if (c->crc[i] == c->crc_check)
+			crc_ok = true;
+	}
+	if (!crc_ok)
+		return false;
+	LOG_INFO("CRC check ok, firmware_bytes: %lu\n", (unsigned long)c->size);
+
+#if CONFIG_BOOT_HMAC
+	// Compare the whole signature, without leaking where it differs
+	const uint8_t *sig = mac_final(&c->hmac.m);
+	uint8_t diff = 0;
+	for (size_t i = 0; i < FW_SIG_SIZE; i++)
+		diff |= sig[i] ^ c->sig[i];
+	if (diff)
+	{
+		LOG_ERR("Firmware signature mismatch\n");
+		return false;
+	}
+	LOG_INFO("Signature check ok\n");
+#endif
+	return true;
+}
@@ -0,0 +1,63 @@
+#ifndef FWCHECK_H
+#define FWCHECK_H
+
+#include "cfg/cfg_boot.h"
+
+#include <cfg/compiler.h>
+#if CONFIG_BOOT_HMAC
+	#include <sec/hash/sha1.h>
+	#include <sec/mac/hmac.h>
+#endif
+
+/*
+ * Firmware image layout: size and CRC, then the image, then the
+ * HMAC-SHA1 of all the previous bytes if CONFIG_BOOT_HMAC is enabled.
+ * The CRC is computed over the board tag followed by the image.
+ */
+#define FW_HDR_SIZE 8
+#if CONFIG_BOOT_HMAC
+	#define FW_SIG_SIZE 20
+#else
+	#define FW_SIG_SIZE 0
+#endif
+
+/* Number of tags accepted as CRC seed */
+#define FW_TAG_CNT 3
+
+/*
+ * What a firmware image is checked against.
+ */
+typedef struct FwCheckCfg
+{
+	const char *tags[FW_TAG_CNT]; ///< The image is accepted if its CRC is seeded with any of these.
+	uint32_t min_size;
+	uint32_t max_size;
+	const uint8_t *key;           ///< HMAC key, unused if CONFIG_BOOT_HMAC is disabled.
+	size_t key_len;
+} FwCheckCfg;
+
+/*
+ * Incremental firmware check, fed with the image as it is received
+ * or read back from flash.
+ */
+typedef struct FwCheck
+{
+	const FwCheckCfg *cfg;
+	uint8_t hdr[FW_HDR_SIZE];
+	uint32_t size;
+	uint32_t crc_check;
+	size_t pos; ///< Bytes checked so far, header included.
+	uint32_t crc[FW_TAG_CNT];
+#if CONFIG_BOOT_HMAC
+	SHA1_Context sha1;
+	HmacContext hmac;
+	uint8_t sig[FW_SIG_SIZE];
+#endif
+} FwCheck;
+
+void fwCheckInit(FwCheck *c, const FwCheckCfg *cfg);
+void fwCheckUpdate(FwCheck *c, const uint8_t *data, size_t len);
+bool fwCheckSizeOk(FwCheck *c);
+bool fwCheckOk(FwCheck *c);
+
+#endif // FWCHECK_H
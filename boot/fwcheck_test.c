@@ -0,0 +1,150 @@
+/*
+ * Check firmware images fed in chunks of different sizes, with the
+ * right and wrong board tag, signed with the right and wrong key, and
+ * truncated at every part of the layout.
+ * Build it with CONFIG_BOOT_HMAC enabled and disabled, linking
+ * algo/crc32.c and, for the former, sec/hash/sha1.c and sec/mac/hmac.c.
+ */
+#include "fwcheck.h"
+
+#include <algo/crc32.h>
+
+#include <cfg/debug.h>
+#include <cfg/macros.h>
+#include <cfg/test.h>
+
+#include <string.h>
+
+#define IMAGE_SIZE 10000
+#define FILE_SIZE  (FW_HDR_SIZE + IMAGE_SIZE + FW_SIG_SIZE)
+
+static const uint8_t key[] = "bertos-boot-key";
+static const uint8_t wrong_key[] = "bertos-boot-kez";
+
+static const FwCheckCfg fw_cfg =
+{
+	.tags = { "kk348", "kk354", "kk0000" },
+	.min_size = 8192,
+	.max_size = 65536,
+	.key = key,
+	.key_len = sizeof(key) - 1,
+};
+
+/* Room for some trailing garbage, the flash is read beyond the image */
+static uint8_t image[FILE_SIZE + 64];
+static uint32_t seed = 1;
+
+static unsigned rnd(unsigned n)
+{
+	seed = seed * 1103515245UL + 12345;
+	return (seed >> 16) % n;
+}
+
+/*
+ * Build an image with the CRC seeded by \a tag, signed with \a k.
+ */
+static void makeImage(uint32_t size, const char *tag, const uint8_t *k, size_t klen)
+{
+	for (size_t i = FW_HDR_SIZE; i < sizeof(image); i++)
+		image[i] = rnd(256);
+
+	uint32_t crc = crc32(tag, strlen(tag), 0);
+	crc = crc32(image + FW_HDR_SIZE, size, crc);
+	memcpy(image, &size, sizeof(size));
+	memcpy(image + sizeof(size), &crc, sizeof(crc));
+
+#if CONFIG_BOOT_HMAC
+	SHA1_Context sha1;
+	HmacContext hmac;
+	SHA1_init(&sha1);
+	hmac_init(&hmac, &sha1.h);
+	mac_set_key(&hmac.m, k, klen);
+	mac_begin(&hmac.m);
+	mac_update(&hmac.m, image, FW_HDR_SIZE + size);
+	memcpy(image + FW_HDR_SIZE + size, mac_final(&hmac.m), FW_SIG_SIZE);
+#else
+	(void)k;
+	(void)klen;
+#endif
+}
+
+/*
+ * Feed the first \a len bytes of the image in chunks of \a chunk bytes.
+ */
+static bool check(size_t len, size_t chunk)
+{
+	FwCheck c;
+	fwCheckInit(&c, &fw_cfg);
+	for (size_t pos = 0; pos < len; pos += chunk)
+		fwCheckUpdate(&c, image + pos, MIN(chunk, len - pos));
+	return fwCheckOk(&c);
+}
+
+static const size_t chunks[] = { 1, 3, 7, 8, 20, 512, 1024, 4096, sizeof(image) };
+
+int fwcheck_testSetup(void)
+{
+	kdbg_init();
+	return 0;
+}
+
+int fwcheck_testTearDown(void)
+{
+	return 0;
+}
+
+int fwcheck_testRun(void)
+{
+	/* Every accepted tag, whatever the chunk size, garbage after the image ignored */
+	for (int t = 0; t < FW_TAG_CNT; t++)
+	{
+		makeImage(IMAGE_SIZE, fw_cfg.tags[t], key, sizeof(key) - 1);
+		for (size_t i = 0; i < countof(chunks); i++)
+		{
+			ASSERT(check(FILE_SIZE, chunks[i]));
+			ASSERT(check(sizeof(image), chunks[i]));
+		}
+	}
+
+	/* Smallest and biggest image allowed, and just outside */
+	makeImage(fw_cfg.min_size, fw_cfg.tags[1], key, sizeof(key) - 1);
+	ASSERT(check(sizeof(image), 512));
+	makeImage(fw_cfg.min_size - 1, fw_cfg.tags[1], key, sizeof(key) - 1);
+	ASSERT(!check(sizeof(image), 512));
+
+	/* Wrong tag */
+	makeImage(IMAGE_SIZE, "kk353", key, sizeof(key) - 1);
+	for (size_t i = 0; i < countof(chunks); i++)
+		ASSERT(!check(FILE_SIZE, chunks[i]));
+
+#if CONFIG_BOOT_HMAC
+	/* Wrong key, the CRC alone is fine */
+	makeImage(IMAGE_SIZE, fw_cfg.tags[1], wrong_key, sizeof(wrong_key) - 1);
+	for (size_t i = 0; i < countof(chunks); i++)
+		ASSERT(!check(FILE_SIZE, chunks[i]));
+
+	/* Right key, every single bit of the signature flipped */
+	makeImage(IMAGE_SIZE, fw_cfg.tags[1], key, sizeof(key) - 1);
+	for (size_t i = FW_HDR_SIZE + IMAGE_SIZE; i < FILE_SIZE; i++)
+		for (int bit = 0; bit < 8; bit++)
+		{
+			image[i] ^= BV(bit);
+			ASSERT(!check(FILE_SIZE, 1024));
+			image[i] ^= BV(bit);
+		}
+	ASSERT(check(FILE_SIZE, 1024));
+#else
+	(void)wrong_key;
+#endif
+
+	/* Truncated in the header, in the image and in the signature */
+	makeImage(IMAGE_SIZE, fw_cfg.tags[1], key, sizeof(key) - 1);
+	for (size_t len = 0; len < FILE_SIZE; len += (len < FW_HDR_SIZE || len > FILE_SIZE - 32) ? 1 : 997)
+		for (size_t i = 0; i < countof(chunks); i++)
+			ASSERT(!check(len, chunks[i]));
+	ASSERT(check(FILE_SIZE, 1));
+
+	return 0;
+}
+
+TEST_MAIN(fwcheck);
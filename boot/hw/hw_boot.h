@@ -8,4 +8,7 @@
 #define MAX_FIRMWARE_SIZE ((F_SIZE * 1024) - FLASH_BOOT_SIZE)
 #define MIN_FIRMWARE_SIZE 8192
 
+/* Firmware signature key, used when CONFIG_BOOT_HMAC is enabled */
+#define BOOT_HMAC_KEY "bertos-boot-key"
+
 #endif //HW_BOOT_H
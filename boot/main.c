@@ -2,7 +2,6 @@
 #include "hw/hw_boot.h"
 #include "hw/hw_eth.h"
 #include "hw/hw_led.h"
-#include "crc32.h"
 #include "common/mac.h"
 #include "common/board_id.h"
 #include "common/ip.h"
@@ -12,6 +11,7 @@
 #include "verstag.h"
 
 #include "telnet.h"
+#include "fwcheck.h"
 #include "common/heartbeat.h"
 #include "common/eth_cfg.h"
 
@@ -22,6 +22,7 @@
 #include <cfg/debug.h>
 #include <cpu/irq.h>
 #include <kern/proc.h>
+#include <kern/signal.h>
 #include <drv/timer.h>
 #include <drv/i2c.h>
 #include <drv/eeprom.h>
@@ -53,6 +54,7 @@ static uint8_t buf[sizeof(Tftpframe)];
 static Process *telnet_proc = NULL;
 PROC_DEFINE_STACK(telnet_stack, KERN_MINSTACKSIZE * 3);
 PROC_DEFINE_STACK(heartbeat_stack, KERN_MINSTACKSIZE * 3);
+PROC_DEFINE_STACK(writer_stack, KERN_MINSTACKSIZE * 3);
 
 void (*rom_start)(void) NORETURN;
 #define START_APP() rom_start()
@@ -111,6 +113,9 @@ STATIC_ASSERT(BOARD_CNT == countof(boot_cfg));
 #define EEPROM_TYPE    EEPROM_24XX128
 
 static const BootCfg *cfg;
+static FwCheckCfg fw_cfg;
+static FwCheck fw_check;
+
 static void init(void)
 {
 	IRQ_ENABLE;
@@ -132,6 +137,15 @@ static void init(void)
 		cfg = &boot_cfg[BOARD_DEFAULT];
 	}
 
+	/* We accept the kk348 tag for backward compatibility for already produced boards */
+	fw_cfg.tags[0] = boot_cfg[KK348_ID].tag;
+	fw_cfg.tags[1] = cfg->tag;
+	fw_cfg.tags[2] = DEF_BOOT_TAG;
+	fw_cfg.min_size = MIN_FIRMWARE_SIZE;
+	fw_cfg.max_size = MAX_FIRMWARE_SIZE;
+	fw_cfg.key = (const uint8_t *)BOOT_HMAC_KEY;
+	fw_cfg.key_len = sizeof(BOOT_HMAC_KEY) - 1;
+
 	eth_init(&system_ethConfig()->eth_cfg->e);
 
 	MacAddress mac;
@@ -180,11 +194,48 @@ static void init(void)
 	LOG_INFO("Init complete\n");
 }
 
+/*
+ * Flash writer process.
+ *
+ * The receiver fills a buffer while the other one is written, so flash
+ * erase and programming, which yield the CPU while busy, overlap with the
+ * TFTP transfer.
+ */
+#define RECV_BUF_SIZE 1024
+#define SIG_BUF_FULL  SIG_USER0 ///< Sent to the writer, a buffer is ready.
+#define SIG_BUF_FREE  SIG_USER1 ///< Sent to the receiver, the buffer was written.
+
+typedef struct FwBuffer
+{
+	uint8_t data[RECV_BUF_SIZE];
+	size_t len;
+} FwBuffer;
+
+static FwBuffer fw_buf[2];
+static KFile *writer_fd;
+static Process *writer_proc;
+static Process *recv_proc;
+static bool writer_error;
+
+static void NORETURN writer_entry(void)
+{
+	int idx = 0;
+
+	while (1)
+	{
+		sig_wait(SIG_BUF_FULL);
+		FwBuffer *b = &fw_buf[idx];
+		if (kfile_write(writer_fd, b->data, b->len) != b->len)
+			writer_error = true;
+		idx ^= 1;
+		sig_send(recv_proc, SIG_BUF_FREE);
+	}
+}
+
 static char filename[100];
-static uint8_t recv_buf[300];
 /*
- * Receive and write the firmware to flash.
- * \return true if successful, false otherwise
+ * Receive and write the firmware to flash, checking it on the fly.
+ * \return true if the firmware was received and checked ok, false otherwise
  */
 static bool receiveFirmware(TftpSession *ctx, KFile *fp)
 {
@@ -213,31 +264,56 @@ static bool receiveFirmware(TftpSession *ctx, KFile *fp)
 			return false;
 		}
 
+		fwCheckInit(&fw_check, &fw_cfg);
+		writer_fd = fp;
+		writer_error = false;
+		recv_proc = proc_current();
+
 		size_t rd = 0;
+		int idx = 0;
+		bool pending = false;
+		bool ok = true;
 		do
 		{
-			rd = kfile_read(tftp, recv_buf, sizeof(recv_buf));
+			FwBuffer *b = &fw_buf[idx];
+			rd = kfile_read(tftp, b->data, sizeof(b->data));
 			if (kfile_error(tftp))
 			{
 				LOG_WARN("Error while reading from Tftp, code: %d\n", kfile_error(tftp));
-				return false;
+				ok = false;
+				break;
 			}
+			fwCheckUpdate(&fw_check, b->data, rd);
 
-			size_t bytes = kfile_write(fp, recv_buf, rd);
-			if (bytes != rd)
+			/* Wait for the other buffer to be written before handing over this one */
+			if (pending)
+				sig_wait(SIG_BUF_FREE);
+			if (writer_error)
 			{
-				LOG_ERR("Error writing to flash memory, error code: %d\n", kfile_error(fp));
-				tftp_setErrorMsg(ctx, "Error writing to flash");
-				kfile_close(tftp);
-				return false;
+				pending = false;
+				break;
 			}
-#if 0
-			else
-				LOG_INFO("Written %zd bytes\n", bytes);
-#endif
-		} while (rd == sizeof(recv_buf));
+			b->len = rd;
+			sig_send(writer_proc, SIG_BUF_FULL);
+			pending = true;
+			idx ^= 1;
+		} while (rd == sizeof(fw_buf[0].data));
+
+		if (pending)
+			sig_wait(SIG_BUF_FREE);
+
+		if (writer_error)
+		{
+			LOG_ERR("Error writing to flash memory, error code: %d\n", kfile_error(fp));
+			tftp_setErrorMsg(ctx, "Error writing to flash");
+			kfile_close(tftp);
+			return false;
+		}
+		if (!ok)
+			return false;
+
 		kfile_flush(fp);
-		return true;
+		return fwCheckOk(&fw_check);
 	}
 
 	if (ctx->error != TFTP_ERR_TIMEOUT)
@@ -246,53 +322,30 @@ static bool receiveFirmware(TftpSession *ctx, KFile *fp)
 	return false;
 }
 
+/*
+ * Check the firmware already in flash, when no new one is received.
+ */
 static bool crcCheckOk(KFile *fd)
 {
 	kfile_seek(fd, 0, KSM_SEEK_SET);
-	// read firmware size and crc from firmware
-	// If memory is not initialized, size is bogus. Clamp max value.
-	size_t size;
-	uint32_t crc_check;
+	fwCheckInit(&fw_check, &fw_cfg);
 
-	size_t rd = kfile_read(fd, &size, sizeof(size_t));
-	rd += kfile_read(fd, &crc_check, sizeof(uint32_t));
-	LOG_INFO("CRC read with kfile, size: %zu, crc: %08lx\n", size, crc_check);
-
-	ASSERT(rd == 8);
-	if (size > MAX_FIRMWARE_SIZE || size < MIN_FIRMWARE_SIZE)
-	{
-		LOG_ERR("Wrong fw size %zu\n", size);
+	size_t rd = kfile_read(fd, buf, FW_HDR_SIZE);
+	ASSERT(rd == FW_HDR_SIZE);
+	fwCheckUpdate(&fw_check, buf, rd);
+	if (!fwCheckSizeOk(&fw_check))
 		return false;
-	}
-
-	uint32_t crc_old = 0;
-	uint32_t crc_actual = 0;
-	uint32_t crc_all = 0;
-
-	crc_old = crc32(boot_cfg[KK348_ID].tag, strlen(boot_cfg[KK348_ID].tag), crc_old);
-	crc_actual = crc32(cfg->tag, strlen(cfg->tag), crc_actual);
-	crc_all = crc32(DEF_BOOT_TAG, strlen(DEF_BOOT_TAG), crc_all);
 
-	size_t flash_bytes = 0;
+	size_t size = fw_check.size + FW_SIG_SIZE;
 	while (size > 0)
 	{
 		size_t bytes = MIN(size, sizeof(buf));
 		rd = kfile_read(fd, buf, bytes);
 		ASSERT(rd == bytes);
-		flash_bytes += rd;
-		crc_old = crc32(buf, rd, crc_old);
-		crc_actual = crc32(buf, rd, crc_actual);
-		crc_all = crc32(buf, rd, crc_all);
+		fwCheckUpdate(&fw_check, buf, rd);
 		size -= rd;
 	}
-	LOG_INFO("Computed CRC(%s): %08lx, CRC(%s): %08lx, CRC(" DEF_BOOT_TAG "): %08lx, firmware_bytes: %zd\n", boot_cfg[KK348_ID].tag, crc_old, cfg->tag, crc_actual, crc_all, flash_bytes);
-
-	if (crc_old == crc_check || crc_actual == crc_check || crc_all == crc_check)
-	{
-		LOG_INFO("CRC check ok\n");
-		return true;
-	}
-	return false;
+	return fwCheckOk(&fw_check);
 }
 
 int main(void)
@@ -325,12 +378,16 @@ int main(void)
 #endif
 
 	proc_new(heartbeat_proc, 0, sizeof(heartbeat_stack), heartbeat_stack);
+	writer_proc = proc_new(writer_entry, NULL, sizeof(writer_stack), writer_stack);
 	/* start tftp server */
 	tftp_init(&server, TFTP_SERVER_PORT, RECV_TIMEOUT);
 
-	bool ret = receiveFirmware(&server, &flash.fd);
-	if (ret)
+	/* A received firmware is checked while it is written */
+	if (receiveFirmware(&server, &flash.fd))
+	{
 		LOG_INFO("Firmware transfer ok\n");
+		goto end;
+	}
 
 	LOG_INFO("CRC check on firmware before jump...\n");
 	if (crcCheckOk(&flash.fd))
@@ -340,13 +397,10 @@ int main(void)
 	LOG_INFO("CRC check failed, waiting for new firmware\n");
 	telnet_proc = proc_new(telnet_entry, NULL, sizeof(telnet_stack), telnet_stack);
 
-	do
+	while (!receiveFirmware(&server, &flash.fd))
 	{
-		while (!receiveFirmware(&server, &flash.fd))
-		{
-			LOG_INFO("Error receiving firmware, retrying...\n");
-		}
-	} while (!crcCheckOk(&flash.fd));
+		LOG_INFO("Error receiving firmware, retrying...\n");
+	}
 
 end:
 	/* load traget address from reset vector (4 bytes offset, 8 bytes length + CRC) */
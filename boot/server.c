@@ -6,17 +6,23 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>    // bool
+#include <strings.h>    // strcasecmp
+#include <stdint.h>     // int16_t
 #include <sys/select.h> // select
 
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 
 #define SERVER_PORT 6969
-#define SIZE        516
+#define BLKSIZE     1468 // max block size accepted with the blksize option
+#define WINDOWSIZE  16   // max window accepted with the windowsize option
+#define RETRIES     4    // ACKs sent again on timeout
+#define SIZE        (BLKSIZE + 4)
 // tftp opcodes
 #define TFTP_RRQ  0x0100 /* TFTP read request packet (already in net endianess). */
 #define TFTP_WRQ  0x0200 /* TFTP write request packet (already in net endianess). */
 #define TFTP_DATA 03     /* TFTP data packet. */
 #define TFTP_ACK  0x0400 /* TFTP acknowledgement packet (already in net endianess). */
+#define TFTP_OACK 0x0600 /* TFTP option acknowledgement packet (already in net endianess). */
 
 #define TFTP_ERR_TIMEOUT -2
 #define TFTP_ERR         -1
@@ -75,7 +81,7 @@ typedef struct __attribute__((__packed__)) Tftpframe
 		short tu_code;    /* error code */
 		char tu_stuff[1]; /* request packet stuff */
 	} th_u;
-	char th_data[512]; /* data or error string */
+	char th_data[BLKSIZE]; /* data or error string */
 } Tftpframe;
 
 struct __attribute__((__packed__)) ackframe
@@ -90,6 +96,11 @@ typedef struct TftpSession
 	socklen_t addr_len;
 	int sock;
 	unsigned short block;
+	size_t blksize;
+	unsigned short windowsize;
+	unsigned short window_cnt; // blocks received since the last ACK
+	bool oack;                 // answer the WRQ with an OACK
+	bool resync;               // an ACK was sent after a lost block
 } TftpSession;
 
 /*
@@ -136,15 +147,86 @@ static int tftp_serverInit(TftpSession *ctx, unsigned short port)
 	return 0;
 }
 
+/*
+ * ACK the last block received in sequence, or the WRQ with an OACK if
+ * options were accepted.
+ */
+static int tftp_sendAck(TftpSession *ctx)
+{
+	char buf[64];
+	size_t len;
+
+	if (ctx->block == 0 && ctx->oack)
+	{
+		short opcode = TFTP_OACK;
+		memcpy(buf, &opcode, sizeof(opcode));
+		len = sizeof(opcode);
+		if (ctx->blksize != 512)
+			len += sprintf(buf + len, "blksize%c%zu", 0, ctx->blksize) + 1;
+		if (ctx->windowsize != 1)
+			len += sprintf(buf + len, "windowsize%c%hu", 0, ctx->windowsize) + 1;
+	}
+	else
+	{
+		struct ackframe *ack = (struct ackframe *)buf;
+		ack->opcode = TFTP_ACK;
+		ack->block_num = htons(ctx->block);
+		len = sizeof(*ack);
+	}
+
+	if (sendto(ctx->sock, buf, len, 0, (struct sockaddr *)&ctx->addr, ctx->addr_len) == (ssize_t)len)
+		return 0;
+	return -1;
+}
+
+/*
+ * Parse blksize (RFC 2348) and windowsize (RFC 7440) options after
+ * file name and mode, lowering them to the values we support.
+ */
+static void parseOptions(TftpSession *ctx, const char *opt, const char *end)
+{
+	for (int i = 0; i < 2 && opt; i++)
+	{
+		opt = memchr(opt, '\0', end - opt);
+		if (opt)
+			opt++;
+	}
+
+	while (opt && opt < end)
+	{
+		const char *val = memchr(opt, '\0', end - opt);
+		if (!val)
+			break;
+		val++;
+		const char *next = memchr(val, '\0', end - val);
+		if (!next)
+			break;
+
+		unsigned long n = strtoul(val, NULL, 10);
+		printf("Option %s = %s\n", opt, val);
+		if (!strcasecmp(opt, "blksize") && n >= 8)
+			ctx->blksize = MIN(n, BLKSIZE);
+		else if (!strcasecmp(opt, "windowsize") && n >= 1)
+			ctx->windowsize = MIN(n, WINDOWSIZE);
+		opt = next + 1;
+	}
+	ctx->oack = ctx->blksize != 512 || ctx->windowsize != 1;
+}
+
 /**
  * Listen for incoming tftp sessions.
- * \param size Must be 516
+ * \param size Must be SIZE
  * \param timeout Time to wait for a connection
  * \return Number of bytes read is successful, TFTP_ERR_TIMEOUT on timeout, TFTP_ERR otherwise
  */
 static ssize_t tftp_listen(TftpSession *ctx, void *buf, size_t size, struct timeval *timeout)
 {
 	ctx->block = 0;
+	ctx->blksize = 512;
+	ctx->windowsize = 1;
+	ctx->window_cnt = 0;
+	ctx->oack = false;
+	ctx->resync = false;
 
 	int res = tftp_waitEvent(ctx, timeout);
 	if (res == 0)
@@ -161,11 +243,8 @@ static ssize_t tftp_listen(TftpSession *ctx, void *buf, size_t size, struct time
 		Tftpframe *tmp = (Tftpframe *)buf;
 		if (tmp->th_opcode == TFTP_WRQ)
 		{
-			struct ackframe ack;
-			ack.opcode = TFTP_ACK;
-			ack.block_num = ctx->block;
-			if (sendto(ctx->sock, &ack, 4, 0, (struct sockaddr *)&ctx->addr, ctx->addr_len) == 4)
-				;
+			parseOptions(ctx, tmp->th_u.tu_stuff, (char *)buf + rd);
+			tftp_sendAck(ctx);
 			return rd;
 		}
 	}
@@ -173,55 +252,85 @@ static ssize_t tftp_listen(TftpSession *ctx, void *buf, size_t size, struct time
 }
 
 /*
- * Check if received data is correct and send ACK if ok.
+ * Check if received data is correct and send ACK if needed.
+ * Blocks in sequence are ACKed once per window or on the last block;
+ * out of order blocks are discarded and the last block in sequence is
+ * ACKed once, so that the client restarts from there.
+ * \return 1 if the block is the next one, 0 if it must be discarded, -1 on errors
  */
-static int checkPacket(TftpSession *ctx, const char *buf, size_t size)
+static int checkPacket(TftpSession *ctx, const char *buf, ssize_t rlen)
 {
-	printf("Checking block %hd, size = %zd\n", ctx->block, size);
+	printf("Checking block %hd, size = %zd\n", ctx->block, rlen);
 	Tftpframe *tmp = (Tftpframe *)buf;
-	if (ntohs(tmp->th_opcode) != TFTP_DATA)
+	if (tmp->th_opcode == TFTP_WRQ && ctx->block == 0)
+		return tftp_sendAck(ctx) ? -1 : 0;
+	if (ntohs(tmp->th_opcode) != TFTP_DATA || rlen < 4)
 	{
 		printf("Opcode != TFTP_DATA (%hd != %d)\n", ntohs(tmp->th_opcode), TFTP_DATA);
 		return -1;
 	}
 
-	// sanity check on block number: silently discard any out of order packets
-	if (ntohs(tmp->th_u.tu_block) != ctx->block + 1)
-		return -1;
+	int16_t diff = (int16_t)(ntohs(tmp->th_u.tu_block) - (unsigned short)(ctx->block + 1));
+	if (diff == 0)
+	{
+		ctx->block++;
+		ctx->resync = false;
+		if (++ctx->window_cnt < ctx->windowsize && (size_t)rlen == ctx->blksize + 4)
+			return 1;
+		ctx->window_cnt = 0;
+		return tftp_sendAck(ctx) ? -1 : 1;
+	}
 
-	ctx->block++;
-	// if everything was ok, send ACK
-	// ACK is already in network order
-	struct ackframe ack;
-	ack.opcode = TFTP_ACK;
-	ack.block_num = htons(ctx->block);
-	ssize_t rc = sendto(ctx->sock, &ack, 4, 0, (struct sockaddr *)&ctx->addr, ctx->addr_len);
-	if (rc == 4)
-		return rc;
-	else
-		return -1;
+	if (diff > 0)
+		printf("Lost block %hu, received %hu\n", (unsigned short)(ctx->block + 1), ntohs(tmp->th_u.tu_block));
+	// ACK only once while the client restarts the window, every time in lock-step
+	if (ctx->resync && ctx->windowsize > 1)
+		return 0;
+	ctx->resync = true;
+	ctx->window_cnt = 0;
+	return tftp_sendAck(ctx) ? -1 : 0;
 }
 
 /**
  * Read a block from TFTP.
- * \param size Must be exactly 516 bytes
- * \param timeout Time to wait the network connection, may be NULL to wait forever
+ * On timeout the last ACK is sent again, up to RETRIES times.
+ * \param size Must be exactly SIZE bytes
+ * \param timeout Time to wait the network connection
  * \return Number of bytes read if success, TFTP_ERR_TIMEOUT on timeout, TFTP_ERR otherwise
  */
 ssize_t tftp_readBlock(TftpSession *ctx, char *buf, size_t size, struct timeval *timeout)
 {
-	int res = tftp_waitEvent(ctx, timeout);
-	if (res == 0)
-		return TFTP_ERR_TIMEOUT;
-	if (res == -1)
-		return TFTP_ERR;
+	long ms = (timeout->tv_sec * 1000 + timeout->tv_usec / 1000) / (RETRIES + 1);
+	struct timeval retry_tm = { ms / 1000, (ms % 1000) * 1000 };
+	int retries = RETRIES;
 
-	ssize_t rlen = recvfrom(ctx->sock, buf, size, 0, NULL, NULL);
-	printf("readBlock(): received %zd bytes\n", rlen);
-	if (rlen > 0 && (checkPacket(ctx, buf, size) > 0))
-		return rlen;
-	else
-		return TFTP_ERR;
+	while (1)
+	{
+		int res = tftp_waitEvent(ctx, &retry_tm);
+		if (res == 0)
+		{
+			if (retries-- <= 0)
+				return TFTP_ERR_TIMEOUT;
+			printf("Timeout, ACK block %hu again\n", ctx->block);
+			ctx->window_cnt = 0;
+			if (tftp_sendAck(ctx))
+				return TFTP_ERR;
+			continue;
+		}
+		if (res == -1)
+			return TFTP_ERR;
+
+		ssize_t rlen = recvfrom(ctx->sock, buf, size, 0, NULL, NULL);
+		printf("readBlock(): received %zd bytes\n", rlen);
+		if (rlen <= 0)
+			return TFTP_ERR;
+
+		int check = checkPacket(ctx, buf, rlen);
+		if (check > 0)
+			return rlen;
+		if (check < 0)
+			return TFTP_ERR;
+	}
 }
 
 /*
@@ -252,7 +361,7 @@ static bool receiveFirmware(TftpSession *ctx, FILE *fp, void *buf, size_t size,
 				break;
 			}
 			fwrite(buf + 4, sizeof(char), rd - 4, fp);
-		} while (rd >= size);
+		} while ((size_t)rd >= ctx->blksize + 4);
 	}
 	if (rd == TFTP_ERR_TIMEOUT)
 		printf("Timeout in tftp\n");
@@ -0,0 +1,202 @@
+/*
+ * Send a firmware image to the TFTP stand-in (server.c) running on
+ * localhost, negotiating blksize and windowsize, while losing and
+ * reordering some blocks on purpose.
+ * Start the stand-in in /tmp before running this test; crc32_test
+ * checks the received image afterwards.
+ */
+#include <algo/crc32.h>
+
+#include <cfg/debug.h>
+#include <cfg/macros.h>
+#include <cfg/test.h>
+
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define SERVER_PORT 6969
+#define BLKSIZE     1468
+#define WINDOWSIZE  8
+#define IMAGE_SIZE  100000
+
+#define TFTP_WRQ  2
+#define TFTP_DATA 3
+#define TFTP_ACK  4
+#define TFTP_OACK 6
+
+static int sock;
+static struct sockaddr_in server;
+static uint8_t image[IMAGE_SIZE + 8];
+static uint8_t pkt[BLKSIZE + 4];
+static uint32_t seed = 1;
+
+static unsigned rnd(unsigned n)
+{
+	seed = seed * 1103515245UL + 12345;
+	return (seed >> 16) % n;
+}
+
+/*
+ * Wait for a packet from the server.
+ * \return Packet length, 0 on timeout
+ */
+static ssize_t recvPacket(long ms)
+{
+	fd_set inset;
+	FD_ZERO(&inset);
+	FD_SET(sock, &inset);
+	struct timeval tm = { ms / 1000, (ms % 1000) * 1000 };
+	if (select(sock + 1, &inset, NULL, NULL, &tm) <= 0)
+		return 0;
+
+	socklen_t len = sizeof(server);
+	return recvfrom(sock, pkt, sizeof(pkt), 0, (struct sockaddr *)&server, &len);
+}
+
+/*
+ * Wait for acknowledges and return the highest block acknowledged,
+ * -1 on timeout.
+ */
+static int waitAck(int last_acked)
+{
+	int acked = -1;
+	ssize_t len;
+
+	for (long ms = 200; (len = recvPacket(ms)) > 0; ms = 10)
+	{
+		ASSERT(len == 4);
+		ASSERT(ntohs(*(uint16_t *)pkt) == TFTP_ACK);
+		int n = last_acked + (int16_t)(ntohs(*(uint16_t *)(pkt + 2)) - (uint16_t)last_acked);
+		acked = MAX(acked, n);
+	}
+	return acked;
+}
+
+static void sendBlock(int n, size_t blksize, int nblocks)
+{
+	size_t off = (size_t)(n - 1) * blksize;
+	size_t len = n == nblocks ? sizeof(image) - off : blksize;
+
+	*(uint16_t *)pkt = htons(TFTP_DATA);
+	*(uint16_t *)(pkt + 2) = htons((uint16_t)n);
+	memcpy(pkt + 4, image + off, len);
+	ASSERT(sendto(sock, pkt, len + 4, 0, (struct sockaddr *)&server, sizeof(server)) == (ssize_t)(len + 4));
+}
+
+int tftp_testSetup(void)
+{
+	kdbg_init();
+
+	for (size_t i = 8; i < sizeof(image); i++)
+		image[i] = rnd(256);
+	uint32_t size = IMAGE_SIZE;
+	uint32_t crc = crc32(image + 8, IMAGE_SIZE, 0);
+	memcpy(image, &size, sizeof(size));
+	memcpy(image + 4, &crc, sizeof(crc));
+
+	sock = socket(AF_INET, SOCK_DGRAM, 0);
+	ASSERT(sock >= 0);
+	server.sin_family = AF_INET;
+	server.sin_port = htons(SERVER_PORT);
+	server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	return 0;
+}
+
+int tftp_testTearDown(void)
+{
+	close(sock);
+	return 0;
+}
+
+int tftp_testRun(void)
+{
+	static const char wrq[] = "\0\2fw.bin\0octet\0blksize\0" "1468\0windowsize\0" "8";
+	ASSERT(sendto(sock, wrq, sizeof(wrq), 0, (struct sockaddr *)&server, sizeof(server)) == sizeof(wrq));
+
+	ssize_t len = recvPacket(1000);
+	ASSERT(len > 2);
+	ASSERT(ntohs(*(uint16_t *)pkt) == TFTP_OACK);
+
+	size_t blksize = 512;
+	int win = 1;
+	for (char *opt = (char *)pkt + 2; opt < (char *)pkt + len; opt += strlen(opt) + 1)
+	{
+		char *val = opt + strlen(opt) + 1;
+		if (!strcmp(opt, "blksize"))
+			blksize = atoi(val);
+		else if (!strcmp(opt, "windowsize"))
+			win = atoi(val);
+		opt = val;
+	}
+	kprintf("OACK blksize %zu, windowsize %d\n", blksize, win);
+	ASSERT(blksize == BLKSIZE);
+	ASSERT(win == WINDOWSIZE);
+
+	int nblocks = sizeof(image) / blksize + 1;
+	int base = 1, sent = 0, lost = 0, timeouts = 0;
+
+	while (base <= nblocks)
+	{
+		int last = MIN(base + win - 1, nblocks);
+		for (int n = base; n <= last; n++)
+		{
+			sent++;
+			if (rnd(20) == 0)
+			{
+				lost++;
+				continue;
+			}
+			// Swap with the following block now and then
+			if (n < last && rnd(15) == 0)
+			{
+				sendBlock(n + 1, blksize, nblocks);
+				sendBlock(n, blksize, nblocks);
+				sent++;
+				n++;
+				continue;
+			}
+			sendBlock(n, blksize, nblocks);
+		}
+
+		int acked = waitAck(base - 1);
+		if (acked < 0)
+			timeouts++;
+		else
+		{
+			ASSERT(acked <= nblocks);
+			base = acked + 1;
+		}
+	}
+	kprintf("%d blocks, %d sent, %d lost, %d timeouts\n", nblocks, sent, lost, timeouts);
+
+	// The stand-in flushes the image when it exits
+	FILE *fp = NULL;
+	for (int i = 0; i < 50 && !fp; i++)
+	{
+		usleep(100000);
+		fp = fopen("/tmp/fw.bin", "r");
+		if (fp && fread(pkt, 1, 8, fp) == 8 && !memcmp(pkt, image, 8))
+			break;
+		if (fp)
+			fclose(fp);
+		fp = NULL;
+	}
+	ASSERT(fp);
+
+	for (size_t off = 8; off < sizeof(image); off += blksize)
+	{
+		size_t bytes = MIN(blksize, sizeof(image) - off);
+		ASSERT(fread(pkt, 1, bytes, fp) == bytes);
+		ASSERT(!memcmp(pkt, image + off, bytes));
+	}
+	fclose(fp);
+	return 0;
+}
+
+TEST_MAIN(tftp);
@@ -93,7 +93,7 @@ static bool fat_write(KFile *fd, int addr, FatEntry *entry)
 
 	kfile_seek(fd, addr * sizeof(FatEntry), KSM_SEEK_SET);
 	bool err = (kfile_write(fd, entry, sizeof(FatEntry)) == sizeof(FatEntry));
-	return err;
+	return err && kfile_flush(fd) == 0;
 }
 
 static void fat_default(FatEntry *entry)
@@ -417,6 +417,7 @@ bool dli_set(const char *key, const char *value)
 		ASSERT(strlen(value) <= BOOT_SIZE);
 		kfile_seek(&boot_file.fd, 0, KSM_SEEK_SET);
 		ret = (kfile_write(&boot_file.fd, value, strlen(value) + 1) == strlen(value) + 1);
+		ret = (kfile_flush(&boot_file.fd) == 0) && ret;
 		goto end;
 	}
 
@@ -425,10 +426,13 @@ bool dli_set(const char *key, const char *value)
 		ASSERT(strlen(value) <= BOOT_SIZE);
 		kfile_seek(&boot_file.fd, MAC_ADDR_STR_LEN + 1, KSM_SEEK_SET);
 		ret = (kfile_write(&boot_file.fd, value, strlen(value) + 1) == strlen(value) + 1);
+		ret = (kfile_flush(&boot_file.fd) == 0) && ret;
 		goto end;
 	}
 
-	if (ini_setString(currIni(), nextIni(), DLI_SECTION, key, value) == EOF)
+	/* The new ini file must reach the eeprom before the FAT entry pointing to it */
+	if ((ini_setString(currIni(), nextIni(), DLI_SECTION, key, value) == EOF) ||
+	    (kfile_flush(&file[0].fd) != 0) || (kfile_flush(&file[1].fd) != 0))
 	{
 		ret = false;
 		goto end;
@@ -484,6 +488,9 @@ void dli_reset(void)
 		kfile_seek(fd, 0, KSM_SEEK_SET);
 		while (kfile_write(fd, buf, sizeof(buf)) == sizeof(buf))
 			;
+		kfile_flush(fd);
 	}
+	kfile_flush(&boot_file.fd);
+	kfile_flush(&fat_file.fd);
 	sem_release(i2c_sem);
 }
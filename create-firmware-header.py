@@ -1,9 +1,9 @@
 # -*- coding: utf-8 -*-
 
-import binascii, sys, struct
+import binascii, sys, struct, hmac, hashlib
 
-if len(sys.argv) < 3:
-	print("Usage: %s [firmware] [new_fw]" % sys.argv[0])
+if len(sys.argv) < 4:
+	print("Usage: %s [firmware] [new_fw] [tag] [hmac_key]" % sys.argv[0])
 	sys.exit(1)
 
 tag = sys.argv[3]
@@ -28,4 +28,11 @@ with open(sys.argv[2], 'wb') as outfile:
 	outfile.write(struct.pack('<I', size))
 	outfile.write(struct.pack('<I', crc))
 
+# append the HMAC-SHA1 signature checked by the boot loader with CONFIG_BOOT_HMAC
+if len(sys.argv) > 4:
+	with open(sys.argv[2], 'rb') as infile:
+		sig = hmac.new(sys.argv[4], infile.read(), hashlib.sha1).digest()
+	with open(sys.argv[2], 'ab') as outfile:
+		outfile.write(sig)
+
 print("Firmware file %s created." % sys.argv[2])